@@ -0,0 +1,36 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License.
+
+# Find cmake module for the zstd library and header.
+# Exports zstd::zstd target
+
+cmake_minimum_required (VERSION 3.5)
+
+include (FindPackageHandleStandardArgs)
+
+find_path (zstd_INCLUDE_DIR
+           NAMES zstd.h)
+
+find_library (zstd_LIBRARY
+              zstd)
+
+find_package_handle_standard_args (zstd
+                                   DEFAULT_MSG
+                                   zstd_INCLUDE_DIR
+                                   zstd_LIBRARY)
+
+if (zstd_FOUND)
+    set (zstd_LIBRARIES ${zstd_LIBRARY})
+    set (zstd_INCLUDE_DIRS ${zstd_INCLUDE_DIR})
+
+    if (NOT TARGET zstd::zstd)
+        add_library (zstd::zstd
+                     INTERFACE
+                     IMPORTED)
+        set_target_properties (zstd::zstd
+                               PROPERTIES INTERFACE_INCLUDE_DIRECTORIES
+                                          "${zstd_INCLUDE_DIRS}"
+                                          INTERFACE_LINK_LIBRARIES
+                                          "${zstd_LIBRARIES}")
+    endif ()
+endif ()
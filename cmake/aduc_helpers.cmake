@@ -99,3 +99,116 @@ macro (
     endforeach()
 
 endmacro ()
+
+# Gets the update content handlers linked into the agent by the ADUC_STATIC_EXTENSIONS build profile:
+# the entries of ADUC_CONTENT_HANDLERS, e.g. "microsoft/swupdate" or "microsoft/steps:1". An entry without a version
+# is version 1.
+#
+# Parameters:
+# out_update_types - receives the update types, e.g. microsoft/swupdate:1
+# out_targets - receives the handler targets, e.g. microsoft_swupdate_1
+function (get_aduc_static_content_handlers out_update_types out_targets)
+    set (update_types)
+    set (targets)
+
+    if (ADUC_STATIC_EXTENSIONS)
+        string (
+            REPLACE ","
+                    ";"
+                    handler_list
+                    "${ADUC_CONTENT_HANDLERS}")
+
+        foreach (handler ${handler_list})
+            string (STRIP "${handler}" update_type)
+            if (NOT update_type MATCHES ":")
+                set (update_type "${update_type}:1")
+            endif ()
+
+            string (
+                REGEX
+                REPLACE "[/:]"
+                        "_"
+                        target
+                        "${update_type}")
+
+            list (APPEND update_types "${update_type}")
+            list (APPEND targets "${target}")
+        endforeach ()
+    endif ()
+
+    set (
+        ${out_update_types}
+        ${update_types}
+        PARENT_SCOPE)
+    set (
+        ${out_targets}
+        ${targets}
+        PARENT_SCOPE)
+endfunction ()
+
+# Checks whether the ADUC_STATIC_EXTENSIONS build profile links the extension @p target into the agent.
+#
+# Parameters:
+# target - an update content handler, content downloader or component enumerator target
+# out_var - receives TRUE or FALSE
+function (is_aduc_static_extension target out_var)
+    set (is_static FALSE)
+
+    if (ADUC_STATIC_EXTENSIONS)
+        get_aduc_static_content_handlers (update_types handler_targets)
+        list (FIND handler_targets ${target} handler_index)
+
+        if (NOT handler_index EQUAL -1
+            OR target STREQUAL "${ADUC_STATIC_CONTENT_DOWNLOADER}"
+            OR target STREQUAL "${ADUC_STATIC_COMPONENT_ENUMERATOR}")
+            set (is_static TRUE)
+        endif ()
+    endif ()
+
+    set (
+        ${out_var}
+        ${is_static}
+        PARENT_SCOPE)
+endfunction ()
+
+# Adds an extension library: a shared library that the agent loads at run time or, for an extension that the
+# ADUC_STATIC_EXTENSIONS build profile links into the agent, a static library.
+#
+# A static extension is compiled with ADUC_STATIC_EXTENSION defined: it shares the agent's process-wide state, e.g.
+# the logger. The entry point of a statically linked update content handler, CreateUpdateContentHandlerExtension, is
+# renamed <target>_CreateUpdateContentHandlerExtension so that several handlers can be linked together.
+#
+# Parameters:
+# target - the extension target
+# ARGN - the source files
+function (add_aduc_extension_library target)
+    is_aduc_static_extension (${target} is_static)
+
+    if (is_static)
+        add_library (${target} STATIC ${ARGN})
+        target_compile_definitions (${target} PRIVATE ADUC_STATIC_EXTENSION=1)
+
+        get_aduc_static_content_handlers (update_types handler_targets)
+        list (FIND handler_targets ${target} handler_index)
+        if (NOT handler_index EQUAL -1)
+            target_compile_definitions (
+                ${target}
+                PRIVATE CreateUpdateContentHandlerExtension=${target}_CreateUpdateContentHandlerExtension)
+        endif ()
+    else ()
+        add_library (${target} SHARED ${ARGN})
+    endif ()
+endfunction ()
+
+# Installs an extension library added with add_aduc_extension_library.
+# Statically linked extensions are part of the agent and are not installed.
+#
+# Parameters:
+# target - the extension target
+function (install_aduc_extension_library target)
+    is_aduc_static_extension (${target} is_static)
+
+    if (NOT is_static)
+        install (TARGETS ${target} LIBRARY DESTINATION ${ADUC_EXTENSIONS_INSTALL_FOLDER})
+    endif ()
+endfunction ()
@@ -32,4 +32,12 @@ typedef void (*ADUC_DownloadProgressCallback)(
     uint64_t bytesTransferred,
     uint64_t bytesTotal);
 
+/**
+ * @brief Function signature for callback to send the transfer rate of a download to, before each progress report.
+ *
+ * @p bytesPerSecond is the effective transfer rate of the file so far, including the time it was throttled or
+ * paused by the download bandwidth limits; 0 if it is not known.
+ */
+typedef void (*ADUC_DownloadRateCallback)(const char* workflowId, const char* fileId, uint64_t bytesPerSecond);
+
 #endif // ADUC_TYPES_DOWNLOAD_H
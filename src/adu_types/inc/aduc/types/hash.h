@@ -25,6 +25,24 @@ typedef struct tagADUC_Hash
     char* type; /** The type of hash held in the entry*/
 } ADUC_Hash;
 
+/**
+ * @brief The largest supported block size of a chunk manifest, in bytes.
+ */
+#define ADUC_CHUNK_MANIFEST_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Block-level hashes of a file, used to verify it while it is being downloaded.
+ *
+ * The file is split into consecutive blocks of ChunkSize bytes; the last block may be shorter.
+ */
+typedef struct tagADUC_ChunkManifest
+{
+    size_t ChunkSize; /**< The size of each block, in bytes. */
+    char* HashType; /**< The type of the block hashes, e.g. "sha256". */
+    char** ChunkHashes; /**< The base64 hash of each block, in file order. */
+    size_t ChunkCount; /**< The number of entries in ChunkHashes. */
+} ADUC_ChunkManifest;
+
 EXTERN_C_END
 
 #endif // ADUC_TYPES_HASH_H
@@ -182,6 +182,27 @@ EXTERN_C_BEGIN
  */
 #define ADUCITF_FIELDNAME_SIZEINBYTES "sizeInBytes"
 
+/**
+ * @brief JSON field name for the optional block-level hashes of a file.
+ */
+#define ADUCITF_FIELDNAME_CHUNKHASHES "chunkHashes"
+
+/**
+ * @brief JSON field name for the block size of chunkHashes (in bytes).
+ */
+#define ADUCITF_FIELDNAME_CHUNKSIZE "chunkSize"
+
+/**
+ * @brief JSON field name for the hash type of chunkHashes.
+ */
+#define ADUCITF_FIELDNAME_HASHTYPE "hashType"
+
+/**
+ * @brief JSON field name for the optional compression format of a file: "gzip", "xz", "zstd",
+ * or "auto" to select it from the file name suffix.
+ */
+#define ADUCITF_FIELDNAME_COMPRESSION "compression"
+
 /**
  * @brief JSON field name for the updateManifest's hash held within the associated JWT
  */
@@ -274,6 +295,18 @@ typedef struct tagADUC_UpdateId
     char* Version; /**< Version for the update*/
 } ADUC_UpdateId;
 
+/**
+ * @brief The compression format of a file to download. A compressed file is decompressed into the sandbox
+ * while it is being downloaded.
+ */
+typedef enum tagADUC_FileCompression
+{
+    ADUC_FileCompression_None = 0, /**< Not compressed. */
+    ADUC_FileCompression_Gzip = 1, /**< gzip (RFC 1952), file name suffix ".gz". */
+    ADUC_FileCompression_Xz = 2, /**< xz, file name suffix ".xz". */
+    ADUC_FileCompression_Zstd = 3, /**< Zstandard (RFC 8878), file name suffix ".zst". */
+} ADUC_FileCompression;
+
 /**
  * @brief Describes a specific file to download.
  */
@@ -286,6 +319,10 @@ typedef struct tagADUC_FileEntity
     char* TargetFilename; /**< File name to store content in DownloadUri to. */
     char* Arguments; //**< Arguments associate with this file. */
     size_t SizeInBytes; /**< File size. */
+    ADUC_ChunkManifest* ChunkManifest; /**< Optional block-level hashes. NULL if the manifest has none. */
+    ADUC_FileCompression Compression; /**< Compression of the downloaded content. TargetFilename is the name of
+                                         the decompressed file. The hashes, SizeInBytes and the chunk manifest
+                                         cover the compressed content, as it is published. */
 } ADUC_FileEntity;
 
 /**
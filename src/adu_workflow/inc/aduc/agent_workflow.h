@@ -70,6 +70,8 @@ void ADUC_Workflow_DefaultDownloadProgressCallback(
     uint64_t bytesTransferred,
     uint64_t bytesTotal);
 
+void ADUC_Workflow_DefaultDownloadRateCallback(const char* workflowId, const char* fileId, uint64_t bytesPerSecond);
+
 EXTERN_C_END
 
 #endif // ADUC_AGENT_WORKFLOW_H
@@ -19,7 +19,9 @@
 #include <time.h>
 
 #include "aduc/agent_orchestration.h"
+#include "aduc/hash_utils.h"
 #include "aduc/logging.h"
+#include "aduc/payload_cache.h"
 #include "aduc/result.h"
 #include "aduc/string_c_utils.h"
 #include "aduc/system_utils.h"
@@ -915,6 +917,14 @@ void ADUC_Workflow_DefaultDownloadProgressCallback(
         bytesTotal);
 }
 
+//
+// Download rate callback
+//
+void ADUC_Workflow_DefaultDownloadRateCallback(const char* workflowId, const char* fileId, uint64_t bytesPerSecond)
+{
+    Log_Info("RateCallback: workflowId: %s; Id %s; Rate: %" PRIu64 " bytes/s", workflowId, fileId, bytesPerSecond);
+}
+
 /**
  * @brief Move state machine to a new stage.
  *
@@ -1097,6 +1107,11 @@ void ADUC_Workflow_MethodCall_Idle(ADUC_WorkflowData* workflowData)
         Log_Info("UpdateAction: Idle. WorkFolder is not valid. Nothing to destroy.");
     }
 
+    // No download is in progress, so the payload cache can be trimmed to its budget, and the digest cache can
+    // forget the files of the workflow.
+    ADUC_PayloadCache_CollectGarbage();
+    ADUC_HashUtils_DigestCache_CollectGarbage();
+
     //
     // Notify callback that we're now back to idle.
     //
@@ -16,8 +16,10 @@
 #include "aduc/device_info_interface.h"
 #include "aduc/extension_manager.h"
 #include "aduc/extension_utils.h"
+#include "aduc/hash_utils.h"
 #include "aduc/health_management.h"
 #include "aduc/logging.h"
+#include "aduc/payload_cache.h"
 #include "aduc/string_c_utils.h"
 #include "aduc/system_utils.h"
 #include <azure_c_shared_utility/shared_util_options.h>
@@ -960,6 +962,8 @@ _Bool StartupAgent(const ADUC_LaunchArguments* launchArgs)
 
     ADUC_Result result;
 
+    ExtensionManager_SetDownloadRateCallback(ADUC_Workflow_DefaultDownloadRateCallback);
+
     // The connection string is valid (IoT hub connection successful) and we are ready for further processing.
     // Send connection string to DO SDK for it to discover the Edge gateway if present.
     if (ConnectionStringUtils_IsNestedEdge(info.connectionString))
@@ -988,6 +992,66 @@ done:
     return succeeded;
 }
 
+/**
+ * @brief Sets the file hashing options from the agent configuration file.
+ */
+static void InitFileHashOptions()
+{
+    ADUC_ConfigInfo config = {};
+
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        const ADUC_HashUtils_FileHashOptions options = {
+            .BufferSize = (size_t)config.fileHashBufferSizeInKB * 1024,
+            .UseMmap = config.fileHashUseMmap,
+            .DropPageCache = config.fileHashDropPageCache,
+        };
+
+        ADUC_HashUtils_SetFileHashOptions(&options);
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+}
+
+/**
+ * @brief Enables the payload cache with the budget from the agent configuration file.
+ * A budget of 0, the default, disables the cache and releases the disk space of its entries.
+ */
+static void InitPayloadCache()
+{
+    uint64_t budgetInBytes = 0;
+    ADUC_ConfigInfo config = {};
+
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        budgetInBytes = (uint64_t)config.payloadCacheSizeInMB * 1024 * 1024;
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    // The payload cache is an optimization only; the agent works without it.
+    if (!ADUC_PayloadCache_Init(ADUC_PAYLOAD_CACHE_FOLDER, budgetInBytes))
+    {
+        Log_Info("Payload cache is disabled.");
+    }
+}
+
+/**
+ * @brief Starts preloading the registered extensions with the concurrency from the agent configuration file.
+ * A concurrency of 0, the default, leaves the extensions to be loaded on first use.
+ */
+static void StartExtensionPreloading()
+{
+    unsigned int concurrency = 0;
+    ADUC_ConfigInfo config = {};
+
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        concurrency = config.extensionPreloadConcurrency;
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    ExtensionManager_StartPreloading(concurrency);
+}
+
 /**
  * @brief Called at agent shutdown.
  */
@@ -997,8 +1061,11 @@ void ShutdownAgent()
     ADUC_PnP_Components_Destroy();
     ADUC_DeviceClient_Destroy(g_iotHubClientHandle);
     DiagnosticsComponent_DestroyDeviceName();
-    ADUC_Logging_Uninit();
+    // Unload extensions (and stop preloading them) while they can still log.
     ExtensionManager_Uninit();
+    ADUC_Logging_Uninit();
+    ADUC_HashUtils_DigestCache_Uninit();
+    ADUC_PayloadCache_Uninit();
 }
 
 /**
@@ -1137,6 +1204,21 @@ int main(int argc, char** argv)
         goto done;
     }
 
+    InitFileHashOptions();
+
+    // The digest cache is an optimization only; the agent works without it.
+    if (!ADUC_HashUtils_DigestCache_Init(ADUC_DIGEST_CACHE_FOLDER))
+    {
+        Log_Warn("Digest cache is disabled.");
+    }
+
+    InitPayloadCache();
+
+#ifdef ADUC_STATIC_EXTENSIONS
+    // Use the extensions linked into the agent instead of loading registered shared libraries.
+    ExtensionManager_RegisterStaticExtensions();
+#endif
+
     //
     // Catch ctrl-C and shutdown signals so we do a best effort of cleanup.
     //
@@ -1153,6 +1235,9 @@ int main(int argc, char** argv)
         goto done;
     }
 
+    // Load the extensions before the first deployment needs them.
+    StartExtensionPreloading();
+
     //
     // Main Loop
     //
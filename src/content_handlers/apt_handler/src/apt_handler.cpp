@@ -39,7 +39,9 @@ EXTERN_C_BEGIN
  */
 ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel)
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Init(logLevel, "apt-handler");
+#endif
     Log_Info("Instantiating an Update Content Handler for 'microsoft/apt:1'");
     try
     {
@@ -65,7 +67,9 @@ EXTERN_C_END
  */
 AptHandlerImpl::~AptHandlerImpl() // override
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Uninit();
+#endif
 }
 
 /**
@@ -134,7 +138,8 @@ ADUC_Result AptHandlerImpl::Download(const tagADUC_WorkflowData* workflowData)
     aptManifestFilename << workFolder << "/" << fileEntity->TargetFilename;
 
     // Download the APT manifest file.
-    result = ExtensionManager::Download(fileEntity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr);
+    result =
+        ExtensionManager::Download(fileEntity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr, handle);
 
     workflow_free_file_entity(fileEntity);
     fileEntity = nullptr;
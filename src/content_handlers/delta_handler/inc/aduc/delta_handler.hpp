@@ -0,0 +1,58 @@
+/**
+ * @file delta_handler.hpp
+ * @brief Defines DeltaHandlerImpl.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DELTA_HANDLER_HPP
+#define ADUC_DELTA_HANDLER_HPP
+
+#include "aduc/content_handler.hpp"
+#include "aduc/logging.h"
+#include <aduc/result.h>
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Instantiates an Update Content Handler for 'microsoft/delta:1' update type.
+ * @return A pointer to an instantiated Update Content Handler object.
+ */
+ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel);
+
+EXTERN_C_END
+
+/**
+ * @class DeltaHandlerImpl
+ * @brief The delta update specific implementation of ContentHandler interface.
+ *
+ * Downloads a binary patch, reconstructs the new image from it and the installed image, then installs the
+ * new image the same way as 'microsoft/swupdate:1'.
+ */
+class DeltaHandlerImpl : public ContentHandler
+{
+public:
+    static ContentHandler* CreateContentHandler();
+
+    // Delete copy ctor, copy assignment, move ctor and move assignment operators.
+    DeltaHandlerImpl(const DeltaHandlerImpl&) = delete;
+    DeltaHandlerImpl& operator=(const DeltaHandlerImpl&) = delete;
+    DeltaHandlerImpl(DeltaHandlerImpl&&) = delete;
+    DeltaHandlerImpl& operator=(DeltaHandlerImpl&&) = delete;
+
+    ~DeltaHandlerImpl() override;
+
+    ADUC_Result Download(const tagADUC_WorkflowData* workflowData) override;
+    ADUC_Result Install(const tagADUC_WorkflowData* workflowData) override;
+    ADUC_Result Apply(const tagADUC_WorkflowData* workflowData) override;
+    ADUC_Result Cancel(const tagADUC_WorkflowData* workflowData) override;
+    ADUC_Result IsInstalled(const tagADUC_WorkflowData* workflowData) override;
+
+protected:
+    // Protected constructor, must call CreateContentHandler factory method.
+    DeltaHandlerImpl()
+    {
+    }
+};
+
+#endif // ADUC_DELTA_HANDLER_HPP
@@ -0,0 +1,39 @@
+/**
+ * @file delta_patch.hpp
+ * @brief Reconstructs an image from a binary delta and the image it was created against.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DELTA_PATCH_HPP
+#define ADUC_DELTA_PATCH_HPP
+
+#include "aduc/hash_utils.h" // for SHAversion
+#include "aduc/result.h"
+
+#include <cstdint>
+
+/**
+ * @brief Reconstructs the target image from a patch created with `zstd --patch-from=<source> <target>`.
+ *
+ * The source is memory-mapped and the patch is streamed through the decoder, so only the decoder window is held
+ * in memory. The target is hashed while it is written, and removed unless it matches @p targetHash.
+ *
+ * @param sourcePath The installed image the patch was created against: a file or a block device.
+ * @param sourceSize The size of the image at the start of @p sourcePath, or 0 to use all of it.
+ * A partition is usually larger than the image it holds.
+ * @param patchPath The patch.
+ * @param targetPath The reconstructed image. Replaced if it exists.
+ * @param targetHash The expected base64 hash of the reconstructed image.
+ * @param algorithm The hashing algorithm of @p targetHash.
+ * @return ADUC_Result ADUC_GeneralResult_Success, or a failure with an ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_* code.
+ */
+ADUC_Result ADUC_DeltaPatch_Apply(
+    const char* sourcePath,
+    uint64_t sourceSize,
+    const char* patchPath,
+    const char* targetPath,
+    const char* targetHash,
+    SHAversion algorithm);
+
+#endif // ADUC_DELTA_PATCH_HPP
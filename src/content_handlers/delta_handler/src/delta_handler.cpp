@@ -0,0 +1,394 @@
+/**
+ * @file delta_handler.cpp
+ * @brief Implementation of ContentHandler API for binary delta image updates.
+ *
+ * Release images are usually almost identical to the installed image, so a binary delta of the new image
+ * against the installed one is a small fraction of the image size. The delta is downloaded, the new image is
+ * reconstructed in the sandbox and verified, then installed with the swupdate tasks of adu-shell.
+ *
+ * microsoft/delta
+ * v1:
+ *   Description:
+ *   Initial revision.
+ *
+ *   Expected files:
+ *   The patch, created with `zstd --patch-from=<installed image> <new image>`.
+ *
+ *   Handler properties:
+ *   sourcePath - Required. The installed image the patch was created against; a file or a block device
+ *                readable by the agent.
+ *   sourceSize - Optional. The size of the installed image at the start of sourcePath. Defaults to the size of
+ *                sourcePath; required when sourcePath is a partition larger than the image.
+ *   targetFileName - Required. The file name of the reconstructed image, e.g. a .swu file.
+ *   targetHash - Required. The base64 hash of the reconstructed image.
+ *   targetHashAlgorithm - Optional. The algorithm of targetHash, "sha256" by default.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/delta_handler.hpp"
+#include "aduc/delta_patch.hpp"
+
+#include "aduc/adu_core_exports.h"
+#include "aduc/extension_manager.hpp"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/process_utils.hpp"
+#include "aduc/string_c_utils.h"
+#include "aduc/string_utils.hpp"
+#include "aduc/types/update_content.h"
+#include "aduc/workflow_data_utils.h"
+#include "aduc/workflow_utils.h"
+#include "adushell_const.hpp"
+
+#include <cstdio> // for remove
+#include <cstdlib> // for free
+#include <cstring> // for strchr
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h> // for access
+#include <vector>
+
+namespace adushconst = Adu::Shell::Const;
+
+EXTERN_C_BEGIN
+/**
+ * @brief Instantiates an Update Content Handler for 'microsoft/delta:1' update type.
+ */
+ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel)
+{
+#ifndef ADUC_STATIC_EXTENSION
+    ADUC_Logging_Init(logLevel, "delta-handler");
+#endif
+    Log_Info("Instantiating an Update Content Handler for 'microsoft/delta:1'");
+    try
+    {
+        return DeltaHandlerImpl::CreateContentHandler();
+    }
+    catch (const std::exception& e)
+    {
+        const char* what = e.what();
+        Log_Error("Unhandled std exception: %s", what);
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return nullptr;
+}
+EXTERN_C_END
+
+/**
+ * @brief Destructor for the Delta Handler Impl class.
+ */
+DeltaHandlerImpl::~DeltaHandlerImpl() // override
+{
+#ifndef ADUC_STATIC_EXTENSION
+    ADUC_Logging_Uninit();
+#endif
+}
+
+/**
+ * @brief Creates a new DeltaHandlerImpl object and casts to a ContentHandler.
+ * Note that there is no way to create a DeltaHandlerImpl directly.
+ *
+ * @return ContentHandler* DeltaHandlerImpl object as a ContentHandler.
+ */
+ContentHandler* DeltaHandlerImpl::CreateContentHandler()
+{
+    return new DeltaHandlerImpl();
+}
+
+/**
+ * @brief Gets the path of the reconstructed image in the sandbox.
+ *
+ * @param workflowHandle The workflow.
+ * @param[out] targetPath The path of the reconstructed image.
+ * @return ADUC_Result_t 0 on success, or an error code if the targetFileName property is missing or invalid.
+ */
+static ADUC_Result_t GetTargetPath(ADUC_WorkflowHandle workflowHandle, std::string* targetPath)
+{
+    const char* targetFileName =
+        workflow_peek_update_manifest_handler_properties_string(workflowHandle, "targetFileName");
+
+    // The reconstructed image must stay in the sandbox.
+    if (IsNullOrEmpty(targetFileName) || strchr(targetFileName, '/') != nullptr)
+    {
+        workflow_set_result_details(workflowHandle, "Missing or invalid 'handlerProperties.targetFileName' property");
+        return ADUC_ERC_DELTA_HANDLER_MISSING_TARGETFILENAME_PROPERTY;
+    }
+
+    char* workFolder = workflow_get_workfolder(workflowHandle);
+    std::stringstream path;
+    path << workFolder << "/" << targetFileName;
+    workflow_free_string(workFolder);
+
+    *targetPath = path.str();
+    return 0;
+}
+
+/**
+ * @brief Performs 'Download' task.
+ * Downloads the patch, then reconstructs and verifies the new image.
+ *
+ * @return ADUC_Result The result of the download.
+ */
+ADUC_Result DeltaHandlerImpl::Download(const tagADUC_WorkflowData* workflowData)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    ADUC_FileEntity* entity = nullptr;
+    ADUC_WorkflowHandle workflowHandle = workflowData->WorkflowHandle;
+    char* workflowId = workflow_get_id(workflowHandle);
+    char* workFolder = workflow_get_workfolder(workflowHandle);
+    char* updateType = workflow_get_update_type(workflowHandle);
+    char* updateName = nullptr;
+    unsigned int updateTypeVersion = 0;
+    const char* sourcePath = nullptr;
+    const char* sourceSizeString = nullptr;
+    unsigned long sourceSize = 0;
+    const char* targetHash = nullptr;
+    const char* targetHashAlgorithm = nullptr;
+    SHAversion algorithm = SHA256;
+    ADUC_Hash targetHashEntry = {};
+    std::string targetPath;
+    std::stringstream patchPath;
+
+    if (!ADUC_ParseUpdateType(updateType, &updateName, &updateTypeVersion) || updateTypeVersion != 1)
+    {
+        Log_Error("Delta download failed. Wrong Handler Version (UpdateType:%s)", updateType);
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_WRONG_UPDATE_VERSION;
+        goto done;
+    }
+
+    // For 'microsoft/delta:1', we're expecting 1 patch file.
+    if (workflow_get_update_files_count(workflowHandle) != 1)
+    {
+        Log_Error("Delta expecting one file. (%d)", workflow_get_update_files_count(workflowHandle));
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_WRONG_FILECOUNT;
+        goto done;
+    }
+
+    if (!workflow_get_update_file(workflowHandle, 0, &entity))
+    {
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_BAD_FILE_ENTITY;
+        goto done;
+    }
+
+    sourcePath = workflow_peek_update_manifest_handler_properties_string(workflowHandle, "sourcePath");
+    if (IsNullOrEmpty(sourcePath))
+    {
+        workflow_set_result_details(workflowHandle, "Missing 'handlerProperties.sourcePath' property");
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_MISSING_SOURCEPATH_PROPERTY;
+        goto done;
+    }
+
+    sourceSizeString = workflow_peek_update_manifest_handler_properties_string(workflowHandle, "sourceSize");
+    if (sourceSizeString != nullptr && !atoul(sourceSizeString, &sourceSize))
+    {
+        workflow_set_result_details(workflowHandle, "Invalid 'handlerProperties.sourceSize' property");
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_INVALID_SOURCESIZE_PROPERTY;
+        goto done;
+    }
+
+    targetHash = workflow_peek_update_manifest_handler_properties_string(workflowHandle, "targetHash");
+    if (IsNullOrEmpty(targetHash))
+    {
+        workflow_set_result_details(workflowHandle, "Missing 'handlerProperties.targetHash' property");
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_MISSING_TARGETHASH_PROPERTY;
+        goto done;
+    }
+
+    targetHashAlgorithm =
+        workflow_peek_update_manifest_handler_properties_string(workflowHandle, "targetHashAlgorithm");
+    if (targetHashAlgorithm != nullptr && !ADUC_HashUtils_GetShaVersionForTypeString(targetHashAlgorithm, &algorithm))
+    {
+        workflow_set_result_details(workflowHandle, "Unsupported 'handlerProperties.targetHashAlgorithm' property");
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_UNSUPPORTED_TARGETHASH_ALGORITHM;
+        goto done;
+    }
+
+    result.ExtendedResultCode = GetTargetPath(workflowHandle, &targetPath);
+    if (result.ExtendedResultCode != 0)
+    {
+        goto done;
+    }
+
+    targetHashEntry.value = const_cast<char*>(targetHash);
+    targetHashEntry.type = const_cast<char*>((targetHashAlgorithm != nullptr) ? targetHashAlgorithm : "sha256");
+
+    // An image reconstructed by an earlier attempt, or verified earlier in this workflow, doesn't need the patch again.
+    if (workflow_is_file_verified(workflowHandle, targetPath.c_str(), &targetHashEntry, 1)
+        || ADUC_HashUtils_IsValidFileHash(targetPath.c_str(), targetHash, algorithm))
+    {
+        Log_Info("Reconstructed image %s is already valid", targetPath.c_str());
+        workflow_set_file_verified(workflowHandle, targetPath.c_str(), &targetHashEntry, 1);
+        result = { ADUC_Result_Download_Success };
+        goto done;
+    }
+
+    result = ExtensionManager::Download(
+        entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr, workflowHandle);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    patchPath << workFolder << "/" << entity->TargetFilename;
+
+    result = ADUC_DeltaPatch_Apply(
+        sourcePath, sourceSize, patchPath.str().c_str(), targetPath.c_str(), targetHash, algorithm);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    // ADUC_DeltaPatch_Apply verified the hash of the reconstructed image.
+    workflow_set_file_verified(workflowHandle, targetPath.c_str(), &targetHashEntry, 1);
+
+    // Only the reconstructed image is needed from now on.
+    (void)remove(patchPath.str().c_str());
+
+    result = { ADUC_Result_Download_Success };
+
+done:
+    free(updateName); // NOLINT(cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    workflow_free_string(updateType);
+    workflow_free_string(workflowId);
+    workflow_free_string(workFolder);
+    workflow_free_file_entity(entity);
+
+    return result;
+}
+
+/**
+ * @brief Install implementation for delta updates.
+ * Calls into the swupdate wrapper script to install the reconstructed image.
+ *
+ * @return ADUC_Result The result of the install.
+ */
+ADUC_Result DeltaHandlerImpl::Install(const tagADUC_WorkflowData* workflowData)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    std::string targetPath;
+
+    result.ExtendedResultCode = GetTargetPath(workflowData->WorkflowHandle, &targetPath);
+    if (result.ExtendedResultCode != 0)
+    {
+        return result;
+    }
+
+    if (access(targetPath.c_str(), F_OK) != 0)
+    {
+        Log_Error("Reconstructed image %s does not exist", targetPath.c_str());
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_INSTALL_FAILURE_MISSING_TARGET;
+        return result;
+    }
+
+    Log_Info("Installing %s", targetPath.c_str());
+
+    std::string command = adushconst::adu_shell;
+    std::vector<std::string> args{ adushconst::update_type_opt,       adushconst::update_type_microsoft_swupdate,
+                                   adushconst::update_action_opt,     adushconst::update_action_install,
+                                   adushconst::target_data_opt,       targetPath,
+                                   adushconst::target_log_folder_opt, ADUC_LOG_FOLDER };
+
+    std::string output;
+    const int exitCode = ADUC_LaunchChildProcess(command, args, output);
+
+    if (exitCode != 0)
+    {
+        Log_Error("Install failed, extendedResultCode = %d", exitCode);
+        return { ADUC_Result_Failure, ADUC_ERC_DELTA_HANDLER_CHILD_PROCESS_FAILURE_EXITCODE(exitCode) };
+    }
+
+    Log_Info("Install succeeded");
+    return { ADUC_Result_Install_Success };
+}
+
+/**
+ * @brief Apply implementation for delta updates.
+ * Calls into the swupdate wrapper script to boot into the updated partition, like 'microsoft/swupdate:1'.
+ *
+ * @return ADUC_Result The result of the apply.
+ */
+ADUC_Result DeltaHandlerImpl::Apply(const tagADUC_WorkflowData* workflowData)
+{
+    std::string command = adushconst::adu_shell;
+    std::vector<std::string> args{ adushconst::update_type_opt,       adushconst::update_type_microsoft_swupdate,
+                                   adushconst::update_action_opt,     adushconst::update_action_apply,
+                                   adushconst::target_log_folder_opt, ADUC_LOG_FOLDER };
+
+    std::string output;
+    const int exitCode = ADUC_LaunchChildProcess(command, args, output);
+
+    if (exitCode != 0)
+    {
+        Log_Error("Apply failed, extendedResultCode = %d", exitCode);
+        return { ADUC_Result_Failure, ADUC_ERC_DELTA_HANDLER_CHILD_PROCESS_FAILURE_EXITCODE(exitCode) };
+    }
+
+    // Cancel requested? Revert the bootloader flag to boot into the current partition.
+    if (workflow_get_operation_cancel_requested(workflowData->WorkflowHandle))
+    {
+        args[3] = adushconst::update_action_cancel;
+        if (ADUC_LaunchChildProcess(command, args, output) == 0)
+        {
+            Log_Info("Apply was cancelled");
+            return { ADUC_Result_Failure_Cancelled };
+        }
+
+        Log_Error("Failed to cancel Apply");
+    }
+
+    return { ADUC_Result_Apply_RequiredImmediateReboot };
+}
+
+/**
+ * @brief Cancel implementation for delta updates.
+ * Reconstruction and install can't be interrupted; cancelling apply is handled by Apply.
+ *
+ * @return ADUC_Result The result of the cancel.
+ */
+ADUC_Result DeltaHandlerImpl::Cancel(const tagADUC_WorkflowData* workflowData)
+{
+    UNREFERENCED_PARAMETER(workflowData);
+    return ADUC_Result{ ADUC_Result_Cancel_Success };
+}
+
+/**
+ * @brief Checks if the installed content matches the installed criteria, i.e. the content of the version file.
+ *
+ * @return ADUC_Result
+ */
+ADUC_Result DeltaHandlerImpl::IsInstalled(const tagADUC_WorkflowData* workflowData)
+{
+    char* installedCriteria = ADUC_WorkflowData_GetInstalledCriteria(workflowData);
+    ADUC_Result result = { ADUC_Result_Failure };
+    std::ifstream file(ADUC_VERSION_FILE);
+    std::string version;
+
+    std::getline(file, version);
+    ADUC::StringUtils::Trim(version);
+
+    if (version.empty())
+    {
+        Log_Error("Version file %s did not contain a version or could not be read.", ADUC_VERSION_FILE);
+        goto done;
+    }
+
+    if (version == installedCriteria)
+    {
+        Log_Info("Installed criteria %s was installed.", installedCriteria);
+        result = { ADUC_Result_IsInstalled_Installed };
+        goto done;
+    }
+
+    Log_Info("Installed criteria %s was not installed, the current version is %s", installedCriteria, version.c_str());
+    result = { ADUC_Result_IsInstalled_NotInstalled };
+
+done:
+    workflow_free_string(installedCriteria);
+    return result;
+}
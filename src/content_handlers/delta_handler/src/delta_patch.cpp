@@ -0,0 +1,258 @@
+/**
+ * @file delta_patch.cpp
+ * @brief Reconstructs an image from a zstd --patch-from delta and the image it was created against.
+ *
+ * A zstd patch is a regular zstd frame compressed with the source image as a raw prefix dictionary; blocks of the
+ * target that also occur in the source are encoded as matches into it. Decoding it with the same prefix restores
+ * the target. The decoder needs a window as large as the source, so the source is memory-mapped rather than read.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/delta_patch.hpp"
+
+#include "aduc/logging.h"
+
+#include <cerrno>
+#include <cstdio> // for remove
+#include <fcntl.h> // for open
+#include <memory>
+#include <sys/mman.h> // for mmap
+#include <unistd.h> // for lseek, read, close
+
+#include <zstd.h>
+
+// Size of the blocks read from the patch.
+#define DELTA_PATCH_READ_BUFFER_SIZE (256 * 1024)
+
+namespace
+{
+/**
+ * @brief A read-only mapping of the source image.
+ */
+class SourceMapping
+{
+public:
+    SourceMapping() = default;
+
+    ~SourceMapping()
+    {
+        if (_data != MAP_FAILED)
+        {
+            munmap(_data, _size);
+        }
+    }
+
+    SourceMapping(const SourceMapping&) = delete;
+    SourceMapping& operator=(const SourceMapping&) = delete;
+    SourceMapping(SourceMapping&&) = delete;
+    SourceMapping& operator=(SourceMapping&&) = delete;
+
+    /**
+     * @brief Maps the first @p size bytes of @p path, or all of it if @p size is 0.
+     * lseek is used for the size, since st_size is 0 for a block device.
+     * @return bool True on success.
+     */
+    bool Map(const char* path, uint64_t size)
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            Log_Error("Cannot open source %s (errno %d)", path, errno);
+            return false;
+        }
+
+        const off_t end = lseek(fd, 0, SEEK_END);
+        if (end <= 0 || (size != 0 && static_cast<uint64_t>(end) < size))
+        {
+            Log_Error(
+                "Source %s is %lld bytes, expected %llu",
+                path,
+                static_cast<long long>(end),
+                static_cast<unsigned long long>(size));
+            close(fd);
+            return false;
+        }
+
+        _size = (size != 0) ? static_cast<size_t>(size) : static_cast<size_t>(end);
+        _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (_data == MAP_FAILED)
+        {
+            Log_Error("Cannot map source %s (errno %d)", path, errno);
+            return false;
+        }
+
+        // Matches may reference any part of the source, so start reading all of it in.
+        (void)madvise(_data, _size, MADV_WILLNEED);
+        return true;
+    }
+
+    const void* Data() const
+    {
+        return _data;
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    void* _data = MAP_FAILED;
+    size_t _size = 0;
+};
+
+/**
+ * @brief Streams @p patchFd through @p dctx into @p sink.
+ * @return ADUC_Result_t 0 on success, or an ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_* code.
+ */
+ADUC_Result_t DecodePatch(ZSTD_DCtx* dctx, int patchFd, ADUC_HashUtils_FileSink* sink)
+{
+    std::unique_ptr<uint8_t[]> input{ new uint8_t[DELTA_PATCH_READ_BUFFER_SIZE] };
+    std::unique_ptr<uint8_t[]> output{ new uint8_t[ZSTD_DStreamOutSize()] };
+    size_t lastResult = 1; // Non-zero until a complete frame was decoded.
+
+    for (;;)
+    {
+        const ssize_t readSize = read(patchFd, input.get(), DELTA_PATCH_READ_BUFFER_SIZE);
+        if (readSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Cannot read patch (errno %d)", errno);
+            return ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_PATCH;
+        }
+
+        if (readSize == 0)
+        {
+            break;
+        }
+
+        ZSTD_inBuffer in = { input.get(), static_cast<size_t>(readSize), 0 };
+        ZSTD_outBuffer out = { output.get(), ZSTD_DStreamOutSize(), 0 };
+
+        // A full output buffer means the decoder may hold more output, even once all input is consumed.
+        do
+        {
+            out.pos = 0;
+            lastResult = ZSTD_decompressStream(dctx, &out, &in);
+            if (ZSTD_isError(lastResult))
+            {
+                Log_Error("Cannot apply patch: %s", ZSTD_getErrorName(lastResult));
+                return ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_PATCH;
+            }
+
+            if (!ADUC_HashUtils_FileSink_Write(sink, output.get(), out.pos))
+            {
+                return ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_WRITE_TARGET;
+            }
+        } while (in.pos < in.size || out.pos == out.size);
+    }
+
+    if (lastResult != 0)
+    {
+        Log_Error("Patch is empty or truncated");
+        return ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_PATCH;
+    }
+
+    return 0;
+}
+
+} // namespace
+
+ADUC_Result ADUC_DeltaPatch_Apply(
+    const char* sourcePath,
+    uint64_t sourceSize,
+    const char* patchPath,
+    const char* targetPath,
+    const char* targetHash,
+    SHAversion algorithm)
+{
+    ADUC_Result result = { ADUC_GeneralResult_Failure };
+    SourceMapping source;
+    ADUC_HashUtils_FileSink sink{};
+    bool sinkOpened = false;
+    bool targetCreated = false;
+    int patchFd = -1;
+    ZSTD_DCtx* dctx = nullptr;
+
+    if (!source.Map(sourcePath, sourceSize))
+    {
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_SOURCE;
+        goto done;
+    }
+
+    patchFd = open(patchPath, O_RDONLY | O_CLOEXEC);
+    if (patchFd == -1)
+    {
+        Log_Error("Cannot open patch %s (errno %d)", patchPath, errno);
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_PATCH;
+        goto done;
+    }
+
+    // The patch window spans the source, which is beyond the default decoder limit (128 MiB) for large images.
+    dctx = ZSTD_createDCtx();
+    if (dctx == nullptr
+        || ZSTD_isError(ZSTD_DCtx_setParameter(
+            dctx, ZSTD_d_windowLogMax, ZSTD_dParam_getBounds(ZSTD_d_windowLogMax).upperBound))
+        || ZSTD_isError(ZSTD_DCtx_refPrefix(dctx, source.Data(), source.Size())))
+    {
+        Log_Error("Cannot create the patch decoder");
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_PATCH;
+        goto done;
+    }
+
+    sinkOpened = ADUC_HashUtils_FileSink_Open(&sink, targetPath, algorithm);
+    targetCreated = sinkOpened;
+    if (!sinkOpened)
+    {
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_WRITE_TARGET;
+        goto done;
+    }
+
+    Log_Info("Applying patch %s to %zu bytes of %s, writing %s", patchPath, source.Size(), sourcePath, targetPath);
+
+    result.ExtendedResultCode = DecodePatch(dctx, patchFd, &sink);
+
+    sinkOpened = false;
+    if (!ADUC_HashUtils_FileSink_Close(&sink, (result.ExtendedResultCode == 0) ? targetHash : nullptr, nullptr)
+        && result.ExtendedResultCode == 0)
+    {
+        Log_Error("Reconstructed %s does not match the target hash", targetPath);
+        result.ExtendedResultCode = ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_TARGET_HASH;
+    }
+
+    if (result.ExtendedResultCode != 0)
+    {
+        goto done;
+    }
+
+    Log_Info("Reconstructed %llu bytes, target hash is valid", static_cast<unsigned long long>(sink.BytesWritten));
+    result = { ADUC_GeneralResult_Success };
+
+done:
+    if (sinkOpened)
+    {
+        ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr);
+    }
+
+    // Only a verified image may be left behind for Install.
+    if (targetCreated && IsAducResultCodeFailure(result.ResultCode))
+    {
+        (void)remove(targetPath);
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    if (patchFd != -1)
+    {
+        close(patchFd);
+    }
+
+    return result;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file delta_patch_ut.cpp
+ * @brief Unit Tests for the zstd patch applier of the delta handler.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/delta_patch.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <cstdio> // for std::remove
+#include <cstdlib> // for mkdtemp
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h> // for rmdir
+
+#include <zstd.h>
+
+static std::string MakeImage(size_t size, unsigned int seed)
+{
+    std::mt19937 random{ seed };
+    std::string image(size, '\0');
+    for (char& c : image)
+    {
+        c = static_cast<char>(random() & 0xff);
+    }
+    return image;
+}
+
+/**
+ * @brief Creates a patch from @p source to @p target, like `zstd --patch-from=source target`.
+ */
+static std::string MakePatch(const std::string& source, const std::string& target)
+{
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    REQUIRE(cctx != nullptr);
+    REQUIRE_FALSE(ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, 24)));
+    REQUIRE_FALSE(ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1)));
+    REQUIRE_FALSE(ZSTD_isError(ZSTD_CCtx_refPrefix(cctx, source.data(), source.size())));
+
+    std::string patch(ZSTD_compressBound(target.size()), '\0');
+    const size_t size = ZSTD_compress2(cctx, &patch[0], patch.size(), target.data(), target.size());
+    REQUIRE_FALSE(ZSTD_isError(size));
+    patch.resize(size);
+
+    ZSTD_freeCCtx(cctx);
+    return patch;
+}
+
+static std::string Sha256(const std::string& path)
+{
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHash(path.c_str(), SHA256, &hash));
+    std::string result{ hash };
+    free(hash); // NOLINT(cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    return result;
+}
+
+static void WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+}
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+TEST_CASE("ADUC_DeltaPatch_Apply")
+{
+    char folder[] = "/tmp/deltapatchXXXXXX";
+    REQUIRE(mkdtemp(folder) != nullptr);
+
+    const std::string sourcePath = std::string(folder) + "/source.img";
+    const std::string patchPath = std::string(folder) + "/image.patch";
+    const std::string targetPath = std::string(folder) + "/target.img";
+    const std::string expectedPath = std::string(folder) + "/expected.img";
+
+    // The target is the source with a few changed and inserted regions.
+    const std::string source = MakeImage(4 * 1024 * 1024, 1);
+    std::string target = source;
+    target.replace(1000, 4096, MakeImage(4096, 2));
+    target.insert(2 * 1024 * 1024, MakeImage(64 * 1024, 3));
+    target.erase(3 * 1024 * 1024, 10000);
+
+    const std::string patch = MakePatch(source, target);
+    REQUIRE(patch.size() < target.size() / 10);
+
+    WriteFile(sourcePath, source);
+    WriteFile(patchPath, patch);
+    WriteFile(expectedPath, target);
+    const std::string targetHash = Sha256(expectedPath);
+
+    SECTION("Target is reconstructed and verified")
+    {
+        const ADUC_Result result = ADUC_DeltaPatch_Apply(
+            sourcePath.c_str(), 0, patchPath.c_str(), targetPath.c_str(), targetHash.c_str(), SHA256);
+        CHECK(IsAducResultCodeSuccess(result.ResultCode));
+        CHECK(ReadFile(targetPath) == target);
+    }
+
+    SECTION("Only the leading sourceSize bytes of the source are used")
+    {
+        WriteFile(sourcePath, source + MakeImage(100000, 4));
+
+        const ADUC_Result result = ADUC_DeltaPatch_Apply(
+            sourcePath.c_str(), source.size(), patchPath.c_str(), targetPath.c_str(), targetHash.c_str(), SHA256);
+        CHECK(IsAducResultCodeSuccess(result.ResultCode));
+        CHECK(ReadFile(targetPath) == target);
+    }
+
+    SECTION("A different source fails and leaves no target")
+    {
+        WriteFile(sourcePath, MakeImage(source.size(), 5));
+
+        const ADUC_Result result = ADUC_DeltaPatch_Apply(
+            sourcePath.c_str(), 0, patchPath.c_str(), targetPath.c_str(), targetHash.c_str(), SHA256);
+        CHECK(IsAducResultCodeFailure(result.ResultCode));
+        CHECK(result.ExtendedResultCode == ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_TARGET_HASH);
+        CHECK(access(targetPath.c_str(), F_OK) != 0);
+    }
+
+    SECTION("A truncated patch fails")
+    {
+        WriteFile(patchPath, patch.substr(0, patch.size() / 2));
+
+        const ADUC_Result result = ADUC_DeltaPatch_Apply(
+            sourcePath.c_str(), 0, patchPath.c_str(), targetPath.c_str(), targetHash.c_str(), SHA256);
+        CHECK(result.ExtendedResultCode == ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_PATCH);
+        CHECK(access(targetPath.c_str(), F_OK) != 0);
+    }
+
+    SECTION("A source smaller than sourceSize fails")
+    {
+        const ADUC_Result result = ADUC_DeltaPatch_Apply(
+            sourcePath.c_str(), source.size() + 1, patchPath.c_str(), targetPath.c_str(), targetHash.c_str(), SHA256);
+        CHECK(result.ExtendedResultCode == ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_SOURCE);
+    }
+
+    for (const std::string& path : { sourcePath, patchPath, targetPath, expectedPath })
+    {
+        (void)std::remove(path.c_str());
+    }
+    (void)rmdir(folder);
+}
@@ -0,0 +1,10 @@
+/**
+ * @file main.cpp
+ * @brief main for delta handler unit tests
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
@@ -38,7 +38,7 @@ EXTERN_C_BEGIN
 /**
  * @brief Instantiates an Update Content Handler for 'microsoft/bundle:1' update type.
  */
-ContentHandler* CreateUpdateContentHandlerExtension()
+ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY /*logLevel*/)
 {
     Log_Info("Instantiating an Update Content Handler for 'microsoft/script:1'");
     return ScriptHandlerImpl::CreateContentHandler();
@@ -95,7 +95,8 @@ static ADUC_Result Script_Handler_DownloadPrimaryScriptFile(const ADUC_WorkflowH
 
     try
     {
-        result = ExtensionManager::Download(entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr);
+        result =
+            ExtensionManager::Download(entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr, handle);
     }
     catch (...)
     {
@@ -137,6 +138,9 @@ ADUC_Result ScriptHandlerImpl::Download(const tagADUC_WorkflowData* workflowData
     char* workFolder = workflow_get_workfolder(workflowData->WorkflowHandle);
     ADUC_FileEntity* entity = nullptr;
     int fileCount = workflow_get_update_files_count(workflowHandle);
+    std::vector<ADUC_FileEntity*> entities;
+    std::vector<const ADUC_FileEntity*> batch;
+    std::vector<ADUC_Result> results;
 
     result = Script_Handler_DownloadPrimaryScriptFile(workflowHandle);
 
@@ -157,10 +161,9 @@ ADUC_Result ScriptHandlerImpl::Download(const tagADUC_WorkflowData* workflowData
 
     result = { ADUC_Result_Download_Success };
 
+    // Download all files at once. The primary script file is already in the work folder, and is skipped.
     for (int i = 0; i < fileCount; i++)
     {
-        Log_Info("Downloading file #%d", i);
-
         if (!workflow_get_update_file(workflowHandle, i, &entity))
         {
             result = { .ResultCode = ADUC_Result_Failure,
@@ -168,27 +171,43 @@ ADUC_Result ScriptHandlerImpl::Download(const tagADUC_WorkflowData* workflowData
             goto done;
         }
 
-        try
-        {
-            result = ExtensionManager::Download(entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr);
-        }
-        catch (...)
-        {
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode = ADUC_ERC_SCRIPT_HANDLER_DOWNLOAD_PAYLOAD_FILE_FAILURE_UNKNOWNEXCEPTION };
-        }
-
-        workflow_free_file_entity(entity);
+        entities.push_back(entity);
         entity = nullptr;
+    }
+
+    batch.assign(entities.begin(), entities.end());
+
+    try
+    {
+        result = ExtensionManager::DownloadBatch(
+            batch,
+            workflowId,
+            workFolder,
+            DO_RETRY_TIMEOUT_DEFAULT,
+            workflowData->DownloadProgressCallback,
+            &results,
+            workflowHandle);
+    }
+    catch (...)
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_SCRIPT_HANDLER_DOWNLOAD_PAYLOAD_FILE_FAILURE_UNKNOWNEXCEPTION };
+    }
 
-        if (IsAducResultCodeFailure(result.ResultCode))
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (IsAducResultCodeFailure(results[i].ResultCode) && results[i].ExtendedResultCode != 0)
         {
-            Log_Error("Cannot download script payload file#%d. (0x%X)", i, result.ExtendedResultCode);
-            goto done;
+            Log_Error("Cannot download script payload file#%zu. (0x%X)", i, results[i].ExtendedResultCode);
         }
     }
 
 done:
+    for (ADUC_FileEntity* payloadEntity : entities)
+    {
+        workflow_free_file_entity(payloadEntity);
+    }
+
     workflow_free_string(workFolder);
     workflow_free_file_entity(entity);
     workflow_free_string(installedCriteria);
@@ -106,7 +106,9 @@ char* _StringFormat(const char* fmt, ...)
  */
 ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel)
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Init(logLevel, "simulator-handler");
+#endif
     Log_Info("Instantiating a Simulator Update Content Handler");
     try
     {
@@ -132,7 +134,9 @@ EXTERN_C_END
  */
 SimulatorHandlerImpl::~SimulatorHandlerImpl() // override
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Uninit();
+#endif
 }
 
 // Forward declarations.
@@ -10,14 +10,14 @@
 
 #include "aduc/c_utils.h"
 #include "aduc/exceptions.hpp"
-#include "aduc/extension_utils.h"
-#include "aduc/hash_utils.h" // for SHAversion
+#include "aduc/extension_registry.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h"
 #include "aduc/result.h"
 #include "aduc/string_utils.hpp"
 
 #include <cstring>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -56,47 +56,29 @@ ADUC_Result ContentHandlerFactory::LoadExtensionLibrary(const std::string& updat
         Log_Debug("Cache not found. Will create a new one.");
     }
 
-    char* error = nullptr;
     UPDATE_CONTENT_HANDLER_CREATE_PROC createUpdateContentHandlerExtension = nullptr;
-    ADUC_FileEntity entity;
-    memset(&entity, 0, sizeof(entity));
+    const std::shared_ptr<const ADUC::ExtensionRegistration> registration =
+        ADUC::ExtensionRegistry::GetInstance().FindUpdateContentHandler(updateType);
 
-    if (!GetUpdateContentHandlerFileEntity(updateType.c_str(), &entity))
+    if (registration == nullptr)
     {
         Log_Error("Update Content Handler for '%s' not found.", updateType.c_str());
         return { ADUC_GeneralResult_Failure, ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_NOT_FOUND };
     }
 
     // Validate file hash.
-    SHAversion algVersion;
-    if (!ADUC_HashUtils_GetShaVersionForTypeString(
-            ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0), &algVersion))
+    if (!ADUC::ExtensionRegistry::VerifyFile(*registration))
     {
-        Log_Error(
-            "FileEntity for %s has unsupported hash type %s",
-            entity.TargetFilename,
-            ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0));
-        result = { ADUC_GeneralResult_Failure, ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_VALIDATE };
-        goto done;
-    }
-
-    if (!ADUC_HashUtils_IsValidFileHash(
-            entity.TargetFilename, 
-            ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0),
-            algVersion))
-    {
-        Log_Error("Hash for %s is not valid", entity.TargetFilename);
-        result = { ADUC_GeneralResult_Failure, ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_VALIDATE };
-        goto done;
+        return { ADUC_GeneralResult_Failure, ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_VALIDATE };
     }
 
-    Log_Debug("Loading update content handler from '%s'.", entity.TargetFilename);
+    Log_Debug("Loading update content handler from '%s'.", registration->FilePath.c_str());
 
-    *libHandle = dlopen(entity.TargetFilename, RTLD_LAZY);
+    *libHandle = dlopen(registration->FilePath.c_str(), RTLD_LAZY);
 
     if (*libHandle == nullptr)
     {
-        Log_Error("Cannot load content handler file %s. %s.", entity.TargetFilename, dlerror());
+        Log_Error("Cannot load content handler file %s. %s.", registration->FilePath.c_str(), dlerror());
         result = { ADUC_GeneralResult_Failure, ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_LOAD };
         goto done;
     }
@@ -133,9 +115,6 @@ done:
         }
     }
 
-    // Done with file entity.
-    ADUC_FileEntity_Uninit(&entity);
-
     return result;
 }
 
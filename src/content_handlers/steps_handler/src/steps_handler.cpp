@@ -8,6 +8,7 @@
 #include "aduc/steps_handler.hpp"
 
 #include "aduc/component_enumerator_extension.hpp"
+#include "aduc/config_utils.h"
 #include "aduc/extension_manager.hpp"
 #include "aduc/extension_utils.h"
 #include "aduc/logging.h"
@@ -18,17 +19,24 @@
 #include "parson.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <azure_c_shared_utility/crt_abstractions.h> // mallocAndStrcpy
 #include <azure_c_shared_utility/strings.h> // STRING_*
 
 #include <dirent.h>
+#include <sys/stat.h> // for stat
 
 // Note: this requires ${CMAKE_DL_LIBS}
 #include <dlfcn.h>
@@ -42,7 +50,9 @@ EXTERN_C_BEGIN
  */
 ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel)
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Init(logLevel, "steps-handler");
+#endif
     Log_Info("Instantiating an Update Content Handler for MSOE");
     try
     {
@@ -67,7 +77,82 @@ EXTERN_C_END
  */
 StepsHandlerImpl::~StepsHandlerImpl() // override
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Uninit();
+#endif
+}
+
+/**
+ * @brief Downloads the detached update manifest files of all reference steps at once.
+ *
+ * @param handle A workflow data object handle.
+ * @param workflowId A workflow identifier.
+ * @param workFolder The sandbox folder.
+ * @return ADUC_Result
+ */
+static ADUC_Result DownloadDetachedStepManifests(
+    const ADUC_WorkflowHandle handle, const char* workflowId, const char* workFolder)
+{
+    ADUC_Result result{ ADUC_Result_Success };
+    auto stepCount = static_cast<unsigned int>(workflow_get_instructions_steps_count(handle));
+    int workflowLevel = workflow_get_level(handle);
+    std::vector<ADUC_FileEntity*> entities;
+    std::vector<const ADUC_FileEntity*> batch;
+
+    for (unsigned int i = 0; i < stepCount; i++)
+    {
+        ADUC_FileEntity* entity = nullptr;
+
+        if (workflow_is_inline_step(handle, i))
+        {
+            continue;
+        }
+
+        if (!workflow_get_step_detached_manifest_file(handle, i, &entity))
+        {
+            result = { .ResultCode = ADUC_Result_Failure,
+                       .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_GET_FILE_ENTITY_FAILURE };
+            Log_Error("Cannot get a detached Update manifest file entity for level#%d step#%d", workflowLevel, i);
+            goto done;
+        }
+
+        entities.push_back(entity);
+    }
+
+    if (entities.empty())
+    {
+        goto done;
+    }
+
+    batch.assign(entities.begin(), entities.end());
+
+    Log_Info("Downloading %zu detached Update manifest file(s) for level#%d.", batch.size(), workflowLevel);
+
+    try
+    {
+        result = ExtensionManager::DownloadBatch(
+            batch, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr, nullptr /* results */, handle);
+    }
+    catch (...)
+    {
+        Log_Error("Exception occured while downloading detached Update Manifest files for level#%d.", workflowLevel);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_UNKNOWNEXCEPTION };
+    }
+
+    // For 'microsoft/steps:1' implementation, abort download task as soon as an error occurs.
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        Log_Error("An error occured while downloading manifest files for level#%d (erc:%d)", workflowLevel, result.ExtendedResultCode);
+    }
+
+done:
+    for (ADUC_FileEntity* entity : entities)
+    {
+        workflow_free_file_entity(entity);
+    }
+
+    return result;
 }
 
 /**
@@ -107,6 +192,13 @@ ADUC_Result EnsureStepsWorkflowsCreated(const ADUC_WorkflowHandle handle)
             workflow_free(child);
         }
 
+        // Download the detached update manifests of all steps before creating the step workflows.
+        result = DownloadDetachedStepManifests(handle, workflowId, workFolder);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            goto done;
+        }
+
         Log_Debug("Creating workflow for %d step(s). Parent's level: %d", stepCount, workflowLevel);
         for (unsigned int i = 0; i < stepCount; i++)
         {
@@ -130,7 +222,7 @@ ADUC_Result EnsureStepsWorkflowsCreated(const ADUC_WorkflowHandle handle)
             }
             else
             {
-                // Download detached update manifest file.
+                // The detached update manifest file was downloaded by DownloadDetachedStepManifests.
                 if (!workflow_get_step_detached_manifest_file(handle, i, &entity))
                 {
                     result = { .ResultCode = ADUC_Result_Failure,
@@ -139,31 +231,12 @@ ADUC_Result EnsureStepsWorkflowsCreated(const ADUC_WorkflowHandle handle)
                     goto done;
                 }
 
-                Log_Info("Downloading a detached Update manifest file for level#%d step#%d (file id:%s).", workflowLevel, i, entity->FileId);
-
-                try
-                {
-                    result = ExtensionManager::Download(entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr);
-                }
-                catch (...)
-                {
-                    Log_Error("Exception occured while downloading a detached Update Manifest file for level#%d step#%d (file id:%s).", workflowLevel, i, entity->FileId);
-                    result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_UNKNOWNEXCEPTION;
-                }
-
                 std::stringstream childManifestFile;
                 childManifestFile << workFolder << "/" << entity->TargetFilename;
 
                 workflow_free_file_entity(entity);
                 entity = nullptr;
 
-                // For 'microsoft/steps:1' implementation, abort download task as soon as an error occurs.
-                if (IsAducResultCodeFailure(result.ResultCode))
-                {
-                    Log_Error("An error occured while downloading manifest file for step#%d (erc:%d)",i, result.ExtendedResultCode);
-                    goto done;
-                }
-
                 // Create child workflow from file.
                 result = workflow_init_from_file(childManifestFile.str().c_str(), false, &childHandle);
 
@@ -181,7 +254,7 @@ ADUC_Result EnsureStepsWorkflowsCreated(const ADUC_WorkflowHandle handle)
                     }
 
                     std::string output;
-                    result = ExtensionManager::SelectComponents(compatibilityString, output);
+                    result = ExtensionManager::SelectComponents(compatibilityString, output, handle);
 
                     if (IsAducResultCodeFailure(result.ResultCode))
                     {
@@ -325,6 +398,553 @@ done:
     return result;
 }
 
+/**
+ * @brief Download pipelining options, from du-config.json.
+ */
+struct StepsPipelineOptions
+{
+    unsigned int PrefetchDepth = 0; /**< Number of upcoming steps to download ahead. 0 disables pipelining. */
+    unsigned long long DiskBudget = 0; /**< Bytes of downloaded, not yet installed steps. 0 for no limit. */
+
+    static StepsPipelineOptions FromConfig()
+    {
+        StepsPipelineOptions options;
+        ADUC_ConfigInfo config = {};
+
+        if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+        {
+            options.PrefetchDepth = config.stepsPrefetchDepth;
+            options.DiskBudget = static_cast<unsigned long long>(config.stepsPrefetchDiskBudgetInMB) * 1024 * 1024;
+            ADUC_ConfigInfo_UnInit(&config);
+        }
+
+        return options;
+    }
+
+    /**
+     * @brief Returns the options of the deployment that @p handle belongs to. du-config.json is read once per
+     * deployment, so that its download and install phases, and all of its steps, use the same options.
+     *
+     * @param handle A steps workflow, or a step (child) workflow.
+     * @return StepsPipelineOptions The options.
+     */
+    static StepsPipelineOptions ForDeployment(ADUC_WorkflowHandle handle)
+    {
+        static std::mutex s_mutex;
+        static std::string s_workflowId;
+        static StepsPipelineOptions s_options;
+
+        const char* workflowId = workflow_peek_id(workflow_get_root(handle));
+        std::lock_guard<std::mutex> lock(s_mutex);
+
+        if (workflowId == nullptr || s_workflowId != workflowId)
+        {
+            s_options = FromConfig();
+            s_workflowId = (workflowId == nullptr) ? "" : workflowId;
+        }
+
+        return s_options;
+    }
+};
+
+/**
+ * @brief Returns the total size of the payload files of a step.
+ *
+ * @param stepHandle The step (child) workflow.
+ * @return unsigned long long The size, in bytes.
+ */
+static unsigned long long GetStepPayloadSize(ADUC_WorkflowHandle stepHandle)
+{
+    unsigned long long size = 0;
+    const size_t fileCount = workflow_get_update_files_count(stepHandle);
+
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        ADUC_FileEntity* entity = nullptr;
+        if (workflow_get_update_file(stepHandle, i, &entity))
+        {
+            size += entity->SizeInBytes;
+            workflow_free_file_entity(entity);
+        }
+    }
+
+    return size;
+}
+
+/**
+ * @brief Downloads the payloads of upcoming steps in the background while the current step installs.
+ *
+ * Only inline steps are prefetched. Their files are downloaded one step at a time, in step order, on a background
+ * thread that only calls ExtensionManager::Download. Everything that reads or changes workflows, such as loading
+ * handlers, calling IsInstalled, selecting components and creating the workflows of reference steps, happens on the
+ * installing thread. The step handler's Download still runs there too, and finds the prefetched files verified.
+ */
+class StepsPrefetcher
+{
+public:
+    StepsPrefetcher(ADUC_WorkflowHandle handle, const StepsPipelineOptions& options) :
+        _handle(handle), _options(options)
+    {
+    }
+
+    ~StepsPrefetcher()
+    {
+        Reset();
+    }
+
+    StepsPrefetcher(const StepsPrefetcher&) = delete;
+    StepsPrefetcher& operator=(const StepsPrefetcher&) = delete;
+    StepsPrefetcher(StepsPrefetcher&&) = delete;
+    StepsPrefetcher& operator=(StepsPrefetcher&&) = delete;
+
+    bool IsEnabled() const
+    {
+        return _options.PrefetchDepth > 0;
+    }
+
+    /**
+     * @brief Makes sure that a step's payloads are downloaded: waits for its prefetch, then runs the step's
+     * Download, which retries anything the prefetch didn't download.
+     *
+     * @param stepIndex The step index.
+     * @param contentHandler The step's handler.
+     * @param stepWorkflow The step's workflow.
+     * @return ADUC_Result The result of the step's Download.
+     */
+    ADUC_Result EnsureDownloaded(int stepIndex, ContentHandler* contentHandler, const ADUC_WorkflowData* stepWorkflow)
+    {
+        auto download = _downloads.find(stepIndex);
+        if (download != _downloads.end() && download->second.Result.valid())
+        {
+            Log_Info("Waiting for the prefetched payloads of step #%d.", stepIndex);
+            const ADUC_Result prefetchResult = download->second.Result.get();
+            if (IsAducResultCodeFailure(prefetchResult.ResultCode))
+            {
+                Log_Warn(
+                    "Prefetching step #%d failed, erc: 0x%08x. Downloading it again.",
+                    stepIndex,
+                    prefetchResult.ExtendedResultCode);
+            }
+        }
+        else
+        {
+            _downloads[stepIndex].Size = GetStepPayloadSize(stepWorkflow->WorkflowHandle);
+        }
+
+        return DownloadStep(contentHandler, stepWorkflow->WorkflowHandle);
+    }
+
+    /**
+     * @brief Starts downloading the inline steps after @p stepIndex, within the lookahead depth and the disk budget.
+     * Steps that are already installed are skipped.
+     *
+     * @param stepIndex The index of the step about to be installed.
+     * @param childCount The number of steps.
+     * @param componentJson The selected component of inline steps.
+     */
+    void Prefetch(int stepIndex, int childCount, const char* componentJson)
+    {
+        const int lastStep = std::min(childCount - 1, stepIndex + static_cast<int>(_options.PrefetchDepth));
+        ADUC_WorkflowHandle rootHandle = workflow_get_root(_handle);
+
+        for (int i = stepIndex + 1; i <= lastStep; i++)
+        {
+            // A reference step is a steps workflow of its own, downloaded by the installing thread when it's reached.
+            if (_downloads.count(i) > 0 || !workflow_is_inline_step(_handle, i))
+            {
+                continue;
+            }
+
+            ADUC_WorkflowHandle stepHandle = workflow_get_child(_handle, i);
+            if (stepHandle == nullptr)
+            {
+                break;
+            }
+
+            // Reported by the install loop when it reaches this step.
+            if (!workflow_set_selected_components(stepHandle, componentJson))
+            {
+                break;
+            }
+
+            ContentHandler* contentHandler = nullptr;
+            const char* stepUpdateType = workflow_peek_update_manifest_step_handler(_handle, i);
+
+            if (IsAducResultCodeFailure(
+                    ExtensionManager::LoadUpdateContentHandlerExtension(stepUpdateType, &contentHandler).ResultCode))
+            {
+                break;
+            }
+
+            if (IsStepInstalled(contentHandler, stepHandle))
+            {
+                continue;
+            }
+
+            const unsigned long long size = GetStepPayloadSize(stepHandle);
+            if (_options.DiskBudget != 0 && GetOutstandingSize() + size > _options.DiskBudget)
+            {
+                Log_Info("Step #%d (%llu bytes) doesn't fit in the prefetch disk budget yet.", i, size);
+                break;
+            }
+
+            std::vector<ADUC_FileEntity*> files;
+            const size_t fileCount = workflow_get_update_files_count(stepHandle);
+            for (size_t j = 0; j < fileCount; j++)
+            {
+                ADUC_FileEntity* entity = nullptr;
+                if (workflow_get_update_file(stepHandle, j, &entity))
+                {
+                    files.push_back(entity);
+                }
+            }
+
+            char* workFolder = workflow_get_workfolder(stepHandle);
+            const int createResult = ADUC_SystemUtils_MkSandboxDirRecursive(workFolder);
+            if (createResult != 0)
+            {
+                Log_Error("Unable to create folder %s, error %d", workFolder, createResult);
+                workflow_free_string(workFolder);
+                FreeFiles(files);
+                break;
+            }
+
+            // Unique among the prefetches of nested steps workflows, so that each can be cancelled on its own.
+            // Cancelling the root workflow id cancels them too (see ExtensionManager::CancelDownload).
+            std::stringstream id;
+            id << workflow_peek_id(rootHandle) << "." << workflow_get_level(stepHandle) << "." << i;
+            const std::string downloadId = id.str();
+            const std::string folder = workFolder;
+            workflow_free_string(workFolder);
+
+            Log_Info("Prefetching step #%d (%llu bytes).", i, size);
+
+            const std::shared_future<ADUC_Result> previous = _lastPrefetch;
+            _lastPrefetch =
+                std::async(std::launch::async, [this, rootHandle, stepHandle, files, previous, downloadId, folder]() {
+                    if (previous.valid())
+                    {
+                        previous.wait();
+                    }
+
+                    const ADUC_Result result = DownloadFiles(rootHandle, stepHandle, files, downloadId, folder);
+                    FreeFiles(files);
+                    return result;
+                }).share();
+
+            _downloads[i] = { _lastPrefetch, size, downloadId };
+        }
+    }
+
+    /**
+     * @brief Releases the disk budget of an installed step.
+     *
+     * @param stepIndex The step index.
+     */
+    void Release(int stepIndex)
+    {
+        auto download = _downloads.find(stepIndex);
+        if (download != _downloads.end())
+        {
+            if (download->second.Result.valid())
+            {
+                download->second.Result.wait();
+            }
+
+            _downloads.erase(download);
+        }
+    }
+
+    /**
+     * @brief Cancels the prefetches that are still running, waits for them, and forgets all steps.
+     */
+    void Reset()
+    {
+        _cancelled = true;
+
+        for (auto& download : _downloads)
+        {
+            if (download.second.Result.valid()
+                && download.second.Result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                (void)ExtensionManager::CancelDownload(download.second.DownloadId.c_str());
+            }
+        }
+
+        for (auto& download : _downloads)
+        {
+            if (download.second.Result.valid())
+            {
+                download.second.Result.wait();
+            }
+        }
+
+        _downloads.clear();
+        _lastPrefetch = {};
+        _cancelled = false;
+    }
+
+private:
+    struct StepDownload
+    {
+        std::shared_future<ADUC_Result> Result; // Invalid if the step was downloaded by the installing thread.
+        unsigned long long Size;
+        std::string DownloadId; // The workflow id of the prefetch downloads, for ExtensionManager::CancelDownload.
+    };
+
+    static ADUC_Result DownloadStep(ContentHandler* contentHandler, ADUC_WorkflowHandle stepHandle)
+    {
+        ADUC_WorkflowData stepWorkflow = {};
+        stepWorkflow.WorkflowHandle = stepHandle;
+
+        try
+        {
+            return contentHandler->Download(&stepWorkflow);
+        }
+        catch (...)
+        {
+            return { .ResultCode = ADUC_Result_Failure,
+                     .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_UNKNOWN_EXCEPTION_DOWNLOAD_CONTENT };
+        }
+    }
+
+    /**
+     * @brief Downloads the files of a step. Runs on the background thread.
+     * Stops before the next file once the prefetches are reset or the deployment is cancelled.
+     */
+    ADUC_Result DownloadFiles(
+        ADUC_WorkflowHandle rootHandle,
+        ADUC_WorkflowHandle stepHandle,
+        const std::vector<ADUC_FileEntity*>& files,
+        const std::string& downloadId,
+        const std::string& workFolder)
+    {
+        ADUC_Result result{ ADUC_Result_Download_Success };
+
+        for (const ADUC_FileEntity* entity : files)
+        {
+            if (_cancelled || workflow_get_operation_cancel_requested(rootHandle))
+            {
+                return { ADUC_Result_Failure_Cancelled };
+            }
+
+            try
+            {
+                // The verified files registry is shared and thread-safe; the step's Download won't hash them again.
+                result = ExtensionManager::Download(
+                    entity, downloadId.c_str(), workFolder.c_str(), DO_RETRY_TIMEOUT_DEFAULT, nullptr, stepHandle);
+            }
+            catch (...)
+            {
+                result = { .ResultCode = ADUC_Result_Failure,
+                           .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_UNKNOWN_EXCEPTION_DOWNLOAD_CONTENT };
+            }
+
+            if (IsAducResultCodeFailure(result.ResultCode))
+            {
+                break;
+            }
+        }
+
+        return result;
+    }
+
+    static void FreeFiles(const std::vector<ADUC_FileEntity*>& files)
+    {
+        for (ADUC_FileEntity* entity : files)
+        {
+            workflow_free_file_entity(entity);
+        }
+    }
+
+    static bool IsStepInstalled(ContentHandler* contentHandler, ADUC_WorkflowHandle stepHandle)
+    {
+        ADUC_WorkflowData stepWorkflow = {};
+        stepWorkflow.WorkflowHandle = stepHandle;
+
+        try
+        {
+            return contentHandler->IsInstalled(&stepWorkflow).ResultCode == ADUC_Result_IsInstalled_Installed;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    unsigned long long GetOutstandingSize() const
+    {
+        unsigned long long size = 0;
+        for (const auto& download : _downloads)
+        {
+            size += download.second.Size;
+        }
+
+        return size;
+    }
+
+    ADUC_WorkflowHandle _handle;
+    StepsPipelineOptions _options;
+    std::map<int, StepDownload> _downloads; // Steps downloaded or downloading, and not yet installed.
+    std::shared_future<ADUC_Result> _lastPrefetch;
+    std::atomic<bool> _cancelled{ false }; // Set by Reset, polled by the prefetches.
+};
+
+/**
+ * @brief The disk space needed for a compressed payload, as a multiple of its compressed size. The manifest only
+ * has the size of the compressed content; this leaves room for the compressed file and a decompressed file twice
+ * its size.
+ */
+static const unsigned long long c_compressedPayloadDiskSpaceFactor = 3;
+
+/**
+ * @brief Adds the number of bytes still to be downloaded for the payloads of a workflow and all of its steps.
+ * A file that was partially downloaded earlier (e.g. before an agent restart) only counts for the space that its
+ * "<target>.partial" file doesn't occupy yet. A segmented download allocates all of its partial file up front.
+ *
+ * This has no side effects: only step workflows that already exist are visited. A reference step whose step
+ * workflows are not created yet counts for the files of its own update manifest; the payloads of the reference
+ * steps nested in it are only known once their detached manifests are downloaded.
+ *
+ * @param handle A steps workflow, or a step (child) workflow.
+ * @param[in,out] pendingBytes Incremented by the number of bytes to download.
+ * @return ADUC_Result
+ */
+static ADUC_Result GetPendingDownloadSize(ADUC_WorkflowHandle handle, unsigned long long* pendingBytes)
+{
+    ADUC_Result result{ ADUC_Result_Success };
+    const int childCount = workflow_get_children_count(handle);
+    char* workFolder = nullptr;
+    size_t fileCount = 0;
+
+    for (int i = 0; i < childCount; i++)
+    {
+        ADUC_WorkflowHandle childHandle = workflow_get_child(handle, i);
+        if (childHandle == nullptr)
+        {
+            result = { .ResultCode = ADUC_Result_Failure,
+                       .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_MISSING_CHILD_WORKFLOW };
+            goto done;
+        }
+
+        result = GetPendingDownloadSize(childHandle, pendingBytes);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            goto done;
+        }
+    }
+
+    // The payloads of a steps workflow are the payloads of its steps.
+    if (childCount > 0)
+    {
+        goto done;
+    }
+
+    workFolder = workflow_get_workfolder(handle);
+    fileCount = workflow_get_update_files_count(handle);
+
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        ADUC_FileEntity* entity = nullptr;
+        if (!workflow_get_update_file(handle, i, &entity))
+        {
+            continue;
+        }
+
+        std::stringstream path;
+        path << workFolder << "/" << entity->TargetFilename;
+
+        struct stat st = {};
+        const bool exists = (stat(path.str().c_str(), &st) == 0);
+
+        if (entity->Compression != ADUC_FileCompression_None)
+        {
+            // The target is only created once the content is decompressed.
+            if (!exists)
+            {
+                *pendingBytes += entity->SizeInBytes * c_compressedPayloadDiskSpaceFactor;
+            }
+        }
+        else
+        {
+            unsigned long long downloadedBytes = 0;
+            if (exists)
+            {
+                downloadedBytes = static_cast<unsigned long long>(st.st_size);
+            }
+            else
+            {
+                // The partial file is renamed to the target once verified, so its disk blocks are already taken.
+                path << ".partial";
+                if (stat(path.str().c_str(), &st) == 0)
+                {
+                    downloadedBytes = static_cast<unsigned long long>(st.st_blocks) * 512;
+                }
+            }
+
+            if (downloadedBytes < entity->SizeInBytes)
+            {
+                *pendingBytes += entity->SizeInBytes - downloadedBytes;
+            }
+        }
+
+        workflow_free_file_entity(entity);
+    }
+
+done:
+    workflow_free_string(workFolder);
+    return result;
+}
+
+/**
+ * @brief Fails fast if the sandbox has no room for the payloads of a steps workflow, instead of after a long
+ * download or half way through the steps. Every steps workflow checks its own steps once they are created, so the
+ * payloads of nested reference steps are checked when their detached manifests are downloaded.
+ *
+ * @param handle A steps workflow, with its step workflows created.
+ * @return ADUC_Result
+ */
+static ADUC_Result CheckDiskSpaceForDownloads(ADUC_WorkflowHandle handle)
+{
+    ADUC_Result result{ ADUC_Result_Success };
+    unsigned long long pendingBytes = 0;
+    unsigned long long availableBytes = 0;
+    char* workFolder = workflow_get_workfolder(handle);
+    int statResult = 0;
+
+    result = GetPendingDownloadSize(handle, &pendingBytes);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    statResult = ADUC_SystemUtils_GetAvailableDiskSpace(workFolder, &availableBytes);
+    if (statResult != 0)
+    {
+        // Not fatal; a download still fails on its own when the disk fills up.
+        Log_Warn("Cannot get the available disk space of %s, error %d", workFolder, statResult);
+        goto done;
+    }
+
+    Log_Info("Payloads to download: %llu bytes, available in %s: %llu bytes", pendingBytes, workFolder, availableBytes);
+
+    if (pendingBytes > availableBytes)
+    {
+        Log_Error("Insufficient disk space, %llu bytes needed, %llu bytes available", pendingBytes, availableBytes);
+        workflow_set_result_details(
+            handle,
+            "Insufficient disk space to download the update: %llu bytes needed, %llu bytes available.",
+            pendingBytes,
+            availableBytes);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_INSUFFICIENT_DISK_SPACE };
+    }
+
+done:
+    workflow_free_string(workFolder);
+    return result;
+}
+
 /**
  * @brief Perform download phase for specified step.
  *
@@ -405,6 +1025,8 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
     char* currentComponent;
     int workflowLevel = workflow_get_level(handle);
     int selectedComponentsCount = 0;
+    bool deferRemainingSteps = false;
+    const StepsPipelineOptions pipelineOptions = StepsPipelineOptions::ForDeployment(handle);
 
     Log_Debug("\n##########\n#\n# Steps_Handler Download begin (level %d, id: %d, addr:0x%x\n#\n##########\n", workflowLevel, workflowId, handle);
 
@@ -434,6 +1056,13 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
         selectedComponentsCount = 1;
     }
 
+    // The steps of this workflow are known at this point; check that they fit before downloading any of them.
+    result = CheckDiskSpaceForDownloads(handle);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
     // If any of the targetted components is not up-to-date, download the update payloads.
     for (int iCom = 0; iCom < selectedComponentsCount; iCom++)
     {
@@ -545,11 +1174,17 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
                 // Propagate item's resultDetails to parent.
                 workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
             }
+            else if (pipelineOptions.PrefetchDepth > 0)
+            {
+                // With download pipelining, Install downloads the remaining steps while earlier steps install.
+                Log_Info("Download pipelining is enabled, deferring the downloads after step #%d to Install.", i);
+                deferRemainingSteps = true;
+            }
 
         instanceDone:
             stepHandle = nullptr;
 
-            if (IsAducResultCodeFailure(result.ResultCode))
+            if (IsAducResultCodeFailure(result.ResultCode) || deferRemainingSteps)
             {
                 goto componentDone;
             }
@@ -564,6 +1199,11 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
             goto done;
         }
 
+        if (deferRemainingSteps)
+        {
+            break;
+        }
+
         // Set step's result.
     }
 
@@ -635,6 +1275,7 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
     char* currentComponent;
     int workflowLevel = workflow_get_level(handle);
     int selectedComponentsCount = 0;
+    StepsPrefetcher prefetcher{ handle, StepsPipelineOptions::ForDeployment(handle) };
 
     Log_Debug("\n##########\n#\n# Steps_Handler Install begin (level %d, id: %s, addr:0x%x\n#\n##########\n", workflowLevel, workflowId, handle);
 
@@ -685,6 +1326,9 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
             Log_Debug("Processing %d step(s) on host device.", workflow_get_children_count(handle));
         }
 
+        // Prefetches only run ahead within the steps of one component.
+        prefetcher.Reset();
+
         //
         // For each step (child workflow), invoke install and apply actions.
         //
@@ -758,6 +1402,20 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
                 goto instanceDone;
             }
 
+            if (prefetcher.IsEnabled())
+            {
+                // Download this step (if it wasn't prefetched), then let the next steps download while it installs.
+                result = prefetcher.EnsureDownloaded(i, contentHandler, &stepWorkflow);
+                if (IsAducResultCodeFailure(result.ResultCode))
+                {
+                    // Propagate item's resultDetails to parent.
+                    workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
+                    goto done;
+                }
+
+                prefetcher.Prefetch(i, childCount, componentJson);
+            }
+
             //
             // Perform 'install' action.
             //
@@ -870,6 +1528,7 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
 
         instanceDone:
             stepHandle = nullptr;
+            prefetcher.Release(i);
 
             if (IsAducResultCodeFailure(result.ResultCode))
             {
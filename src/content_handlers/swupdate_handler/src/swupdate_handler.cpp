@@ -46,7 +46,9 @@ EXTERN_C_BEGIN
  */
 ContentHandler* CreateUpdateContentHandlerExtension(ADUC_LOG_SEVERITY logLevel)
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Init(logLevel, "swupdate-handler");
+#endif
     Log_Info("Instantiating an Update Content Handler for 'microsoft/swupdate:1'");
     try
     {
@@ -71,7 +73,9 @@ EXTERN_C_END
  */
 SWUpdateHandlerImpl::~SWUpdateHandlerImpl() // override
 {
+#ifndef ADUC_STATIC_EXTENSION
     ADUC_Logging_Uninit();
+#endif
 }
 
 // Forward declarations.
@@ -139,7 +143,8 @@ ADUC_Result SWUpdateHandlerImpl::Download(const tagADUC_WorkflowData* workflowDa
 
     updateFilename << workFolder << "/" << entity->TargetFilename;
 
-    result = ExtensionManager::Download(entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr);
+    result = ExtensionManager::Download(
+        entity, workflowId, workFolder, DO_RETRY_TIMEOUT_DEFAULT, nullptr, workflowHandle);
 
 done:
     workflow_free_string(workflowId);
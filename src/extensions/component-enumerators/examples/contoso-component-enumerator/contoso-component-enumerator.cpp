@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <sstream>
 #include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h> // for read
 
 /*
 
@@ -43,6 +45,9 @@
 //
 const char* g_contosoComponentInventoryFilePath = "/usr/local/contoso-devices/components-inventory.json";
 
+// Watches the folder of the component inventory file, so that the agent is notified when it is written or replaced.
+int g_componentsChangedFd = -1;
+
 JSON_Value* _GetAllComponentsFromFile(const char* configFilepath)
 {
     // Read config file.
@@ -231,4 +236,63 @@ extern "C"
         json_free_serialized_string(string);
     }
 
+    /**
+     * @brief Returns a descriptor that becomes readable when the component inventory file may have changed.
+     * @return int An inotify descriptor, or -1 if the inventory folder can't be watched.
+     */
+    int GetComponentsChangedFd()
+    {
+        if (g_componentsChangedFd >= 0)
+        {
+            return g_componentsChangedFd;
+        }
+
+        std::string folder = g_contosoComponentInventoryFilePath;
+        folder = folder.substr(0, folder.find_last_of('/'));
+
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            return -1;
+        }
+
+        if (inotify_add_watch(fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+            < 0)
+        {
+            printf("Cannot watch component inventory folder ('%s').", folder.c_str());
+            close(fd);
+            return -1;
+        }
+
+        g_componentsChangedFd = fd;
+        return fd;
+    }
+
+    /**
+     * @brief Consumes the pending inotify events.
+     */
+    void AcknowledgeComponentsChanged()
+    {
+        char buffer[4096];
+
+        if (g_componentsChangedFd < 0)
+        {
+            return;
+        }
+
+        while (read(g_componentsChangedFd, buffer, sizeof(buffer)) > 0)
+        {
+        }
+    }
+
+    /**
+     * @brief SelectComponents selects the components whose string properties equal every selector property, see
+     * _json_object_contains_named_value, so the agent may select them from its own index.
+     * @return bool Always true.
+     */
+    bool SelectsComponentsByStringEquality()
+    {
+        return true;
+    }
+
 } // extern "c"
@@ -0,0 +1,882 @@
+/**
+ * @file cache_content_downloader.cpp
+ * @brief Content Downloader Extension that downloads files from local caches, falling back to their origin.
+ *
+ * The cache endpoints come from du-config.json (downloadCacheEndpoints) and are tried in order:
+ *
+ * - "http(s)://host[:port][/path]": an on-premises HTTP cache.
+ * - "unix:/path/to/socket": a cache daemon that serves HTTP on a Unix domain socket.
+ * - "file:///path/to/mirror": a mirror directory, e.g. removable media at an air-gapped site.
+ *
+ * The download URI of a file is rewritten by its sha256 hash to "<endpoint>/<key>", where the key is the name of
+ * the file in the payload cache (see CacheDownloader_GetCacheKey). A cache that doesn't have the file, can't be
+ * reached or serves content that doesn't match the hash is a miss, and the next endpoint is tried. When all
+ * endpoints miss, or the file has no sha256 hash, the file is downloaded from its origin URI.
+ *
+ * Each cache is tried once, since it is on the local network. The origin transfer is retried until the retry timeout
+ * expires, and resumes where the previous attempt stopped (see resumable_download_utils.hpp).
+ *
+ * Only origin transfers pass through the download governor (see download_governor.h); local caches don't use the
+ * WAN link that the bandwidth limits and the pause file protect.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/cache_content_downloader.hpp"
+#include "aduc/config_utils.h"
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/download_governor.h"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/resumable_download_utils.hpp"
+
+#include <atomic>
+#include <cctype> // for isalnum
+#include <chrono>
+#include <cstdlib> // for free
+#include <cstring> // for strcmp, strncmp
+#include <list>
+#include <mutex>
+#include <stdio.h> // for remove
+
+#include <curl/curl.h>
+
+// Minimum interval between two InProgress progress reports.
+#define CACHE_DOWNLOADER_PROGRESS_INTERVAL std::chrono::seconds(1)
+
+// A cache is on the local network; give up on it quickly.
+#define CACHE_DOWNLOADER_CACHE_CONNECT_TIMEOUT_SECONDS 5L
+
+#define CACHE_DOWNLOADER_ORIGIN_CONNECT_TIMEOUT_SECONDS 30L
+
+// Abort a transfer that stays below 1 byte/s for this many seconds.
+#define CACHE_DOWNLOADER_LOW_SPEED_TIME_SECONDS 60L
+
+#define CACHE_DOWNLOADER_MAX_REDIRECTS 10L
+
+#define CACHE_DOWNLOADER_UNIX_SOCKET_PREFIX "unix:"
+
+namespace
+{
+/**
+ * @brief A parsed cache endpoint.
+ */
+struct CacheEndpoint
+{
+    std::string BaseUrl; /**< The URL that the cache key is appended to. */
+    std::string UnixSocketPath; /**< The socket to connect to instead of the host of BaseUrl, if not empty. */
+};
+
+/**
+ * @brief The state of one download, shared with the libcurl callbacks.
+ */
+struct DownloadContext
+{
+    const ADUC_FileEntity* Entity = nullptr;
+    const char* WorkflowId = nullptr;
+    ADUC_DownloadProgressCallback ProgressCallback = nullptr;
+    ADUC_HashUtils_FileSink Sink{};
+    bool IsOrigin = false; /**< The current transfer is from the origin, and is subject to the download governor. */
+    std::chrono::steady_clock::time_point TransferStart;
+    std::chrono::steady_clock::time_point LastProgressReport;
+    std::atomic<bool> Cancelled{ false };
+};
+
+std::once_flag s_initOnce;
+bool s_isInitialized = false;
+
+std::mutex s_endpointsMutex;
+std::vector<CacheEndpoint> s_endpoints;
+bool s_endpointsConfigured = false;
+
+std::mutex s_activeDownloadsMutex;
+std::list<DownloadContext*> s_activeDownloads;
+
+// Receives the rate of each download before its progress reports. Set by SetDownloadRateCallback.
+std::atomic<ADUC_DownloadRateCallback> s_rateCallback{ nullptr };
+
+/**
+ * @brief Reports the progress of a download to @p progressCallback, after reporting @p bytesPerSecond to the rate
+ * callback.
+ */
+void ReportProgress(
+    ADUC_DownloadProgressCallback progressCallback,
+    const char* workflowId,
+    const char* fileId,
+    ADUC_DownloadProgressState state,
+    uint64_t bytesTransferred,
+    uint64_t bytesTotal,
+    uint64_t bytesPerSecond)
+{
+    const ADUC_DownloadRateCallback rateCallback = s_rateCallback;
+    if (rateCallback != nullptr)
+    {
+        rateCallback(workflowId, fileId, bytesPerSecond);
+    }
+
+    progressCallback(workflowId, fileId, state, bytesTransferred, bytesTotal);
+}
+
+/**
+ * @brief Parses @p endpoint.
+ * @return bool False if @p endpoint has an unsupported scheme.
+ */
+bool ParseEndpoint(const std::string& endpoint, CacheEndpoint& parsed)
+{
+    static const char unixPrefix[] = CACHE_DOWNLOADER_UNIX_SOCKET_PREFIX;
+
+    if (endpoint.compare(0, sizeof(unixPrefix) - 1, unixPrefix) == 0)
+    {
+        parsed.UnixSocketPath = endpoint.substr(sizeof(unixPrefix) - 1);
+        parsed.BaseUrl = "http://localhost";
+        return !parsed.UnixSocketPath.empty();
+    }
+
+    if (endpoint.compare(0, 7, "http://") != 0 && endpoint.compare(0, 8, "https://") != 0
+        && endpoint.compare(0, 7, "file://") != 0)
+    {
+        return false;
+    }
+
+    const size_t end = endpoint.find_last_not_of('/');
+    parsed.BaseUrl = (end == std::string::npos) ? endpoint : endpoint.substr(0, end + 1);
+    parsed.UnixSocketPath.clear();
+    return true;
+}
+
+/**
+ * @brief Sets the endpoints. Must be called with s_endpointsMutex held.
+ */
+void SetEndpoints(const std::vector<std::string>& endpoints)
+{
+    s_endpoints.clear();
+
+    for (const std::string& endpoint : endpoints)
+    {
+        CacheEndpoint parsed;
+        if (ParseEndpoint(endpoint, parsed))
+        {
+            s_endpoints.push_back(parsed);
+        }
+        else
+        {
+            Log_Warn("Ignoring unsupported download cache endpoint '%s'", endpoint.c_str());
+        }
+    }
+}
+
+/**
+ * @brief Initializes libcurl and reads the cache endpoints from the agent configuration. Called once per process.
+ */
+void InitCacheDownloader()
+{
+    const CURLcode initResult = curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (initResult != CURLE_OK)
+    {
+        Log_Error("curl_global_init failed: %s", curl_easy_strerror(initResult));
+        return;
+    }
+
+    s_isInitialized = true;
+
+    std::lock_guard<std::mutex> lock(s_endpointsMutex);
+
+    if (!s_endpointsConfigured)
+    {
+        ADUC_ConfigInfo config = {};
+        std::vector<std::string> endpoints;
+
+        if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+        {
+            for (unsigned int i = 0; i < config.downloadCacheEndpointCount; ++i)
+            {
+                endpoints.emplace_back(config.downloadCacheEndpoints[i]);
+            }
+
+            ADUC_ConfigInfo_UnInit(&config);
+        }
+
+        SetEndpoints(endpoints);
+    }
+
+    Log_Info("Cache downloader initialized: %s, cache endpoints: %zu", curl_version(), s_endpoints.size());
+}
+
+/**
+ * @brief Gets the base64 sha256 hash of @p entity.
+ * @return const char* The hash, or nullptr if the entity has no sha256 hash.
+ */
+const char* GetSha256HashValue(const ADUC_FileEntity* entity)
+{
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        const char* hashType = ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, i);
+        if (ADUC_HashUtils_GetShaVersionForTypeString(hashType, &algorithm) && algorithm == SHA256)
+        {
+            return ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, i);
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Download governor cancellation function.
+ */
+_Bool IsDownloadCancelled(void* context)
+{
+    return static_cast<DownloadContext*>(context)->Cancelled;
+}
+
+/**
+ * @brief Gets the effective rate of the current transfer of @p context.
+ * @return uint64_t The rate in bytes per second, or 0 if no transfer started.
+ */
+uint64_t GetBytesPerSecond(const DownloadContext* context)
+{
+    if (context->TransferStart == std::chrono::steady_clock::time_point{})
+    {
+        return 0;
+    }
+
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - context->TransferStart)
+                               .count();
+    return (elapsedMs > 0) ? context->Sink.BytesWritten * 1000 / static_cast<uint64_t>(elapsedMs) : 0;
+}
+
+/**
+ * @brief libcurl write callback. Streams the received content into the hashing file sink.
+ */
+size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    auto* context = static_cast<DownloadContext*>(userdata);
+    const size_t byteCount = size * nmemb;
+
+    if (context->Cancelled
+        || (context->IsOrigin && !ADUC_DownloadGovernor_Acquire(byteCount, IsDownloadCancelled, context)))
+    {
+        return 0;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* data = reinterpret_cast<const uint8_t*>(ptr);
+
+    // Returning less than byteCount makes libcurl fail the transfer with CURLE_WRITE_ERROR.
+    return ADUC_HashUtils_FileSink_Write(&context->Sink, data, byteCount) ? byteCount : 0;
+}
+
+/**
+ * @brief libcurl progress callback. Reports progress and aborts the transfer when it is cancelled.
+ */
+int ProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNREFERENCED_PARAMETER(dltotal);
+    UNREFERENCED_PARAMETER(dlnow);
+    UNREFERENCED_PARAMETER(ultotal);
+    UNREFERENCED_PARAMETER(ulnow);
+
+    auto* context = static_cast<DownloadContext*>(clientp);
+
+    if (context->Cancelled)
+    {
+        // Makes libcurl fail the transfer with CURLE_ABORTED_BY_CALLBACK.
+        return 1;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (context->ProgressCallback != nullptr && context->Sink.BytesWritten > 0
+        && now - context->LastProgressReport >= CACHE_DOWNLOADER_PROGRESS_INTERVAL)
+    {
+        context->LastProgressReport = now;
+        ReportProgress(
+            context->ProgressCallback,
+            context->WorkflowId,
+            context->Entity->FileId,
+            ADUC_DownloadProgressState_InProgress,
+            context->Sink.BytesWritten,
+            context->Entity->SizeInBytes,
+            GetBytesPerSecond(context));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Registers @p context so that Cancel() can find it, for the lifetime of the object.
+ */
+class ActiveDownloadRegistration
+{
+public:
+    explicit ActiveDownloadRegistration(DownloadContext* context) : _context(context)
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.push_back(_context);
+    }
+
+    ~ActiveDownloadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.remove(_context);
+    }
+
+    ActiveDownloadRegistration(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration& operator=(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration(ActiveDownloadRegistration&&) = delete;
+    ActiveDownloadRegistration& operator=(ActiveDownloadRegistration&&) = delete;
+
+private:
+    DownloadContext* _context;
+};
+
+/**
+ * @brief libcurl header callback. Records the status and validators of an origin response, for the resume state.
+ */
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    auto* download = static_cast<ADUC_ResumableDownload*>(userdata);
+    const size_t byteCount = size * nitems;
+
+    ADUC_ResumableDownload_OnResponseHeader(download, buffer, byteCount);
+    return byteCount;
+}
+
+/**
+ * @brief Creates an easy handle that streams @p url into context->Sink.
+ *
+ * @param context The download.
+ * @param url The URL to download.
+ * @param unixSocketPath Optional. The socket to connect to instead of the host of @p url.
+ * @return CURL* The handle, or nullptr on failure. Caller must call curl_easy_cleanup().
+ */
+CURL* CreateEasyHandle(DownloadContext* context, const std::string& url, const std::string& unixSocketPath)
+{
+    CURL* curl = curl_easy_init();
+
+    if (curl == nullptr)
+    {
+        return nullptr;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, CACHE_DOWNLOADER_MAX_REDIRECTS);
+#if LIBCURL_VERSION_NUM >= 0x075500
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, context->IsOrigin ? "http,https" : "http,https,file");
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+#else
+    curl_easy_setopt(
+        curl,
+        CURLOPT_PROTOCOLS,
+        context->IsOrigin ? (CURLPROTO_HTTP | CURLPROTO_HTTPS) : (CURLPROTO_HTTP | CURLPROTO_HTTPS | CURLPROTO_FILE));
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+#endif
+    curl_easy_setopt(
+        curl,
+        CURLOPT_CONNECTTIMEOUT,
+        context->IsOrigin ? CACHE_DOWNLOADER_ORIGIN_CONNECT_TIMEOUT_SECONDS
+                          : CACHE_DOWNLOADER_CACHE_CONNECT_TIMEOUT_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, CACHE_DOWNLOADER_LOW_SPEED_TIME_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, context);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, context);
+
+    if (!unixSocketPath.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unixSocketPath.c_str());
+    }
+
+    return curl;
+}
+
+/**
+ * @brief Downloads @p url from a cache to @p filePath and verifies the content against the file hash.
+ *
+ * @param context The download.
+ * @param url The URL to download.
+ * @param unixSocketPath Optional. The socket to connect to instead of the host of @p url.
+ * @param filePath The output file. It is removed if the content is not valid.
+ * @param algorithm The algorithm of the file hash.
+ * @param[out] curlResult The libcurl result.
+ * @param[out] httpStatus The HTTP status of the response, if any.
+ * @return bool True if the file is complete and its hash is valid.
+ */
+bool DownloadAndVerify(
+    DownloadContext* context,
+    const std::string& url,
+    const std::string& unixSocketPath,
+    const char* filePath,
+    SHAversion algorithm,
+    CURLcode* curlResult,
+    long* httpStatus)
+{
+    const ADUC_FileEntity* entity = context->Entity;
+    bool isValidHash = false;
+    CURL* curl = nullptr;
+
+    *curlResult = CURLE_FAILED_INIT;
+    *httpStatus = 0;
+
+    if (!ADUC_HashUtils_FileSink_Open(&context->Sink, filePath, algorithm))
+    {
+        Log_Error("Cannot open %s", filePath);
+        return false;
+    }
+
+    if (!ADUC_HashUtils_FileSink_SetExpectedHashes(&context->Sink, entity->Hash, entity->HashCount))
+    {
+        goto done;
+    }
+
+    if (entity->ChunkManifest != nullptr && !ADUC_HashUtils_FileSink_SetChunkManifest(&context->Sink, entity->ChunkManifest))
+    {
+        goto done;
+    }
+
+    curl = CreateEasyHandle(context, url, unixSocketPath);
+    if (curl == nullptr)
+    {
+        goto done;
+    }
+
+    context->TransferStart = std::chrono::steady_clock::now();
+    *curlResult = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, httpStatus);
+    curl_easy_cleanup(curl);
+
+done:
+    // Only compare hashes of a complete transfer. The sink is closed either way.
+    isValidHash = ADUC_HashUtils_FileSink_Close(
+                      &context->Sink,
+                      (*curlResult == CURLE_OK) ? ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0)
+                                                : nullptr,
+                      nullptr)
+        && *curlResult == CURLE_OK;
+
+    if (!isValidHash)
+    {
+        (void)remove(filePath);
+    }
+
+    return isValidHash;
+}
+
+/**
+ * @brief Runs one download attempt from the origin into the partial file of @p download, resuming where the
+ * previous attempt stopped when possible.
+ *
+ * @param context The download.
+ * @param download The partial file and resume state.
+ * @param algorithm The algorithm of the file hash.
+ * @param[out] retriable Set to true if the attempt failed in a way worth retrying.
+ * @return ADUC_Result ADUC_Result_Download_Success if the partial file is complete and verified.
+ */
+ADUC_Result DownloadOriginAttempt(
+    DownloadContext* context, ADUC_ResumableDownload* download, SHAversion algorithm, bool* retriable)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    const ADUC_FileEntity* entity = context->Entity;
+    CURLcode curlResult = CURLE_FAILED_INIT;
+    long httpStatus = 0;
+    CURL* curl = nullptr;
+    struct curl_slist* headers = nullptr;
+    std::string ifRangeHeader;
+    char* prefixHash = nullptr;
+    bool isValidHash = false;
+
+    *retriable = false;
+
+    // With a chunk manifest, the verified blocks of an earlier attempt are kept and the sink verifies the others.
+    if (!ADUC_ResumableDownload_OpenSink(download, &context->Sink, entity, algorithm, true /* allowResume */))
+    {
+        Log_Error("Cannot open %s", download->PartialPath.c_str());
+        result.ExtendedResultCode = ADUC_ERROR_CACHE_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE;
+        return result;
+    }
+
+    if (!ADUC_HashUtils_FileSink_SetExpectedHashes(&context->Sink, entity->Hash, entity->HashCount))
+    {
+        ADUC_HashUtils_FileSink_Close(&context->Sink, nullptr, nullptr);
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        return result;
+    }
+
+    curl = CreateEasyHandle(context, entity->DownloadUri, std::string{});
+    if (curl != nullptr)
+    {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, download);
+
+        if (context->Sink.BytesWritten > 0)
+        {
+            Log_Info("Resuming download at offset %llu", static_cast<unsigned long long>(context->Sink.BytesWritten));
+
+            // libcurl fails with CURLE_RANGE_ERROR if the server ignores the range, or sends all of the content
+            // because it changed since the partial file was written.
+            curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(context->Sink.BytesWritten));
+
+            ifRangeHeader = ADUC_ResumableDownload_GetIfRangeHeader(download, context->Sink.BytesWritten);
+            if (!ifRangeHeader.empty())
+            {
+                headers = curl_slist_append(headers, ifRangeHeader.c_str());
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+            }
+        }
+
+        context->TransferStart = std::chrono::steady_clock::now();
+        curlResult = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+        curl_easy_cleanup(curl);
+        curl_slist_free_all(headers);
+    }
+
+    // Only compare hashes of a complete transfer.
+    // For an incomplete transfer, get the hash of what was written, to resume from it.
+    isValidHash = ADUC_HashUtils_FileSink_Close(
+        &context->Sink,
+        (curlResult == CURLE_OK) ? ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0) : nullptr,
+        (curlResult == CURLE_OK) ? nullptr : &prefixHash);
+
+    if (context->Cancelled)
+    {
+        Log_Info("Download was cancelled");
+        result = { ADUC_Result_Failure_Cancelled };
+        goto done;
+    }
+
+    if (context->Sink.ChunkMismatch)
+    {
+        Log_Error("Content of %s does not match its chunk manifest", entity->TargetFilename);
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_CHUNK_HASH_INVALID_HASH;
+        goto done;
+    }
+
+    if (curlResult != CURLE_OK)
+    {
+        Log_Error(
+            "Download failed after %llu bytes: %s (HTTP status %ld)",
+            static_cast<unsigned long long>(context->Sink.BytesWritten),
+            curl_easy_strerror(curlResult),
+            httpStatus);
+
+        if (curlResult == CURLE_RANGE_ERROR)
+        {
+            // The origin can't resume this content, or it changed. Start over.
+            ADUC_ResumableDownload_Restart(download);
+        }
+        else if (isValidHash)
+        {
+            ADUC_ResumableDownload_SaveState(download, entity, &context->Sink, prefixHash);
+        }
+
+        *retriable = ADUC_ResumableDownload_IsRetriableFailure(curlResult, httpStatus);
+        result.ExtendedResultCode = (curlResult == CURLE_FAILED_INIT)
+            ? ADUC_ERROR_CACHE_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE
+            : ADUC_ERROR_CACHE_DOWNLOADER_EXTERNAL_FAILURE(curlResult);
+        goto done;
+    }
+
+    if (!isValidHash)
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
+        ADUC_ResumableDownload_Restart(download);
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH;
+        goto done;
+    }
+
+    Log_Info(
+        "Downloaded %llu bytes from origin, file hash is valid",
+        static_cast<unsigned long long>(context->Sink.BytesWritten));
+    result = { ADUC_Result_Download_Success };
+
+done:
+    free(prefixHash);
+    return result;
+}
+
+} // namespace
+
+void CacheDownloader_SetEndpoints(const std::vector<std::string>& endpoints)
+{
+    std::lock_guard<std::mutex> lock(s_endpointsMutex);
+    s_endpointsConfigured = true;
+    SetEndpoints(endpoints);
+}
+
+std::string CacheDownloader_GetCacheKey(const char* sha256HashBase64)
+{
+    std::string key;
+
+    if (sha256HashBase64 == nullptr)
+    {
+        return key;
+    }
+
+    for (const char* c = sha256HashBase64; *c != '\0' && *c != '='; ++c)
+    {
+        if (isalnum(static_cast<unsigned char>(*c)) == 0 && *c != '+' && *c != '/')
+        {
+            return std::string{};
+        }
+
+        key += (*c == '+') ? '-' : (*c == '/') ? '_' : *c;
+    }
+
+    return key;
+}
+
+EXTERN_C_BEGIN
+
+ADUC_Result Download_cache(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    SHAversion algVersion;
+    std::string filePath;
+    std::string cacheKey;
+    std::vector<CacheEndpoint> endpoints;
+    ADUC_ResumableDownload download;
+    bool reportProgress = false;
+    bool isValidHash = false;
+    CURLcode curlResult = CURLE_OK;
+    long httpStatus = 0;
+    DownloadContext context;
+
+    std::call_once(s_initOnce, InitCacheDownloader);
+
+    if (entity == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY;
+        return result;
+    }
+
+    if (entity->DownloadUri == nullptr || *entity->DownloadUri == 0)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_DOWNLOAD_URI;
+        return result;
+    }
+
+    if (!s_isInitialized)
+    {
+        result.ExtendedResultCode = ADUC_ERROR_CACHE_DOWNLOADER_NOT_INITIALIZED;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (entity->HashCount == 0)
+    {
+        Log_Error("File entity does not contain a file hash! Cannot validate cancelling download.");
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_IS_EMPTY;
+        reportProgress = true;
+        goto done;
+    }
+
+    filePath = std::string(workFolder) + "/" + entity->TargetFilename;
+
+    if (!ADUC_HashUtils_GetShaVersionForTypeString(
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
+    {
+        Log_Error(
+            "FileEntity for %s has unsupported hash type %s",
+            filePath.c_str(),
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    // If target file exists, validate file hash.
+    // If file is valid, then skip the download.
+    if (ADUC_HashUtils_VerifyFileHashes(filePath.c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */))
+    {
+        result = { ADUC_Result_Download_Skipped_FileExists };
+        reportProgress = true;
+        goto done;
+    }
+
+    context.Entity = entity;
+    context.WorkflowId = workflowId;
+    context.ProgressCallback = downloadProgressCallback;
+
+    {
+        ActiveDownloadRegistration registration{ &context };
+
+        {
+            std::lock_guard<std::mutex> lock(s_endpointsMutex);
+            endpoints = s_endpoints;
+        }
+
+        cacheKey = CacheDownloader_GetCacheKey(GetSha256HashValue(entity));
+
+        for (const CacheEndpoint& endpoint : endpoints)
+        {
+            if (cacheKey.empty() || context.Cancelled)
+            {
+                break;
+            }
+
+            const std::string url = endpoint.BaseUrl + "/" + cacheKey;
+
+            Log_Info(
+                "Downloading File '%s' from cache '%s%s%s' to '%s'",
+                entity->TargetFilename,
+                endpoint.UnixSocketPath.empty() ? "" : CACHE_DOWNLOADER_UNIX_SOCKET_PREFIX,
+                endpoint.UnixSocketPath.c_str(),
+                url.c_str(),
+                filePath.c_str());
+
+            isValidHash = DownloadAndVerify(
+                &context, url, endpoint.UnixSocketPath, filePath.c_str(), algVersion, &curlResult, &httpStatus);
+            if (isValidHash)
+            {
+                break;
+            }
+
+            Log_Info(
+                "Cache miss: %s (HTTP status %ld, %s)",
+                curl_easy_strerror(curlResult),
+                httpStatus,
+                (curlResult == CURLE_OK || context.Sink.ChunkMismatch) ? "content does not match its hash"
+                                                                        : "not available");
+        }
+
+        if (!isValidHash && !context.Cancelled)
+        {
+            Log_Info(
+                "Downloading File '%s' from origin '%s' to '%s'",
+                entity->TargetFilename,
+                entity->DownloadUri,
+                filePath.c_str());
+
+            context.IsOrigin = true;
+            ADUC_ResumableDownload_Init(&download, filePath, entity->DownloadUri);
+
+            // Retry transient failures until retryTimeout expires. Each attempt resumes where the previous one
+            // stopped.
+            result = ADUC_ResumableDownload_Run(
+                retryTimeout,
+                [&context, &download, algVersion](bool* retriable) -> ADUC_Result {
+                    return DownloadOriginAttempt(&context, &download, algVersion, retriable);
+                },
+                IsDownloadCancelled,
+                &context);
+        }
+    }
+
+    reportProgress = true;
+
+    if (context.IsOrigin)
+    {
+        if (IsAducResultCodeSuccess(result.ResultCode) && !ADUC_ResumableDownload_Commit(&download))
+        {
+            result = { .ResultCode = ADUC_Result_Failure,
+                       .ExtendedResultCode = ADUC_ERROR_CACHE_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE };
+        }
+
+        goto done;
+    }
+
+    if (context.Cancelled)
+    {
+        Log_Info("Download was cancelled");
+        result = { ADUC_Result_Failure_Cancelled };
+        goto done;
+    }
+
+    Log_Info(
+        "Downloaded %llu bytes from cache, file hash is valid",
+        static_cast<unsigned long long>(context.Sink.BytesWritten));
+    result = { ADUC_Result_Download_Success };
+
+done:
+    if (reportProgress && (downloadProgressCallback != nullptr))
+    {
+        if (IsAducResultCodeSuccess(result.ResultCode))
+        {
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_Completed,
+                (context.Sink.BytesWritten != 0) ? context.Sink.BytesWritten : entity->SizeInBytes,
+                entity->SizeInBytes,
+                GetBytesPerSecond(&context));
+        }
+        else
+        {
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                (result.ResultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
+                                                                     : ADUC_DownloadProgressState_Error,
+                context.Sink.BytesWritten,
+                entity->SizeInBytes,
+                GetBytesPerSecond(&context));
+        }
+    }
+
+    Log_Info(
+        "Download task end. resultCode: %d, extendedCode: %d (0x%X)",
+        result.ResultCode,
+        result.ExtendedResultCode,
+        result.ExtendedResultCode);
+    return result;
+}
+
+ADUC_Result Download(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    return Download_cache(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
+}
+
+ADUC_Result Cancel(const char* workflowId)
+{
+    ADUC_Result result = { ADUC_Result_Cancel_UnableToCancel };
+
+    if (workflowId == nullptr)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+    for (DownloadContext* context : s_activeDownloads)
+    {
+        if (context->WorkflowId != nullptr && strcmp(context->WorkflowId, workflowId) == 0)
+        {
+            Log_Info("Cancelling download of file '%s'", context->Entity->FileId);
+            context->Cancelled = true;
+            result = { ADUC_Result_Cancel_Success };
+        }
+    }
+
+    return result;
+}
+
+void SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    s_rateCallback = rateCallback;
+}
+
+ADUC_Result Initialize(const char* initializeData)
+{
+    UNREFERENCED_PARAMETER(initializeData);
+    return { ADUC_GeneralResult_Success };
+}
+
+EXTERN_C_END
@@ -0,0 +1,30 @@
+/**
+ * @file cache_content_downloader.hpp
+ * @brief Internal interface of the cache content downloader, for tests.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_CACHE_CONTENT_DOWNLOADER_HPP
+#define ADUC_CACHE_CONTENT_DOWNLOADER_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sets the cache endpoints, instead of the downloadCacheEndpoints setting of the agent configuration file.
+ * @param endpoints The endpoints, tried in order: "http(s)://host[:port][/path]", "unix:/path/to/socket" or
+ * "file:///path/to/mirror". Invalid endpoints are skipped.
+ */
+void CacheDownloader_SetEndpoints(const std::vector<std::string>& endpoints);
+
+/**
+ * @brief Gets the name of a file in a cache: its base64 sha256 hash, URL-safe ('+' and '/' replaced by '-' and '_')
+ * and without padding. This is also the name of the file in the payload cache of a device, so the payload cache
+ * folder of a gateway can be served as a cache.
+ * @param sha256HashBase64 The base64 sha256 hash of the file.
+ * @return std::string The name, or an empty string if @p sha256HashBase64 is not base64.
+ */
+std::string CacheDownloader_GetCacheKey(const char* sha256HashBase64);
+
+#endif // ADUC_CACHE_CONTENT_DOWNLOADER_HPP
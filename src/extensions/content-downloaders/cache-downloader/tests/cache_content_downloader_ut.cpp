@@ -0,0 +1,382 @@
+/**
+ * @file cache_content_downloader_ut.cpp
+ * @brief Unit Tests for the cache content downloader, against a local stand-in for the cache and origin servers.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/cache_content_downloader.hpp"
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/download_governor.h"
+#include "aduc/hash_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <arpa/inet.h> // for htonl
+#include <cstdio> // for std::remove
+#include <cstdlib> // for free, mkdtemp
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <netinet/in.h> // for sockaddr_in
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h> // for sockaddr_un
+#include <thread>
+#include <unistd.h> // for close, rmdir
+#include <vector>
+
+extern "C" {
+ADUC_Result Download(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback);
+}
+
+/**
+ * @brief A minimal HTTP server that serves a fixed set of paths, and records the paths requested.
+ */
+class StandInServer
+{
+public:
+    /**
+     * @brief Listens on an ephemeral TCP port of the loopback interface.
+     */
+    StandInServer()
+    {
+        _socket = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(_socket >= 0);
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE(bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+
+        socklen_t length = sizeof(address);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE(getsockname(_socket, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+        _url = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+
+        Start();
+    }
+
+    /**
+     * @brief Listens on the Unix domain socket @p socketPath.
+     */
+    explicit StandInServer(const std::string& socketPath) : _socketPath(socketPath)
+    {
+        _socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(_socket >= 0);
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        REQUIRE(socketPath.size() < sizeof(address.sun_path));
+        socketPath.copy(address.sun_path, socketPath.size());
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE(bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+
+        Start();
+    }
+
+    ~StandInServer()
+    {
+        // Unblocks accept().
+        shutdown(_socket, SHUT_RDWR);
+        _thread.join();
+        close(_socket);
+
+        if (!_socketPath.empty())
+        {
+            (void)std::remove(_socketPath.c_str());
+        }
+    }
+
+    StandInServer(const StandInServer&) = delete;
+    StandInServer& operator=(const StandInServer&) = delete;
+    StandInServer(StandInServer&&) = delete;
+    StandInServer& operator=(StandInServer&&) = delete;
+
+    const std::string& GetUrl() const
+    {
+        return _url;
+    }
+
+    void Serve(const std::string& path, const std::string& content)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _content[path] = content;
+    }
+
+    std::vector<std::string> GetRequestedPaths()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _requestedPaths;
+    }
+
+private:
+    void Start()
+    {
+        REQUIRE(listen(_socket, 8) == 0);
+        _thread = std::thread{ [this]() { Run(); } };
+    }
+
+    void Run()
+    {
+        for (;;)
+        {
+            const int connection = accept(_socket, nullptr, nullptr);
+            if (connection < 0)
+            {
+                return;
+            }
+
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos)
+            {
+                const ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                {
+                    break;
+                }
+                request.append(buffer, static_cast<size_t>(received));
+            }
+
+            // "GET <path> HTTP/1.1"
+            const size_t pathStart = request.find(' ') + 1;
+            const std::string path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+
+            std::ostringstream response;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _requestedPaths.push_back(path);
+
+                const auto entry = _content.find(path);
+                if (entry != _content.end())
+                {
+                    response << "HTTP/1.1 200 OK\r\nContent-Length: " << entry->second.size()
+                             << "\r\nConnection: close\r\n\r\n"
+                             << entry->second;
+                }
+                else
+                {
+                    response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                }
+            }
+
+            const std::string data = response.str();
+            (void)send(connection, data.data(), data.size(), MSG_NOSIGNAL);
+            close(connection);
+        }
+    }
+
+    int _socket = -1;
+    std::string _socketPath;
+    std::string _url;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::map<std::string, std::string> _content;
+    std::vector<std::string> _requestedPaths;
+};
+
+/**
+ * @brief A temporary work folder, and a file entity with the hash of its content.
+ */
+class TestFile
+{
+public:
+    TestFile(const std::string& content, const std::string& downloadUri) : _content(content), _downloadUri(downloadUri)
+    {
+        char folderTemplate[] = "/tmp/cache_content_downloader_ut_XXXXXX";
+        REQUIRE(mkdtemp(folderTemplate) != nullptr);
+        _workFolder = folderTemplate;
+
+        ADUC_HashUtils_DigestContext context = {};
+        REQUIRE(ADUC_HashUtils_DigestInit(&context, SHA256));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE(ADUC_HashUtils_DigestUpdate(&context, reinterpret_cast<const uint8_t*>(content.data()), content.size()));
+        char* hash = ADUC_HashUtils_DigestFinalBase64(&context);
+        REQUIRE(hash != nullptr);
+        _hashValue = hash;
+        free(hash); // NOLINT(cppcoreguidelines-no-malloc)
+
+        _hash.value = const_cast<char*>(_hashValue.c_str());
+        _hash.type = const_cast<char*>("sha256");
+
+        _entity.FileId = const_cast<char*>("f1");
+        _entity.DownloadUri = const_cast<char*>(_downloadUri.c_str());
+        _entity.Hash = &_hash;
+        _entity.HashCount = 1;
+        _entity.TargetFilename = const_cast<char*>("payload.bin");
+        _entity.SizeInBytes = content.size();
+    }
+
+    ~TestFile()
+    {
+        (void)std::remove(GetFilePath().c_str());
+        (void)rmdir(_workFolder.c_str());
+    }
+
+    TestFile(const TestFile&) = delete;
+    TestFile& operator=(const TestFile&) = delete;
+    TestFile(TestFile&&) = delete;
+    TestFile& operator=(TestFile&&) = delete;
+
+    const ADUC_FileEntity* GetEntity() const
+    {
+        return &_entity;
+    }
+
+    std::string GetCacheKey() const
+    {
+        return CacheDownloader_GetCacheKey(_hashValue.c_str());
+    }
+
+    std::string GetFilePath() const
+    {
+        return _workFolder + "/payload.bin";
+    }
+
+    ADUC_Result Download() const
+    {
+        return ::Download(&_entity, "workflow", _workFolder.c_str(), 60, nullptr);
+    }
+
+    std::string ReadDownloadedFile() const
+    {
+        std::ifstream file{ GetFilePath(), std::ios::binary };
+        return std::string{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    }
+
+private:
+    std::string _content;
+    std::string _downloadUri;
+    std::string _workFolder;
+    std::string _hashValue;
+    ADUC_Hash _hash = {};
+    ADUC_FileEntity _entity = {};
+};
+
+/**
+ * @brief A mirror directory with one file in it.
+ */
+class TestMirror
+{
+public:
+    TestMirror(const std::string& name, const std::string& content)
+    {
+        char folderTemplate[] = "/tmp/cache_content_downloader_mirror_XXXXXX";
+        REQUIRE(mkdtemp(folderTemplate) != nullptr);
+        _folder = folderTemplate;
+        _filePath = _folder + "/" + name;
+
+        std::ofstream file{ _filePath, std::ios::binary };
+        file << content;
+    }
+
+    ~TestMirror()
+    {
+        (void)std::remove(_filePath.c_str());
+        (void)rmdir(_folder.c_str());
+    }
+
+    TestMirror(const TestMirror&) = delete;
+    TestMirror& operator=(const TestMirror&) = delete;
+    TestMirror(TestMirror&&) = delete;
+    TestMirror& operator=(TestMirror&&) = delete;
+
+    std::string GetUrl() const
+    {
+        return "file://" + _folder + "/";
+    }
+
+private:
+    std::string _folder;
+    std::string _filePath;
+};
+
+// Nothing listens on port 1; connections are refused immediately.
+static const char* const s_unreachableOrigin = "http://127.0.0.1:1/payload.bin";
+
+TEST_CASE("CacheDownloader_GetCacheKey")
+{
+    CHECK(CacheDownloader_GetCacheKey("ab+/cd12==") == "ab-_cd12");
+    CHECK(CacheDownloader_GetCacheKey("abcd") == "abcd");
+    CHECK(CacheDownloader_GetCacheKey("../etc/passwd").empty());
+    CHECK(CacheDownloader_GetCacheKey(nullptr).empty());
+}
+
+TEST_CASE("Download from a cache with origin fallback")
+{
+    const std::string content = "cache content downloader test payload";
+
+    ADUC_DownloadGovernor_Configure(nullptr);
+
+    SECTION("Downloads from a file mirror without contacting the origin")
+    {
+        TestFile testFile{ content, s_unreachableOrigin };
+        TestMirror mirror{ testFile.GetCacheKey(), content };
+        CacheDownloader_SetEndpoints({ mirror.GetUrl() });
+
+        const ADUC_Result result = testFile.Download();
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(testFile.ReadDownloadedFile() == content);
+    }
+
+    SECTION("Falls back to the origin on a cache miss")
+    {
+        StandInServer server;
+        TestFile testFile{ content, server.GetUrl() + "/origin/payload.bin" };
+        server.Serve("/origin/payload.bin", content);
+        CacheDownloader_SetEndpoints({ "unsupported://cache", server.GetUrl() + "/cache" });
+
+        const ADUC_Result result = testFile.Download();
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(testFile.ReadDownloadedFile() == content);
+        CHECK(
+            server.GetRequestedPaths()
+            == std::vector<std::string>{ "/cache/" + testFile.GetCacheKey(), "/origin/payload.bin" });
+    }
+
+    SECTION("Downloads from a cache daemon on a Unix domain socket")
+    {
+        const std::string socketPath = "/tmp/cache_content_downloader_ut_" + std::to_string(getpid()) + ".sock";
+        StandInServer daemon{ socketPath };
+        TestFile testFile{ content, s_unreachableOrigin };
+        daemon.Serve("/" + testFile.GetCacheKey(), content);
+        CacheDownloader_SetEndpoints({ "unix:" + socketPath });
+
+        const ADUC_Result result = testFile.Download();
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(testFile.ReadDownloadedFile() == content);
+    }
+
+    SECTION("Falls back to the origin when cached content does not match its hash")
+    {
+        StandInServer server;
+        TestFile testFile{ content, server.GetUrl() + "/origin/payload.bin" };
+        TestMirror corruptMirror{ testFile.GetCacheKey(), "corrupted content" };
+        server.Serve("/origin/payload.bin", content);
+        CacheDownloader_SetEndpoints({ corruptMirror.GetUrl() });
+
+        const ADUC_Result result = testFile.Download();
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(testFile.ReadDownloadedFile() == content);
+        CHECK(server.GetRequestedPaths() == std::vector<std::string>{ "/origin/payload.bin" });
+    }
+
+    SECTION("Fails when neither the caches nor the origin have the file")
+    {
+        StandInServer server;
+        TestFile testFile{ content, server.GetUrl() + "/origin/payload.bin" };
+        CacheDownloader_SetEndpoints({ server.GetUrl() });
+
+        const ADUC_Result result = testFile.Download();
+        CHECK(result.ResultCode == ADUC_Result_Failure);
+        CHECK(result.ExtendedResultCode == ADUC_ERROR_CACHE_DOWNLOADER_EXTERNAL_FAILURE(22 /* CURLE_HTTP_RETURNED_ERROR */));
+    }
+}
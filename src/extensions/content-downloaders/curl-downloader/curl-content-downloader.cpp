@@ -2,22 +2,341 @@
  * @file curl_content_downloader.cpp
  * @brief Content Downloader Extension using curl command.
  *
+ * Content is downloaded into "<target>.partial" and renamed to the target once its hash is verified. Failed
+ * attempts are retried until the retry timeout expires, and resume where they stopped with an HTTP range request
+ * (see resumable_download_utils.hpp).
+ *
+ * Content read from curl passes through the download governor (see download_governor.h); while it waits, the pipe
+ * fills up and curl stops reading from the connection, so the limits apply to the network transfer too.
+ *
+ * Cancel() stops the downloads of a workflow: curl is terminated when it writes its next content, and no further
+ * attempt starts.
+ *
  * @copyright Copyright (c) Microsoft Corporation.
  * Licensed under the MIT License.
  */
 #include "aduc/content_downloader_extension.hpp"
+#include "aduc/download_governor.h"
 #include "aduc/hash_utils.h"
 #include "aduc/logging.h"
 #include "aduc/process_utils.hpp"
+#include "aduc/resumable_download_utils.hpp"
 
 #include <atomic>
-#include <sstream>
-#include <stdio.h> // for FILE
-#include <stdlib.h> // for calloc
-#include <strings.h> // for strcasecmp
+#include <chrono>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <stdio.h> // for remove
+#include <stdlib.h> // for free
+#include <string.h> // for strcmp
+#include <string> // for std::to_string
 #include <sys/stat.h> // for stat
 #include <vector>
 
+// Minimum interval between two InProgress progress reports.
+#define CURL_DOWNLOADER_PROGRESS_INTERVAL std::chrono::seconds(1)
+
+// curl exit code when the server can't resume the content (see curl(1)).
+#define CURL_EXIT_RANGE_ERROR 33
+
+namespace
+{
+/**
+ * @brief The state of one download, across its attempts.
+ */
+struct DownloadContext
+{
+    const ADUC_FileEntity* Entity = nullptr;
+    const char* WorkflowId = nullptr;
+    ADUC_DownloadProgressCallback Callback = nullptr;
+    std::chrono::steady_clock::time_point Start; /**< When the first attempt started. */
+    std::chrono::steady_clock::time_point LastReport;
+    uint64_t BytesReceived = 0; /**< Bytes received by all attempts. */
+    std::atomic<bool> Cancelled{ false };
+};
+
+std::mutex s_activeDownloadsMutex;
+std::list<DownloadContext*> s_activeDownloads;
+
+// Receives the rate of each download before its progress reports. Set by SetDownloadRateCallback.
+std::atomic<ADUC_DownloadRateCallback> s_rateCallback{ nullptr };
+
+/**
+ * @brief Reports the progress of a download to @p progressCallback, after reporting @p bytesPerSecond to the rate
+ * callback.
+ */
+void ReportProgress(
+    ADUC_DownloadProgressCallback progressCallback,
+    const char* workflowId,
+    const char* fileId,
+    ADUC_DownloadProgressState state,
+    uint64_t bytesTransferred,
+    uint64_t bytesTotal,
+    uint64_t bytesPerSecond)
+{
+    const ADUC_DownloadRateCallback rateCallback = s_rateCallback;
+    if (rateCallback != nullptr)
+    {
+        rateCallback(workflowId, fileId, bytesPerSecond);
+    }
+
+    progressCallback(workflowId, fileId, state, bytesTransferred, bytesTotal);
+}
+
+/**
+ * @brief Download governor and retry loop cancellation function.
+ */
+_Bool IsDownloadCancelled(void* context)
+{
+    return static_cast<DownloadContext*>(context)->Cancelled;
+}
+
+/**
+ * @brief Registers @p context so that Cancel() can find it, for the lifetime of the object.
+ */
+class ActiveDownloadRegistration
+{
+public:
+    explicit ActiveDownloadRegistration(DownloadContext* context) : _context(context)
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.push_back(_context);
+    }
+
+    ~ActiveDownloadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.remove(_context);
+    }
+
+    ActiveDownloadRegistration(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration& operator=(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration(ActiveDownloadRegistration&&) = delete;
+    ActiveDownloadRegistration& operator=(ActiveDownloadRegistration&&) = delete;
+
+private:
+    DownloadContext* _context;
+};
+
+/**
+ * @brief Gets the effective rate of the download of @p context, including the time spent waiting for the download
+ * governor and between attempts.
+ * @return uint64_t The rate in bytes per second, or 0 if no attempt started.
+ */
+uint64_t GetBytesPerSecond(const DownloadContext& context)
+{
+    if (context.Start == std::chrono::steady_clock::time_point{})
+    {
+        return 0;
+    }
+
+    const auto elapsedMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - context.Start)
+            .count();
+    return (elapsedMs > 0) ? context.BytesReceived * 1000 / static_cast<uint64_t>(elapsedMs) : 0;
+}
+
+/**
+ * @brief Parses the response headers of an attempt from a curl --dump-header file.
+ */
+void ParseResponseHeaders(const std::string& path, ADUC_ResumableDownload* download)
+{
+    std::ifstream headers{ path };
+    std::string line;
+
+    while (std::getline(headers, line))
+    {
+        ADUC_ResumableDownload_OnResponseHeader(download, line.c_str(), line.size());
+    }
+}
+
+/**
+ * @brief Runs one download attempt into the partial file, resuming where the previous attempt stopped when possible.
+ *
+ * @param entity The file to download.
+ * @param algVersion The algorithm of the file hash.
+ * @param download The files and resume state of the download.
+ * @param context The progress reporting and cancellation state of the download.
+ * @param[out] retriable Set to true if the attempt failed in a way worth retrying.
+ * @return ADUC_Result ADUC_Result_Download_Success if the partial file is complete and verified.
+ */
+ADUC_Result DownloadAttempt(
+    const ADUC_FileEntity* entity,
+    SHAversion algVersion,
+    ADUC_ResumableDownload* download,
+    DownloadContext& context,
+    bool* retriable)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    ADUC_HashUtils_FileSink sink{};
+    std::vector<std::string> args;
+    std::string output;
+    std::string ifRangeHeader;
+    const std::string headersPath = download->PartialPath + ".headers";
+    char* prefixHash = nullptr;
+    bool isValidHash = false;
+    int exitCode = 1;
+
+    *retriable = false;
+
+    // Stream curl's standard output through a hashing file sink, so the payload is verified
+    // while it is being written and never has to be read back from disk.
+    // With a chunk manifest, each block is verified as it arrives.
+    if (!ADUC_ResumableDownload_OpenSink(download, &sink, entity, algVersion, true /* allowResume */))
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE };
+        goto done;
+    }
+
+    // Every declared hash is computed while the content is written, and compared when the sink is closed.
+    if (!ADUC_HashUtils_FileSink_SetExpectedHashes(&sink, entity->Hash, entity->HashCount))
+    {
+        ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED };
+        goto done;
+    }
+
+    args.emplace_back("--silent");
+    args.emplace_back("--show-error");
+    args.emplace_back("--fail");
+    args.emplace_back("--dump-header");
+    args.emplace_back(headersPath);
+
+    if (sink.BytesWritten > 0)
+    {
+        Log_Info("Resuming download at offset %llu", static_cast<unsigned long long>(sink.BytesWritten));
+        args.emplace_back("--continue-at");
+        args.emplace_back(std::to_string(sink.BytesWritten));
+
+        // If the content changed since the partial file was written, the server sends all of it instead of the
+        // range, and curl fails with CURL_EXIT_RANGE_ERROR.
+        ifRangeHeader = ADUC_ResumableDownload_GetIfRangeHeader(download, sink.BytesWritten);
+        if (!ifRangeHeader.empty())
+        {
+            args.emplace_back("--header");
+            args.emplace_back(ifRangeHeader);
+        }
+    }
+
+    args.emplace_back(entity->DownloadUri);
+
+    exitCode = ADUC_LaunchChildProcessWithOutputSink(
+        "/usr/bin/curl",
+        args,
+        [entity, &sink, &context](const uint8_t* data, size_t size) -> bool {
+            // Returning false terminates curl.
+            if (context.Cancelled || !ADUC_DownloadGovernor_Acquire(size, IsDownloadCancelled, &context))
+            {
+                return false;
+            }
+
+            if (!ADUC_HashUtils_FileSink_Write(&sink, data, size))
+            {
+                return false;
+            }
+
+            context.BytesReceived += size;
+
+            const auto now = std::chrono::steady_clock::now();
+            if (context.Callback != nullptr && now - context.LastReport >= CURL_DOWNLOADER_PROGRESS_INTERVAL)
+            {
+                context.LastReport = now;
+                ReportProgress(
+                    context.Callback,
+                    context.WorkflowId,
+                    entity->FileId,
+                    ADUC_DownloadProgressState_InProgress,
+                    sink.BytesWritten,
+                    entity->SizeInBytes,
+                    GetBytesPerSecond(context));
+            }
+
+            return true;
+        },
+        output);
+
+    ParseResponseHeaders(headersPath, download);
+    (void)remove(headersPath.c_str());
+
+    // The sink compares every declared hash.
+    // For an incomplete transfer, get the hash of what was written, to resume from it.
+    isValidHash = ADUC_HashUtils_FileSink_Close(
+        &sink,
+        (exitCode == 0) ? ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0) : nullptr,
+        (exitCode == 0) ? nullptr : &prefixHash);
+
+    if (!output.empty())
+    {
+        Log_Info("Download output:: \n%s", output.c_str());
+    }
+
+    if (sink.ChunkMismatch)
+    {
+        Log_Error("Content of %s does not match its chunk manifest", entity->TargetFilename);
+
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_CHUNK_HASH_INVALID_HASH };
+        goto done;
+    }
+
+    if (exitCode == CURL_EXIT_RANGE_ERROR)
+    {
+        // The server can't resume this content, or it changed. Start over.
+        Log_Warn(
+            "Cannot resume download of %s (HTTP status %ld), restarting.",
+            entity->TargetFilename,
+            download->ResponseStatus);
+        ADUC_ResumableDownload_Restart(download);
+    }
+    else if (exitCode != 0 && isValidHash)
+    {
+        ADUC_ResumableDownload_SaveState(download, entity, &sink, prefixHash);
+    }
+
+    if (context.Cancelled)
+    {
+        Log_Info("Download of %s was cancelled", entity->TargetFilename);
+        result = { ADUC_Result_Failure_Cancelled };
+        goto done;
+    }
+
+    if (exitCode != 0)
+    {
+        Log_Warn(
+            "Download attempt failed after %llu bytes (curl exit code %d, HTTP status %ld)",
+            static_cast<unsigned long long>(sink.BytesWritten),
+            exitCode,
+            download->ResponseStatus);
+
+        *retriable = ADUC_ResumableDownload_IsRetriableFailure(exitCode, download->ResponseStatus);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) };
+        goto done;
+    }
+
+    if (!isValidHash)
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
+
+        ADUC_ResumableDownload_Restart(download);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH };
+        goto done;
+    }
+
+    Log_Info("Downloaded %llu bytes, file hash is valid", static_cast<unsigned long long>(sink.BytesWritten));
+    result = { ADUC_Result_Download_Success };
+
+done:
+    free(prefixHash);
+    return result;
+}
+
+} // namespace
+
 EXTERN_C_BEGIN
 
 ADUC_Result Download_curl(
@@ -27,15 +346,12 @@ ADUC_Result Download_curl(
     unsigned int retryTimeout,
     ADUC_DownloadProgressCallback downloadProgressCallback)
 {
-    UNREFERENCED_PARAMETER(retryTimeout);
     ADUC_Result result = { ADUC_Result_Failure };
     SHAversion algVersion;
-    std::vector<std::string> args;
-    std::string output;
-    int exitCode = 1;
-    std::stringstream fullFilePath;
+    ADUC_ResumableDownload download;
     bool isValidHash;
     bool reportProgress = false;
+    DownloadContext context;
 
     if (entity == nullptr)
     {
@@ -65,14 +381,15 @@ ADUC_Result Download_curl(
         goto done;
     }
 
-    fullFilePath << workFolder << "/" << entity->TargetFilename;
+    ADUC_ResumableDownload_Init(
+        &download, std::string(workFolder) + "/" + entity->TargetFilename, entity->DownloadUri);
 
     if (!ADUC_HashUtils_GetShaVersionForTypeString(
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
     {
         Log_Error(
             "FileEntity for %s has unsupported hash type %s",
-            fullFilePath.str().c_str(),
+            download.TargetPath.c_str(),
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
         result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
 
@@ -90,8 +407,8 @@ ADUC_Result Download_curl(
 
     // If target file exists, validate file hash.
     // If file is valid, then skip the download.
-    isValidHash = ADUC_HashUtils_IsValidFileHash(
-        fullFilePath.str().c_str(), ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0), algVersion);
+    isValidHash = ADUC_HashUtils_VerifyFileHashes(
+        download.TargetPath.c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */);
 
     if (isValidHash)
     {
@@ -104,48 +421,33 @@ ADUC_Result Download_curl(
         "Downloading File '%s' from '%s' to '%s'",
         entity->TargetFilename,
         entity->DownloadUri,
-        fullFilePath.str().c_str());
+        download.TargetPath.c_str());
 
-    args.emplace_back("-o");
-    args.emplace_back(fullFilePath.str().c_str());
-    args.emplace_back("-O");
-    args.emplace_back(entity->DownloadUri);
+    context.Entity = entity;
+    context.WorkflowId = workflowId;
+    context.Callback = downloadProgressCallback;
+    context.Start = std::chrono::steady_clock::now();
+    context.LastReport = context.Start;
 
-    exitCode = ADUC_LaunchChildProcess("/usr/bin/curl", args, output);
-
-    if (exitCode == 0)
+    // Retry transient failures until retryTimeout expires. Each attempt resumes where the previous one stopped.
     {
-        result = { ADUC_Result_Download_Success };
+        ActiveDownloadRegistration registration{ &context };
+        result = ADUC_ResumableDownload_Run(
+            retryTimeout,
+            [entity, algVersion, &download, &context](bool* retriable) -> ADUC_Result {
+                return DownloadAttempt(entity, algVersion, &download, context, retriable);
+            },
+            IsDownloadCancelled,
+            &context);
     }
-    else
+
+    if (IsAducResultCodeSuccess(result.ResultCode) && !ADUC_ResumableDownload_Commit(&download))
     {
         result = { .ResultCode = ADUC_Result_Failure,
-                   .ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) };
-        reportProgress = true;
-        goto done;
+                   .ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE };
     }
 
-    Log_Info("Download output:: \n%s", output.c_str());
-
-    // If we downloaded successfully, validate the file hash.
-    if (IsAducResultCodeSuccess(result.ResultCode))
-    {
-        // Note: Currently we expect there to be only one hash, but
-        // support for multiple hashes is already built in.
-        Log_Info("Validating file hash");
-
-        const bool isValid = ADUC_HashUtils_IsValidFileHash(
-            fullFilePath.str().c_str(), ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0), algVersion);
-        if (!isValid)
-        {
-            Log_Error("Hash for %s is not valid", entity->TargetFilename);
-
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH };
-            reportProgress = true;
-            goto done;
-        }
-    }
+    reportProgress = true;
 
 done:
 
@@ -156,19 +458,27 @@ done:
             struct stat st
             {
             };
-            const off_t fileSize{ (stat(fullFilePath.str().c_str(), &st) == 0) ? st.st_size : 0 };
-            downloadProgressCallback(
-                workflowId, entity->FileId, ADUC_DownloadProgressState_Completed, fileSize, entity->SizeInBytes);
+            const off_t fileSize{ (stat(download.TargetPath.c_str(), &st) == 0) ? st.st_size : 0 };
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_Completed,
+                fileSize,
+                entity->SizeInBytes,
+                GetBytesPerSecond(context));
         }
         else
         {
-            downloadProgressCallback(
+            ReportProgress(
+                downloadProgressCallback,
                 workflowId,
                 entity->FileId,
                 (result.ResultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
                                                                      : ADUC_DownloadProgressState_Error,
                 0,
-                entity->SizeInBytes);
+                entity->SizeInBytes,
+                GetBytesPerSecond(context));
         }
     }
 
@@ -190,6 +500,34 @@ ADUC_Result Download(
     return Download_curl(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
 }
 
+ADUC_Result Cancel(const char* workflowId)
+{
+    ADUC_Result result = { ADUC_Result_Cancel_UnableToCancel };
+
+    if (workflowId == nullptr)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+    for (DownloadContext* context : s_activeDownloads)
+    {
+        if (context->WorkflowId != nullptr && strcmp(context->WorkflowId, workflowId) == 0)
+        {
+            Log_Info("Cancelling download of file '%s'", context->Entity->FileId);
+            context->Cancelled = true;
+            result = { ADUC_Result_Cancel_Success };
+        }
+    }
+
+    return result;
+}
+
+void SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    s_rateCallback = rateCallback;
+}
+
 ADUC_Result Initialize(const char* initializeData)
 {
     UNREFERENCED_PARAMETER(initializeData);
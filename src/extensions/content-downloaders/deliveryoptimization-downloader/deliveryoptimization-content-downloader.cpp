@@ -2,21 +2,36 @@
  * @file deliveryoptimization_content_downloader.cpp
  * @brief Content Downloader Extension using Microsoft Delivery Optimization Agent.
  *
+ * Each file is downloaded through a Delivery Optimization download object, whose status is polled to report
+ * progress. Cancel() aborts the download objects of a workflow directly, so the Delivery Optimization agent stops
+ * the transfer without waiting for the next poll. Files of a batch run concurrently on the download scheduler's
+ * worker threads, each polling its own download object.
+ *
+ * The Delivery Optimization agent transfers the content out of process, with its own bandwidth policy, so the
+ * download governor (see download_governor.h) can't limit its rate; downloads are paused and resumed with it.
+ *
  * @copyright Copyright (c) Microsoft Corporation.
  * Licensed under the MIT License.
  */
 #include "aduc/connection_string_utils.h"
 #include "aduc/content_downloader_extension.hpp"
+#include "aduc/download_governor.h"
 #include "aduc/hash_utils.h"
 #include "aduc/logging.h"
 #include "aduc/process_utils.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <cstring> // for strcmp
+#include <list>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdio.h> // for FILE
 #include <stdlib.h> // for calloc
 #include <strings.h> // for strcasecmp
 #include <sys/stat.h> // for stat
+#include <thread>
 #include <vector>
 
 #include <do_config.h>
@@ -25,6 +40,187 @@
 
 namespace MSDO = microsoft::deliveryoptimization;
 
+// Interval between two polls of the status of a download.
+#define DO_DOWNLOADER_POLL_INTERVAL std::chrono::milliseconds(250)
+
+// Minimum interval between two InProgress progress reports.
+#define DO_DOWNLOADER_PROGRESS_INTERVAL std::chrono::seconds(1)
+
+namespace
+{
+/**
+ * @brief A download in progress, shared with Cancel().
+ */
+struct ActiveDownload
+{
+    const char* WorkflowId = nullptr;
+    const char* FileId = nullptr;
+    std::unique_ptr<MSDO::download> Download; /**< Set under s_activeDownloadsMutex. */
+    std::atomic<bool> Cancelled{ false };
+};
+
+std::mutex s_activeDownloadsMutex;
+std::list<ActiveDownload*> s_activeDownloads;
+
+// Receives the rate of each download before its progress reports. Set by SetDownloadRateCallback.
+std::atomic<ADUC_DownloadRateCallback> s_rateCallback{ nullptr };
+
+/**
+ * @brief Reports the progress of a download to @p progressCallback, after reporting @p bytesPerSecond to the rate
+ * callback.
+ */
+void ReportProgress(
+    ADUC_DownloadProgressCallback progressCallback,
+    const char* workflowId,
+    const char* fileId,
+    ADUC_DownloadProgressState state,
+    uint64_t bytesTransferred,
+    uint64_t bytesTotal,
+    uint64_t bytesPerSecond)
+{
+    const ADUC_DownloadRateCallback rateCallback = s_rateCallback;
+    if (rateCallback != nullptr)
+    {
+        rateCallback(workflowId, fileId, bytesPerSecond);
+    }
+
+    progressCallback(workflowId, fileId, state, bytesTransferred, bytesTotal);
+}
+
+/**
+ * @brief Registers @p download so that Cancel() can find it, for the lifetime of the object.
+ */
+class ActiveDownloadRegistration
+{
+public:
+    explicit ActiveDownloadRegistration(ActiveDownload* download) : _download(download)
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.push_back(_download);
+    }
+
+    ~ActiveDownloadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.remove(_download);
+    }
+
+    ActiveDownloadRegistration(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration& operator=(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration(ActiveDownloadRegistration&&) = delete;
+    ActiveDownloadRegistration& operator=(ActiveDownloadRegistration&&) = delete;
+
+private:
+    ActiveDownload* _download;
+};
+
+/**
+ * @brief Download governor cancellation function.
+ */
+_Bool IsDownloadCancelled(void* context)
+{
+    return static_cast<ActiveDownload*>(context)->Cancelled;
+}
+
+/**
+ * @brief Starts @p active->Download and polls its status until it completes, fails, times out or is cancelled.
+ * The download is paused while the download governor pauses downloads; paused time doesn't count towards
+ * @p retryTimeout.
+ *
+ * @param active The download.
+ * @param entity The file being downloaded.
+ * @param workflowId The workflow identifier, for progress reports.
+ * @param retryTimeout How long the transfer may take, in seconds.
+ * @param downloadProgressCallback Optional. Receives InProgress reports.
+ * @param[out] bytesPerSecond The effective rate of the transfer.
+ * @return int32_t 0 once the file is complete, otherwise the Delivery Optimization error code.
+ * Delivery Optimization calls that fail throw MSDO::exception.
+ */
+int32_t RunDownload(
+    ActiveDownload* active,
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    uint64_t* bytesPerSecond)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(retryTimeout);
+    auto lastProgressReport = start;
+    std::chrono::steady_clock::time_point pausedSince{};
+
+    active->Download->start();
+
+    for (;;)
+    {
+        std::this_thread::sleep_for(DO_DOWNLOADER_POLL_INTERVAL);
+
+        if (active->Cancelled)
+        {
+            // Cancel() already aborted the download.
+            return static_cast<int32_t>(std::errc::operation_canceled);
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const MSDO::download_status status = active->Download->get_status();
+        const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+
+        *bytesPerSecond = (elapsedMs > 0) ? status.bytes_transferred() * 1000 / static_cast<uint64_t>(elapsedMs) : 0;
+
+        if (status.state() == MSDO::download_state::transferred)
+        {
+            active->Download->finalize();
+            return 0;
+        }
+
+        // The Delivery Optimization agent retries transient errors itself.
+        if (status.is_error() && !status.is_transient_error())
+        {
+            Log_Error(
+                "DO download failed, code: %d, extended code: %d", status.error_code(), status.extended_error_code());
+            active->Download->abort();
+            return status.error_code();
+        }
+
+        _Bool paused = false;
+        ADUC_DownloadGovernor_GetLimits(nullptr /* bytesPerSecond */, &paused);
+
+        if (paused && pausedSince == std::chrono::steady_clock::time_point{})
+        {
+            Log_Info("Pausing download of file '%s'", entity->FileId);
+            active->Download->pause();
+            pausedSince = now;
+        }
+        else if (!paused && pausedSince != std::chrono::steady_clock::time_point{})
+        {
+            Log_Info("Resuming download of file '%s'", entity->FileId);
+            active->Download->resume();
+            deadline += now - pausedSince;
+            pausedSince = std::chrono::steady_clock::time_point{};
+        }
+        else if (!paused && now >= deadline)
+        {
+            active->Download->abort();
+            return static_cast<int32_t>(std::errc::timed_out);
+        }
+
+        if (downloadProgressCallback != nullptr && now - lastProgressReport >= DO_DOWNLOADER_PROGRESS_INTERVAL)
+        {
+            lastProgressReport = now;
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_InProgress,
+                status.bytes_transferred(),
+                (status.bytes_total() != 0) ? status.bytes_total() : entity->SizeInBytes,
+                *bytesPerSecond);
+        }
+    }
+}
+
+} // namespace
+
 EXTERN_C_BEGIN
 
 ADUC_Result do_download(
@@ -36,6 +232,8 @@ ADUC_Result do_download(
 {
     ADUC_Result_t resultCode = ADUC_Result_Failure;
     ADUC_Result_t extendedResultCode = ADUC_ERC_NOTRECOVERABLE;
+    int32_t doErrorCode = 0;
+    uint64_t bytesPerSecond = 0;
 
     if (entity->HashCount == 0)
     {
@@ -58,41 +256,40 @@ ADUC_Result do_download(
         entity->DownloadUri,
         fullFilePath.str().c_str());
 
-    try
-    {
-        MSDO::download::download_url_to_path(
-            entity->DownloadUri, fullFilePath.str(), false, std::chrono::seconds(retryTimeout));
+    ActiveDownload active;
+    active.WorkflowId = workflowId;
+    active.FileId = entity->FileId;
+    ActiveDownloadRegistration registration{ &active };
 
-        resultCode = ADUC_Result_Download_Success;
-    }
-    // Catch DO exception only to get extended result code. Other exceptions will be caught by CallResultMethodAndHandleExceptions
-    catch (const MSDO::exception& e)
+    try
     {
-        const int32_t doErrorCode = e.error_code();
-
-        Log_Info("Caught DO exception, msg: %s, code: %d (%#08x)", e.what(), doErrorCode, doErrorCode);
-
-        if (doErrorCode == static_cast<int32_t>(std::errc::operation_canceled))
+        // Don't hand the download to the Delivery Optimization agent while downloads are paused.
+        if (!ADUC_DownloadGovernor_Acquire(0, IsDownloadCancelled, &active))
         {
-            Log_Info("Download was cancelled");
-            if (downloadProgressCallback != nullptr)
-            {
-                downloadProgressCallback(workflowId, entity->FileId, ADUC_DownloadProgressState_Cancelled, 0, 0);
-            }
-
-            resultCode = ADUC_Result_Failure_Cancelled;
+            doErrorCode = static_cast<int32_t>(std::errc::operation_canceled);
         }
         else
         {
-            if (doErrorCode == static_cast<int32_t>(std::errc::timed_out))
             {
-                Log_Error("Download failed due to DO timeout");
+                std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+                active.Download.reset(new MSDO::download(entity->DownloadUri, fullFilePath.str()));
             }
 
-            resultCode = ADUC_Result_Failure;
+            doErrorCode =
+                RunDownload(&active, entity, workflowId, retryTimeout, downloadProgressCallback, &bytesPerSecond);
         }
 
-        extendedResultCode = MAKE_ADUC_DELIVERY_OPTIMIZATION_EXTENDEDRESULTCODE(doErrorCode);
+        if (doErrorCode == 0)
+        {
+            resultCode = ADUC_Result_Download_Success;
+        }
+    }
+    // Catch DO exception only to get extended result code. Other exceptions will be caught by CallResultMethodAndHandleExceptions
+    catch (const MSDO::exception& e)
+    {
+        doErrorCode = e.error_code();
+
+        Log_Info("Caught DO exception, msg: %s, code: %d (%#08x)", e.what(), doErrorCode, doErrorCode);
     }
     catch (const std::exception& e)
     {
@@ -124,6 +321,32 @@ ADUC_Result do_download(
         }
     }
 
+    // A call on a download that Cancel() aborted may fail with another error.
+    if (active.Cancelled && resultCode != ADUC_Result_Download_Success)
+    {
+        doErrorCode = static_cast<int32_t>(std::errc::operation_canceled);
+    }
+
+    if (doErrorCode != 0)
+    {
+        if (doErrorCode == static_cast<int32_t>(std::errc::operation_canceled))
+        {
+            Log_Info("Download was cancelled");
+            resultCode = ADUC_Result_Failure_Cancelled;
+        }
+        else
+        {
+            if (doErrorCode == static_cast<int32_t>(std::errc::timed_out))
+            {
+                Log_Error("Download failed due to DO timeout");
+            }
+
+            resultCode = ADUC_Result_Failure;
+        }
+
+        extendedResultCode = MAKE_ADUC_DELIVERY_OPTIMIZATION_EXTENDEDRESULTCODE(doErrorCode);
+    }
+
     // If we downloaded successfully, validate the file hash.
     if (resultCode == ADUC_Result_Download_Success)
     {
@@ -148,8 +371,9 @@ ADUC_Result do_download(
             return ADUC_Result{ resultCode, extendedResultCode };
         }
 
-        const bool isValid = ADUC_HashUtils_IsValidFileHash(
-            fullFilePath.str().c_str(), ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0), algVersion);
+        // Check every declared hash in a single read of the file.
+        const bool isValid = ADUC_HashUtils_VerifyFileHashes(
+            fullFilePath.str().c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */);
         if (!isValid)
         {
             Log_Error("Hash for %s is not valid", entity->TargetFilename);
@@ -176,18 +400,26 @@ ADUC_Result do_download(
     {
         if (resultCode == ADUC_Result_Download_Success)
         {
-            downloadProgressCallback(
-                workflowId, entity->FileId, ADUC_DownloadProgressState_Completed, fileSize, fileSize);
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_Completed,
+                fileSize,
+                fileSize,
+                bytesPerSecond);
         }
         else
         {
-            downloadProgressCallback(
+            ReportProgress(
+                downloadProgressCallback,
                 workflowId,
                 entity->FileId,
                 (resultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
                                                               : ADUC_DownloadProgressState_Error,
                 fileSize,
-                fileSize);
+                fileSize,
+                bytesPerSecond);
         }
     }
 
@@ -205,6 +437,47 @@ ADUC_Result Download(
     return do_download(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
 }
 
+ADUC_Result Cancel(const char* workflowId)
+{
+    ADUC_Result result = { ADUC_Result_Cancel_UnableToCancel };
+
+    if (workflowId == nullptr)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+    for (ActiveDownload* active : s_activeDownloads)
+    {
+        if (active->WorkflowId != nullptr && strcmp(active->WorkflowId, workflowId) == 0)
+        {
+            Log_Info("Cancelling download of file '%s'", active->FileId);
+            active->Cancelled = true;
+
+            if (active->Download != nullptr)
+            {
+                try
+                {
+                    active->Download->abort();
+                }
+                catch (const MSDO::exception& e)
+                {
+                    Log_Warn("Cannot abort download of file '%s', code: %d", active->FileId, e.error_code());
+                }
+            }
+
+            result = { ADUC_Result_Cancel_Success };
+        }
+    }
+
+    return result;
+}
+
+void SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    s_rateCallback = rateCallback;
+}
+
 ADUC_Result Initialize(const char* initializeData)
 {
     ADUC_Result result{ ADUC_GeneralResult_Success };
@@ -0,0 +1,1523 @@
+/**
+ * @file libcurl_content_downloader.cpp
+ * @brief Content Downloader Extension using libcurl in-process.
+ *
+ * All downloads share one libcurl connection cache, DNS cache and TLS session cache, so the files of a
+ * deployment reuse the same keep-alive connections to the content host.
+ *
+ * Large files can be downloaded in segments: the file is preallocated, and several byte ranges are fetched
+ * concurrently and written in place. The segment count and minimum segment size come from du-config.json
+ * (downloadSegmentCount, downloadMinSegmentSizeInMB). Since a SHA-2 digest can't be computed out of order,
+ * the file hash is verified by reading the file back once all segments are complete; blocks of a chunk
+ * manifest are still verified as they arrive.
+ *
+ * Compressed files (see ADUC_FileEntity::Compression) are decompressed into the sandbox as they arrive, so the
+ * compressed payload never touches the disk. The file hashes and the chunk manifest cover the compressed content,
+ * as it is published; every file hash is computed over the compressed stream and compared once it ended.
+ * Compressed files are always downloaded with a single request from the start, since a decoder can't resume in
+ * the middle of a stream.
+ *
+ * Content is downloaded into "<target>.partial" and renamed to the target once its hash is verified. Failed
+ * attempts are retried until the retry timeout expires, and resume where the previous attempt stopped with range
+ * requests guarded by If-Range (see resumable_download_utils.hpp): a single-request download from the end of its
+ * verified prefix, and a segmented download from the end of what each segment wrote.
+ *
+ * Received content passes through the download governor (see download_governor.h), which limits the bandwidth
+ * and holds the transfers while downloads are paused. A pause that outlasts the idle timeout of the server fails
+ * the transfer, which then resumes from the verified prefix on the next attempt.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/config_utils.h"
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/decompression_utils.h"
+#include "aduc/download_governor.h"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/resumable_download_utils.hpp"
+
+#include <algorithm> // for std::fill, std::min
+#include <atomic>
+#include <chrono>
+#include <cstdlib> // for free
+#include <cstring> // for strcmp
+#include <errno.h>
+#include <fcntl.h> // for open, fallocate
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/stat.h> // for stat
+#include <unistd.h> // for pwrite, ftruncate, close
+#include <vector>
+
+#include <curl/curl.h>
+
+// Minimum interval between two InProgress progress reports.
+#define LIBCURL_DOWNLOADER_PROGRESS_INTERVAL std::chrono::seconds(1)
+
+// Abort a transfer that stays below 1 byte/s for this many seconds.
+#define LIBCURL_DOWNLOADER_LOW_SPEED_TIME_SECONDS 60L
+
+#define LIBCURL_DOWNLOADER_CONNECT_TIMEOUT_SECONDS 30L
+
+#define LIBCURL_DOWNLOADER_MAX_REDIRECTS 10L
+
+// Upper bound for downloadSegmentCount.
+#define LIBCURL_DOWNLOADER_MAX_SEGMENTS 16
+
+// How long curl_multi_wait blocks when no transfer has activity.
+#define LIBCURL_DOWNLOADER_MULTI_WAIT_MS 1000
+
+namespace
+{
+/**
+ * @brief The state of one download, shared with the libcurl callbacks.
+ */
+struct DownloadContext
+{
+    const ADUC_FileEntity* Entity = nullptr;
+    const char* WorkflowId = nullptr;
+    ADUC_DownloadProgressCallback ProgressCallback = nullptr;
+    ADUC_HashUtils_FileSink Sink{};
+    ADUC_ResumableDownload* Resumable = nullptr; /**< The partial file and resume state. */
+    uint64_t ResumeOffset = 0; /**< Bytes already on disk when the transfer started. */
+    std::chrono::steady_clock::time_point TransferStart; /**< When the transfer started, for the reported rate. */
+    std::chrono::steady_clock::time_point LastProgressReport;
+    std::atomic<bool> Cancelled{ false };
+
+    // Segmented downloads.
+    int Fd = -1; /**< The preallocated output file. */
+    uint64_t SegmentedBytesWritten = 0; /**< Bytes written by all segments. */
+    bool RangeIgnored = false; /**< The server answered a range request with something other than 206. Sticky. */
+    bool ContentChanged = false; /**< A resumed segment got all of the content: it changed since the last attempt. */
+    bool ChunkMismatch = false; /**< A block did not match the chunk manifest. */
+
+    // Compressed downloads.
+    ADUC_Decompressor* Decompressor = nullptr; /**< Decompresses the content into Sink. NULL if not compressed. */
+    /** The running digests of the compressed content, one per algorithm of the file hashes, indexed by SHAversion. */
+    ADUC_HashUtils_DigestContext CompressedDigests[ADUC_HASH_UTILS_SHA_VERSION_COUNT]{};
+    bool CompressedDigestActive[ADUC_HASH_UTILS_SHA_VERSION_COUNT]{}; /**< Which of CompressedDigests are in use. */
+    ADUC_HashUtils_ChunkVerifier CompressedChunks{}; /**< Verifies the compressed content against the manifest. */
+    bool HasCompressedChunks = false;
+    bool OutputFailed = false; /**< The decompressed content could not be written. */
+    bool DecompressionFailed = false; /**< The compressed content is corrupt or truncated. */
+};
+
+/**
+ * @brief The state of one byte range of a segmented download.
+ */
+struct SegmentContext
+{
+    DownloadContext* Download = nullptr;
+    CURL* Handle = nullptr;
+    uint64_t Start = 0; /**< Offset of the first byte of the segment. */
+    uint64_t End = 0; /**< Offset past the last byte of the segment. */
+    uint64_t BytesWritten = 0;
+    ADUC_HashUtils_ChunkVerifier Verifier{};
+    bool HasVerifier = false;
+    bool Resumed = false; /**< The segment continues the content written by an earlier attempt. */
+    bool StatusChecked = false; /**< The status of the response was checked. */
+    struct curl_slist* Headers = nullptr; /**< The If-Range header of a resumed segment. */
+    bool Paused = false; /**< The write callback paused the transfer until the governor lets it resume. */
+    std::chrono::steady_clock::time_point ResumeTime; /**< When to resume the paused transfer. */
+};
+
+std::once_flag s_initOnce;
+CURLSH* s_share = nullptr;
+std::mutex s_shareLocks[CURL_LOCK_DATA_LAST];
+
+std::mutex s_activeDownloadsMutex;
+std::list<DownloadContext*> s_activeDownloads;
+
+unsigned int s_segmentCount = 0;
+uint64_t s_minSegmentSize = 0;
+
+// Receives the rate of each download before its progress reports. Set by SetDownloadRateCallback.
+std::atomic<ADUC_DownloadRateCallback> s_rateCallback{ nullptr };
+
+/**
+ * @brief Reports the progress of a download to @p progressCallback, after reporting @p bytesPerSecond to the rate
+ * callback.
+ */
+void ReportProgress(
+    ADUC_DownloadProgressCallback progressCallback,
+    const char* workflowId,
+    const char* fileId,
+    ADUC_DownloadProgressState state,
+    uint64_t bytesTransferred,
+    uint64_t bytesTotal,
+    uint64_t bytesPerSecond)
+{
+    const ADUC_DownloadRateCallback rateCallback = s_rateCallback;
+    if (rateCallback != nullptr)
+    {
+        rateCallback(workflowId, fileId, bytesPerSecond);
+    }
+
+    progressCallback(workflowId, fileId, state, bytesTransferred, bytesTotal);
+}
+
+void LockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    UNREFERENCED_PARAMETER(handle);
+    UNREFERENCED_PARAMETER(access);
+    UNREFERENCED_PARAMETER(userptr);
+    s_shareLocks[data].lock();
+}
+
+void UnlockShare(CURL* handle, curl_lock_data data, void* userptr)
+{
+    UNREFERENCED_PARAMETER(handle);
+    UNREFERENCED_PARAMETER(userptr);
+    s_shareLocks[data].unlock();
+}
+
+/**
+ * @brief Initializes libcurl and the share object that holds the connection pool. Called once per process.
+ */
+void InitLibcurl()
+{
+    const CURLcode initResult = curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (initResult != CURLE_OK)
+    {
+        Log_Error("curl_global_init failed: %s", curl_easy_strerror(initResult));
+        return;
+    }
+
+    s_share = curl_share_init();
+    if (s_share == nullptr)
+    {
+        Log_Error("curl_share_init failed.");
+        return;
+    }
+
+    curl_share_setopt(s_share, CURLSHOPT_LOCKFUNC, LockShare);
+    curl_share_setopt(s_share, CURLSHOPT_UNLOCKFUNC, UnlockShare);
+    curl_share_setopt(s_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(s_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // Shared connection cache (libcurl 7.57.0 and later): keep-alive connections outlive each download.
+    curl_share_setopt(s_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+    ADUC_ConfigInfo config = {};
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        s_segmentCount = std::min(config.downloadSegmentCount, static_cast<unsigned int>(LIBCURL_DOWNLOADER_MAX_SEGMENTS));
+        s_minSegmentSize = static_cast<uint64_t>(config.downloadMinSegmentSizeInMB) * 1024 * 1024;
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    Log_Info(
+        "libcurl downloader initialized: %s, segments: %u, min segment size: %llu",
+        curl_version(),
+        s_segmentCount,
+        static_cast<unsigned long long>(s_minSegmentSize));
+}
+
+/**
+ * @brief Download governor cancellation function.
+ */
+_Bool IsDownloadCancelled(void* context)
+{
+    return static_cast<DownloadContext*>(context)->Cancelled;
+}
+
+/**
+ * @brief Gets the effective rate of the transfer of @p context, which received @p byteCount bytes so far.
+ * @return uint64_t The rate in bytes per second, or 0 if the transfer didn't start.
+ */
+uint64_t GetBytesPerSecond(const DownloadContext* context, uint64_t byteCount)
+{
+    if (context->TransferStart == std::chrono::steady_clock::time_point{})
+    {
+        return 0;
+    }
+
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - context->TransferStart)
+                               .count();
+    return (elapsedMs > 0) ? byteCount * 1000 / static_cast<uint64_t>(elapsedMs) : 0;
+}
+
+/**
+ * @brief Decompressor output function. Writes the decompressed content into the hashing file sink.
+ */
+_Bool WriteDecompressed(void* outputContext, const uint8_t* data, size_t size)
+{
+    auto* context = static_cast<DownloadContext*>(outputContext);
+
+    if (!ADUC_HashUtils_FileSink_Write(&context->Sink, data, size))
+    {
+        context->OutputFailed = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Hashes, verifies and decompresses received compressed content.
+ * @return bool True on success.
+ */
+bool WriteCompressed(DownloadContext* context, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (context->CompressedDigestActive[i]
+            && !ADUC_HashUtils_DigestUpdate(&context->CompressedDigests[i], data, size))
+        {
+            return false;
+        }
+    }
+
+    if (context->HasCompressedChunks && !ADUC_HashUtils_ChunkVerifier_Update(&context->CompressedChunks, data, size))
+    {
+        context->ChunkMismatch = true;
+        return false;
+    }
+
+    if (!ADUC_Decompressor_Write(context->Decompressor, data, size))
+    {
+        context->DecompressionFailed = !context->OutputFailed;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief libcurl write callback. Streams the received content into the hashing file sink, through the
+ * decompressor if the file is compressed.
+ */
+size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    auto* context = static_cast<DownloadContext*>(userdata);
+    const size_t byteCount = size * nmemb;
+
+    if (context->Cancelled || !ADUC_DownloadGovernor_Acquire(byteCount, IsDownloadCancelled, context))
+    {
+        return 0;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* data = reinterpret_cast<const uint8_t*>(ptr);
+
+    if (!((context->Decompressor != nullptr) ? WriteCompressed(context, data, byteCount)
+                                             : ADUC_HashUtils_FileSink_Write(&context->Sink, data, byteCount)))
+    {
+        // Makes libcurl fail the transfer with CURLE_WRITE_ERROR.
+        return 0;
+    }
+
+    return byteCount;
+}
+
+/**
+ * @brief Sets up the decompression of @p context->Entity into the open sink, and a digest of the compressed content
+ * for every algorithm of the file hashes.
+ * @return bool True on success. Call EndDecompression() either way.
+ */
+bool BeginDecompression(DownloadContext* context)
+{
+    const ADUC_FileEntity* entity = context->Entity;
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* hash = &entity->Hash[i];
+        if (hash->type == nullptr || hash->value == nullptr
+            || !ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm))
+        {
+            Log_Error("Unsupported hash type %s", hash->type);
+            return false;
+        }
+
+        if (!context->CompressedDigestActive[algorithm])
+        {
+            if (!ADUC_HashUtils_DigestInit(&context->CompressedDigests[algorithm], algorithm))
+            {
+                return false;
+            }
+
+            context->CompressedDigestActive[algorithm] = true;
+        }
+    }
+
+    if (entity->ChunkManifest != nullptr)
+    {
+        context->HasCompressedChunks =
+            ADUC_HashUtils_ChunkVerifier_Init(&context->CompressedChunks, entity->ChunkManifest, 0);
+        if (!context->HasCompressedChunks)
+        {
+            return false;
+        }
+    }
+
+    context->Decompressor = ADUC_Decompressor_Create(entity->Compression, WriteDecompressed, context);
+    return context->Decompressor != nullptr;
+}
+
+/**
+ * @brief Compares every file hash of @p context->Entity to the digests of the compressed content.
+ * @return bool True if every hash matches.
+ */
+bool VerifyCompressedHashes(DownloadContext* context)
+{
+    const ADUC_FileEntity* entity = context->Entity;
+    char* hashes[ADUC_HASH_UTILS_SHA_VERSION_COUNT] = {};
+    bool success = (entity->HashCount > 0);
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (context->CompressedDigestActive[i])
+        {
+            hashes[i] = ADUC_HashUtils_DigestFinalBase64(&context->CompressedDigests[i]);
+        }
+    }
+
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* hash = &entity->Hash[i];
+
+        // The types were validated by BeginDecompression.
+        (void)ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm);
+
+        if (hashes[algorithm] == nullptr || strcmp(hash->value, hashes[algorithm]) != 0)
+        {
+            Log_Error(
+                "Invalid Hash, Expect: %s, Result: %s, SHAversion: %d", hash->value, hashes[algorithm], algorithm);
+            success = false;
+        }
+    }
+
+    for (char* hash : hashes)
+    {
+        free(hash);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Flushes the decompressor once the transfer ended, verifies the compressed content, and releases the
+ * decompression resources.
+ * @param complete True if the whole compressed content was received.
+ * @return bool True if @p complete is true, and the compressed content was decompressed and matches every file hash.
+ */
+bool EndDecompression(DownloadContext* context, bool complete)
+{
+    bool isValidHash = false;
+
+    if (complete && context->Decompressor != nullptr)
+    {
+        if (context->HasCompressedChunks && !ADUC_HashUtils_ChunkVerifier_Final(&context->CompressedChunks))
+        {
+            context->ChunkMismatch = true;
+        }
+        else if (!ADUC_Decompressor_Finish(context->Decompressor))
+        {
+            context->DecompressionFailed = !context->OutputFailed;
+        }
+        else
+        {
+            isValidHash = VerifyCompressedHashes(context);
+        }
+    }
+
+    ADUC_Decompressor_Destroy(context->Decompressor);
+    context->Decompressor = nullptr;
+    ADUC_HashUtils_ChunkVerifier_Uninit(&context->CompressedChunks);
+    context->HasCompressedChunks = false;
+
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (context->CompressedDigestActive[i])
+        {
+            ADUC_HashUtils_DigestUninit(&context->CompressedDigests[i]);
+            context->CompressedDigestActive[i] = false;
+        }
+    }
+
+    return isValidHash;
+}
+
+/**
+ * @brief libcurl progress callback. Reports progress and aborts the transfer when it is cancelled.
+ */
+int ProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNREFERENCED_PARAMETER(ultotal);
+    UNREFERENCED_PARAMETER(ulnow);
+
+    auto* context = static_cast<DownloadContext*>(clientp);
+
+    if (context->Cancelled)
+    {
+        // Makes libcurl fail the transfer with CURLE_ABORTED_BY_CALLBACK.
+        return 1;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (context->ProgressCallback != nullptr && dlnow > 0
+        && now - context->LastProgressReport >= LIBCURL_DOWNLOADER_PROGRESS_INTERVAL)
+    {
+        context->LastProgressReport = now;
+
+        const uint64_t total = (context->Entity->SizeInBytes != 0) ? context->Entity->SizeInBytes
+                                                                    : context->ResumeOffset + dltotal;
+        ReportProgress(
+            context->ProgressCallback,
+            context->WorkflowId,
+            context->Entity->FileId,
+            ADUC_DownloadProgressState_InProgress,
+            context->ResumeOffset + dlnow,
+            total,
+            GetBytesPerSecond(context, static_cast<uint64_t>(dlnow)));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief libcurl header callback. Records the status and validators of the response, for the resume state.
+ */
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    auto* context = static_cast<DownloadContext*>(userdata);
+    const size_t byteCount = size * nitems;
+
+    ADUC_ResumableDownload_OnResponseHeader(context->Resumable, buffer, byteCount);
+    return byteCount;
+}
+
+/**
+ * @brief Registers @p context so that Cancel() can find it, for the lifetime of the object.
+ */
+class ActiveDownloadRegistration
+{
+public:
+    explicit ActiveDownloadRegistration(DownloadContext* context) : _context(context)
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.push_back(_context);
+    }
+
+    ~ActiveDownloadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        s_activeDownloads.remove(_context);
+    }
+
+    ActiveDownloadRegistration(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration& operator=(const ActiveDownloadRegistration&) = delete;
+    ActiveDownloadRegistration(ActiveDownloadRegistration&&) = delete;
+    ActiveDownloadRegistration& operator=(ActiveDownloadRegistration&&) = delete;
+
+private:
+    DownloadContext* _context;
+};
+
+/**
+ * @brief Creates an easy handle for @p url with the options shared by all transfers.
+ * @return CURL* The handle, or nullptr on failure. Caller must call curl_easy_cleanup().
+ */
+CURL* CreateEasyHandle(const char* url)
+{
+    CURL* curl = curl_easy_init();
+
+    if (curl == nullptr)
+    {
+        return nullptr;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_SHARE, s_share);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, LIBCURL_DOWNLOADER_MAX_REDIRECTS);
+#if LIBCURL_VERSION_NUM >= 0x075500
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "http,https");
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+#else
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+#endif
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, LIBCURL_DOWNLOADER_CONNECT_TIMEOUT_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, LIBCURL_DOWNLOADER_LOW_SPEED_TIME_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    return curl;
+}
+
+/**
+ * @brief Runs the transfer of @p context->Entity into the already opened sink, from context->ResumeOffset on.
+ * @return CURLcode The libcurl result.
+ */
+CURLcode PerformTransfer(DownloadContext* context, long* httpStatus)
+{
+    CURLcode curlResult = CURLE_FAILED_INIT;
+    struct curl_slist* headers = nullptr;
+    std::string ifRangeHeader;
+    CURL* curl = CreateEasyHandle(context->Entity->DownloadUri);
+
+    if (curl == nullptr)
+    {
+        return CURLE_FAILED_INIT;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, context);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, context);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, context);
+
+    if (context->ResumeOffset > 0)
+    {
+        // libcurl fails with CURLE_RANGE_ERROR if the server ignores the range, or sends all of the content because
+        // it changed since the partial file was written.
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(context->ResumeOffset));
+
+        ifRangeHeader = ADUC_ResumableDownload_GetIfRangeHeader(context->Resumable, context->ResumeOffset);
+        if (!ifRangeHeader.empty())
+        {
+            headers = curl_slist_append(headers, ifRangeHeader.c_str());
+            if (headers == nullptr)
+            {
+                curl_easy_cleanup(curl);
+                return CURLE_OUT_OF_MEMORY;
+            }
+
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        }
+    }
+
+    context->TransferStart = std::chrono::steady_clock::now();
+    curlResult = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, httpStatus);
+
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
+    return curlResult;
+}
+
+/**
+ * @brief Gets the segment size to use for @p entity.
+ * @return uint64_t The segment size, or 0 if the file should be downloaded with a single request.
+ */
+uint64_t GetSegmentSize(const ADUC_FileEntity* entity)
+{
+    if (entity->Compression != ADUC_FileCompression_None || s_segmentCount < 2 || s_minSegmentSize == 0
+        || entity->SizeInBytes < 2 * s_minSegmentSize)
+    {
+        return 0;
+    }
+
+    const uint64_t segmentCount = std::min(static_cast<uint64_t>(s_segmentCount), entity->SizeInBytes / s_minSegmentSize);
+    uint64_t segmentSize = (entity->SizeInBytes + segmentCount - 1) / segmentCount;
+
+    // Align segments to blocks, so each segment can verify its own blocks.
+    if (entity->ChunkManifest != nullptr && entity->ChunkManifest->ChunkSize != 0)
+    {
+        const uint64_t chunkSize = entity->ChunkManifest->ChunkSize;
+        segmentSize = ((segmentSize + chunkSize - 1) / chunkSize) * chunkSize;
+    }
+
+    return (segmentSize < entity->SizeInBytes) ? segmentSize : 0;
+}
+
+/**
+ * @brief libcurl write callback of a segment. Writes the received content at its offset in the output file.
+ *
+ * All segments share the thread of the multi handle, so a segment that must wait for the download governor
+ * pauses its own transfer instead of blocking the others. PerformSegmentedTransfer resumes it, and libcurl then
+ * delivers the same content again.
+ */
+size_t SegmentWriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    auto* segment = static_cast<SegmentContext*>(userdata);
+    DownloadContext* context = segment->Download;
+    const size_t byteCount = size * nmemb;
+    long httpStatus = 0;
+    size_t written = 0;
+    uint64_t waitMs = 0;
+
+    if (context->Cancelled)
+    {
+        return 0;
+    }
+
+    if (!segment->StatusChecked)
+    {
+        // A server that doesn't support ranges sends the whole file with a 200. So does a server whose content
+        // changed since the If-Range validator of a resumed segment.
+        curl_easy_getinfo(segment->Handle, CURLINFO_RESPONSE_CODE, &httpStatus);
+        if (httpStatus != 206)
+        {
+            Log_Warn("Range request returned HTTP status %ld", httpStatus);
+            if (segment->Resumed)
+            {
+                context->ContentChanged = true;
+            }
+            else
+            {
+                context->RangeIgnored = true;
+            }
+
+            return 0;
+        }
+
+        segment->StatusChecked = true;
+    }
+
+    if (byteCount > segment->End - segment->Start - segment->BytesWritten)
+    {
+        Log_Error("Segment at offset %llu received too much content.", static_cast<unsigned long long>(segment->Start));
+        return 0;
+    }
+
+    if (!ADUC_DownloadGovernor_TryAcquire(byteCount, &waitMs))
+    {
+        segment->Paused = true;
+        segment->ResumeTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(waitMs);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* data = reinterpret_cast<const uint8_t*>(ptr);
+
+    if (segment->HasVerifier && !ADUC_HashUtils_ChunkVerifier_Update(&segment->Verifier, data, byteCount))
+    {
+        context->ChunkMismatch = true;
+        return 0;
+    }
+
+    while (written < byteCount)
+    {
+        const ssize_t result = pwrite(
+            context->Fd,
+            data + written,
+            byteCount - written,
+            static_cast<off_t>(segment->Start + segment->BytesWritten + written));
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Write failed (errno %d)", errno);
+            return 0;
+        }
+
+        written += static_cast<size_t>(result);
+    }
+
+    segment->BytesWritten += byteCount;
+    context->SegmentedBytesWritten += byteCount;
+    return byteCount;
+}
+
+/**
+ * @brief libcurl progress callback of a segment. Reports the progress of all segments.
+ */
+int SegmentProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNREFERENCED_PARAMETER(dltotal);
+    UNREFERENCED_PARAMETER(dlnow);
+    UNREFERENCED_PARAMETER(ultotal);
+    UNREFERENCED_PARAMETER(ulnow);
+
+    auto* context = static_cast<DownloadContext*>(clientp);
+
+    if (context->Cancelled)
+    {
+        return 1;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (context->ProgressCallback != nullptr && context->SegmentedBytesWritten > 0
+        && now - context->LastProgressReport >= LIBCURL_DOWNLOADER_PROGRESS_INTERVAL)
+    {
+        context->LastProgressReport = now;
+        ReportProgress(
+            context->ProgressCallback,
+            context->WorkflowId,
+            context->Entity->FileId,
+            ADUC_DownloadProgressState_InProgress,
+            context->SegmentedBytesWritten,
+            context->Entity->SizeInBytes,
+            GetBytesPerSecond(context, context->SegmentedBytesWritten - context->ResumeOffset));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Resumes the paused segments whose wait for the download governor is over.
+ * @param segments The segments.
+ * @param[out] waitTimeoutMs How long curl_multi_wait may block before the next paused segment is due, in
+ * milliseconds.
+ * @return CURLcode The libcurl result of the first segment that failed to resume, or CURLE_OK.
+ */
+CURLcode ResumePausedSegments(std::vector<SegmentContext>& segments, int* waitTimeoutMs)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    *waitTimeoutMs = LIBCURL_DOWNLOADER_MULTI_WAIT_MS;
+
+    for (SegmentContext& segment : segments)
+    {
+        if (segment.Paused && segment.ResumeTime <= now)
+        {
+            // libcurl delivers the paused content again right away, which may pause the segment again.
+            segment.Paused = false;
+            const CURLcode curlResult = curl_easy_pause(segment.Handle, CURLPAUSE_CONT);
+            if (curlResult != CURLE_OK)
+            {
+                return curlResult;
+            }
+        }
+
+        if (segment.Paused)
+        {
+            const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(segment.ResumeTime - now).count();
+            *waitTimeoutMs = std::min(*waitTimeoutMs, static_cast<int>(std::max<decltype(remaining)>(remaining, 0)));
+        }
+    }
+
+    return CURLE_OK;
+}
+
+/**
+ * @brief Runs the concurrent transfers of all segments of @p context->Entity into @p context->Fd.
+ * All segments run on the calling thread, through one multi handle. A segment held back by the download governor
+ * is paused, and resumed by this loop once its wait is over.
+ *
+ * Each segment starts after the bytes kept for it in context->Resumable->SegmentBytesWritten, which is updated with
+ * the bytes each segment wrote, or verified with a chunk manifest, when the transfers end.
+ *
+ * @param[out] httpStatus The HTTP status of the first segment that failed.
+ * @return CURLcode The libcurl result of the first segment that failed, or CURLE_OK.
+ */
+CURLcode PerformSegmentedTransfer(DownloadContext* context, uint64_t segmentSize, long* httpStatus)
+{
+    const ADUC_FileEntity* entity = context->Entity;
+    const size_t segmentCount = static_cast<size_t>((entity->SizeInBytes + segmentSize - 1) / segmentSize);
+    std::vector<SegmentContext> segments(segmentCount);
+    CURLcode curlResult = CURLE_OK;
+    CURLM* multi = curl_multi_init();
+    int running = 0;
+
+    if (multi == nullptr)
+    {
+        return CURLE_FAILED_INIT;
+    }
+
+    for (size_t i = 0; i < segmentCount; ++i)
+    {
+        SegmentContext& segment = segments[i];
+        segment.Download = context;
+        segment.Start = i * segmentSize;
+        segment.End = std::min(segment.Start + segmentSize, entity->SizeInBytes);
+        segment.BytesWritten = std::min(context->Resumable->SegmentBytesWritten[i], segment.End - segment.Start);
+        segment.Resumed = (segment.BytesWritten > 0);
+
+        // Complete in an earlier attempt.
+        if (segment.BytesWritten == segment.End - segment.Start)
+        {
+            continue;
+        }
+
+        segment.Handle = CreateEasyHandle(entity->DownloadUri);
+
+        if (segment.Handle == nullptr)
+        {
+            curlResult = CURLE_FAILED_INIT;
+            goto done;
+        }
+
+        if (entity->ChunkManifest != nullptr)
+        {
+            // The bytes kept with a chunk manifest end on a block boundary.
+            segment.HasVerifier = ADUC_HashUtils_ChunkVerifier_Init(
+                &segment.Verifier, entity->ChunkManifest, segment.Start + segment.BytesWritten);
+            if (!segment.HasVerifier)
+            {
+                context->ChunkMismatch = true;
+                curlResult = CURLE_WRITE_ERROR;
+                goto done;
+            }
+        }
+
+        if (segment.Resumed)
+        {
+            const std::string ifRangeHeader =
+                ADUC_ResumableDownload_GetIfRangeHeader(context->Resumable, segment.Start + segment.BytesWritten);
+            if (!ifRangeHeader.empty())
+            {
+                segment.Headers = curl_slist_append(nullptr, ifRangeHeader.c_str());
+                if (segment.Headers == nullptr)
+                {
+                    curlResult = CURLE_OUT_OF_MEMORY;
+                    goto done;
+                }
+
+                curl_easy_setopt(segment.Handle, CURLOPT_HTTPHEADER, segment.Headers);
+            }
+        }
+
+        const std::string range =
+            std::to_string(segment.Start + segment.BytesWritten) + "-" + std::to_string(segment.End - 1);
+        curl_easy_setopt(segment.Handle, CURLOPT_RANGE, range.c_str());
+        curl_easy_setopt(segment.Handle, CURLOPT_WRITEFUNCTION, SegmentWriteCallback);
+        curl_easy_setopt(segment.Handle, CURLOPT_WRITEDATA, &segment);
+        curl_easy_setopt(segment.Handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(segment.Handle, CURLOPT_HEADERDATA, context);
+        curl_easy_setopt(segment.Handle, CURLOPT_XFERINFOFUNCTION, SegmentProgressCallback);
+        curl_easy_setopt(segment.Handle, CURLOPT_XFERINFODATA, context);
+        curl_multi_add_handle(multi, segment.Handle);
+    }
+
+    context->TransferStart = std::chrono::steady_clock::now();
+
+    do
+    {
+        CURLMsg* message = nullptr;
+        int messageCount = 0;
+        int waitTimeoutMs = LIBCURL_DOWNLOADER_MULTI_WAIT_MS;
+        CURLMcode multiResult = curl_multi_perform(multi, &running);
+
+        if (multiResult == CURLM_OK && running > 0)
+        {
+            curlResult = ResumePausedSegments(segments, &waitTimeoutMs);
+        }
+
+        if (multiResult == CURLM_OK && running > 0 && curlResult == CURLE_OK)
+        {
+            multiResult = curl_multi_wait(multi, nullptr, 0, waitTimeoutMs, nullptr);
+        }
+
+        if (multiResult != CURLM_OK)
+        {
+            Log_Error("curl_multi failed: %s", curl_multi_strerror(multiResult));
+            curlResult = CURLE_FAILED_INIT;
+            break;
+        }
+
+        // Stop all segments as soon as one fails.
+        while ((message = curl_multi_info_read(multi, &messageCount)) != nullptr)
+        {
+            if (message->msg == CURLMSG_DONE && message->data.result != CURLE_OK && curlResult == CURLE_OK)
+            {
+                curlResult = message->data.result;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, httpStatus);
+            }
+        }
+    } while (running > 0 && curlResult == CURLE_OK && !context->Cancelled);
+
+    // The progress callback of a paused segment may not run, so cancellation is also checked here.
+    if (curlResult == CURLE_OK && context->Cancelled)
+    {
+        curlResult = CURLE_ABORTED_BY_CALLBACK;
+    }
+
+    for (SegmentContext& segment : segments)
+    {
+        if (curlResult == CURLE_OK && segment.BytesWritten != segment.End - segment.Start)
+        {
+            Log_Error("Segment at offset %llu is incomplete.", static_cast<unsigned long long>(segment.Start));
+            curlResult = CURLE_PARTIAL_FILE;
+        }
+
+        // Only the last segment ends with a partial block; the others end on a block boundary.
+        if (curlResult == CURLE_OK && segment.HasVerifier
+            && !((segment.End == entity->SizeInBytes)
+                     ? ADUC_HashUtils_ChunkVerifier_Final(&segment.Verifier)
+                     : ADUC_HashUtils_ChunkVerifier_GetVerifiedSize(&segment.Verifier) == segment.End))
+        {
+            context->ChunkMismatch = true;
+            curlResult = CURLE_WRITE_ERROR;
+        }
+    }
+
+done:
+    for (size_t i = 0; i < segmentCount; ++i)
+    {
+        SegmentContext& segment = segments[i];
+
+        // With a chunk manifest, only the verified blocks are kept.
+        context->Resumable->SegmentBytesWritten[i] = segment.HasVerifier
+            ? ADUC_HashUtils_ChunkVerifier_GetVerifiedSize(&segment.Verifier) - segment.Start
+            : segment.BytesWritten;
+
+        if (segment.HasVerifier)
+        {
+            ADUC_HashUtils_ChunkVerifier_Uninit(&segment.Verifier);
+        }
+
+        if (segment.Handle != nullptr)
+        {
+            curl_multi_remove_handle(multi, segment.Handle);
+            curl_easy_cleanup(segment.Handle);
+        }
+
+        curl_slist_free_all(segment.Headers);
+    }
+
+    curl_multi_cleanup(multi);
+    return curlResult;
+}
+
+/**
+ * @brief Downloads @p context->Entity into the partial file of @p context->Resumable in segments of @p segmentSize
+ * bytes. The segments resume after the bytes that an earlier attempt wrote, and a failed attempt records what each
+ * segment wrote for the next one.
+ * @param[out] retriable Set to true if the download failed in a way worth retrying.
+ * @return ADUC_Result The result. context->RangeIgnored is set if the server doesn't support range requests.
+ */
+ADUC_Result DownloadSegmented(DownloadContext* context, uint64_t segmentSize, bool* retriable)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    const ADUC_FileEntity* entity = context->Entity;
+    ADUC_ResumableDownload* download = context->Resumable;
+    const char* filePath = download->PartialPath.c_str();
+    const size_t segmentCount = static_cast<size_t>((entity->SizeInBytes + segmentSize - 1) / segmentSize);
+    CURLcode curlResult = CURLE_OK;
+    long httpStatus = 0;
+    struct stat st = {};
+    int openFlags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    *retriable = false;
+
+    // The partial file of an earlier segmented attempt was preallocated to the size of the file.
+    if (ADUC_ResumableDownload_LoadSegments(download, segmentSize, segmentCount) && stat(filePath, &st) == 0
+        && static_cast<uint64_t>(st.st_size) == entity->SizeInBytes)
+    {
+        openFlags &= ~O_TRUNC;
+        for (uint64_t bytes : download->SegmentBytesWritten)
+        {
+            context->ResumeOffset += bytes;
+        }
+    }
+    else
+    {
+        std::fill(download->SegmentBytesWritten.begin(), download->SegmentBytesWritten.end(), 0);
+    }
+
+    context->SegmentedBytesWritten = context->ResumeOffset;
+
+    Log_Info(
+        "Downloading %llu bytes in segments of %llu bytes, %llu bytes kept from an earlier attempt",
+        static_cast<unsigned long long>(entity->SizeInBytes),
+        static_cast<unsigned long long>(segmentSize),
+        static_cast<unsigned long long>(context->ResumeOffset));
+
+    context->Fd = open(filePath, openFlags, 0666);
+    if (context->Fd == -1)
+    {
+        Log_Error("Cannot open %s (errno %d)", filePath, errno);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE;
+        goto done;
+    }
+
+    // Reserve the whole file up front, so segments don't fragment it and a full disk fails early.
+    if (fallocate(context->Fd, 0, 0, static_cast<off_t>(entity->SizeInBytes)) != 0
+        && (errno != EOPNOTSUPP || ftruncate(context->Fd, static_cast<off_t>(entity->SizeInBytes)) != 0))
+    {
+        const int error = errno;
+        Log_Error("Cannot allocate %llu bytes (errno %d)", static_cast<unsigned long long>(entity->SizeInBytes), error);
+        result.ExtendedResultCode = (error == ENOSPC) ? ADUC_ERC_CONTENT_DOWNLOADER_INSUFFICIENT_DISK_SPACE
+                                                      : ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE;
+        goto done;
+    }
+
+    curlResult = PerformSegmentedTransfer(context, segmentSize, &httpStatus);
+
+    if (close(context->Fd) != 0 && curlResult == CURLE_OK)
+    {
+        curlResult = CURLE_WRITE_ERROR;
+    }
+    context->Fd = -1;
+
+    if (context->RangeIgnored || context->ContentChanged)
+    {
+        // The content written so far may not belong to the content now served.
+        ADUC_ResumableDownload_Restart(download);
+    }
+    else if (curlResult != CURLE_OK)
+    {
+        ADUC_ResumableDownload_SaveSegments(download);
+    }
+
+    if (context->Cancelled)
+    {
+        Log_Info("Download was cancelled");
+        result = { ADUC_Result_Failure_Cancelled };
+        goto done;
+    }
+
+    if (context->ChunkMismatch)
+    {
+        Log_Error("Content of %s does not match its chunk manifest", entity->TargetFilename);
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_CHUNK_HASH_INVALID_HASH;
+        goto done;
+    }
+
+    if (context->ContentChanged)
+    {
+        Log_Warn("Content of %s changed since the last attempt, restarting.", entity->TargetFilename);
+        *retriable = true;
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_EXTERNAL_FAILURE(curlResult);
+        goto done;
+    }
+
+    if (curlResult != CURLE_OK)
+    {
+        if (!context->RangeIgnored)
+        {
+            Log_Error(
+                "Segmented download failed: %s (HTTP status %ld)", curl_easy_strerror(curlResult), httpStatus);
+            *retriable = ADUC_ResumableDownload_IsRetriableFailure(curlResult, httpStatus);
+        }
+
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_EXTERNAL_FAILURE(curlResult);
+        goto done;
+    }
+
+    if (!ADUC_HashUtils_VerifyFileHashes(filePath, entity->Hash, entity->HashCount, nullptr /* verdicts */))
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
+        ADUC_ResumableDownload_Restart(download);
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH;
+        goto done;
+    }
+
+    Log_Info("Downloaded %llu bytes, file hash is valid", static_cast<unsigned long long>(entity->SizeInBytes));
+    result = { ADUC_Result_Download_Success };
+
+done:
+    if (context->Fd != -1)
+    {
+        close(context->Fd);
+        context->Fd = -1;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Runs one download attempt of @p context->Entity into the partial file of @p download.
+ *
+ * Large files are downloaded in segments, unless the server ignored a range request before. Otherwise a single
+ * request is used. Either resumes where the previous attempt stopped, except for compressed files, which always
+ * start over.
+ *
+ * @param context The download context.
+ * @param download The partial file and resume state.
+ * @param algVersion The algorithm of the file hash.
+ * @param[out] retriable Set to true if the attempt failed in a way worth retrying.
+ * @return ADUC_Result ADUC_Result_Download_Success if the partial file is complete and verified.
+ */
+ADUC_Result DownloadAttempt(
+    DownloadContext* context, ADUC_ResumableDownload* download, SHAversion algVersion, bool* retriable)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    const ADUC_FileEntity* entity = context->Entity;
+    const bool decompressing = (entity->Compression != ADUC_FileCompression_None);
+    const uint64_t segmentSize = context->RangeIgnored ? 0 : GetSegmentSize(entity);
+    bool isValidHash = false;
+    char* prefixHash = nullptr;
+    const char* expectedHash = nullptr;
+    CURLcode curlResult = CURLE_OK;
+    long httpStatus = 0;
+
+    *retriable = false;
+
+    context->Sink = ADUC_HashUtils_FileSink{};
+    context->ResumeOffset = 0;
+    context->SegmentedBytesWritten = 0;
+    context->ContentChanged = false;
+    context->ChunkMismatch = false;
+    context->OutputFailed = false;
+    context->DecompressionFailed = false;
+
+    if (segmentSize != 0)
+    {
+        result = DownloadSegmented(context, segmentSize, retriable);
+
+        if (!context->RangeIgnored || context->Cancelled)
+        {
+            goto done;
+        }
+
+        Log_Info("Server does not support range requests, downloading with a single request.");
+        context->ResumeOffset = 0;
+        context->SegmentedBytesWritten = 0;
+    }
+
+    // The write callback streams the content through a hashing file sink, so the payload is verified
+    // while it is being written. The content kept from an earlier attempt is not downloaded again.
+    if (!ADUC_ResumableDownload_OpenSink(download, &context->Sink, entity, algVersion, !decompressing))
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE };
+        goto done;
+    }
+
+    // Every declared hash of uncompressed content is computed while it is written, and compared on close.
+    if (!decompressing && !ADUC_HashUtils_FileSink_SetExpectedHashes(&context->Sink, entity->Hash, entity->HashCount))
+    {
+        ADUC_HashUtils_FileSink_Close(&context->Sink, nullptr, nullptr);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED };
+        goto done;
+    }
+
+    if (decompressing && !BeginDecompression(context))
+    {
+        (void)EndDecompression(context, false /* complete */);
+        ADUC_HashUtils_FileSink_Close(&context->Sink, nullptr, nullptr);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DECOMPRESSION_FAILURE };
+        goto done;
+    }
+
+    context->ResumeOffset = context->Sink.BytesWritten;
+
+    if (context->ResumeOffset > 0)
+    {
+        Log_Info("Resuming download at offset %llu", static_cast<unsigned long long>(context->ResumeOffset));
+    }
+
+    // Reserve the rest of the file without changing its size, so a full disk fails before the transfer rather than
+    // part way through it. The size of decompressed output is not known up front.
+    if (!decompressing && entity->SizeInBytes > context->ResumeOffset
+        && fallocate(
+               fileno(context->Sink.File),
+               FALLOC_FL_KEEP_SIZE,
+               static_cast<off_t>(context->ResumeOffset),
+               static_cast<off_t>(entity->SizeInBytes - context->ResumeOffset))
+            != 0)
+    {
+        if (errno == ENOSPC)
+        {
+            Log_Error("Insufficient disk space for %llu bytes", static_cast<unsigned long long>(entity->SizeInBytes));
+            ADUC_HashUtils_FileSink_Close(&context->Sink, nullptr, nullptr);
+            result = { .ResultCode = ADUC_Result_Failure,
+                       .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INSUFFICIENT_DISK_SPACE };
+            goto done;
+        }
+
+        // E.g. EOPNOTSUPP; the file just grows as it is written.
+        Log_Debug("Cannot preallocate %s (errno %d)", download->PartialPath.c_str(), errno);
+    }
+
+    curlResult = PerformTransfer(context, &httpStatus);
+
+    // Only compare hashes of a complete transfer.
+    expectedHash =
+        (curlResult == CURLE_OK) ? ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0) : nullptr;
+
+    if (decompressing)
+    {
+        // The hashes of a compressed file cover the compressed content only.
+        const bool isValidCompressedHash = EndDecompression(context, curlResult == CURLE_OK);
+        isValidHash = ADUC_HashUtils_FileSink_Close(&context->Sink, nullptr, nullptr) && isValidCompressedHash;
+    }
+    else
+    {
+        // For an incomplete transfer, get the hash of what was written, to resume from it.
+        isValidHash = ADUC_HashUtils_FileSink_Close(
+            &context->Sink, expectedHash, (curlResult == CURLE_OK) ? nullptr : &prefixHash);
+    }
+
+    if (context->Cancelled)
+    {
+        Log_Info("Download was cancelled");
+        result = { ADUC_Result_Failure_Cancelled };
+        goto done;
+    }
+
+    if (context->Sink.ChunkMismatch || context->ChunkMismatch)
+    {
+        Log_Error("Content of %s does not match its chunk manifest", entity->TargetFilename);
+
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_CHUNK_HASH_INVALID_HASH };
+        goto done;
+    }
+
+    if (context->DecompressionFailed)
+    {
+        Log_Error("Content of %s could not be decompressed", entity->TargetFilename);
+
+        ADUC_ResumableDownload_Restart(download);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DECOMPRESSION_FAILURE };
+        goto done;
+    }
+
+    if (curlResult != CURLE_OK)
+    {
+        Log_Error(
+            "Download failed after %llu bytes: %s (HTTP status %ld)",
+            static_cast<unsigned long long>(context->Sink.BytesWritten),
+            curl_easy_strerror(curlResult),
+            httpStatus);
+
+        if (curlResult == CURLE_RANGE_ERROR)
+        {
+            // The server can't resume this content, or it changed. Start over.
+            ADUC_ResumableDownload_Restart(download);
+        }
+        else if (!decompressing && isValidHash)
+        {
+            ADUC_ResumableDownload_SaveState(download, entity, &context->Sink, prefixHash);
+        }
+
+        *retriable = ADUC_ResumableDownload_IsRetriableFailure(curlResult, httpStatus);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_EXTERNAL_FAILURE(curlResult) };
+        goto done;
+    }
+
+    if (!isValidHash)
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
+
+        ADUC_ResumableDownload_Restart(download);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH };
+        goto done;
+    }
+
+    Log_Info("Downloaded %llu bytes, file hash is valid", static_cast<unsigned long long>(context->Sink.BytesWritten));
+    result = { ADUC_Result_Download_Success };
+
+done:
+    free(prefixHash);
+    return result;
+}
+
+} // namespace
+
+EXTERN_C_BEGIN
+
+ADUC_Result Download_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    SHAversion algVersion;
+    std::stringstream fullFilePath;
+    ADUC_ResumableDownload download;
+    bool reportProgress = false;
+    DownloadContext context;
+
+    std::call_once(s_initOnce, InitLibcurl);
+
+    if (entity == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY;
+        return result;
+    }
+
+    if (entity->DownloadUri == nullptr || *entity->DownloadUri == 0)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_DOWNLOAD_URI;
+        return result;
+    }
+
+    if (s_share == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_NOT_INITIALIZED;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (entity->HashCount == 0)
+    {
+        Log_Error("File entity does not contain a file hash! Cannot validate cancelling download.");
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_IS_EMPTY;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (!ADUC_Decompression_IsSupported(entity->Compression))
+    {
+        Log_Error("Compression %d of %s is not supported", entity->Compression, entity->TargetFilename);
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_COMPRESSION_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    fullFilePath << workFolder << "/" << entity->TargetFilename;
+
+    if (!ADUC_HashUtils_GetShaVersionForTypeString(
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
+    {
+        Log_Error(
+            "FileEntity for %s has unsupported hash type %s",
+            fullFilePath.str().c_str(),
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    // If target file exists, validate file hash.
+    // If file is valid, then skip the download. The hashes of a compressed file don't cover its decompressed target.
+    if (entity->Compression == ADUC_FileCompression_None
+        && ADUC_HashUtils_VerifyFileHashes(
+            fullFilePath.str().c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */))
+    {
+        result = { ADUC_Result_Download_Skipped_FileExists };
+        reportProgress = true;
+        goto done;
+    }
+
+    Log_Info(
+        "Downloading File '%s' from '%s' to '%s'",
+        entity->TargetFilename,
+        entity->DownloadUri,
+        fullFilePath.str().c_str());
+
+    ADUC_ResumableDownload_Init(&download, fullFilePath.str(), entity->DownloadUri);
+
+    context.Entity = entity;
+    context.WorkflowId = workflowId;
+    context.ProgressCallback = downloadProgressCallback;
+    context.Resumable = &download;
+
+    // Retry transient failures until retryTimeout expires. Each attempt resumes where the previous one stopped.
+    {
+        ActiveDownloadRegistration registration{ &context };
+        result = ADUC_ResumableDownload_Run(
+            retryTimeout,
+            [&context, &download, algVersion](bool* retriable) -> ADUC_Result {
+                return DownloadAttempt(&context, &download, algVersion, retriable);
+            },
+            IsDownloadCancelled,
+            &context);
+    }
+
+    if (IsAducResultCodeSuccess(result.ResultCode) && !ADUC_ResumableDownload_Commit(&download))
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE };
+    }
+
+    reportProgress = true;
+
+done:
+    if (reportProgress && (downloadProgressCallback != nullptr))
+    {
+        const uint64_t bytesPerSecond = GetBytesPerSecond(
+            &context,
+            (context.Sink.BytesWritten > context.ResumeOffset) ? context.Sink.BytesWritten - context.ResumeOffset
+                                                               : context.SegmentedBytesWritten);
+
+        if (IsAducResultCodeSuccess(result.ResultCode))
+        {
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_Completed,
+                (context.Sink.BytesWritten != 0) ? context.Sink.BytesWritten : entity->SizeInBytes,
+                entity->SizeInBytes,
+                bytesPerSecond);
+        }
+        else
+        {
+            ReportProgress(
+                downloadProgressCallback,
+                workflowId,
+                entity->FileId,
+                (result.ResultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
+                                                                     : ADUC_DownloadProgressState_Error,
+                context.Sink.BytesWritten,
+                entity->SizeInBytes,
+                bytesPerSecond);
+        }
+    }
+
+    Log_Info(
+        "Download task end. resultCode: %d, extendedCode: %d (0x%X)",
+        result.ResultCode,
+        result.ExtendedResultCode,
+        result.ExtendedResultCode);
+    return result;
+}
+
+ADUC_Result Download(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    return Download_libcurl(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
+}
+
+ADUC_Result Cancel(const char* workflowId)
+{
+    ADUC_Result result = { ADUC_Result_Cancel_UnableToCancel };
+
+    if (workflowId == nullptr)
+    {
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+    for (DownloadContext* context : s_activeDownloads)
+    {
+        if (context->WorkflowId != nullptr && strcmp(context->WorkflowId, workflowId) == 0)
+        {
+            Log_Info("Cancelling download of file '%s'", context->Entity->FileId);
+            context->Cancelled = true;
+            result = { ADUC_Result_Cancel_Success };
+        }
+    }
+
+    return result;
+}
+
+void SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    s_rateCallback = rateCallback;
+}
+
+bool IsCompressionSupported(ADUC_FileCompression compression)
+{
+    return ADUC_Decompression_IsSupported(compression);
+}
+
+ADUC_Result Initialize(const char* initializeData)
+{
+    UNREFERENCED_PARAMETER(initializeData);
+
+    std::call_once(s_initOnce, InitLibcurl);
+    if (s_share == nullptr)
+    {
+        return { ADUC_GeneralResult_Failure, ADUC_ERROR_LIBCURL_DOWNLOADER_NOT_INITIALIZED };
+    }
+
+    return { ADUC_GeneralResult_Success };
+}
+
+EXTERN_C_END
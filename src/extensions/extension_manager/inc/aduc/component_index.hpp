@@ -0,0 +1,67 @@
+/**
+ * @file component_index.hpp
+ * @brief Definition of the ComponentIndex, which selects components from memory.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ADUC_COMPONENT_INDEX_HPP
+#define ADUC_COMPONENT_INDEX_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief An in-memory index of the components returned by a component enumerator's GetAllComponents.
+ *
+ * Every string property of a component (id, name, group, manufacturer, model, ...) is indexed in a hash table,
+ * so a selector is answered by intersecting the components that have each of its properties, without going back
+ * to the component enumerator.
+ *
+ * Selection follows the rule of enumerators that export SelectsComponentsByStringEquality: a component is selected
+ * if it has all the name-value pairs of the selector, as string properties.
+ */
+class ComponentIndex
+{
+public:
+    /**
+     * @brief Indexes the components in @p componentsJson.
+     * @param componentsJson The output of GetAllComponents: { "components": [ ... ] }.
+     * @return std::unique_ptr<ComponentIndex> The index, or nullptr if @p componentsJson isn't valid.
+     */
+    static std::unique_ptr<ComponentIndex> Create(const char* componentsJson);
+
+    /**
+     * @brief Selects the components matching @p selectorJson.
+     * @param selectorJson A JSON object of name-value pairs, e.g. { "group": "motors" }.
+     * @param[out] outputComponentsData Receives { "components": [ ... ] }, with the selected components in their
+     * enumeration order.
+     * @return bool False if @p selectorJson isn't a JSON object.
+     */
+    bool Select(const char* selectorJson, std::string& outputComponentsData) const;
+
+    /**
+     * @brief Gets the number of indexed components.
+     */
+    size_t GetComponentCount() const
+    {
+        return _components.size();
+    }
+
+private:
+    ComponentIndex() = default;
+
+    const std::vector<size_t>* Find(const std::string& name, const std::string& value) const;
+    std::string Serialize(const std::vector<size_t>& selected) const;
+
+    std::vector<std::string> _components; /**< The serialized components, in enumeration order. */
+
+    /** The positions of the components, in ascending order, by property name and value. */
+    std::unordered_map<std::string, std::unordered_map<std::string, std::vector<size_t>>> _index;
+};
+
+#endif // ADUC_COMPONENT_INDEX_HPP
@@ -0,0 +1,141 @@
+/**
+ * @file download_scheduler.hpp
+ * @brief Definition of the DownloadScheduler, which downloads a batch of files concurrently.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ADUC_DOWNLOAD_SCHEDULER_HPP
+#define ADUC_DOWNLOAD_SCHEDULER_HPP
+
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/result.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Default number of files downloaded at the same time.
+#define DOWNLOAD_SCHEDULER_DEFAULT_CONCURRENCY 4
+
+// File identifier of the progress reports of a whole batch.
+#define DOWNLOAD_SCHEDULER_BATCH_FILE_ID "*"
+
+/**
+ * @brief The limits applied to a batch of downloads.
+ */
+struct DownloadSchedulerOptions
+{
+    unsigned int MaxConcurrency = DOWNLOAD_SCHEDULER_DEFAULT_CONCURRENCY; /**< Maximum number of concurrent downloads. */
+    unsigned int MaxConcurrencyPerHost = 0; /**< Maximum number of concurrent downloads from one host. 0 for no limit. */
+
+    /**
+     * @brief Reads the options from the agent configuration file, falling back to the defaults.
+     */
+    static DownloadSchedulerOptions FromConfig();
+};
+
+/**
+ * @brief Downloads one file. Called concurrently from the scheduler's worker threads.
+ *
+ * @param entity The file to download.
+ * @param progressCallback The progress callback to pass to the content downloader.
+ */
+typedef std::function<ADUC_Result(const ADUC_FileEntity* entity, ADUC_DownloadProgressCallback progressCallback)>
+    DownloadSchedulerDownloadProc;
+
+/**
+ * @brief Runs the downloads of a batch of files on a bounded pool of worker threads.
+ *
+ * Each worker takes the next file whose host is below the per-host limit. The combined bandwidth is limited
+ * by the content downloaders themselves (see download_governor.h).
+ * Files with the same target file name are downloaded once, since concurrent downloads would write the same file.
+ * After the first failure, files that have not started yet are not downloaded.
+ * The progress of the files is summed into progress reports of the whole batch.
+ */
+class DownloadScheduler
+{
+public:
+    DownloadScheduler(const DownloadSchedulerOptions& options, DownloadSchedulerDownloadProc downloadProc);
+
+    /**
+     * @brief Downloads all @p entities and waits for them to complete.
+     *
+     * @param entities The files to download.
+     * @param workflowId The workflow identifier, for progress reports.
+     * @param downloadProgressCallback Receives the progress of each file, each followed by the progress of the batch
+     * with the file identifier DOWNLOAD_SCHEDULER_BATCH_FILE_ID. The batch reports sum the progress of all files
+     * against the sum of their sizes, and end with a Completed or Error report. May be nullptr.
+     * @param[out] results Optional. Receives the result of each file, in the order of @p entities.
+     * A file with the same target file name as an earlier one gets the result of that file.
+     * Files that were not downloaded because of an earlier failure get ADUC_Result_Failure.
+     * @return ADUC_Result The first failure, or ADUC_Result_Download_Success.
+     */
+    ADUC_Result Run(
+        const std::vector<const ADUC_FileEntity*>& entities,
+        const char* workflowId,
+        ADUC_DownloadProgressCallback downloadProgressCallback,
+        std::vector<ADUC_Result>* results);
+
+    /**
+     * @brief Gets the host (and port) part of @p uri, used for the per-host limit.
+     * @return std::string The host, or an empty string if @p uri has none.
+     */
+    static std::string GetHost(const char* uri);
+
+private:
+    struct Job
+    {
+        const ADUC_FileEntity* Entity = nullptr;
+        std::string Host;
+        ADUC_Result Result = { ADUC_Result_Failure };
+        uint64_t BytesReported = 0; /**< Bytes transferred at the last progress report. */
+        bool Started = false;
+    };
+
+    /**
+     * @brief Finds the job of the batch that downloads @p fileId for @p workflowId. Must be called with
+     * s_activeSchedulersMutex held.
+     * @return Job* The job, or nullptr if the file is not part of this batch.
+     */
+    Job* FindJob(const char* workflowId, const char* fileId);
+
+    static void OnProgress(
+        const char* workflowId,
+        const char* fileId,
+        ADUC_DownloadProgressState state,
+        uint64_t bytesTransferred,
+        uint64_t bytesTotal);
+
+    void WorkerThread();
+    Job* TakeNextJob();
+    void RunJob(Job* job);
+    void AddTransferredBytes(Job* job, uint64_t bytesTransferred);
+    uint64_t GetBatchBytes() const;
+
+    DownloadSchedulerOptions _options;
+    DownloadSchedulerDownloadProc _downloadProc;
+    std::string _workflowId;
+    ADUC_DownloadProgressCallback _progressCallback = nullptr;
+
+    std::mutex _mutex;
+    std::condition_variable _jobDone;
+    std::vector<Job> _jobs;
+    std::unordered_map<std::string, unsigned int> _activePerHost;
+    ADUC_Result _firstFailure = { ADUC_Result_Download_Success };
+    bool _failed = false;
+
+    // Bytes reported by all downloads of the batch. Guarded by s_activeSchedulersMutex, like Job::BytesReported.
+    uint64_t _totalBytes = 0;
+
+    // Sum of the sizes of all files of the batch, counting files with the same target once.
+    uint64_t _totalSize = 0;
+};
+
+#endif // ADUC_DOWNLOAD_SCHEDULER_HPP
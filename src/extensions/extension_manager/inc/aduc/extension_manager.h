@@ -19,6 +19,14 @@ EXTERN_C_BEGIN
  */
 ADUC_Result ExtensionManager_InitializeContentDownloader(const char* initializeData);
 
+/**
+ * @brief Sets the callback that receives the transfer rate of each download. Call before
+ * ExtensionManager_InitializeContentDownloader.
+ *
+ * @param rateCallback The download rate callback, or NULL.
+ */
+void ExtensionManager_SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback);
+
 /**
  * @brief Downloads using the content downloader extension.
  *
@@ -31,6 +39,20 @@ ADUC_Result ExtensionManager_InitializeContentDownloader(const char* initializeD
  */
 ADUC_Result ExtensionManager_Download(const ADUC_FileEntity* entity, const char* workflowId, const char* workFolder, unsigned int retryTimeout, ADUC_DownloadProgressCallback downloadProgressCallback);
 
+/**
+ * @brief Starts verifying and loading all the registered extensions in the background.
+ *
+ * @param concurrency Number of extensions verified and loaded at the same time. 0 does nothing.
+ */
+void ExtensionManager_StartPreloading(unsigned int concurrency);
+
+/**
+ * @brief Registers the extensions linked into the agent with the extension manager.
+ *
+ * Only agents built with ADUC_STATIC_EXTENSIONS define it, in a table generated from static_extensions.cpp.in.
+ */
+void ExtensionManager_RegisterStaticExtensions(void);
+
 /**
  * @brief Uninitializes the extension manager.
  */
@@ -10,12 +10,15 @@
 #define ADUC_EXTENSION_MANAGER_HPP
 
 #include "aduc/component_enumerator_extension.hpp"
+#include "aduc/extension_registry.hpp"
 #include "aduc/extension_utils.h"
 #include "aduc/result.h"
+#include "aduc/types/workflow.h"
 
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 typedef enum tagADUC_ExtensionType
 {
@@ -27,9 +30,14 @@ typedef enum tagADUC_ExtensionType
 // Default DO retry timeout is 24 hours.
 #define DO_RETRY_TIMEOUT_DEFAULT (60 * 60 * 24)
 
-// Forward declaration.
+// Forward declarations.
 class ContentHandler;
 
+namespace ADUC
+{
+struct StaticExtensions;
+} // namespace ADUC
+
 typedef ContentHandler* (*UPDATE_CONTENT_HANDLER_CREATE_PROC)(ADUC_LOG_SEVERITY logLevel);
 
 class ExtensionManager
@@ -40,6 +48,29 @@ public:
 
     static ADUC_Result LoadUpdateContentHandlerExtension(const std::string& updateType, ContentHandler** handler);
 
+    /**
+     * @brief Sets the extensions linked into the agent (ADUC_STATIC_EXTENSIONS build profile). They are used
+     * instead of registered shared libraries: an update content handler for the same update type, the content
+     * downloader and the component enumerator aren't loaded.
+     *
+     * Must be called before any extension is loaded.
+     *
+     * @param extensions A table that outlives the extension manager, or nullptr.
+     */
+    static void SetStaticExtensions(const ADUC::StaticExtensions* extensions);
+
+    /**
+     * @brief Starts verifying and loading all the registered extensions on background threads, so that the first
+     * deployment finds them loaded. The load time of each extension is logged.
+     * Update content handlers registered without an update type (by older agents) are loaded on first use.
+     *
+     * @param concurrency Number of extensions verified and loaded at the same time. 0 does nothing.
+     */
+    static void StartPreloading(unsigned int concurrency);
+
+    /**
+     * @brief Waits for preloading to stop, then unloads all the extensions.
+     */
     static void Uninit();
 
     /**
@@ -50,10 +81,32 @@ public:
 
     /**
      * @brief Selects component(s) matching specified @p selector.
+     * If the component enumerator exports SelectsComponentsByStringEquality and it returns true, selections with a
+     * @p workflowHandle enumerate the components once per deployment: the first selection indexes GetAllComponents
+     * in the root workflow, and later selections are answered from that index. Otherwise, or if the components
+     * can't be indexed, the component enumerator's SelectComponents is called.
+     *
      * @param selector A JSON string contains name-value pairs used for selecting components.
      * @param[out] outputComponentsData An output string containing components data.
+     * @param workflowHandle The workflow selecting the components, or nullptr.
+     */
+    static ADUC_Result SelectComponents(
+        const std::string& selector,
+        std::string& outputComponentsData,
+        ADUC_WorkflowHandle workflowHandle = nullptr);
+
+    /**
+     * @brief Gets the descriptor that the component enumerator makes readable when the components may have changed.
+     * @param[out] fd Receives the descriptor, or -1 if the component enumerator doesn't notify changes.
+     * @return ADUC_Result Failure if the component enumerator can't be loaded.
+     */
+    static ADUC_Result GetComponentsChangedFd(int* fd);
+
+    /**
+     * @brief Has the component enumerator consume its pending change notifications.
+     * See AcknowledgeComponentsChangedProc.
      */
-    static ADUC_Result SelectComponents(const std::string& selector, std::string& outputComponentsData);
+    static void AcknowledgeComponentsChanged();
 
     /**
      * @brief Initialize Content Downloader extension.
@@ -62,6 +115,14 @@ public:
      */
     static ADUC_Result InitializeContentDownloader(const char* initializeData);
 
+    /**
+     * @brief Sets the callback that receives the transfer rate of each download, before each of its progress reports.
+     * Takes effect when the content downloader is initialized, for content downloaders that export
+     * "SetDownloadRateCallback".
+     * @param rateCallback The callback, or nullptr.
+     */
+    static void SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback);
+
     /**
      * @brief
      *
@@ -70,6 +131,8 @@ public:
      * @param workFolder A full path to target directory (sandbox).
      * @param retryTimeout A download retry timeout (in seconds).
      * @param downloadProgressCallback A download progress reporting callback.
+     * @param workflowHandle Optional. The workflow that the file belongs to. An existing file that was verified
+     * earlier in the workflow is not hashed again (see workflow_is_file_verified).
      * @return ADUC_Result
      */
     static ADUC_Result Download(
@@ -77,7 +140,42 @@ public:
         const char* workflowId,
         const char* workFolder,
         unsigned int retryTimeout,
-        ADUC_DownloadProgressCallback downloadProgressCallback);
+        ADUC_DownloadProgressCallback downloadProgressCallback,
+        ADUC_WorkflowHandle workflowHandle = nullptr);
+
+    /**
+     * @brief Downloads a batch of files concurrently, within the limits set in the agent configuration file
+     * (downloadConcurrency and downloadConcurrencyPerHost).
+     * After the first failure, files that have not started yet are not downloaded.
+     *
+     * @param entities The files to download.
+     * @param workflowId A workflow identifier.
+     * @param workFolder A full path to target directory (sandbox).
+     * @param retryTimeout A download retry timeout (in seconds).
+     * @param downloadProgressCallback A download progress reporting callback. Receives the progress of each file,
+     * and the progress of the whole batch (see DownloadScheduler::Run).
+     * @param[out] results Optional. Receives the result of each file, in the order of @p entities.
+     * @param workflowHandle Optional. The workflow that the files belong to, see Download.
+     * @return ADUC_Result The first failure, or ADUC_Result_Download_Success.
+     */
+    static ADUC_Result DownloadBatch(
+        const std::vector<const ADUC_FileEntity*>& entities,
+        const char* workflowId,
+        const char* workFolder,
+        unsigned int retryTimeout,
+        ADUC_DownloadProgressCallback downloadProgressCallback,
+        std::vector<ADUC_Result>* results = nullptr,
+        ADUC_WorkflowHandle workflowHandle = nullptr);
+
+    /**
+     * @brief Asks the content downloader to abort the downloads in progress for @p workflowId, and for the workflows
+     * nested in it, whose ids start with "<workflowId>.", e.g. the step prefetches of the steps handler.
+     * Content downloaders that don't export "Cancel" can't be interrupted.
+     *
+     * @param workflowId A workflow identifier.
+     * @return ADUC_Result ADUC_Result_Cancel_Success if a download was aborted.
+     */
+    static ADUC_Result CancelDownload(const char* workflowId);
 
 private:
     static void UnloadAllUpdateContentHandlers();
@@ -85,12 +183,12 @@ private:
 
     static void _FreeComponentsDataString(char* componentsJson);
 
+    static void PreloadExtensions(unsigned int concurrency);
+    static void PreloadExtension(const ADUC::ExtensionRegistration& registration, const std::string& name);
+
     static ADUC_Result LoadExtensionLibrary(
         const char* extensionName,
-        const char* extensionPath,
-        const char* extensionSubfolder,
-        const char* extensionRegFileName,
-        const char* requiredFunction,
+        const ADUC::ExtensionRegistration* registration,
         int facilityCode,
         int componentCode,
         void** libHandle);
@@ -0,0 +1,71 @@
+/**
+ * @file static_extensions.hpp
+ * @brief Table of the extensions linked into the agent by the ADUC_STATIC_EXTENSIONS build profile.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_STATIC_EXTENSIONS_HPP
+#define ADUC_STATIC_EXTENSIONS_HPP
+
+#include "aduc/component_enumerator_extension.hpp"
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/extension_manager.hpp" // for UPDATE_CONTENT_HANDLER_CREATE_PROC
+
+#include <cstddef> // for size_t
+
+namespace ADUC
+{
+/**
+ * @brief An update content handler linked into the agent.
+ */
+struct StaticUpdateContentHandler
+{
+    const char* UpdateType; /**< The update type handled, e.g. "microsoft/swupdate:1". */
+    UPDATE_CONTENT_HANDLER_CREATE_PROC Create; /**< The handler's CreateUpdateContentHandlerExtension. */
+};
+
+/**
+ * @brief The content downloader linked into the agent. Cancel, IsCompressionSupported and SetDownloadRateCallback are
+ * optional.
+ */
+struct StaticContentDownloader
+{
+    const char* Name; /**< The name of the downloader target. */
+    InitializeProc Initialize;
+    DownloadProc Download;
+    CancelDownloadProc Cancel;
+    IsCompressionSupportedProc IsCompressionSupported;
+    SetDownloadRateCallbackProc SetDownloadRateCallback;
+};
+
+/**
+ * @brief The component enumerator linked into the agent. GetComponentsChangedFd, AcknowledgeComponentsChanged and
+ * SelectsComponentsByStringEquality are optional.
+ */
+struct StaticComponentEnumerator
+{
+    const char* Name; /**< The name of the enumerator target. */
+    GetAllComponentsProc GetAllComponents;
+    SelectComponentsProc SelectComponents;
+    FreeComponentsDataStringProc FreeComponentsDataString;
+    GetComponentsChangedFdProc GetComponentsChangedFd;
+    AcknowledgeComponentsChangedProc AcknowledgeComponentsChanged;
+    SelectsComponentsByStringEqualityProc SelectsComponentsByStringEquality;
+};
+
+/**
+ * @brief The extensions linked into the agent. The agent generates a constant table at build time, see
+ * src/agent/src/static_extensions.cpp.in, and passes it to ExtensionManager::SetStaticExtensions.
+ */
+struct StaticExtensions
+{
+    const StaticUpdateContentHandler* ContentHandlers; /**< The update content handlers. */
+    size_t ContentHandlerCount; /**< The number of entries in ContentHandlers. */
+    const StaticContentDownloader* ContentDownloader; /**< The content downloader, or nullptr. */
+    const StaticComponentEnumerator* ComponentEnumerator; /**< The component enumerator, or nullptr. */
+};
+
+} // namespace ADUC
+
+#endif // ADUC_STATIC_EXTENSIONS_HPP
@@ -0,0 +1,174 @@
+/**
+ * @file component_index.cpp
+ * @brief Implementation of the ComponentIndex.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_index.hpp"
+
+#include <algorithm> // for std::sort, std::set_intersection
+#include <iterator> // for std::back_inserter
+
+#include <parson.h>
+
+std::unique_ptr<ComponentIndex> ComponentIndex::Create(const char* componentsJson)
+{
+    std::unique_ptr<ComponentIndex> index;
+    JSON_Value* rootValue = nullptr;
+    JSON_Array* components = nullptr;
+
+    if (componentsJson == nullptr)
+    {
+        goto done;
+    }
+
+    rootValue = json_parse_string(componentsJson);
+    components = json_object_get_array(json_object(rootValue), "components");
+    if (components == nullptr)
+    {
+        goto done;
+    }
+
+    index.reset(new ComponentIndex());
+    index->_components.reserve(json_array_get_count(components));
+
+    for (size_t i = 0; i < json_array_get_count(components); ++i)
+    {
+        char* serialized = json_serialize_to_string(json_array_get_value(components, i));
+        if (serialized == nullptr)
+        {
+            index.reset();
+            goto done;
+        }
+
+        index->_components.emplace_back(serialized);
+        json_free_serialized_string(serialized);
+
+        // Components that aren't objects are returned when selecting all components, but never match a property.
+        JSON_Object* component = json_array_get_object(components, i);
+        for (size_t p = 0; p < json_object_get_count(component); ++p)
+        {
+            const char* name = json_object_get_name(component, p);
+            const char* value = json_string(json_object_get_value_at(component, p));
+            if (name != nullptr && *name != '\0' && value != nullptr && *value != '\0')
+            {
+                // Components are visited in order, so each list of positions stays sorted.
+                index->_index[name][value].push_back(i);
+            }
+        }
+    }
+
+done:
+    json_value_free(rootValue);
+    return index;
+}
+
+bool ComponentIndex::Select(const char* selectorJson, std::string& outputComponentsData) const
+{
+    bool succeeded = false;
+    JSON_Value* selectorValue = nullptr;
+    JSON_Object* selector = nullptr;
+    std::vector<const std::vector<size_t>*> matches;
+    std::vector<size_t> selected;
+
+    outputComponentsData = "";
+
+    if (selectorJson == nullptr)
+    {
+        goto done;
+    }
+
+    selectorValue = json_parse_string(selectorJson);
+    selector = json_object(selectorValue);
+    if (selector == nullptr)
+    {
+        goto done;
+    }
+
+    succeeded = true;
+
+    if (json_object_get_count(selector) == 0)
+    {
+        selected.resize(_components.size());
+        for (size_t i = 0; i < selected.size(); ++i)
+        {
+            selected[i] = i;
+        }
+
+        goto done;
+    }
+
+    for (size_t s = 0; s < json_object_get_count(selector); ++s)
+    {
+        const char* name = json_object_get_name(selector, s);
+        const char* value = json_string(json_object_get_value_at(selector, s));
+        const std::vector<size_t>* positions =
+            (name == nullptr || value == nullptr) ? nullptr : Find(name, value);
+
+        // Empty names and values, and values that aren't strings, match no component.
+        if (positions == nullptr)
+        {
+            goto done;
+        }
+
+        matches.push_back(positions);
+    }
+
+    // Intersect from the most selective property, so the intermediate results stay small.
+    std::sort(matches.begin(), matches.end(), [](const std::vector<size_t>* a, const std::vector<size_t>* b) {
+        return a->size() < b->size();
+    });
+
+    selected = *matches[0];
+    for (size_t m = 1; m < matches.size() && !selected.empty(); ++m)
+    {
+        std::vector<size_t> intersection;
+        std::set_intersection(
+            selected.begin(),
+            selected.end(),
+            matches[m]->begin(),
+            matches[m]->end(),
+            std::back_inserter(intersection));
+        selected.swap(intersection);
+    }
+
+done:
+    if (succeeded)
+    {
+        outputComponentsData = Serialize(selected);
+    }
+
+    json_value_free(selectorValue);
+    return succeeded;
+}
+
+const std::vector<size_t>* ComponentIndex::Find(const std::string& name, const std::string& value) const
+{
+    auto property = _index.find(name);
+    if (property == _index.end())
+    {
+        return nullptr;
+    }
+
+    auto positions = property->second.find(value);
+    return (positions == property->second.end()) ? nullptr : &positions->second;
+}
+
+std::string ComponentIndex::Serialize(const std::vector<size_t>& selected) const
+{
+    std::string output = R"({"components":[)";
+
+    for (size_t i = 0; i < selected.size(); ++i)
+    {
+        if (i != 0)
+        {
+            output += ',';
+        }
+
+        output += _components[selected[i]];
+    }
+
+    output += "]}";
+    return output;
+}
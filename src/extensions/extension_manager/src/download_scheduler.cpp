@@ -0,0 +1,387 @@
+/**
+ * @file download_scheduler.cpp
+ * @brief Implementation of the DownloadScheduler.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_scheduler.hpp"
+
+#include "aduc/config_utils.h"
+#include "aduc/logging.h"
+
+#include <algorithm> // for std::min
+#include <cstring> // for strstr, strcspn, memchr, strcmp
+#include <list>
+#include <system_error>
+#include <thread>
+
+// The schedulers whose batch is running. Content downloaders may report progress from threads of their own,
+// e.g. the polling thread of Delivery Optimization, so the progress callback finds its job by workflow and file
+// identifier rather than by thread.
+static std::mutex s_activeSchedulersMutex;
+static std::list<DownloadScheduler*> s_activeSchedulers;
+
+DownloadSchedulerOptions DownloadSchedulerOptions::FromConfig()
+{
+    DownloadSchedulerOptions options;
+    ADUC_ConfigInfo config = {};
+
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        if (config.downloadConcurrency != 0)
+        {
+            options.MaxConcurrency = config.downloadConcurrency;
+        }
+
+        options.MaxConcurrencyPerHost = config.downloadConcurrencyPerHost;
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    return options;
+}
+
+DownloadScheduler::DownloadScheduler(const DownloadSchedulerOptions& options, DownloadSchedulerDownloadProc downloadProc) :
+    _options(options), _downloadProc(std::move(downloadProc))
+{
+    if (_options.MaxConcurrency == 0)
+    {
+        _options.MaxConcurrency = 1;
+    }
+}
+
+std::string DownloadScheduler::GetHost(const char* uri)
+{
+    if (uri == nullptr)
+    {
+        return "";
+    }
+
+    const char* host = strstr(uri, "://");
+    host = (host == nullptr) ? uri : host + 3;
+
+    // Skip user info.
+    const size_t authorityLength = strcspn(host, "/?#");
+    const char* at = static_cast<const char*>(memchr(host, '@', authorityLength));
+    if (at != nullptr)
+    {
+        return std::string(at + 1, host + authorityLength);
+    }
+
+    return std::string(host, authorityLength);
+}
+
+ADUC_Result DownloadScheduler::Run(
+    const std::vector<const ADUC_FileEntity*>& entities,
+    const char* workflowId,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    std::vector<ADUC_Result>* results)
+{
+    std::vector<std::thread> workers;
+    std::vector<size_t> jobIndices(entities.size());
+    std::unordered_map<std::string, size_t> jobsByTarget;
+    ADUC_DownloadProgressState batchState = ADUC_DownloadProgressState_Completed;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    _workflowId = (workflowId == nullptr) ? "" : workflowId;
+    _progressCallback = downloadProgressCallback;
+    _jobs.clear();
+    _jobs.reserve(entities.size());
+    _activePerHost.clear();
+    _firstFailure = { ADUC_Result_Download_Success };
+    _failed = false;
+    _totalBytes = 0;
+    _totalSize = 0;
+
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        const char* targetFilename = entities[i]->TargetFilename;
+
+        if (targetFilename != nullptr)
+        {
+            const auto existing = jobsByTarget.find(targetFilename);
+            if (existing != jobsByTarget.end())
+            {
+                Log_Info(
+                    "File '%s' has the same target as file '%s', downloading it once.",
+                    entities[i]->FileId,
+                    _jobs[existing->second].Entity->FileId);
+                jobIndices[i] = existing->second;
+                continue;
+            }
+
+            jobsByTarget.emplace(targetFilename, _jobs.size());
+        }
+
+        jobIndices[i] = _jobs.size();
+        _jobs.emplace_back();
+        _jobs.back().Entity = entities[i];
+        _jobs.back().Host = GetHost(entities[i]->DownloadUri);
+        _totalSize += entities[i]->SizeInBytes;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_activeSchedulersMutex);
+        s_activeSchedulers.push_back(this);
+    }
+
+    const size_t workerCount = std::min(static_cast<size_t>(_options.MaxConcurrency), _jobs.size());
+
+    Log_Info(
+        "Downloading %zu file(s) for workflow %s with %zu worker(s).",
+        _jobs.size(),
+        workflowId == nullptr ? "" : workflowId,
+        workerCount);
+
+    // A single file doesn't need a worker thread.
+    if (workerCount == 1)
+    {
+        WorkerThread();
+    }
+    else
+    {
+        try
+        {
+            for (size_t i = 0; i < workerCount; ++i)
+            {
+                workers.emplace_back(&DownloadScheduler::WorkerThread, this);
+            }
+        }
+        catch (const std::system_error& e)
+        {
+            // Run with the workers that could be started; with none, run on this thread.
+            Log_Warn("Cannot start download worker: %s", e.what());
+            if (workers.empty())
+            {
+                WorkerThread();
+            }
+        }
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_activeSchedulersMutex);
+        s_activeSchedulers.remove(this);
+    }
+
+    const auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    Log_Info(
+        "Download batch end. %zu file(s), %llu bytes reported, %lld ms. resultCode: %d, extendedCode: %d (0x%X)",
+        _jobs.size(),
+        static_cast<unsigned long long>(_totalBytes),
+        static_cast<long long>(elapsed.count()),
+        _firstFailure.ResultCode,
+        _firstFailure.ExtendedResultCode,
+        _firstFailure.ExtendedResultCode);
+
+    if (_progressCallback != nullptr)
+    {
+        if (IsAducResultCodeFailure(_firstFailure.ResultCode))
+        {
+            batchState = ADUC_DownloadProgressState_Error;
+        }
+
+        _progressCallback(workflowId, DOWNLOAD_SCHEDULER_BATCH_FILE_ID, batchState, GetBatchBytes(), _totalSize);
+    }
+
+    if (results != nullptr)
+    {
+        results->clear();
+        for (const size_t jobIndex : jobIndices)
+        {
+            results->push_back(_jobs[jobIndex].Result);
+        }
+    }
+
+    return _firstFailure;
+}
+
+void DownloadScheduler::WorkerThread()
+{
+    Job* job = nullptr;
+
+    while ((job = TakeNextJob()) != nullptr)
+    {
+        RunJob(job);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_activePerHost[job->Host];
+
+        if (IsAducResultCodeFailure(job->Result.ResultCode) && !_failed)
+        {
+            _failed = true;
+            _firstFailure = job->Result;
+        }
+
+        _jobDone.notify_all();
+    }
+}
+
+/**
+ * @brief Waits for a job that can start without exceeding the per-host limit, and marks it started.
+ * @return Job* The job, or nullptr when there is nothing left to start.
+ */
+DownloadScheduler::Job* DownloadScheduler::TakeNextJob()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (;;)
+    {
+        bool hasPendingJobs = false;
+
+        if (_failed)
+        {
+            return nullptr;
+        }
+
+        for (Job& job : _jobs)
+        {
+            if (job.Started)
+            {
+                continue;
+            }
+
+            hasPendingJobs = true;
+
+            unsigned int& activeCount = _activePerHost[job.Host];
+            if (_options.MaxConcurrencyPerHost == 0 || activeCount < _options.MaxConcurrencyPerHost)
+            {
+                ++activeCount;
+                job.Started = true;
+                return &job;
+            }
+        }
+
+        if (!hasPendingJobs)
+        {
+            return nullptr;
+        }
+
+        // All pending files are on hosts that are at their limit.
+        _jobDone.wait(lock);
+    }
+}
+
+void DownloadScheduler::RunJob(Job* job)
+{
+    Log_Info("Downloading file '%s' (%s)", job->Entity->FileId, job->Entity->TargetFilename);
+
+    try
+    {
+        job->Result = _downloadProc(job->Entity, &DownloadScheduler::OnProgress);
+    }
+    catch (...)
+    {
+        job->Result = { .ResultCode = ADUC_Result_Failure,
+                        .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DOWNLOAD_EXCEPTION };
+    }
+
+    if (IsAducResultCodeFailure(job->Result.ResultCode))
+    {
+        Log_Error(
+            "Cannot download file '%s'. (0x%X)", job->Entity->FileId, job->Result.ExtendedResultCode);
+    }
+}
+
+void DownloadScheduler::OnProgress(
+    const char* workflowId,
+    const char* fileId,
+    ADUC_DownloadProgressState state,
+    uint64_t bytesTransferred,
+    uint64_t bytesTotal)
+{
+    ADUC_DownloadProgressCallback progressCallback = nullptr;
+    uint64_t batchBytes = 0;
+    uint64_t batchSize = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(s_activeSchedulersMutex);
+
+        for (DownloadScheduler* scheduler : s_activeSchedulers)
+        {
+            Job* job = scheduler->FindJob(workflowId, fileId);
+            if (job != nullptr)
+            {
+                if (state == ADUC_DownloadProgressState_InProgress || state == ADUC_DownloadProgressState_Completed)
+                {
+                    scheduler->AddTransferredBytes(job, bytesTransferred);
+                }
+
+                progressCallback = scheduler->_progressCallback;
+                batchBytes = scheduler->GetBatchBytes();
+                batchSize = scheduler->_totalSize;
+                break;
+            }
+        }
+    }
+
+    // Reports of files that are not part of a running batch are dropped.
+    if (progressCallback != nullptr)
+    {
+        progressCallback(workflowId, fileId, state, bytesTransferred, bytesTotal);
+
+        // The batch completes in Run, once all files completed.
+        progressCallback(
+            workflowId,
+            DOWNLOAD_SCHEDULER_BATCH_FILE_ID,
+            ADUC_DownloadProgressState_InProgress,
+            batchBytes,
+            batchSize);
+    }
+}
+
+DownloadScheduler::Job* DownloadScheduler::FindJob(const char* workflowId, const char* fileId)
+{
+    if (fileId == nullptr || _workflowId != (workflowId == nullptr ? "" : workflowId))
+    {
+        return nullptr;
+    }
+
+    for (Job& job : _jobs)
+    {
+        if (job.Entity->FileId != nullptr && strcmp(job.Entity->FileId, fileId) == 0)
+        {
+            return &job;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Accounts for the bytes transferred since the last report of @p job. Must be called with
+ * s_activeSchedulersMutex held.
+ */
+void DownloadScheduler::AddTransferredBytes(Job* job, uint64_t bytesTransferred)
+{
+    if (bytesTransferred <= job->BytesReported)
+    {
+        // A restarted transfer starts counting again.
+        job->BytesReported = bytesTransferred;
+        return;
+    }
+
+    _totalBytes += bytesTransferred - job->BytesReported;
+    job->BytesReported = bytesTransferred;
+}
+
+/**
+ * @brief Gets the progress of the batch: the sum of the bytes each file last reported. Must be called with
+ * s_activeSchedulersMutex held.
+ */
+uint64_t DownloadScheduler::GetBatchBytes() const
+{
+    uint64_t bytes = 0;
+
+    for (const Job& job : _jobs)
+    {
+        bytes += job.BytesReported;
+    }
+
+    return bytes;
+}
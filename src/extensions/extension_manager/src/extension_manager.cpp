@@ -10,16 +10,29 @@
 #include "aduc/content_handler.hpp"
 
 #include "aduc/c_utils.h"
+#include "aduc/component_index.hpp"
+#include "aduc/decompression_utils.h"
+#include "aduc/download_scheduler.hpp"
 #include "aduc/exceptions.hpp"
 #include "aduc/extension_manager.hpp"
+#include "aduc/extension_registry.hpp"
 #include "aduc/extension_utils.h"
 #include "aduc/hash_utils.h" // for SHAversion
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h"
+#include "aduc/payload_cache.h"
 #include "aduc/result.h"
+#include "aduc/static_extensions.hpp"
 #include "aduc/string_utils.hpp"
+#include "aduc/workflow_utils.h"
 
+#include <algorithm> // for std::min
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -37,21 +50,223 @@ std::unordered_map<std::string, ContentHandler*> ExtensionManager::_contentHandl
 void* ExtensionManager::_contentDownloader;
 void* ExtensionManager::_componentEnumerator;
 
-STRING_HANDLE FolderNameFromHandlerId(const char* handlerId)
+// Serializes loading, caching and unloading extensions in the static members above; DownloadBatch downloads on
+// several threads at once, and handlers may download on other threads, e.g. the steps handler while it pipelines
+// step downloads.
+static std::mutex s_loadMutex;
+
+// Background preloading, started by StartPreloading and joined by Uninit.
+static std::thread s_preloadThread;
+static std::atomic<bool> s_preloadCancelled{ false };
+
+// The extensions linked into the agent, set by SetStaticExtensions.
+static const ADUC::StaticExtensions* s_staticExtensions = nullptr;
+
+// Passed to the content downloader when it is initialized, set by SetDownloadRateCallback.
+static ADUC_DownloadRateCallback s_downloadRateCallback = nullptr;
+
+// Serializes indexing the components of a workflow and selecting from the index.
+static std::mutex s_componentIndexMutex;
+
+// The number of downloads in progress per workflow id, so that CancelDownload reaches the downloads of nested
+// workflow ids, e.g. the step prefetches of the steps handler ("<workflowId>.<level>.<step>").
+static std::mutex s_activeDownloadsMutex;
+static std::unordered_map<std::string, unsigned int> s_activeDownloads;
+
+/**
+ * @brief Registers a download in s_activeDownloads for its lifetime.
+ */
+class ActiveDownload
+{
+public:
+    explicit ActiveDownload(const char* workflowId) : _workflowId(workflowId == nullptr ? "" : workflowId)
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        ++s_activeDownloads[_workflowId];
+    }
+
+    ~ActiveDownload()
+    {
+        std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+        auto download = s_activeDownloads.find(_workflowId);
+        if (download != s_activeDownloads.end() && --download->second == 0)
+        {
+            s_activeDownloads.erase(download);
+        }
+    }
+
+    ActiveDownload(const ActiveDownload&) = delete;
+    ActiveDownload& operator=(const ActiveDownload&) = delete;
+
+private:
+    std::string _workflowId;
+};
+
+/**
+ * @brief Gets @p workflowId and the ids of the downloads in progress for workflows nested in it.
+ */
+static std::vector<std::string> GetDownloadsToCancel(const char* workflowId)
+{
+    const std::string id = (workflowId == nullptr) ? "" : workflowId;
+    const std::string prefix = id + ".";
+    std::vector<std::string> ids{ id };
+
+    std::lock_guard<std::mutex> lock(s_activeDownloadsMutex);
+    for (const auto& download : s_activeDownloads)
+    {
+        if (download.first.compare(0, prefix.size(), prefix) == 0)
+        {
+            ids.push_back(download.first);
+        }
+    }
+
+    return ids;
+}
+
+/**
+ * @brief Finds the update content handler for @p updateType that is linked into the agent.
+ * @return const ADUC::StaticUpdateContentHandler* The handler, or nullptr if it isn't linked into the agent.
+ */
+static const ADUC::StaticUpdateContentHandler* FindStaticUpdateContentHandler(const std::string& updateType)
 {
-    STRING_HANDLE name = STRING_construct(handlerId);
-    STRING_replace(name, '/', '_');
-    STRING_replace(name, ':', '_');
-    return name;
+    if (s_staticExtensions == nullptr)
+    {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < s_staticExtensions->ContentHandlerCount; ++i)
+    {
+        if (updateType == s_staticExtensions->ContentHandlers[i].UpdateType)
+        {
+            return &s_staticExtensions->ContentHandlers[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Checks whether the extension of @p registration is linked into the agent, so its file is not used.
+ */
+static bool IsStaticallyLinked(const ADUC::ExtensionRegistration& registration)
+{
+    if (s_staticExtensions == nullptr)
+    {
+        return false;
+    }
+
+    switch (registration.Kind)
+    {
+    case ADUC::ExtensionKind::UpdateContentHandler:
+        return FindStaticUpdateContentHandler(registration.HandlerId) != nullptr;
+
+    case ADUC::ExtensionKind::ContentDownloader:
+        return s_staticExtensions->ContentDownloader != nullptr;
+
+    case ADUC::ExtensionKind::ComponentEnumerator:
+        return s_staticExtensions->ComponentEnumerator != nullptr;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Gets the function @p name exported by the extension library @p lib.
+ *
+ * The handle of a content downloader or component enumerator linked into the agent is its entry in the static
+ * extensions table; its functions are looked up there instead of with dlsym.
+ *
+ * @return void* The function, or nullptr if the extension doesn't export it.
+ */
+static void* GetExtensionSymbol(void* lib, const char* name)
+{
+    if (s_staticExtensions != nullptr && lib != nullptr && lib == s_staticExtensions->ContentDownloader)
+    {
+        const ADUC::StaticContentDownloader* downloader = s_staticExtensions->ContentDownloader;
+
+        if (strcmp(name, "Initialize") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(downloader->Initialize);
+        }
+
+        if (strcmp(name, "Download") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(downloader->Download);
+        }
+
+        if (strcmp(name, "Cancel") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(downloader->Cancel);
+        }
+
+        if (strcmp(name, "IsCompressionSupported") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(downloader->IsCompressionSupported);
+        }
+
+        if (strcmp(name, "SetDownloadRateCallback") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(downloader->SetDownloadRateCallback);
+        }
+
+        return nullptr;
+    }
+
+    if (s_staticExtensions != nullptr && lib != nullptr && lib == s_staticExtensions->ComponentEnumerator)
+    {
+        const ADUC::StaticComponentEnumerator* enumerator = s_staticExtensions->ComponentEnumerator;
+
+        if (strcmp(name, "GetAllComponents") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->GetAllComponents);
+        }
+
+        if (strcmp(name, "SelectComponents") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->SelectComponents);
+        }
+
+        if (strcmp(name, "FreeComponentsDataString") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->FreeComponentsDataString);
+        }
+
+        if (strcmp(name, "GetComponentsChangedFd") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->GetComponentsChangedFd);
+        }
+
+        if (strcmp(name, "AcknowledgeComponentsChanged") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->AcknowledgeComponentsChanged);
+        }
+
+        if (strcmp(name, "SelectsComponentsByStringEquality") == 0)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            return reinterpret_cast<void*>(enumerator->SelectsComponentsByStringEquality);
+        }
+
+        return nullptr;
+    }
+
+    return dlsym(lib, name);
 }
 
 /**
  * @brief Loads extension shared library file.
  * @param extensionName An extension name.
- * @param extensionFolder An extension root folder.
- * @param extensionSubfolder An extension sub-folder.
- * @param extensionRegFileName An extension registration file name.
- * @param requiredFunctionName An required function.
+ * @param registration The registration of the extension, from the extension registry.
  * @param facilityCode Facility code for extended error report.
  * @param componentCode Component code for extended error report.
  * @param libHandle A buffer for storing output extension library handle.
@@ -59,22 +274,12 @@ STRING_HANDLE FolderNameFromHandlerId(const char* handlerId)
  */
 ADUC_Result ExtensionManager::LoadExtensionLibrary(
     const char* extensionName,
-    const char* extensionPath,
-    const char* extensionSubfolder,
-    const char* extensionRegFileName,
-    const char* requiredFunction,
+    const ADUC::ExtensionRegistration* registration,
     int facilityCode,
     int componentCode,
     void** libHandle)
 {
     ADUC_Result result{ ADUC_GeneralResult_Failure };
-    ADUC_FileEntity entity = {};
-    SHAversion algVersion;
-
-    std::stringstream path;
-    path << extensionPath << "/" << extensionSubfolder << "/" << extensionRegFileName;
-
-    Log_Info("Loading extension '%s'. Reg file : %s", extensionName, path.str().c_str());
 
     if (libHandle == nullptr)
     {
@@ -102,54 +307,38 @@ ADUC_Result ExtensionManager::LoadExtensionLibrary(
         }
     }
 
-    memset(&entity, 0, sizeof(entity));
-
-    if (!GetExtensionFileEntity(path.str().c_str(), &entity))
+    if (registration == nullptr)
     {
-        Log_Error("Failed to load extension from '%s'.", path.str().c_str());
+        Log_Error("Extension '%s' is not registered.", extensionName);
         result.ExtendedResultCode = ADUC_ERC_EXTENSION_CREATE_FAILURE_NOT_FOUND(facilityCode, componentCode);
         goto done;
     }
 
-    // Validate file hash.
-    if (!ADUC_HashUtils_GetShaVersionForTypeString(
-            ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0), &algVersion))
-    {
-        Log_Error(
-            "FileEntity for %s has unsupported hash type %s",
-            entity.TargetFilename,
-            ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0));
-        result.ExtendedResultCode = ADUC_ERC_EXTENSION_CREATE_FAILURE_VALIDATE(facilityCode, componentCode);
-        goto done;
-    }
+    Log_Info("Loading extension '%s'. Reg file : %s", extensionName, registration->RegistrationFile.c_str());
 
-    if (!ADUC_HashUtils_IsValidFileHash(
-            entity.TargetFilename, ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0), algVersion))
+    // Validate file hash.
+    if (!ADUC::ExtensionRegistry::VerifyFile(*registration))
     {
-        Log_Error("Hash for %s is not valid", entity.TargetFilename);
         result.ExtendedResultCode = ADUC_ERC_EXTENSION_CREATE_FAILURE_VALIDATE(facilityCode, componentCode);
         goto done;
     }
 
-    *libHandle = dlopen(entity.TargetFilename, RTLD_LAZY);
+    *libHandle = dlopen(registration->FilePath.c_str(), RTLD_LAZY);
 
     if (*libHandle == nullptr)
     {
-        Log_Error("Cannot load content handler file %s. %s.", entity.TargetFilename, dlerror());
+        Log_Error("Cannot load content handler file %s. %s.", registration->FilePath.c_str(), dlerror());
         result.ExtendedResultCode = ADUC_ERC_EXTENSION_CREATE_FAILURE_LOAD(facilityCode, componentCode);
         goto done;
     }
 
-    dlerror(); // Clear any existing error
-
-    // Only check whether required function exist, if specified.
-    if (requiredFunction != nullptr && *requiredFunction != '\0')
+    for (const std::string& requiredFunction : registration->RequiredSymbols)
     {
-        void* reqFunc = dlsym(*libHandle, requiredFunction);
+        dlerror(); // Clear any existing error
 
-        if (reqFunc == nullptr)
+        if (dlsym(*libHandle, requiredFunction.c_str()) == nullptr)
         {
-            Log_Error("The specified function ('%s') doesn't exist. %s\n", requiredFunction, dlerror());
+            Log_Error("The specified function ('%s') doesn't exist. %s\n", requiredFunction.c_str(), dlerror());
             result.ExtendedResultCode =
                 ADUC_ERC_EXTENSION_FAILURE_REQUIRED_FUNCTION_NOTIMPL(facilityCode, componentCode);
             goto done;
@@ -164,16 +353,13 @@ ADUC_Result ExtensionManager::LoadExtensionLibrary(
 done:
     if (IsAducResultCodeFailure(result.ResultCode))
     {
-        if (*libHandle != nullptr)
+        if (libHandle != nullptr && *libHandle != nullptr)
         {
             dlclose(*libHandle);
             *libHandle = nullptr;
         }
     }
 
-    // Done with file entity.
-    ADUC_FileEntity_Uninit(&entity);
-
     return result;
 }
 
@@ -186,12 +372,12 @@ done:
 ADUC_Result
 ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateType, ContentHandler** handler)
 {
+    std::lock_guard<std::mutex> lock(s_loadMutex);
     ADUC_Result result = { ADUC_Result_Failure };
 
     UPDATE_CONTENT_HANDLER_CREATE_PROC createUpdateContentHandlerExtension = nullptr;
+    const ADUC::StaticUpdateContentHandler* staticHandler = nullptr;
     void* libHandle = nullptr;
-    STRING_HANDLE folderName = nullptr;
-    STRING_HANDLE path = nullptr;
 
     Log_Info("Loading Update Content Handler for '%s'.", updateType.c_str());
 
@@ -226,15 +412,17 @@ ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateTyp
         goto done;
     }
 
-    folderName = FolderNameFromHandlerId(updateType.c_str());
-    path = STRING_construct_sprintf("%s/%s", ADUC_UPDATE_CONTENT_HANDLER_EXTENSION_DIR, STRING_c_str(folderName));
+    staticHandler = FindStaticUpdateContentHandler(updateType);
+    if (staticHandler != nullptr)
+    {
+        Log_Info("'%s' is handled by an update content handler linked into the agent.", updateType.c_str());
+        createUpdateContentHandlerExtension = staticHandler->Create;
+        goto create;
+    }
 
     result = LoadExtensionLibrary(
         updateType.c_str(),
-        ADUC_UPDATE_CONTENT_HANDLER_EXTENSION_DIR,
-        STRING_c_str(folderName),
-        ADUC_UPDATE_CONTENT_HANDLER_REG_FILENAME,
-        "CreateUpdateContentHandlerExtension",
+        ADUC::ExtensionRegistry::GetInstance().FindUpdateContentHandler(updateType).get(),
         ADUC_FACILITY_EXTENSION_UPDATE_CONTENT_HANDLER,
         0,
         &libHandle);
@@ -246,7 +434,7 @@ ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateTyp
 
     dlerror(); // Clear any existing error
 
-    createUpdateContentHandlerExtension = reinterpret_cast<UPDATE_CONTENT_HANDLER_CREATE_PROC>(dlsym(
+    createUpdateContentHandlerExtension = reinterpret_cast<UPDATE_CONTENT_HANDLER_CREATE_PROC>(GetExtensionSymbol(
         libHandle, "CreateUpdateContentHandlerExtension")); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
 
     if (createUpdateContentHandlerExtension == nullptr)
@@ -257,6 +445,7 @@ ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateTyp
         goto done;
     }
 
+create:
     try
     {
         *handler = createUpdateContentHandlerExtension(ADUC_Logging_GetLevel());
@@ -291,14 +480,13 @@ done:
         }
     }
 
-    STRING_delete(folderName);
-    STRING_delete(path);
-
     return result;
 }
 
 void ExtensionManager::UnloadAllUpdateContentHandlers()
 {
+    std::lock_guard<std::mutex> lock(s_loadMutex);
+
     for (auto& contentHandler : _contentHandlers)
     {
         delete (contentHandler.second); // NOLINT(cppcoreguidelines-owning-memory)
@@ -316,6 +504,8 @@ void ExtensionManager::UnloadAllExtensions()
     // Make sure we unload every handlers first.
     UnloadAllUpdateContentHandlers();
 
+    std::lock_guard<std::mutex> lock(s_loadMutex);
+
     for (auto& lib : _libs)
     {
         dlclose(lib.second);
@@ -326,13 +516,180 @@ void ExtensionManager::UnloadAllExtensions()
 
 void ExtensionManager::Uninit()
 {
+    s_preloadCancelled = true;
+    if (s_preloadThread.joinable())
+    {
+        s_preloadThread.join();
+    }
+
     ExtensionManager::UnloadAllExtensions();
 }
 
+void ExtensionManager::SetStaticExtensions(const ADUC::StaticExtensions* extensions)
+{
+    std::lock_guard<std::mutex> lock(s_loadMutex);
+    s_staticExtensions = extensions;
+}
+
+void ExtensionManager::StartPreloading(unsigned int concurrency)
+{
+    if (concurrency == 0 || s_preloadThread.joinable())
+    {
+        return;
+    }
+
+    s_preloadCancelled = false;
+
+    try
+    {
+        s_preloadThread = std::thread(PreloadExtensions, concurrency);
+    }
+    catch (const std::system_error& ex)
+    {
+        // Extensions are still loaded on first use.
+        Log_Warn("Cannot start preloading extensions: %s", ex.what());
+    }
+}
+
+/**
+ * @brief Verifies and loads all the registered extensions, @p concurrency at a time.
+ * @param concurrency Number of worker threads.
+ */
+void ExtensionManager::PreloadExtensions(unsigned int concurrency)
+{
+    const auto start = std::chrono::steady_clock::now();
+    ADUC::ExtensionRegistry& registry = ADUC::ExtensionRegistry::GetInstance();
+
+    // Each extension, with the name it's cached under.
+    std::vector<std::pair<std::shared_ptr<const ADUC::ExtensionRegistration>, std::string>> extensions;
+
+    for (auto& registration : registry.GetUpdateContentHandlers())
+    {
+        if (IsStaticallyLinked(*registration))
+        {
+            continue;
+        }
+
+        if (registration->HandlerId.empty())
+        {
+            Log_Debug("Not preloading %s, it was registered without an update type.", registration->FilePath.c_str());
+            continue;
+        }
+
+        const std::string handlerId = registration->HandlerId;
+        extensions.emplace_back(std::move(registration), handlerId);
+    }
+
+    auto contentDownloader = registry.FindContentDownloader();
+    if (contentDownloader != nullptr && !IsStaticallyLinked(*contentDownloader))
+    {
+        extensions.emplace_back(std::move(contentDownloader), "Content Downloader");
+    }
+
+    auto componentEnumerator = registry.FindComponentEnumerator();
+    if (componentEnumerator != nullptr && !IsStaticallyLinked(*componentEnumerator))
+    {
+        extensions.emplace_back(std::move(componentEnumerator), "Component Enumerator");
+    }
+
+    // Handlers linked into the agent need no verification, and are quick to create.
+    for (size_t i = 0; s_staticExtensions != nullptr && i < s_staticExtensions->ContentHandlerCount; ++i)
+    {
+        ContentHandler* handler = nullptr;
+        (void)LoadUpdateContentHandlerExtension(s_staticExtensions->ContentHandlers[i].UpdateType, &handler);
+    }
+
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&extensions, &next]() {
+        for (size_t i = next++; i < extensions.size() && !s_preloadCancelled; i = next++)
+        {
+            PreloadExtension(*extensions[i].first, extensions[i].second);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    try
+    {
+        for (size_t i = 1; i < std::min<size_t>(concurrency, extensions.size()); ++i)
+        {
+            workers.emplace_back(worker);
+        }
+    }
+    catch (const std::system_error& ex)
+    {
+        Log_Warn("Preloading extensions with fewer threads: %s", ex.what());
+    }
+
+    // This thread is a worker too.
+    worker();
+
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    Log_Info(
+        "Preloaded %zu extension(s) in %lld ms.",
+        extensions.size(),
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()));
+}
+
+/**
+ * @brief Verifies and loads the extension of @p registration, and logs how long it took.
+ * @param registration The extension.
+ * @param name The name of the extension: its update type for an update content handler.
+ */
+void ExtensionManager::PreloadExtension(const ADUC::ExtensionRegistration& registration, const std::string& name)
+{
+    const auto start = std::chrono::steady_clock::now();
+    ADUC_Result result = { ADUC_GeneralResult_Failure };
+    ContentHandler* contentHandler = nullptr;
+    void* extensionLib = nullptr;
+
+    // Loading holds s_loadMutex, so hash the file first, concurrently with the other extensions; the load then
+    // finds its digest in the digest cache.
+    if (ADUC::ExtensionRegistry::VerifyFile(registration))
+    {
+        switch (registration.Kind)
+        {
+        case ADUC::ExtensionKind::UpdateContentHandler:
+            result = LoadUpdateContentHandlerExtension(name, &contentHandler);
+            break;
+
+        case ADUC::ExtensionKind::ContentDownloader:
+            result = LoadContentDownloaderLibrary(&extensionLib);
+            break;
+
+        case ADUC::ExtensionKind::ComponentEnumerator:
+            result = LoadComponentEnumeratorLibrary(&extensionLib);
+            break;
+        }
+    }
+
+    const long long elapsedMs = static_cast<long long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if (IsAducResultCodeSuccess(result.ResultCode))
+    {
+        Log_Info("Preloaded extension '%s' (%s) in %lld ms.", name.c_str(), registration.FilePath.c_str(), elapsedMs);
+    }
+    else
+    {
+        // The deployment that needs the extension reports the failure.
+        Log_Warn(
+            "Cannot preload extension '%s' (%s), extended result code: 0x%08x, %lld ms.",
+            name.c_str(),
+            registration.FilePath.c_str(),
+            result.ExtendedResultCode,
+            elapsedMs);
+    }
+}
+
 ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloaderLibrary)
 {
+    std::lock_guard<std::mutex> lock(s_loadMutex);
     ADUC_Result result = { ADUC_Result_Failure };
-    static const char* functionNames[] = { "Download", "Initialize" };
     void* extensionLib = nullptr;
 
     if (_contentDownloader != nullptr)
@@ -342,12 +699,21 @@ ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloa
         goto done;
     }
 
+    // A content downloader linked into the agent is never unloaded; its handle is its static table entry.
+    if (s_staticExtensions != nullptr && s_staticExtensions->ContentDownloader != nullptr)
+    {
+        Log_Info("Using content downloader '%s' linked into the agent.", s_staticExtensions->ContentDownloader->Name);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        *contentDownloaderLibrary = _contentDownloader =
+            const_cast<ADUC::StaticContentDownloader*>(s_staticExtensions->ContentDownloader);
+        result = { ADUC_GeneralResult_Success };
+        goto done;
+    }
+
+    // LoadExtensionLibrary checks that the library exports "Download" and "Initialize".
     result = LoadExtensionLibrary(
         "Content Downloader",
-        ADUC_EXTENSIONS_FOLDER,
-        ADUC_EXTENSIONS_SUBDIR_CONTENT_DOWNLOADER,
-        ADUC_EXTENSION_REG_FILENAME,
-        functionNames[0],
+        ADUC::ExtensionRegistry::GetInstance().FindContentDownloader().get(),
         ADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER,
         0,
         &extensionLib);
@@ -357,20 +723,6 @@ ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloa
         goto done;
     }
 
-    for (auto& functionName : functionNames)
-    {
-        dlerror(); // Clear any existing error
-        void* downloadFunc = dlsym(extensionLib, functionName);
-
-        if (downloadFunc == nullptr)
-        {
-            Log_Error("The specified function ('%s') doesn't exist. %s\n", functionName, dlerror());
-            result = { .ResultCode = ADUC_GeneralResult_Failure,
-                       .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CREATE_FAILURE_NO_SYMBOL };
-            goto done;
-        }
-    }
-
     *contentDownloaderLibrary = _contentDownloader = extensionLib;
 
     result = { ADUC_Result_Success };
@@ -381,10 +733,9 @@ done:
 
 ADUC_Result ExtensionManager::LoadComponentEnumeratorLibrary(void** componentEnumerator)
 {
+    std::lock_guard<std::mutex> lock(s_loadMutex);
     ADUC_Result result = { ADUC_Result_Failure };
-    void* mainFunc = nullptr;
     void* extensionLib = nullptr;
-    const char* requiredFunction = "GetAllComponents";
 
     if (_componentEnumerator != nullptr)
     {
@@ -393,12 +744,21 @@ ADUC_Result ExtensionManager::LoadComponentEnumeratorLibrary(void** componentEnu
         goto done;
     }
 
+    if (s_staticExtensions != nullptr && s_staticExtensions->ComponentEnumerator != nullptr)
+    {
+        Log_Info(
+            "Using component enumerator '%s' linked into the agent.", s_staticExtensions->ComponentEnumerator->Name);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        *componentEnumerator = _componentEnumerator =
+            const_cast<ADUC::StaticComponentEnumerator*>(s_staticExtensions->ComponentEnumerator);
+        result = { ADUC_GeneralResult_Success };
+        goto done;
+    }
+
+    // LoadExtensionLibrary checks that the library exports "GetAllComponents".
     result = LoadExtensionLibrary(
         "Component Enumerator",
-        ADUC_EXTENSIONS_FOLDER,
-        ADUC_EXTENSIONS_SUBDIR_COMPONENT_ENUMERATOR,
-        ADUC_EXTENSION_REG_FILENAME,
-        requiredFunction,
+        ADUC::ExtensionRegistry::GetInstance().FindComponentEnumerator().get(),
         ADUC_FACILITY_EXTENSION_COMPONENT_ENUMERATOR,
         0,
         &extensionLib);
@@ -408,23 +768,6 @@ ADUC_Result ExtensionManager::LoadComponentEnumeratorLibrary(void** componentEnu
         goto done;
     }
 
-    dlerror(); // Clear any existing error
-    try
-    {
-        mainFunc = dlsym(extensionLib, requiredFunction);
-    }
-    catch (...)
-    {
-    }
-
-    if (mainFunc == nullptr)
-    {
-        Log_Error("The specified function ('%s') doesn't exist. %s\n", requiredFunction, dlerror());
-        result = { .ResultCode = ADUC_GeneralResult_Failure,
-                   .ExtendedResultCode = ADUC_ERC_UPDATE_CONTENT_HANDLER_CREATE_FAILURE_NO_SYMBOL };
-        goto done;
-    }
-
     *componentEnumerator = _componentEnumerator = extensionLib;
 
     result = { ADUC_Result_Success };
@@ -446,7 +789,7 @@ void ExtensionManager::_FreeComponentsDataString(char* componentsJson)
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
     freeComponentsDataStringProc =
-        reinterpret_cast<FreeComponentsDataStringProc>(dlsym(lib, "FreeComponentsDataString"));
+        reinterpret_cast<FreeComponentsDataStringProc>(GetExtensionSymbol(lib, "FreeComponentsDataString"));
 
     if (freeComponentsDataStringProc == nullptr)
     {
@@ -495,7 +838,7 @@ ADUC_Result ExtensionManager::GetAllComponents(std::string& outputComponentsData
     }
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    _getAllComponents = reinterpret_cast<GetAllComponentsProc>(dlsym(lib, "GetAllComponents"));
+    _getAllComponents = reinterpret_cast<GetAllComponentsProc>(GetExtensionSymbol(lib, "GetAllComponents"));
     if (_getAllComponents == nullptr)
     {
         result = { .ResultCode = ADUC_Result_Failure,
@@ -527,26 +870,121 @@ done:
 }
 
 /**
- * @brief Returns all components information in JSON format.
+ * @brief Frees a ComponentIndex attached to a workflow.
+ */
+static void FreeComponentIndex(void* index)
+{
+    delete static_cast<ComponentIndex*>(index);
+}
+
+/**
+ * @brief Gets whether the component enumerator @p lib selects components by string equality, and so may be
+ * answered from a ComponentIndex. See SelectsComponentsByStringEqualityProc.
+ */
+static bool SelectsComponentsByStringEquality(void* lib)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto selectsByStringEquality = reinterpret_cast<SelectsComponentsByStringEqualityProc>(
+        GetExtensionSymbol(lib, "SelectsComponentsByStringEquality"));
+    if (selectsByStringEquality == nullptr)
+    {
+        return false;
+    }
+
+    try
+    {
+        return selectsByStringEquality();
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief Selects the components matching @p selector from the component index of @p workflowHandle. The index is
+ * built from GetAllComponents on first use.
+ * @return bool False if the components can't be indexed, or @p selector isn't a JSON object.
+ */
+static bool SelectIndexedComponents(
+    const std::string& selector, std::string& outputComponentsData, ADUC_WorkflowHandle workflowHandle)
+{
+    std::lock_guard<std::mutex> lock(s_componentIndexMutex);
+
+    const ComponentIndex* index = static_cast<const ComponentIndex*>(workflow_peek_component_index(workflowHandle));
+    if (index == nullptr)
+    {
+        std::string components;
+        ADUC_Result result = ExtensionManager::GetAllComponents(components);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            return false;
+        }
+
+        std::unique_ptr<ComponentIndex> newIndex = ComponentIndex::Create(components.c_str());
+        if (newIndex == nullptr)
+        {
+            Log_Warn("Cannot index the components returned by GetAllComponents.");
+            return false;
+        }
+
+        Log_Info("Indexed %zu components for the workflow.", newIndex->GetComponentCount());
+        workflow_set_component_index(workflowHandle, newIndex.release(), FreeComponentIndex);
+
+        index = static_cast<const ComponentIndex*>(workflow_peek_component_index(workflowHandle));
+        if (index == nullptr)
+        {
+            return false;
+        }
+    }
+
+    return index->Select(selector.c_str(), outputComponentsData);
+}
+
+/**
+ * @brief Selects component(s) matching specified @p selector.
  * @param selector A JSON string contains name-value pairs used for selecting components.
  * @param[out] outputComponentsData An output string containing components data.
+ * @param workflowHandle The workflow selecting the components, or nullptr.
  */
-ADUC_Result ExtensionManager::SelectComponents(const std::string& selector, std::string& outputComponentsData)
+ADUC_Result ExtensionManager::SelectComponents(
+    const std::string& selector, std::string& outputComponentsData, ADUC_WorkflowHandle workflowHandle)
 {
     void* lib = nullptr;
     SelectComponentsProc _selectComponents = nullptr;
     char* components = nullptr;
+    ADUC_Result result = { ADUC_Result_Failure };
 
     outputComponentsData = "";
 
-    ADUC_Result result = ExtensionManager::LoadComponentEnumeratorLibrary(&lib);
+    result = ExtensionManager::LoadComponentEnumeratorLibrary(&lib);
     if (IsAducResultCodeFailure(result.ResultCode))
     {
         goto done;
     }
 
+    // Only an enumerator that opts in is answered from the component index of the workflow.
+    if (workflowHandle != nullptr && SelectsComponentsByStringEquality(lib))
+    {
+        try
+        {
+            if (SelectIndexedComponents(selector, outputComponentsData, workflowHandle))
+            {
+                result = { ADUC_GeneralResult_Success };
+                goto done;
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            Log_Warn("Cannot select indexed components: %s", ex.what());
+        }
+
+        Log_Info("Selecting components with the component enumerator.");
+        outputComponentsData = "";
+    }
+
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    _selectComponents = reinterpret_cast<SelectComponentsProc>(dlsym(lib, "SelectComponents"));
+    _selectComponents = reinterpret_cast<SelectComponentsProc>(GetExtensionSymbol(lib, "SelectComponents"));
     if (_selectComponents == nullptr)
     {
         result = { .ResultCode = ADUC_Result_Failure,
@@ -575,10 +1013,82 @@ done:
     return result;
 }
 
+ADUC_Result ExtensionManager::GetComponentsChangedFd(int* fd)
+{
+    void* lib = nullptr;
+    GetComponentsChangedFdProc getComponentsChangedFd = nullptr;
+
+    *fd = -1;
+
+    ADUC_Result result = ExtensionManager::LoadComponentEnumeratorLibrary(&lib);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    result = { ADUC_GeneralResult_Success };
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    getComponentsChangedFd =
+        reinterpret_cast<GetComponentsChangedFdProc>(GetExtensionSymbol(lib, "GetComponentsChangedFd"));
+    if (getComponentsChangedFd == nullptr)
+    {
+        goto done;
+    }
+
+    if (GetExtensionSymbol(lib, "AcknowledgeComponentsChanged") == nullptr)
+    {
+        Log_Warn("Component enumerator exports GetComponentsChangedFd without AcknowledgeComponentsChanged.");
+        goto done;
+    }
+
+    try
+    {
+        *fd = getComponentsChangedFd();
+    }
+    catch (...)
+    {
+        *fd = -1;
+    }
+
+done:
+    return result;
+}
+
+void ExtensionManager::AcknowledgeComponentsChanged()
+{
+    void* lib = nullptr;
+    AcknowledgeComponentsChangedProc acknowledgeComponentsChanged = nullptr;
+
+    ADUC_Result result = ExtensionManager::LoadComponentEnumeratorLibrary(&lib);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        return;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    acknowledgeComponentsChanged =
+        reinterpret_cast<AcknowledgeComponentsChangedProc>(GetExtensionSymbol(lib, "AcknowledgeComponentsChanged"));
+    if (acknowledgeComponentsChanged == nullptr)
+    {
+        return;
+    }
+
+    try
+    {
+        acknowledgeComponentsChanged();
+    }
+    catch (...)
+    {
+        Log_Warn("Component enumerator threw while acknowledging a components change.");
+    }
+}
+
 ADUC_Result ExtensionManager::InitializeContentDownloader(const char* initializeData)
 {
     void* lib = nullptr;
     InitializeProc _initialize = nullptr;
+    SetDownloadRateCallbackProc setDownloadRateCallback = nullptr;
     char* components = nullptr;
 
     ADUC_Result result = ExtensionManager::LoadContentDownloaderLibrary(&lib);
@@ -588,7 +1098,7 @@ ADUC_Result ExtensionManager::InitializeContentDownloader(const char* initialize
     }
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    _initialize = reinterpret_cast<InitializeProc>(dlsym(lib, "Initialize"));
+    _initialize = reinterpret_cast<InitializeProc>(GetExtensionSymbol(lib, "Initialize"));
     if (_initialize == nullptr)
     {
         result = { .ResultCode = ADUC_Result_Failure,
@@ -607,6 +1117,200 @@ ADUC_Result ExtensionManager::InitializeContentDownloader(const char* initialize
         goto done;
     }
 
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    setDownloadRateCallback =
+        reinterpret_cast<SetDownloadRateCallbackProc>(GetExtensionSymbol(lib, "SetDownloadRateCallback"));
+    if (setDownloadRateCallback != nullptr)
+    {
+        setDownloadRateCallback(s_downloadRateCallback);
+    }
+
+done:
+    return result;
+}
+
+void ExtensionManager::SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    s_downloadRateCallback = rateCallback;
+}
+
+ADUC_Result ExtensionManager::CancelDownload(const char* workflowId)
+{
+    void* lib = nullptr;
+    CancelDownloadProc cancelProc = nullptr;
+    bool cancelled = false;
+
+    ADUC_Result result = ExtensionManager::LoadContentDownloaderLibrary(&lib);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    cancelProc = reinterpret_cast<CancelDownloadProc>(GetExtensionSymbol(lib, "Cancel"));
+    if (cancelProc == nullptr)
+    {
+        Log_Info("Content downloader does not support cancel.");
+        result = { ADUC_Result_Cancel_UnableToCancel };
+        goto done;
+    }
+
+    for (const std::string& id : GetDownloadsToCancel(workflowId))
+    {
+        try
+        {
+            result = cancelProc(id.c_str());
+        }
+        catch (...)
+        {
+            result = { ADUC_Result_Cancel_UnableToCancel };
+        }
+
+        if (result.ResultCode == ADUC_Result_Cancel_Success)
+        {
+            cancelled = true;
+        }
+    }
+
+    if (cancelled)
+    {
+        result = { ADUC_Result_Cancel_Success };
+    }
+
+done:
+    return result;
+}
+
+/**
+ * @brief Gets the sha256 hash of @p entity, which keys the payload cache.
+ * @return const char* The base64 hash, or nullptr if the entity has no sha256 hash.
+ */
+static const char* GetSha256HashValue(const ADUC_FileEntity* entity)
+{
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        const char* hashType = ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, i);
+        if (ADUC_HashUtils_GetShaVersionForTypeString(hashType, &algorithm) && algorithm == SHA256)
+        {
+            return ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, i);
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Checks whether the content downloader in @p lib decompresses files compressed with @p compression
+ * while it downloads them.
+ */
+static bool ContentDownloaderDecompresses(void* lib, ADUC_FileCompression compression)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto isCompressionSupportedProc =
+        reinterpret_cast<IsCompressionSupportedProc>(GetExtensionSymbol(lib, "IsCompressionSupported"));
+
+    try
+    {
+        return isCompressionSupportedProc != nullptr && isCompressionSupportedProc(compression);
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief Places the payload of @p entity at @p targetFile from the payload cache, and verifies it. The cache holds
+ * payloads as published, so a compressed payload is verified, then decompressed into @p targetFile.
+ * @return bool True if @p targetFile was created from a valid cache entry. On failure, @p targetFile doesn't exist.
+ */
+static bool FetchFromPayloadCache(const ADUC_FileEntity* entity, const char* sha256Hash, const std::string& targetFile)
+{
+    const bool compressed = (entity->Compression != ADUC_FileCompression_None);
+    const std::string fetchedFile = compressed ? targetFile + ".compressed" : targetFile;
+    bool success = false;
+
+    if (!ADUC_PayloadCache_Fetch(sha256Hash, fetchedFile.c_str()))
+    {
+        return false;
+    }
+
+    if (!ADUC_HashUtils_VerifyFileHashes(fetchedFile.c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */))
+    {
+        Log_Warn("Payload cache entry for %s is corrupt, downloading it.", entity->FileId);
+        ADUC_PayloadCache_Remove(sha256Hash);
+    }
+    else if (
+        compressed
+        && !ADUC_Decompression_DecompressFile(entity->Compression, fetchedFile.c_str(), targetFile.c_str()))
+    {
+        Log_Warn("Cannot decompress payload cache entry for %s, downloading it.", entity->FileId);
+        (void)remove(targetFile.c_str());
+    }
+    else
+    {
+        success = true;
+    }
+
+    if (compressed || !success)
+    {
+        (void)remove(fetchedFile.c_str());
+    }
+
+    return success;
+}
+
+/**
+ * @brief Has @p downloadProc download and verify the compressed content of @p entity next to the target file,
+ * then decompresses it into the target file. Used with content downloaders that can't decompress while
+ * downloading. The verified compressed content is added to the payload cache.
+ */
+static ADUC_Result DownloadAndDecompress(
+    DownloadProc downloadProc,
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const std::string& targetFile)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    std::string compressedFilename = std::string(entity->TargetFilename) + ".compressed";
+    const std::string compressedFile = std::string(workFolder) + "/" + compressedFilename;
+    const char* sha256Hash = GetSha256HashValue(entity);
+    ADUC_FileEntity compressedEntity = *entity;
+
+    if (!ADUC_Decompression_IsSupported(entity->Compression))
+    {
+        Log_Error("Compression %d of %s is not supported", entity->Compression, entity->TargetFilename);
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_COMPRESSION_NOT_SUPPORTED;
+        goto done;
+    }
+
+    compressedEntity.TargetFilename = &compressedFilename[0];
+    compressedEntity.Compression = ADUC_FileCompression_None;
+
+    result = downloadProc(&compressedEntity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    if (!ADUC_Decompression_DecompressFile(entity->Compression, compressedFile.c_str(), targetFile.c_str()))
+    {
+        Log_Error("Cannot decompress %s", compressedFile.c_str());
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DECOMPRESSION_FAILURE };
+    }
+    else if (sha256Hash != nullptr)
+    {
+        ADUC_PayloadCache_Store(sha256Hash, compressedFile.c_str());
+    }
+
+    (void)remove(compressedFile.c_str());
+
 done:
     return result;
 }
@@ -616,13 +1320,14 @@ ADUC_Result ExtensionManager::Download(
     const char* workflowId,
     const char* workFolder,
     unsigned int retryTimeout,
-    ADUC_DownloadProgressCallback downloadProgressCallback)
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_WorkflowHandle workflowHandle)
 {
     void* lib = nullptr;
     DownloadProc downloadProc = nullptr;
     char* components = nullptr;
     SHAversion algVersion;
-    bool isFileExistsAndValidHash = false;
+    const char* sha256Hash = nullptr;
 
     std::stringstream childManifestFile;
     ADUC_Result result;
@@ -646,7 +1351,7 @@ ADUC_Result ExtensionManager::Download(
     }
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    downloadProc = reinterpret_cast<DownloadProc>(dlsym(lib, "Download"));
+    downloadProc = reinterpret_cast<DownloadProc>(GetExtensionSymbol(lib, "Download"));
     if (downloadProc == nullptr)
     {
         result = { .ResultCode = ADUC_Result_Failure,
@@ -665,65 +1370,136 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
+    // A file verified earlier in the workflow, e.g. for another component, is still valid if it didn't change.
+    if (workflowHandle != nullptr
+        && workflow_is_file_verified(workflowHandle, childManifestFile.str().c_str(), entity->Hash, entity->HashCount))
+    {
+        result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+        goto done;
+    }
+
     // If file exists and has a valid hash, then skip download.
     // Otherwise, delete an existing file, then download.
+    // The hashes of a compressed file cover the compressed content, so its decompressed target is only trusted
+    // through the verified-file registry above.
     if (access(childManifestFile.str().c_str(), F_OK) == 0)
     {
-        // If target file exists, validate file hash.
-        // If file is valid, then skip the download.
-        isFileExistsAndValidHash = ADUC_HashUtils_IsValidFileHash(
-            childManifestFile.str().c_str(),
-            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-            algVersion);
-
-        if (!isFileExistsAndValidHash)
+        if (entity->Compression == ADUC_FileCompression_None
+            && ADUC_HashUtils_VerifyFileHashes(
+                childManifestFile.str().c_str(), entity->Hash, entity->HashCount, nullptr /* verdicts */))
         {
-            // Delete existing file.
-            if (remove(childManifestFile.str().c_str()) != 0)
+            workflow_set_file_verified(workflowHandle, childManifestFile.str().c_str(), entity->Hash, entity->HashCount);
+
+            sha256Hash = GetSha256HashValue(entity);
+            if (sha256Hash != nullptr)
             {
-                Log_Error("Cannot delete existing file that has invalid hash.");
-                result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
-                goto done;
+                ADUC_PayloadCache_Store(sha256Hash, childManifestFile.str().c_str());
             }
+
+            result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+            goto done;
+        }
+
+        // Delete existing file. Content downloaders resume from "<target>.partial", never from the target.
+        if (remove(childManifestFile.str().c_str()) != 0)
+        {
+            Log_Error("Cannot delete existing file that has invalid hash.");
+            result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
+            goto done;
         }
+    }
 
+    // A payload downloaded before, by this or an earlier workflow, is taken from the payload cache
+    // without network I/O.
+    sha256Hash = GetSha256HashValue(entity);
+    if (sha256Hash != nullptr && access(childManifestFile.str().c_str(), F_OK) != 0
+        && FetchFromPayloadCache(entity, sha256Hash, childManifestFile.str()))
+    {
+        workflow_set_file_verified(workflowHandle, childManifestFile.str().c_str(), entity->Hash, entity->HashCount);
         result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
         goto done;
     }
 
-    if (!isFileExistsAndValidHash)
+    try
     {
-        try
+        ActiveDownload activeDownload{ workflowId };
+
+        if (entity->Compression != ADUC_FileCompression_None
+            && !ContentDownloaderDecompresses(lib, entity->Compression))
         {
-            result = downloadProc(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
+            result = DownloadAndDecompress(
+                downloadProc,
+                entity,
+                workflowId,
+                workFolder,
+                retryTimeout,
+                downloadProgressCallback,
+                childManifestFile.str());
         }
-        catch (...)
+        else
         {
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DOWNLOAD_EXCEPTION };
-            goto done;
+            result = downloadProc(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
         }
+    }
+    catch (...)
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DOWNLOAD_EXCEPTION };
+        goto done;
+    }
 
-        if (IsAducResultCodeSuccess(result.ResultCode))
-        {
-            if (!ADUC_HashUtils_IsValidFileHash(
-                    childManifestFile.str().c_str(),
-                    ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-                    algVersion))
-            {
-                result = { .ResultCode = ADUC_Result_Failure,
-                           .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_DOWNLOAD_EXCEPTION };
-                goto done;
-            }
-        }
+    // A content downloader only reports success after it has verified the file hash,
+    // so there is no need to read the (possibly multi-GB) file again here.
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
     }
 
+    // The payload cache holds payloads as published; DownloadAndDecompress adds compressed ones, and those that were
+    // decompressed while they downloaded never were on disk.
+    if (sha256Hash != nullptr && entity->Compression == ADUC_FileCompression_None)
+    {
+        ADUC_PayloadCache_Store(sha256Hash, childManifestFile.str().c_str());
+    }
+
+    // For a compressed file, this records that the target was decompressed from verified content, so later checks
+    // in the workflow don't download it again.
+    workflow_set_file_verified(workflowHandle, childManifestFile.str().c_str(), entity->Hash, entity->HashCount);
+
     result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
 
 done:
     return result;
 }
 
+ADUC_Result ExtensionManager::DownloadBatch(
+    const std::vector<const ADUC_FileEntity*>& entities,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    std::vector<ADUC_Result>* results,
+    ADUC_WorkflowHandle workflowHandle)
+{
+    void* lib = nullptr;
+
+    // Load the content downloader once, before the workers start.
+    ADUC_Result result = ExtensionManager::LoadContentDownloaderLibrary(&lib);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        return result;
+    }
+
+    DownloadScheduler scheduler{ DownloadSchedulerOptions::FromConfig(),
+                                 [workflowId, workFolder, retryTimeout, workflowHandle](
+                                     const ADUC_FileEntity* entity, ADUC_DownloadProgressCallback progressCallback) {
+                                     return ExtensionManager::Download(
+                                         entity, workflowId, workFolder, retryTimeout, progressCallback, workflowHandle);
+                                 } };
+
+    return scheduler.Run(entities, workflowId, downloadProgressCallback, results);
+}
+
 EXTERN_C_BEGIN
 
 ADUC_Result ExtensionManager_InitializeContentDownloader(const char* initializeData)
@@ -731,6 +1507,11 @@ ADUC_Result ExtensionManager_InitializeContentDownloader(const char* initializeD
     return ExtensionManager::InitializeContentDownloader(initializeData);
 }
 
+void ExtensionManager_SetDownloadRateCallback(ADUC_DownloadRateCallback rateCallback)
+{
+    ExtensionManager::SetDownloadRateCallback(rateCallback);
+}
+
 ADUC_Result ExtensionManager_Download(
     const ADUC_FileEntity* entity,
     const char* workflowId,
@@ -741,6 +1522,11 @@ ADUC_Result ExtensionManager_Download(
     return ExtensionManager::Download(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
 }
 
+void ExtensionManager_StartPreloading(unsigned int concurrency)
+{
+    ExtensionManager::StartPreloading(concurrency);
+}
+
 /**
  * @brief Uninitializes the extension manager.
  */
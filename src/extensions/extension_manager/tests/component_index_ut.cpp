@@ -0,0 +1,147 @@
+/**
+ * @file component_index_ut.cpp
+ * @brief Unit tests for the ComponentIndex.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_index.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <string>
+
+// The inventory of the contoso virtual vacuum, see contoso-component-enumerator.
+static const char* const c_components = R"({
+    "components": [
+        {
+            "id": "0",
+            "name": "host-firmware",
+            "group": "firmware",
+            "manufacturer": "contoso",
+            "model": "virtual-firmware",
+            "properties": { "path": "/usr/local/contoso-devices/vacuum-1/firmware" }
+        },
+        {
+            "id": "1",
+            "name": "left-motor",
+            "group": "motors",
+            "manufacturer": "contoso",
+            "model": "virtual-motor"
+        },
+        {
+            "id": "2",
+            "name": "right-motor",
+            "group": "motors",
+            "manufacturer": "contoso",
+            "model": "virtual-motor",
+            "revision": 2
+        },
+        {
+            "id": "3",
+            "name": "vacuum-motor",
+            "group": "motors",
+            "manufacturer": "fabrikam",
+            "model": "virtual-vacuum-motor"
+        }
+    ]
+})";
+
+/**
+ * @brief Selects with @p selector and returns the names of the selected components, e.g. "left-motor,right-motor".
+ */
+static std::string SelectNames(const ComponentIndex& index, const char* selector)
+{
+    std::string output;
+    REQUIRE(index.Select(selector, output));
+
+    std::string names;
+    for (const char* name : { "host-firmware", "left-motor", "right-motor", "vacuum-motor" })
+    {
+        if (output.find(std::string(R"("name":")") + name + '"') != std::string::npos)
+        {
+            names += (names.empty() ? "" : ",") + std::string(name);
+        }
+    }
+
+    return names;
+}
+
+TEST_CASE("ComponentIndex selects components by property")
+{
+    std::unique_ptr<ComponentIndex> index = ComponentIndex::Create(c_components);
+    REQUIRE(index != nullptr);
+    CHECK(index->GetComponentCount() == 4);
+
+    SECTION("Select by group")
+    {
+        CHECK(SelectNames(*index, R"({ "group": "motors" })") == "left-motor,right-motor,vacuum-motor");
+        CHECK(SelectNames(*index, R"({ "group": "firmware" })") == "host-firmware");
+    }
+
+    SECTION("Select by name")
+    {
+        CHECK(SelectNames(*index, R"({ "name": "right-motor" })") == "right-motor");
+    }
+
+    SECTION("Select by manufacturer and model")
+    {
+        CHECK(
+            SelectNames(*index, R"({ "manufacturer": "contoso", "model": "virtual-motor" })")
+            == "left-motor,right-motor");
+        CHECK(SelectNames(*index, R"({ "manufacturer": "fabrikam", "group": "motors" })") == "vacuum-motor");
+    }
+
+    SECTION("Every property must match")
+    {
+        CHECK(SelectNames(*index, R"({ "manufacturer": "fabrikam", "model": "virtual-motor" })").empty());
+        CHECK(SelectNames(*index, R"({ "group": "wheels" })").empty());
+        CHECK(SelectNames(*index, R"({ "color": "red" })").empty());
+    }
+
+    SECTION("Only string properties match")
+    {
+        CHECK(SelectNames(*index, R"({ "revision": 2 })").empty());
+        CHECK(SelectNames(*index, R"({ "revision": "2" })").empty());
+        CHECK(SelectNames(*index, R"({ "group": "" })").empty());
+        CHECK(SelectNames(*index, R"({ "path": "/usr/local/contoso-devices/vacuum-1/firmware" })").empty());
+    }
+
+    SECTION("An empty selector selects all components")
+    {
+        CHECK(SelectNames(*index, "{}") == "host-firmware,left-motor,right-motor,vacuum-motor");
+    }
+
+    SECTION("Selected components are returned as enumerated")
+    {
+        std::string output;
+        REQUIRE(index->Select(R"({ "name": "left-motor" })", output));
+        CHECK(
+            output
+            == R"({"components":[{"id":"1","name":"left-motor","group":"motors","manufacturer":"contoso","model":"virtual-motor"}]})");
+    }
+
+    SECTION("Invalid selectors are rejected")
+    {
+        std::string output = "previous";
+        CHECK_FALSE(index->Select("not json", output));
+        CHECK(output.empty());
+        CHECK_FALSE(index->Select(R"([ "group", "motors" ])", output));
+        CHECK_FALSE(index->Select(nullptr, output));
+    }
+}
+
+TEST_CASE("ComponentIndex rejects invalid components data")
+{
+    CHECK(ComponentIndex::Create(nullptr) == nullptr);
+    CHECK(ComponentIndex::Create("not json") == nullptr);
+    CHECK(ComponentIndex::Create(R"({ "devices": [] })") == nullptr);
+
+    std::unique_ptr<ComponentIndex> index = ComponentIndex::Create(R"({ "components": [] })");
+    REQUIRE(index != nullptr);
+
+    std::string output;
+    REQUIRE(index->Select(R"({ "group": "motors" })", output));
+    CHECK(output == R"({"components":[]})");
+}
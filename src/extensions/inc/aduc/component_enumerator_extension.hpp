@@ -134,6 +134,38 @@ typedef char* (*GetAllComponentsProc)();
  */
 typedef void (*FreeComponentsDataStringProc)(char* string);
 
+/**
+ * @brief Optional "GetComponentsChangedFd" export. Returns a file descriptor that becomes readable when the
+ * components may have changed, e.g. an inotify, udev monitor or netlink socket descriptor, so the agent re-reads the
+ * components within seconds of a hot-plug instead of polling GetAllComponents.
+ *
+ * The enumerator owns the descriptor; the agent only polls it, and calls AcknowledgeComponentsChanged when it is
+ * readable. Enumerators without this export, or that return -1, are polled.
+ *
+ * @return int The descriptor, or -1 if changes can't be notified.
+ */
+typedef int (*GetComponentsChangedFdProc)();
+
+/**
+ * @brief "AcknowledgeComponentsChanged" export, required with GetComponentsChangedFd. Consumes the pending
+ * notifications, so the descriptor is no longer readable until the components change again. The agent calls it
+ * before it re-reads the components, so a change made in between is notified again.
+ */
+typedef void (*AcknowledgeComponentsChangedProc)();
+
+/**
+ * @brief Optional "SelectsComponentsByStringEquality" export. Returns true if SelectComponents selects exactly the
+ * components of GetAllComponents that have every name-value pair of the selector as a top-level string property,
+ * in their enumeration order.
+ *
+ * Such selections don't depend on the enumerator, so the agent answers them from an index of GetAllComponents,
+ * built once per deployment, instead of calling SelectComponents for every step. Enumerators without this export,
+ * or that return false, are always asked through SelectComponents.
+ *
+ * @return bool True if the agent may select the components itself.
+ */
+typedef bool (*SelectsComponentsByStringEqualityProc)();
+
 } // extern "c"
 
 #endif // _COMPONENT_ENUMERATOR_EXTENSION_HPP_
@@ -14,8 +14,38 @@ extern "C" {
 
 typedef ADUC_Result (*InitializeProc)(const char* initializeData);
 
+/**
+ * @brief Downloads the file described by @p entity into @p workFolder.
+ *
+ * A successful result (ADUC_Result_Download_Success or ADUC_Result_Download_Skipped_FileExists) asserts that the
+ * content of the target file was verified against the first hash in @p entity. Callers rely on this and do not
+ * read the file again to re-verify it, so a downloader must hash the content itself, preferably while writing it.
+ */
 typedef ADUC_Result (*DownloadProc)(const ADUC_FileEntity* entity, const char* workflowId, const char* workFolder, unsigned int retryTimeout, ADUC_DownloadProgressCallback downloadProgressCallback);
 
+/**
+ * @brief Optional "Cancel" export. Aborts the downloads in progress for @p workflowId; each aborted DownloadProc call
+ * returns ADUC_Result_Failure_Cancelled.
+ *
+ * @return ADUC_Result_Cancel_Success if a download was aborted, otherwise ADUC_Result_Cancel_UnableToCancel.
+ */
+typedef ADUC_Result (*CancelDownloadProc)(const char* workflowId);
+
+/**
+ * @brief Optional "IsCompressionSupported" export. Returns true if DownloadProc decompresses files compressed
+ * with @p compression while it downloads them, verifying every hash against the compressed content.
+ *
+ * Otherwise, and for downloaders without this export, the extension manager has the compressed file downloaded
+ * and verified as is, and decompresses it afterwards.
+ */
+typedef bool (*IsCompressionSupportedProc)(ADUC_FileCompression compression);
+
+/**
+ * @brief Optional "SetDownloadRateCallback" export. Sets the callback that receives the transfer rate of each
+ * download before each of its progress reports. NULL stops the rate reports.
+ */
+typedef void (*SetDownloadRateCallbackProc)(ADUC_DownloadRateCallback rateCallback);
+
 }
 
 #endif // ADUC_CONTENT_DOWNLOADER_EXTENSION_HPP
@@ -148,6 +148,9 @@ typedef enum tagADUC_Content_Handler
     /*indicates errors from Script Update Handler. */
     ADUC_CONTENT_HANDLER_SCRIPT = 0x05,
 
+    /*indicates errors from Delta Update Handler. */
+    ADUC_CONTENT_HANDLER_DELTA = 0x06,
+
     /*indicates errors from Custom Update handlers. */
     ADUC_CONTENT_HANDLER_EXTERNAL = 0x20,
 } ADUC_Content_Handler;
@@ -166,6 +169,12 @@ typedef enum tagADUC_Content_Downloader
     /*indicates errors from Curl Downloader. */
     ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER = 0x03,
 
+    /*indicates errors from libcurl (in-process) Downloader. */
+    ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER = 0x04,
+
+    /*indicates errors from Cache Downloader. */
+    ADUC_CONTENT_DOWNLOADER_CACHE_DOWNLOADER = 0x05,
+
 } ADUC_Content_Downloader;
 
 typedef enum tagADUC_Component
@@ -305,6 +314,7 @@ MAKE_ADUC_UPDATE_CONTENT_HANDLER_EXTENDEDRESULTCODE(const ADUC_Content_Handler h
 #define ADUC_ERC_VALIDATION_FILE_HASH_IS_EMPTY MAKE_ADUC_VALIDATION_EXTENDEDRESULTCODE(1)
 #define ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED MAKE_ADUC_VALIDATION_EXTENDEDRESULTCODE(2)
 #define ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH MAKE_ADUC_VALIDATION_EXTENDEDRESULTCODE(3)
+#define ADUC_ERC_VALIDATION_FILE_CHUNK_HASH_INVALID_HASH MAKE_ADUC_VALIDATION_EXTENDEDRESULTCODE(4)
 
 //
 // Reserved extension common error codes (0-300)
@@ -458,6 +468,9 @@ static inline ADUC_Result_t MAKE_ADUC_STEPS_HANDLER_EXTENDEDRESULTCODE(const int
 #define ADUC_ERC_STEPS_HANDLER_DOWNLOAD_UNKNOWN_EXCEPTION_DOWNLOAD_CONTENT \
     MAKE_ADUC_STEPS_HANDLER_EXTENDEDRESULTCODE(0x102)
 
+#define ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_INSUFFICIENT_DISK_SPACE \
+    MAKE_ADUC_STEPS_HANDLER_EXTENDEDRESULTCODE(0x103)
+
 // Install related errors (0x200 - 0x2FF)
 #define ADUC_ERC_STEPS_HANDLER_INSTALL_FAILURES_UNKNOWNEXCEPTION MAKE_ADUC_STEPS_HANDLER_EXTENDEDRESULTCODE(0x200)
 
@@ -546,6 +559,55 @@ static inline ADUC_Result_t MAKE_ADUC_SCRIPT_HANDLER_EXTENDEDRESULTCODE(const in
 #define ADUC_ERC_SCRIPT_HANDLER_CHILD_PROCESS_FAILURE_EXITCODE(exitCode) \
     MAKE_ADUC_SCRIPT_HANDLER_EXTENDEDRESULTCODE((0x1000 + exitCode))
 
+//
+// Delta Update Handler errors.
+// (Begins with 0x306#####)
+//
+
+/**
+ * @brief Macros to convert Delta Handler results to extended result code values.
+ * Extended error codes begin with 0x306#####
+ */
+static inline ADUC_Result_t MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(const int32_t value)
+{
+    return MAKE_ADUC_CONTENT_HANDLER_EXTENDEDRESULTCODE(ADUC_CONTENT_HANDLER_DELTA, value);
+}
+
+// General errors. (0x30600000 - 0FF)
+#define ADUC_ERC_DELTA_HANDLER_MISSING_SOURCEPATH_PROPERTY MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(1)
+
+#define ADUC_ERC_DELTA_HANDLER_MISSING_TARGETFILENAME_PROPERTY MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(2)
+
+#define ADUC_ERC_DELTA_HANDLER_MISSING_TARGETHASH_PROPERTY MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(3)
+
+#define ADUC_ERC_DELTA_HANDLER_UNSUPPORTED_TARGETHASH_ALGORITHM MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(4)
+
+#define ADUC_ERC_DELTA_HANDLER_INVALID_SOURCESIZE_PROPERTY MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(5)
+
+// Download errors. (0x30600100 - 1FF)
+#define ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_WRONG_UPDATE_VERSION MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x101)
+
+#define ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_WRONG_FILECOUNT MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x102)
+
+#define ADUC_ERC_DELTA_HANDLER_DOWNLOAD_FAILURE_BAD_FILE_ENTITY MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x103)
+
+#define ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_SOURCE MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x104)
+
+#define ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_OPEN_PATCH MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x105)
+
+#define ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_CANNOT_WRITE_TARGET MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x106)
+
+#define ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_PATCH MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x107)
+
+#define ADUC_ERC_DELTA_HANDLER_PATCH_FAILURE_INVALID_TARGET_HASH MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x108)
+
+// Install errors. (0x30600200 - 2FF)
+#define ADUC_ERC_DELTA_HANDLER_INSTALL_FAILURE_MISSING_TARGET MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE(0x201)
+
+// Exit code from child process. (0x30601000 + exitCode)
+#define ADUC_ERC_DELTA_HANDLER_CHILD_PROCESS_FAILURE_EXITCODE(exitCode) \
+    MAKE_ADUC_DELTA_HANDLER_EXTENDEDRESULTCODE((0x1000 + exitCode))
+
 /**
  * @brief Macros to convert a Downloader Extension results to extended result code values.\n
  * The facility code for these errors is ADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER.
@@ -596,13 +658,45 @@ MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(const ADUC_Content_Downlo
 #define ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE \
     MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_COMMON, 10)
 
+#define ADUC_ERC_CONTENT_DOWNLOADER_COMPRESSION_NOT_SUPPORTED \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_COMMON, 11)
+
+#define ADUC_ERC_CONTENT_DOWNLOADER_DECOMPRESSION_FAILURE \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_COMMON, 12)
+
+#define ADUC_ERC_CONTENT_DOWNLOADER_INSUFFICIENT_DISK_SPACE \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_COMMON, 13)
+
 // Curl Downloader.
 #define ADUC_ERROR_CURL_DOWNLOADER_INVALID_FILE_HASH \
     MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER, 1)
 
+#define ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER, 2)
+
 #define ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) \
     MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER, (1000 + exitCode))
 
+// libcurl Downloader.
+#define ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER, 1)
+
+#define ADUC_ERROR_LIBCURL_DOWNLOADER_NOT_INITIALIZED \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER, 2)
+
+#define ADUC_ERROR_LIBCURL_DOWNLOADER_EXTERNAL_FAILURE(curlCode) \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER, (1000 + curlCode))
+
+// Cache Downloader.
+#define ADUC_ERROR_CACHE_DOWNLOADER_CANNOT_OPEN_OUTPUT_FILE \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CACHE_DOWNLOADER, 1)
+
+#define ADUC_ERROR_CACHE_DOWNLOADER_NOT_INITIALIZED \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CACHE_DOWNLOADER, 2)
+
+#define ADUC_ERROR_CACHE_DOWNLOADER_EXTERNAL_FAILURE(curlCode) \
+    MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_CACHE_DOWNLOADER, (1000 + curlCode))
+
 // Delivery Optimization Downloader.
 #define ADUC_ERROR_DELIVERY_OPTIMIZATION_DOWNLOADER_NOT_INITIALIZE \
     MAKE_ADUC_UPDATE_CONTENT_DOWNLOADER_EXTENDEDRESULTCODE(ADUC_CONTENT_DOWNLOADER_DELIVERY_OPTIMIZATION, 1)
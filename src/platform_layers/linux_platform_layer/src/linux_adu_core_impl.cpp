@@ -21,6 +21,7 @@
 
 #include <cstring>
 #include <grp.h> // for getgrnam
+#include <poll.h>
 #include <pwd.h> // for getpwnam
 #include <sys/stat.h>
 #include <unistd.h>
@@ -36,8 +37,10 @@ using ADUC::StringUtils::cstr_wrapper;
 #define UPDATE_MANIFEST_V4_DEFAULT_HANDLER "microsoft/update-manifest"
 #define COMPONENT_CHANGED_DETECTION_INTERVAL_SECONDS 600
 
-std::string LinuxPlatformLayer::g_componentsInfo;
+std::string LinuxPlatformLayer::g_componentsDigest;
 time_t LinuxPlatformLayer::g_lastComponentsCheckTime;
+int LinuxPlatformLayer::g_componentsChangedFd = -1;
+bool LinuxPlatformLayer::g_componentsChangedFdQueried = false;
 
 /**
  * @brief Factory method for LinuxPlatformLayer
@@ -238,7 +241,9 @@ void LinuxPlatformLayer::Cancel(const ADUC_WorkflowData* workflowData)
     Log_Info("Cancelling. workflowId: %s", workflowId);
 
     _IsCancellationRequested = true;
-    workflow_free_string(workflowId);
+
+    // Interrupt a download in progress on the worker thread, if the content downloader supports it.
+    (void)ExtensionManager::CancelDownload(workflowId);
 
     ContentHandler* contentHandler = GetContentTypeHandler(workflowData, &result);
     if (contentHandler == nullptr)
@@ -264,7 +269,7 @@ void LinuxPlatformLayer::Cancel(const ADUC_WorkflowData* workflowData)
     }
 
 done:
-    return;
+    workflow_free_string(workflowId);
 }
 
 /**
@@ -401,6 +406,72 @@ void LinuxPlatformLayer::RetryWorkflowDueToComponentChanged(ADUC_WorkflowData* c
     ADUC_Workflow_HandleComponentChanged(currentWorkflowData);
 }
 
+/**
+ * @brief Computes the SHA-256 digest of the components data, which is kept instead of the data itself.
+ * @return std::string The base64 digest, or an empty string on failure.
+ */
+static std::string GetComponentsDigest(const std::string& components)
+{
+    ADUC_HashUtils_DigestContext context;
+    std::string digest;
+
+    if (!ADUC_HashUtils_DigestInit(&context, SHA256))
+    {
+        return digest;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (!ADUC_HashUtils_DigestUpdate(&context, reinterpret_cast<const uint8_t*>(components.data()), components.size()))
+    {
+        ADUC_HashUtils_DigestUninit(&context);
+        return digest;
+    }
+
+    char* base64 = ADUC_HashUtils_DigestFinalBase64(&context);
+    if (base64 != nullptr)
+    {
+        digest = base64;
+        free(base64);
+    }
+
+    return digest;
+}
+
+void LinuxPlatformLayer::QueryComponentsChangedFd()
+{
+    int fd = -1;
+    g_componentsChangedFdQueried = true;
+
+    ADUC_Result result = ExtensionManager::GetComponentsChangedFd(&fd);
+    if (IsAducResultCodeSuccess(result.ResultCode) && fd >= 0)
+    {
+        Log_Info("The component enumerator notifies components changes.");
+        g_componentsChangedFd = fd;
+    }
+}
+
+bool LinuxPlatformLayer::IsComponentsChangeNotified()
+{
+    struct pollfd pollFd = {};
+    pollFd.fd = g_componentsChangedFd;
+    pollFd.events = POLLIN;
+
+    if (poll(&pollFd, 1, 0 /* timeout */) <= 0)
+    {
+        return false;
+    }
+
+    if ((pollFd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+    {
+        // Fall back to checking periodically.
+        Log_Warn("Component enumerator's change notification descriptor failed, revents: 0x%x", pollFd.revents);
+        g_componentsChangedFd = -1;
+        return false;
+    }
+
+    return (pollFd.revents & POLLIN) != 0;
+}
+
 /**
  * @brief Detect changes in components collection. 
  *        If new component is added, ensure that it has to latest available update installed.
@@ -413,41 +484,81 @@ void LinuxPlatformLayer::DetectAndHandleComponentsAvailabilityChangedEvent(ADUC_
     struct timeval tv;
     gettimeofday(&tv, NULL);
     time_t nowTime = tv.tv_sec;
+    bool checkComponents = false;
+    std::string components;
+    std::string digest;
+    ADUC_Result result;
 
-    if ((nowTime - g_lastComponentsCheckTime) > COMPONENT_CHANGED_DETECTION_INTERVAL_SECONDS)
+    if (!g_componentsChangedFdQueried)
     {
-        g_lastComponentsCheckTime = nowTime;
-        Log_Info("Check whether the components collection has changed...");
-        std::string components;
-        ADUC_Result result = ExtensionManager::GetAllComponents(components);
-        if (IsAducResultCodeFailure(result.ResultCode))
-        {
-            if (result.ExtendedResultCode == ADUC_ERC_COMPONENT_ENUMERATOR_GETALLCOMPONENTS_NOTIMP)
-            {
-                // No component enumerators, no op.
-                goto done;
-            }
+        QueryComponentsChangedFd();
 
-            Log_Error("Cannot get components information. erc: 0x%x", result.ExtendedResultCode);
-            goto done;
-        }
+        // Take the baseline now, so the first notified change is detected.
+        checkComponents = (g_componentsChangedFd >= 0);
+    }
+
+    if (g_componentsChangedFd >= 0)
+    {
+        checkComponents = IsComponentsChangeNotified() || checkComponents;
+    }
+    else if ((nowTime - g_lastComponentsCheckTime) > COMPONENT_CHANGED_DETECTION_INTERVAL_SECONDS)
+    {
+        checkComponents = true;
+
+        // A component enumerator may have been registered since.
+        g_componentsChangedFdQueried = false;
+    }
 
-        // If component has changed, re-process the latest deployment goal state.
-        if (g_componentsInfo.empty())
+    if (!checkComponents)
+    {
+        goto done;
+    }
+
+    g_lastComponentsCheckTime = nowTime;
+
+    if (g_componentsChangedFd >= 0)
+    {
+        // Before reading the components, so that a change made while they are read is notified again.
+        ExtensionManager::AcknowledgeComponentsChanged();
+    }
+
+    Log_Info("Check whether the components collection has changed...");
+    result = ExtensionManager::GetAllComponents(components);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        if (result.ExtendedResultCode == ADUC_ERC_COMPONENT_ENUMERATOR_GETALLCOMPONENTS_NOTIMP)
         {
-            // Save the baseline.
-            g_componentsInfo = components;
+            // No component enumerators, no op.
             goto done;
         }
 
-        if (g_componentsInfo != components)
-        {
-            // Something changed.
-            Log_Info("Components changed deltected");
-            g_componentsInfo = components;
+        Log_Error("Cannot get components information. erc: 0x%x", result.ExtendedResultCode);
+        goto done;
+    }
 
-            RetryWorkflowDueToComponentChanged((ADUC_WorkflowData*)workflowData);
-        }
+    // Only the digest of the components data is kept and compared.
+    digest = GetComponentsDigest(components);
+    if (digest.empty())
+    {
+        Log_Error("Cannot compute the digest of the components information.");
+        goto done;
+    }
+
+    // If component has changed, re-process the latest deployment goal state.
+    if (g_componentsDigest.empty())
+    {
+        // Save the baseline.
+        g_componentsDigest = digest;
+        goto done;
+    }
+
+    if (g_componentsDigest != digest)
+    {
+        // Something changed.
+        Log_Info("Components changed deltected");
+        g_componentsDigest = digest;
+
+        RetryWorkflowDueToComponentChanged((ADUC_WorkflowData*)workflowData);
     }
 
 done:
@@ -35,8 +35,10 @@ public:
     ADUC_Result SetUpdateActionCallbacks(ADUC_UpdateActionCallbacks* data);
 
 private:
-    static std::string g_componentsInfo;
+    static std::string g_componentsDigest; /**< The SHA-256 digest of the last components data. */
     static time_t g_lastComponentsCheckTime;
+    static int g_componentsChangedFd; /**< Readable when the components may have changed, or -1. */
+    static bool g_componentsChangedFdQueried;
 
     //
     // Static callbacks.
@@ -276,11 +278,25 @@ private:
     /**
      * @brief Detect changes in components collection. 
      *        If new component is added, ensure that it has to latest available update installed.
+     *
+     * Components are checked when the component enumerator notifies a change (see GetComponentsChangedFdProc),
+     * or periodically if it can't.
      * 
      * @param token Contains pointer to our class instance.
      * @param workflowData Current workflow data object, if any.
      */
     static void DetectAndHandleComponentsAvailabilityChangedEvent(ADUC_Token token, ADUC_WorkflowDataToken workflowData);
+
+    /**
+     * @brief Gets the change notification descriptor of the component enumerator, if it has one.
+     */
+    static void QueryComponentsChangedFd();
+
+    /**
+     * @brief Checks, without blocking, whether the component enumerator notified a components change.
+     * @return bool True if the components may have changed.
+     */
+    static bool IsComponentsChangeNotified();
     
     /**
      * @brief Implements DoWork callback.
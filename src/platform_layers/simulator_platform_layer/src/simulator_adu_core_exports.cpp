@@ -71,6 +71,15 @@ ADUC_Result ADUC_RegisterPlatformLayer(ADUC_UpdateActionCallbacks* data, unsigne
         };
         SimulationType simulationType = SimulationType::AllSuccessful;
 
+        // download_mode= argument.
+        const std::string downloadModeArgPrefix{ "download_mode=" };
+        const std::unordered_map<std::string, SimulationDownloadMode> downloadModeMap{
+            { "simulated", SimulationDownloadMode::Simulated },
+            { "buffered", SimulationDownloadMode::Buffered },
+            { "streaming", SimulationDownloadMode::Streaming },
+        };
+        SimulationDownloadMode downloadMode = SimulationDownloadMode::Simulated;
+
         const std::string manufacturerArgPrefix{ "deviceinfo_manufacturer=" };
         const std::string modelArgPrefix{ "deviceinfo_model=" };
         const std::string swVersionArgPrefix{ "deviceinfo_swversion=" };
@@ -124,10 +133,30 @@ ADUC_Result ADUC_RegisterPlatformLayer(ADUC_UpdateActionCallbacks* data, unsigne
 
                 Log_Info("[Args] Using simulation mode %s", value.c_str());
             }
+            else if (argument.substr(dashdash_cch, downloadModeArgPrefix.size()) == downloadModeArgPrefix)
+            {
+                const std::string value{ argument.substr(dashdash_cch + downloadModeArgPrefix.size()) };
+                if (value.empty())
+                {
+                    continue;
+                }
+
+                try
+                {
+                    downloadMode = downloadModeMap.at(value);
+                }
+                catch (std::out_of_range&)
+                {
+                    Log_Error("[Args] Invalid download mode %s", value.c_str());
+                    throw;
+                }
+
+                Log_Info("[Args] Using download mode %s", value.c_str());
+            }
         }
 
         std::unique_ptr<ADUC::SimulatorPlatformLayer> pImpl{ ADUC::SimulatorPlatformLayer::Create(
-            simulationType) };
+            simulationType, downloadMode) };
         ADUC_Result result{ pImpl->SetUpdateActionCallbacks(data) };
         // The platform layer object is now owned by the UpdateActionCallbacks object.
         pImpl.release();
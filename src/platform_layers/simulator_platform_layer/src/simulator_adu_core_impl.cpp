@@ -2,6 +2,7 @@
  * @file simulator_adu_core_impl.cpp
  * @brief Implements an ADUC "simulator" mode.
  *
+ * Update files are only reported as downloaded, unless a download mode that downloads them was selected.
  * Define DISABLE_REAL_DOWNLOADING to disable support for real downloads, e.g. to ease porting.
  *
  * @copyright Copyright (c) Microsoft Corporation.
@@ -16,6 +17,7 @@
 #include <cstring>
 #include <vector>
 
+#include "aduc/hash_utils.h"
 #include "aduc/logging.h"
 #include "aduc/string_utils.hpp"
 #include "aduc/workflow_data_utils.h"
@@ -25,18 +27,20 @@
 using ADUC::SimulatorPlatformLayer;
 
 std::unique_ptr<SimulatorPlatformLayer> SimulatorPlatformLayer::Create(
-    SimulationType type /*= SimulationType::AllSuccessful*/)
+    SimulationType type /*= SimulationType::AllSuccessful*/,
+    SimulationDownloadMode downloadMode /*= SimulationDownloadMode::Simulated*/)
 {
-    return std::unique_ptr<SimulatorPlatformLayer>{ new SimulatorPlatformLayer(type) };
+    return std::unique_ptr<SimulatorPlatformLayer>{ new SimulatorPlatformLayer(type, downloadMode) };
 }
 
 /**
  * @brief Construct a new Simulator Impl object
  *
  * @param type Simulation type to run.
+ * @param downloadMode How update files are downloaded.
  */
-SimulatorPlatformLayer::SimulatorPlatformLayer(SimulationType type) :
-    _simulationType(type), _cancellationRequested(false)
+SimulatorPlatformLayer::SimulatorPlatformLayer(SimulationType type, SimulationDownloadMode downloadMode) :
+    _simulationType(type), _downloadMode(downloadMode), _cancellationRequested(false)
 {
 }
 
@@ -121,6 +125,14 @@ ADUC_Result SimulatorPlatformLayer::Download(const ADUC_WorkflowData* workflowDa
         goto done;
     }
 
+#ifndef DISABLE_REAL_DOWNLOADING
+    if (GetDownloadMode() != SimulationDownloadMode::Simulated)
+    {
+        result = DownloadFiles(workflowData);
+        goto done;
+    }
+#endif
+
     // Simulation mode.
 
     workflowData->DownloadProgressCallback(
@@ -143,6 +155,87 @@ done:
     return result;
 }
 
+#ifndef DISABLE_REAL_DOWNLOADING
+/**
+ * @brief Gets the base64 SHA256 hash of @p entity, or nullptr if it has none.
+ */
+static const char* GetSha256HashValue(const ADUC_FileEntity* entity)
+{
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        const char* hashType = ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, i);
+        if (ADUC_HashUtils_GetShaVersionForTypeString(hashType, &algorithm) && algorithm == SHA256)
+        {
+            return ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, i);
+        }
+    }
+
+    return nullptr;
+}
+
+ADUC_Result SimulatorPlatformLayer::DownloadFiles(const ADUC_WorkflowData* workflowData)
+{
+    ADUC_Result result = { ADUC_Result_Download_Success };
+    ADUC_WorkflowHandle handle = workflowData->WorkflowHandle;
+    char* workflowId = workflow_get_id(handle);
+    char* workFolder = workflow_get_workfolder(handle);
+    const size_t fileCount = workflow_get_update_files_count(handle);
+
+    for (size_t i = 0; i < fileCount && IsAducResultCodeSuccess(result.ResultCode); ++i)
+    {
+        ADUC_FileEntity* entity = nullptr;
+        UHttpDownloaderResult downloadResult = DR_INVALID_ARG;
+        UHttpDownloaderReport report{};
+
+        if (!workflow_get_update_file(handle, i, &entity))
+        {
+            result = { ADUC_Result_Failure, ADUC_ERC_NOTRECOVERABLE };
+            break;
+        }
+
+        const char* sha256Hash = GetSha256HashValue(entity);
+        const std::string outputFile = std::string{ workFolder } + "/" + entity->TargetFilename;
+
+        if (sha256Hash == nullptr)
+        {
+            Log_Error("%s has no SHA256 hash", entity->TargetFilename);
+        }
+        else if (GetDownloadMode() == SimulationDownloadMode::Streaming)
+        {
+            downloadResult = DownloadFileStreaming(entity->DownloadUri, sha256Hash, outputFile.c_str(), 60, &report);
+        }
+        else
+        {
+            downloadResult = DownloadFile(entity->DownloadUri, sha256Hash, outputFile.c_str(), 60, &report);
+        }
+
+        if (downloadResult == DR_OK)
+        {
+            workflowData->DownloadProgressCallback(
+                workflowId,
+                entity->FileId,
+                ADUC_DownloadProgressState_Completed,
+                report.BytesReceived,
+                report.BytesReceived);
+        }
+        else
+        {
+            Log_Error("Download of %s failed, error %d", entity->DownloadUri, downloadResult);
+            workflowData->DownloadProgressCallback(workflowId, entity->FileId, ADUC_DownloadProgressState_Error, 0, 0);
+            result = { ADUC_Result_Failure, ADUC_ERC_NOTRECOVERABLE };
+        }
+
+        workflow_free_file_entity(entity);
+    }
+
+    workflow_free_string(workflowId);
+    workflow_free_string(workFolder);
+    return result;
+}
+#endif
+
 ADUC_Result SimulatorPlatformLayer::Install(const ADUC_WorkflowData* workflowData)
 {
     ADUC_Result result;
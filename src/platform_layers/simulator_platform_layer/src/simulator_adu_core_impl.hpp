@@ -32,6 +32,16 @@ enum class SimulationType
     AllSuccessful, /**< Simulate a successful run. */
 };
 
+/**
+ * @brief How the simulator downloads update files.
+ */
+enum class SimulationDownloadMode
+{
+    Simulated, /**< Report the files as downloaded without downloading them. */
+    Buffered, /**< Download the files with uHTTP, which holds each whole file in memory. */
+    Streaming, /**< Download the files with the streaming downloader, which writes them as they arrive. */
+};
+
 namespace ADUC
 {
 /**
@@ -40,8 +50,9 @@ namespace ADUC
 class SimulatorPlatformLayer
 {
 public:
-    static std::unique_ptr<SimulatorPlatformLayer>
-    Create(SimulationType type = SimulationType::AllSuccessful);
+    static std::unique_ptr<SimulatorPlatformLayer> Create(
+        SimulationType type = SimulationType::AllSuccessful,
+        SimulationDownloadMode downloadMode = SimulationDownloadMode::Simulated);
 
     // Delete copy ctor, copy assignment, move ctor and move assignment operators.
     SimulatorPlatformLayer(const SimulatorPlatformLayer&) = delete;
@@ -316,7 +327,7 @@ private:
     //
 
     // Private constructor, must use Create factory method to creat an object.
-    SimulatorPlatformLayer(SimulationType type);
+    SimulatorPlatformLayer(SimulationType type, SimulationDownloadMode downloadMode);
 
     /**
      * @brief Class implementation of Idle method.
@@ -329,6 +340,13 @@ private:
      */
     ADUC_Result Download(const ADUC_WorkflowData* workflowData);
 
+    /**
+     * @brief Downloads all update files of @p workflowData into its work folder, with the downloader of the
+     * download mode.
+     * @return ADUC_Result
+     */
+    ADUC_Result DownloadFiles(const ADUC_WorkflowData* workflowData);
+
     /**
      * @brief Class implementation of Install method.
      * @return ADUC_Result
@@ -378,6 +396,16 @@ private:
         return _simulationType;
     }
 
+    /**
+     * @brief Get the #SimulationDownloadMode object
+     *
+     * @return SimulationDownloadMode
+     */
+    SimulationDownloadMode GetDownloadMode() const
+    {
+        return _downloadMode;
+    }
+
     /**
      * @brief Determine if cancellation was requested.
      *
@@ -397,6 +425,11 @@ private:
      */
     SimulationType _simulationType;
 
+    /**
+     * @brief How update files are downloaded.
+     */
+    SimulationDownloadMode _downloadMode;
+
     /**
      * @brief Was Cancel called?
      */
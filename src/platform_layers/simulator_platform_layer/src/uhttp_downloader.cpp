@@ -7,6 +7,7 @@
  * Note that uHTTP is a rudimentary HTTP implementation and may not support production-level requirements.
  */
 #include "uhttp_downloader.h"
+#include "uhttp_response_parser.hpp"
 
 #include <azure_c_shared_utility/azure_base64.h>
 #include <azure_c_shared_utility/buffer_.h>
@@ -14,13 +15,125 @@
 #include <azure_c_shared_utility/sha.h>
 #include <azure_c_shared_utility/socketio.h>
 #include <azure_c_shared_utility/tlsio.h>
+#include <azure_c_shared_utility/xio.h>
 #include <azure_uhttp_c/uhttp.h>
 
+#include <algorithm> // for std::max
+#include <chrono>
+#include <cstdio> // for std::remove
+#include <cstring> // for strcmp
 #include <fstream>
 #include <string>
 
 #include <aduc/logging.h>
 
+using UHttpDownloaderClock = std::chrono::steady_clock;
+
+static UHttpDownloaderResult
+ParseUrl(const char* url, unsigned* port, std::string* hostName, std::string* relativePath)
+{
+    std::string temp{ url };
+    size_t scheme_cch;
+
+    if (temp.substr(0, 7) == "http://")
+    {
+        *port = 80;
+
+        scheme_cch = 7;
+    }
+    else if (temp.substr(0, 8) == "https://")
+    {
+        *port = 443;
+
+        scheme_cch = 8;
+    }
+    else
+    {
+        return DR_INVALID_ARG;
+    }
+
+    // NOTE: Assumes port isn't specified, e.g. "example.com:80"
+    const std::size_t start = temp.find('/', scheme_cch);
+    if (start == std::string::npos)
+    {
+        return DR_INVALID_ARG;
+    }
+
+    const std::size_t end = temp.find('/', start);
+    if (end == std::string::npos)
+    {
+        return DR_INVALID_ARG;
+    }
+
+    *hostName = temp.substr(scheme_cch, start - scheme_cch);
+    *relativePath = temp.substr(end);
+
+    return DR_OK;
+}
+
+/**
+ * @brief Finishes @p context and compares the result to @p base64Sha256Hash.
+ */
+static bool HashResultMatches(USHAContext* context, const std::string& base64Sha256Hash)
+{
+    bool hashMatches = false;
+
+    // "USHAHashSize(algorithm)" is more precise, but requires a variable length array, or heap allocation.
+    unsigned char buffer_hash[USHAMaxHashSize];
+
+    if (USHAResult(context, buffer_hash) == 0)
+    {
+        STRING_HANDLE encoded_file_hash = Azure_Base64_Encode_Bytes(buffer_hash, USHAHashSize(SHAversion::SHA256));
+        if (encoded_file_hash != nullptr)
+        {
+            hashMatches = (strcmp(base64Sha256Hash.c_str(), STRING_c_str(encoded_file_hash)) == 0);
+            STRING_delete(encoded_file_hash);
+        }
+    }
+
+    return hashMatches;
+}
+
+static unsigned long long ElapsedMs(UHttpDownloaderClock::time_point from, UHttpDownloaderClock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+}
+
+/**
+ * @brief Fills in and logs the throughput and latency of a download.
+ */
+static void ReportDownload(
+    const char* outputFile,
+    unsigned long long bytesReceived,
+    UHttpDownloaderClock::time_point start,
+    UHttpDownloaderClock::time_point firstByte,
+    unsigned long long peakBufferedBytes,
+    UHttpDownloaderReport* report)
+{
+    const UHttpDownloaderClock::time_point end = UHttpDownloaderClock::now();
+
+    UHttpDownloaderReport result{};
+    result.BytesReceived = bytesReceived;
+    result.TimeToFirstByteMs = (firstByte < start) ? 0 : ElapsedMs(start, firstByte);
+    result.TotalTimeMs = ElapsedMs(start, end);
+    result.BytesPerSecond = bytesReceived * 1000 / std::max(result.TotalTimeMs, 1ULL);
+    result.PeakBufferedBytes = peakBufferedBytes;
+
+    Log_Info(
+        "%s: %llu bytes in %llu ms (first byte after %llu ms), %llu bytes/s, peak buffered %llu bytes",
+        outputFile,
+        result.BytesReceived,
+        result.TotalTimeMs,
+        result.TimeToFirstByteMs,
+        result.BytesPerSecond,
+        result.PeakBufferedBytes);
+
+    if (report != nullptr)
+    {
+        *report = result;
+    }
+}
+
 class UHttpDownloader
 {
 public:
@@ -33,8 +146,12 @@ public:
     UHttpDownloader(UHttpDownloader&&) = delete;
     UHttpDownloader& operator=(UHttpDownloader&&) = delete;
 
-    UHttpDownloaderResult
-    Download(const char* url, const char* base64Sha256Hash, const char* outputFile, unsigned int timeoutSecs);
+    UHttpDownloaderResult Download(
+        const char* url,
+        const char* base64Sha256Hash,
+        const char* outputFile,
+        unsigned int timeoutSecs,
+        UHttpDownloaderReport* report);
 
     static UHttpDownloaderResult ResultFromHttpClientResult(HTTP_CLIENT_RESULT result);
 
@@ -50,82 +167,22 @@ private:
         unsigned int statusCode,
         HTTP_HEADERS_HANDLE /*responseHeadersHandle*/);
 
-    static UHttpDownloaderResult
-    ParseUrl(const char* url, unsigned* port, std::string* hostName, std::string* relativePath)
-    {
-        std::string temp{ url };
-        size_t scheme_cch;
-
-        if (temp.substr(0, 7) == "http://")
-        {
-            *port = 80;
-
-            scheme_cch = 7;
-        }
-        else if (temp.substr(0, 8) == "https://")
-        {
-            *port = 443;
-
-            scheme_cch = 8;
-        }
-        else
-        {
-            return DR_INVALID_ARG;
-        }
-
-        // NOTE: Assumes port isn't specified, e.g. "example.com:80"
-        const std::size_t start = temp.find('/', scheme_cch);
-        if (start == std::string::npos)
-        {
-            return DR_INVALID_ARG;
-        }
-
-        const std::size_t end = temp.find('/', start);
-        if (end == std::string::npos)
-        {
-            return DR_INVALID_ARG;
-        }
-
-        *hostName = temp.substr(scheme_cch, start - scheme_cch);
-        *relativePath = temp.substr(end);
-
-        return DR_OK;
-    }
-
     std::string m_base64Sha256Hash;
     std::string m_outputFile;
 
     bool m_keepRunning = false;
     UHttpDownloaderResult m_reason = DR_INVALID_STATE;
     unsigned int m_statusCode = 500;
+
+    unsigned long long m_bytesReceived = 0;
+    UHttpDownloaderClock::time_point m_firstByteTime;
 };
 
 bool UHttpDownloader::HashMatches(const unsigned char* content, size_t content_len)
 {
-    bool hashMatches = false;
-
-    const SHAversion algorithm = SHAversion::SHA256;
     USHAContext context;
-    if (USHAReset(&context, algorithm) == 0)
-    {
-        if (USHAInput(&context, content, content_len) == 0)
-        {
-            // "USHAHashSize(algorithm)" is more precise, but requires a variable length array, or heap allocation.
-            unsigned char buffer_hash[USHAMaxHashSize];
-
-            if (USHAResult(&context, buffer_hash) == 0)
-            {
-                STRING_HANDLE encoded_file_hash = Azure_Base64_Encode_Bytes(buffer_hash, USHAHashSize(algorithm));
-                if (encoded_file_hash != nullptr)
-                {
-                    hashMatches = (strcmp(m_base64Sha256Hash.c_str(), STRING_c_str(encoded_file_hash)) == 0);
-                    STRING_delete(encoded_file_hash);
-                }
-            }
-        }
-    }
-
-    return hashMatches;
+    return USHAReset(&context, SHAversion::SHA256) == 0 && USHAInput(&context, content, content_len) == 0
+        && HashResultMatches(&context, m_base64Sha256Hash);
 }
 
 void UHttpDownloader::OnRequestCallback(
@@ -157,6 +214,9 @@ void UHttpDownloader::OnRequestCallback(
     // We've got data!
     //
 
+    m_firstByteTime = UHttpDownloaderClock::now();
+    m_bytesReceived = content_len;
+
     // check the hash.
 
     if (!HashMatches(content, content_len))
@@ -187,7 +247,11 @@ void UHttpDownloader::OnRequestCallback(
 }
 
 UHttpDownloaderResult UHttpDownloader::Download(
-    const char* url, const char* base64Sha256Hash, const char* outputFile, unsigned int timeoutSecs)
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs,
+    UHttpDownloaderReport* report)
 {
     // RAII wrapper for HTTP_CLIENT_HANDLE
     class HttpClientHandle
@@ -323,6 +387,8 @@ UHttpDownloaderResult UHttpDownloader::Download(
     // Execute the GET request.
     //
 
+    const UHttpDownloaderClock::time_point start_request_clock = UHttpDownloaderClock::now();
+
     result = uhttp_client_execute_request(
         handle.Get(),
         HTTP_CLIENT_REQUEST_GET,
@@ -366,6 +432,12 @@ UHttpDownloaderResult UHttpDownloader::Download(
         return DR_TIMEOUT;
     }
 
+    if (m_reason == DR_OK)
+    {
+        // The whole body is held in memory by uHTTP.
+        ReportDownload(outputFile, m_bytesReceived, start_request_clock, m_firstByteTime, m_bytesReceived, report);
+    }
+
     return m_reason;
 }
 
@@ -431,10 +503,393 @@ UHttpDownloaderResult UHttpDownloader::ResultFromHttpCallbackReason(HTTP_CALLBAC
     return DR_CALLBACK_ERROR;
 }
 
-UHttpDownloaderResult
-DownloadFile(const char* url, const char* base64Sha256Hash, const char* outputFile, unsigned int timeoutSecs)
+/**
+ * @brief Downloads over a plain socket or TLS connection, handling each received block as it arrives.
+ *
+ * uHTTP only reports a response once the whole body was received, so this talks HTTP/1.1 over the
+ * azure_c_shared_utility IO layer directly: UHttpResponseParser parses the response incrementally, and the body is
+ * hashed and written to the output file one received block at a time.
+ */
+class UHttpStreamingDownloader
+{
+public:
+    UHttpStreamingDownloader() = default;
+    ~UHttpStreamingDownloader() = default;
+
+    UHttpStreamingDownloader(const UHttpStreamingDownloader&) = delete;
+    UHttpStreamingDownloader& operator=(const UHttpStreamingDownloader&) = delete;
+
+    UHttpStreamingDownloader(UHttpStreamingDownloader&&) = delete;
+    UHttpStreamingDownloader& operator=(UHttpStreamingDownloader&&) = delete;
+
+    UHttpDownloaderResult Download(
+        const char* url,
+        const char* base64Sha256Hash,
+        const char* outputFile,
+        unsigned int timeoutSecs,
+        UHttpDownloaderReport* report);
+
+private:
+    void OnOpenComplete(IO_OPEN_RESULT openResult);
+    void OnSendComplete(IO_SEND_RESULT sendResult);
+    void OnBytesReceived(const unsigned char* buffer, size_t size);
+    void OnIoError();
+
+    bool OnHeaders(unsigned int statusCode);
+    bool OnBody(const unsigned char* buffer, size_t size);
+    void Finish(UHttpDownloaderResult reason);
+
+    XIO_HANDLE m_xio = nullptr;
+    std::string m_request;
+    std::string m_base64Sha256Hash;
+    std::string m_outputFile;
+
+    std::ofstream m_file;
+    USHAContext m_shaContext = {};
+
+    UHttpResponseParser m_parser{
+        [](void* context, unsigned int statusCode) -> bool {
+            return static_cast<UHttpStreamingDownloader*>(context)->OnHeaders(statusCode);
+        },
+        [](void* context, const unsigned char* buffer, size_t size) -> bool {
+            return static_cast<UHttpStreamingDownloader*>(context)->OnBody(buffer, size);
+        },
+        this
+    };
+
+    bool m_keepRunning = false;
+    UHttpDownloaderResult m_reason = DR_INVALID_STATE;
+
+    unsigned long long m_bytesReceived = 0;
+    unsigned long long m_peakBufferedBytes = 0;
+    UHttpDownloaderClock::time_point m_firstByteTime;
+    UHttpDownloaderClock::time_point m_lastActivityTime; // Of the connection, for the inactivity timeout.
+};
+
+void UHttpStreamingDownloader::OnOpenComplete(IO_OPEN_RESULT openResult)
+{
+    m_lastActivityTime = UHttpDownloaderClock::now();
+
+    if (openResult != IO_OPEN_OK)
+    {
+        Log_Warn("xio_open callback failed, error %d", openResult);
+        Finish(DR_CALLBACK_OPEN_FAILED);
+        return;
+    }
+
+    if (xio_send(
+            m_xio,
+            m_request.data(),
+            m_request.size(),
+            [](void* context, IO_SEND_RESULT sendResult) -> void {
+                static_cast<UHttpStreamingDownloader*>(context)->OnSendComplete(sendResult);
+            },
+            this)
+        != 0)
+    {
+        Log_Warn("xio_send failed");
+        Finish(DR_SEND_FAILED);
+    }
+}
+
+void UHttpStreamingDownloader::OnSendComplete(IO_SEND_RESULT sendResult)
+{
+    m_lastActivityTime = UHttpDownloaderClock::now();
+
+    if (sendResult != IO_SEND_OK)
+    {
+        Log_Warn("xio_send callback failed, error %d", sendResult);
+        Finish(DR_CALLBACK_SEND_FAILED);
+    }
+}
+
+void UHttpStreamingDownloader::OnIoError()
+{
+    if (!m_keepRunning)
+    {
+        return;
+    }
+
+    if (m_parser.OnConnectionClosed())
+    {
+        Finish(DR_OK);
+        return;
+    }
+
+    Log_Warn("Connection lost while receiving %s", m_outputFile.c_str());
+    Finish(DR_CALLBACK_DISCONNECTED);
+}
+
+bool UHttpStreamingDownloader::OnHeaders(unsigned int statusCode)
+{
+    if (statusCode != 200)
+    {
+        Log_Warn("xio response failed, statuscode %u", statusCode);
+        Finish(DR_CALLBACK_ERROR);
+        return false;
+    }
+
+    m_file.open(m_outputFile, std::ios::binary | std::ios::trunc);
+    if (m_file.fail())
+    {
+        Log_Warn("unable to open %s", m_outputFile.c_str());
+        Finish(DR_FILE_ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+bool UHttpStreamingDownloader::OnBody(const unsigned char* buffer, size_t size)
+{
+    if (m_bytesReceived == 0)
+    {
+        m_firstByteTime = UHttpDownloaderClock::now();
+    }
+
+    m_bytesReceived += size;
+
+    if (USHAInput(&m_shaContext, buffer, static_cast<unsigned int>(size)) != 0)
+    {
+        Finish(DR_ERROR);
+        return false;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    m_file.write(reinterpret_cast<const char*>(buffer), static_cast<std::streamsize>(size));
+    if (m_file.fail())
+    {
+        Log_Warn("unable to write %s", m_outputFile.c_str());
+        Finish(DR_FILE_ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+void UHttpStreamingDownloader::OnBytesReceived(const unsigned char* buffer, size_t size)
+{
+    m_lastActivityTime = UHttpDownloaderClock::now();
+    m_peakBufferedBytes = std::max<unsigned long long>(m_peakBufferedBytes, size);
+
+    if (!m_keepRunning)
+    {
+        return;
+    }
+
+    // A callback that stopped the parser finished the download with its own reason already.
+    if (!m_parser.Parse(buffer, size))
+    {
+        Finish(DR_CALLBACK_PARSING_ERROR);
+    }
+    else if (m_parser.IsComplete())
+    {
+        Finish(DR_OK);
+    }
+}
+
+void UHttpStreamingDownloader::Finish(UHttpDownloaderResult reason)
+{
+    if (!m_keepRunning)
+    {
+        return;
+    }
+
+    m_keepRunning = false;
+    m_reason = reason;
+
+    if (!m_file.is_open())
+    {
+        return;
+    }
+
+    m_file.close();
+    if (m_reason == DR_OK && m_file.fail())
+    {
+        Log_Warn("unable to write %s", m_outputFile.c_str());
+        m_reason = DR_FILE_ERROR;
+    }
+
+    if (m_reason == DR_OK && !HashResultMatches(&m_shaContext, m_base64Sha256Hash))
+    {
+        Log_Warn("Invalid content hash");
+        m_reason = DR_CALLBACK_ERROR;
+    }
+
+    // Unlike the buffered downloader, the file was written before it could be verified.
+    if (m_reason != DR_OK)
+    {
+        (void)std::remove(m_outputFile.c_str());
+    }
+}
+
+UHttpDownloaderResult UHttpStreamingDownloader::Download(
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs,
+    UHttpDownloaderReport* report)
+{
+    // RAII wrapper for XIO_HANDLE
+    class XioHandle
+    {
+    public:
+        explicit XioHandle(XIO_HANDLE handle) : _handle(handle)
+        {
+        }
+        ~XioHandle()
+        {
+            if (_handle != nullptr)
+            {
+                (void)xio_close(_handle, nullptr, nullptr);
+                xio_destroy(_handle);
+            }
+        }
+
+        XioHandle(const XioHandle&) = delete;
+        XioHandle& operator=(const XioHandle&) = delete;
+
+        XioHandle(XioHandle&&) = delete;
+        XioHandle& operator=(XioHandle&&) = delete;
+
+        XIO_HANDLE Get() const
+        {
+            return _handle;
+        }
+
+    private:
+        XIO_HANDLE _handle;
+    };
+
+    unsigned int port;
+    std::string hostname;
+    std::string relativePath;
+
+    m_reason = ParseUrl(url, &port, &hostname, &relativePath);
+    if (m_reason != DR_OK)
+    {
+        Log_Warn("ParseUrl failed, error %u", m_reason);
+        return m_reason;
+    }
+
+    if (USHAReset(&m_shaContext, SHAversion::SHA256) != 0)
+    {
+        return DR_ERROR;
+    }
+
+    m_base64Sha256Hash = base64Sha256Hash;
+    m_outputFile = outputFile;
+    m_request = "GET " + relativePath + " HTTP/1.1\r\nHost: " + hostname + "\r\nConnection: close\r\n\r\n";
+
+    //
+    // Create HTTP or HTTPS IO.
+    //
+
+    const IO_INTERFACE_DESCRIPTION* io_interface_desc;
+    TLSIO_CONFIG tlsIoConfig = {}; // HTTPS
+    SOCKETIO_CONFIG socketIoConfig = {}; // HTTP
+    const void* xioParam; // points to either tlsIoConfig or socketIoConfig.
+
+    if (port != 80)
+    {
+        // HTTPS
+        tlsIoConfig.hostname = hostname.c_str();
+        tlsIoConfig.port = port;
+        xioParam = &tlsIoConfig;
+        io_interface_desc = platform_get_default_tlsio();
+    }
+    else
+    {
+        // HTTP
+        socketIoConfig.hostname = hostname.c_str();
+        socketIoConfig.port = port;
+        xioParam = &socketIoConfig;
+        io_interface_desc = socketio_get_interface_description();
+    }
+
+    XioHandle handle{ xio_create(io_interface_desc, xioParam) };
+    if (handle.Get() == nullptr)
+    {
+        Log_Warn("xio_create failed");
+        return DR_ERROR;
+    }
+
+    m_xio = handle.Get();
+    m_keepRunning = true;
+
+    //
+    // Open the connection. The request is sent once it is open.
+    //
+
+    const UHttpDownloaderClock::time_point start_request_clock = UHttpDownloaderClock::now();
+
+    if (xio_open(
+            handle.Get(),
+            [](void* context, IO_OPEN_RESULT openResult) -> void {
+                static_cast<UHttpStreamingDownloader*>(context)->OnOpenComplete(openResult);
+            },
+            this,
+            [](void* context, const unsigned char* buffer, size_t size) -> void {
+                static_cast<UHttpStreamingDownloader*>(context)->OnBytesReceived(buffer, size);
+            },
+            this,
+            [](void* context) -> void { static_cast<UHttpStreamingDownloader*>(context)->OnIoError(); },
+            this)
+        != 0)
+    {
+        Log_Warn("xio_open failed");
+        return DR_OPEN_FAILED;
+    }
+
+    //
+    // Start worker loop. Run until complete, or until nothing was received for timeoutSecs.
+    //
+
+    m_lastActivityTime = start_request_clock;
+    bool timeout = false;
+
+    do
+    {
+        xio_dowork(handle.Get());
+        timeout = (UHttpDownloaderClock::now() - m_lastActivityTime) > std::chrono::seconds(timeoutSecs);
+    } while (m_keepRunning && !timeout);
+
+    if (timeout)
+    {
+        Log_Warn("Nothing received for %u seconds", timeoutSecs);
+        Finish(DR_TIMEOUT);
+        return DR_TIMEOUT;
+    }
+
+    if (m_reason == DR_OK)
+    {
+        ReportDownload(
+            outputFile, m_bytesReceived, start_request_clock, m_firstByteTime, m_peakBufferedBytes, report);
+    }
+
+    return m_reason;
+}
+
+UHttpDownloaderResult DownloadFile(
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs,
+    UHttpDownloaderReport* report)
 {
     UHttpDownloader downloader;
 
-    return downloader.Download(url, base64Sha256Hash, outputFile, timeoutSecs);
+    return downloader.Download(url, base64Sha256Hash, outputFile, timeoutSecs, report);
+}
+
+UHttpDownloaderResult DownloadFileStreaming(
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs,
+    UHttpDownloaderReport* report)
+{
+    UHttpStreamingDownloader downloader;
+
+    return downloader.Download(url, base64Sha256Hash, outputFile, timeoutSecs, report);
 }
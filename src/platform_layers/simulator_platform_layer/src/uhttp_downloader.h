@@ -31,7 +31,49 @@ typedef enum tagUHttpDownloaderResult
     DR_CALLBACK_DISCONNECTED,
 } UHttpDownloaderResult;
 
-UHttpDownloaderResult
-DownloadFile(const char* url, const char* base64Sha256Hash, const char* outputFile, unsigned int timeoutSecs = 60);
+/**
+ * @brief Throughput and latency of a download.
+ */
+typedef struct tagUHttpDownloaderReport
+{
+    unsigned long long BytesReceived; /**< Size of the response body. */
+    unsigned long long TimeToFirstByteMs; /**< Time from starting the request to receiving the first body bytes. */
+    unsigned long long TotalTimeMs; /**< Time from starting the request to the end of the response. */
+    unsigned long long BytesPerSecond; /**< Average throughput of the whole request. */
+    unsigned long long PeakBufferedBytes; /**< Largest part of the response held in memory at once. */
+} UHttpDownloaderReport;
+
+/**
+ * @brief Downloads @p url to @p outputFile once its SHA256 hash is verified.
+ *
+ * uHTTP delivers the whole response body at once, so memory use grows with the payload size.
+ *
+ * @param timeoutSecs Seconds the whole download may take, since uHTTP doesn't report progress before the end.
+ * @param report Optional. Receives the throughput and latency of the download.
+ */
+UHttpDownloaderResult DownloadFile(
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs = 60,
+    UHttpDownloaderReport* report = nullptr);
+
+/**
+ * @brief Downloads @p url to @p outputFile, writing and hashing the response body as it arrives.
+ *
+ * Memory use is bounded by the size of the received blocks, regardless of the payload size.
+ * Supports Content-Length, chunked and connection-close delimited responses.
+ * @p outputFile is removed if the download fails or its SHA256 hash does not match.
+ *
+ * @param timeoutSecs Seconds without any activity on the connection before the download fails, so large payloads
+ * on slow links are not cut short.
+ * @param report Optional. Receives the throughput and latency of the download.
+ */
+UHttpDownloaderResult DownloadFileStreaming(
+    const char* url,
+    const char* base64Sha256Hash,
+    const char* outputFile,
+    unsigned int timeoutSecs = 60,
+    UHttpDownloaderReport* report = nullptr);
 
 #endif // UHTTP_DOWNLOADER_H
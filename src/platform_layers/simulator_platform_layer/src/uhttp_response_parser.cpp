@@ -0,0 +1,248 @@
+/**
+ * @file uhttp_response_parser.cpp
+ * @brief Incremental HTTP/1.1 response parser used by the streaming downloader.
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "uhttp_response_parser.hpp"
+
+#include <algorithm> // for std::min, std::transform
+#include <cctype> // for tolower
+#include <cstdlib> // for strtoul, strtoull
+#include <cstring> // for memchr
+
+#include <aduc/logging.h>
+
+UHttpResponseParser::UHttpResponseParser(HeadersCallback onHeaders, BodyCallback onBody, void* context) :
+    _onHeaders(onHeaders), _onBody(onBody), _context(context)
+{
+}
+
+/**
+ * @brief Appends bytes up to the end of the current line to _line, consuming them from @p buffer.
+ * @return bool True if _line holds a complete line, without its line ending.
+ */
+bool UHttpResponseParser::ReadLine(const unsigned char** buffer, size_t* size)
+{
+    const unsigned char* newline = static_cast<const unsigned char*>(memchr(*buffer, '\n', *size));
+    const size_t length = (newline == nullptr) ? *size : static_cast<size_t>(newline - *buffer) + 1;
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    _line.append(reinterpret_cast<const char*>(*buffer), length);
+    *buffer += length;
+    *size -= length;
+
+    if (newline == nullptr)
+    {
+        return false;
+    }
+
+    _line.pop_back();
+    if (!_line.empty() && _line.back() == '\r')
+    {
+        _line.pop_back();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Handles the complete line in _line.
+ * @return bool False if the line is malformed, or a callback stopped the parsing.
+ */
+bool UHttpResponseParser::OnLine()
+{
+    switch (_state)
+    {
+    case State::StatusLine:
+    {
+        // e.g. "HTTP/1.1 200 OK"
+        const size_t space = _line.find(' ');
+        char* end = nullptr;
+
+        if (_line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+        {
+            Log_Warn("Invalid status line");
+            return false;
+        }
+
+        _statusCode = static_cast<unsigned int>(strtoul(_line.c_str() + space + 1, &end, 10));
+        if (end == _line.c_str() + space + 1 || _statusCode < 100 || _statusCode > 999)
+        {
+            Log_Warn("Invalid status code");
+            return false;
+        }
+
+        _state = State::Headers;
+        return true;
+    }
+
+    case State::Headers:
+    {
+        if (_line.empty())
+        {
+            return OnHeadersEnd();
+        }
+
+        const size_t colon = _line.find(':');
+        if (colon == std::string::npos || colon == 0)
+        {
+            Log_Warn("Invalid header line");
+            return false;
+        }
+
+        std::string name = _line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        const char* value = _line.c_str() + colon + 1;
+
+        if (name == "content-length")
+        {
+            char* end = nullptr;
+            _remaining = strtoull(value, &end, 10);
+            if (end == value)
+            {
+                Log_Warn("Invalid Content-Length");
+                return false;
+            }
+
+            _hasContentLength = true;
+        }
+        else if (name == "transfer-encoding")
+        {
+            std::string encoding{ value };
+            std::transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+            _chunked = (encoding.find("chunked") != std::string::npos);
+        }
+
+        return true;
+    }
+
+    case State::ChunkSize:
+    {
+        // Chunk extensions after ';' are ignored.
+        char* end = nullptr;
+        _remaining = strtoull(_line.c_str(), &end, 16);
+        if (end == _line.c_str())
+        {
+            Log_Warn("Invalid chunk size");
+            return false;
+        }
+
+        _state = (_remaining == 0) ? State::Trailers : State::ChunkData;
+        return true;
+    }
+
+    case State::ChunkDataEnd:
+        if (!_line.empty())
+        {
+            Log_Warn("Chunk data longer than its size");
+            return false;
+        }
+
+        _state = State::ChunkSize;
+        return true;
+
+    case State::Trailers:
+        if (_line.empty())
+        {
+            _state = State::Done;
+        }
+
+        return true;
+
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Handles the end of the headers, and picks how the body is delimited.
+ * @return bool False if the headers callback stopped the parsing.
+ */
+bool UHttpResponseParser::OnHeadersEnd()
+{
+    if (!_onHeaders(_context, _statusCode))
+    {
+        return false;
+    }
+
+    if (_chunked)
+    {
+        // Transfer-Encoding overrides Content-Length.
+        _hasContentLength = false;
+        _state = State::ChunkSize;
+    }
+    else
+    {
+        _state = (_hasContentLength && _remaining == 0) ? State::Done : State::Body;
+    }
+
+    return true;
+}
+
+bool UHttpResponseParser::OnBody(const unsigned char* buffer, size_t size)
+{
+    return size == 0 || _onBody(_context, buffer, size);
+}
+
+bool UHttpResponseParser::Parse(const unsigned char* buffer, size_t size)
+{
+    while (size > 0 && _state != State::Done && _state != State::Failed)
+    {
+        if (_state == State::Body || _state == State::ChunkData)
+        {
+            const bool delimited = (_state == State::ChunkData || _hasContentLength);
+            const size_t length =
+                delimited ? static_cast<size_t>(std::min<unsigned long long>(_remaining, size)) : size;
+
+            if (!OnBody(buffer, length))
+            {
+                _state = State::Failed;
+                break;
+            }
+
+            buffer += length;
+            size -= length;
+
+            if (delimited)
+            {
+                _remaining -= length;
+                if (_remaining == 0)
+                {
+                    _state = (_state == State::ChunkData) ? State::ChunkDataEnd : State::Done;
+                }
+            }
+
+            continue;
+        }
+
+        const bool isLineComplete = ReadLine(&buffer, &size);
+        if (_line.size() > UHTTP_RESPONSE_PARSER_MAX_LINE_LENGTH)
+        {
+            Log_Warn("Response line too long");
+            _state = State::Failed;
+        }
+        else if (isLineComplete)
+        {
+            if (!OnLine())
+            {
+                _state = State::Failed;
+            }
+
+            _line.clear();
+        }
+    }
+
+    return _state != State::Failed;
+}
+
+bool UHttpResponseParser::OnConnectionClosed()
+{
+    // Without Content-Length or chunked encoding, the server ends the body by closing the connection.
+    if (_state == State::Body && !_hasContentLength)
+    {
+        _state = State::Done;
+    }
+
+    return _state == State::Done;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file uhttp_response_parser.hpp
+ * @brief Incremental HTTP/1.1 response parser used by the streaming downloader.
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef UHTTP_RESPONSE_PARSER_HPP
+#define UHTTP_RESPONSE_PARSER_HPP
+
+#include <cstddef>
+#include <string>
+
+// Longest status, header or chunk size line accepted by the parser.
+#define UHTTP_RESPONSE_PARSER_MAX_LINE_LENGTH (8 * 1024)
+
+/**
+ * @brief Parses an HTTP/1.1 response as it is received, in blocks of any size.
+ *
+ * The status line and headers are parsed line by line, even when a line is split across blocks. The body is passed
+ * on as it arrives, without being buffered. Content-Length, chunked and connection-close delimited bodies are
+ * supported.
+ */
+class UHttpResponseParser
+{
+public:
+    /**
+     * @brief Called once the headers were received.
+     * @return bool False to stop parsing, e.g. for an unexpected status code.
+     */
+    using HeadersCallback = bool (*)(void* context, unsigned int statusCode);
+
+    /**
+     * @brief Called with each received part of the body.
+     * @return bool False to stop parsing, e.g. if the body can't be written.
+     */
+    using BodyCallback = bool (*)(void* context, const unsigned char* buffer, size_t size);
+
+    UHttpResponseParser(HeadersCallback onHeaders, BodyCallback onBody, void* context);
+
+    /**
+     * @brief Parses the next @p size received bytes.
+     * @return bool False if the response is malformed or a callback stopped the parsing. Later calls do nothing.
+     */
+    bool Parse(const unsigned char* buffer, size_t size);
+
+    /**
+     * @brief Handles the end of the connection.
+     * @return bool True if the response is complete, e.g. because the connection ended a connection-close delimited
+     * body.
+     */
+    bool OnConnectionClosed();
+
+    /**
+     * @brief Gets whether the whole response was received.
+     */
+    bool IsComplete() const
+    {
+        return _state == State::Done;
+    }
+
+    /**
+     * @brief Gets the status code of the response, or 0 before the status line was received.
+     */
+    unsigned int GetStatusCode() const
+    {
+        return _statusCode;
+    }
+
+private:
+    enum class State
+    {
+        StatusLine,
+        Headers,
+        Body, // Content-Length or connection-close delimited.
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        Trailers,
+        Done,
+        Failed,
+    };
+
+    bool ReadLine(const unsigned char** buffer, size_t* size);
+    bool OnLine();
+    bool OnHeadersEnd();
+    bool OnBody(const unsigned char* buffer, size_t size);
+
+    HeadersCallback _onHeaders;
+    BodyCallback _onBody;
+    void* _context;
+
+    State _state = State::StatusLine;
+    std::string _line;
+    unsigned int _statusCode = 0;
+    bool _chunked = false;
+    bool _hasContentLength = false;
+    unsigned long long _remaining = 0; // Of the body if _hasContentLength, or of the current chunk.
+};
+
+#endif // UHTTP_RESPONSE_PARSER_HPP
@@ -0,0 +1,170 @@
+/**
+ * @file uhttp_response_parser_ut.cpp
+ * @brief Unit Tests for the UHttpResponseParser of the simulator streaming downloader
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "uhttp_response_parser.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm> // for std::min
+#include <string>
+
+/**
+ * @brief Records what the parser reports.
+ */
+struct ParsedResponse
+{
+    int HeadersCalls = 0;
+    unsigned int StatusCode = 0;
+    std::string Body;
+    bool AcceptHeaders = true;
+};
+
+static bool OnHeaders(void* context, unsigned int statusCode)
+{
+    auto* response = static_cast<ParsedResponse*>(context);
+    ++response->HeadersCalls;
+    response->StatusCode = statusCode;
+    return response->AcceptHeaders;
+}
+
+static bool OnBody(void* context, const unsigned char* buffer, size_t size)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    static_cast<ParsedResponse*>(context)->Body.append(reinterpret_cast<const char*>(buffer), size);
+    return true;
+}
+
+/**
+ * @brief Feeds @p data to @p parser in blocks of at most @p blockSize bytes.
+ * @return bool False if the parser failed.
+ */
+static bool Feed(UHttpResponseParser& parser, const std::string& data, size_t blockSize)
+{
+    for (size_t offset = 0; offset < data.size(); offset += blockSize)
+    {
+        const size_t size = std::min(blockSize, data.size() - offset);
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        if (!parser.Parse(reinterpret_cast<const unsigned char*>(data.data()) + offset, size))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+TEST_CASE("UHttpResponseParser delimits bodies")
+{
+    // 1 byte blocks split every line, including the status line and the headers.
+    const size_t blockSize = GENERATE(1, 7, 4096);
+    ParsedResponse response;
+    UHttpResponseParser parser{ OnHeaders, OnBody, &response };
+
+    SECTION("Content-Length")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\nServer: test\r\n\r\n0123456789", blockSize));
+        CHECK(parser.IsComplete());
+        CHECK(response.HeadersCalls == 1);
+        CHECK(response.StatusCode == 200);
+        CHECK(response.Body == "0123456789");
+    }
+
+    SECTION("Content-Length with bytes after the body")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\ncontent-length: 4\r\n\r\n0123456789", blockSize));
+        CHECK(parser.IsComplete());
+        CHECK(response.Body == "0123");
+    }
+
+    SECTION("Empty Content-Length body")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", blockSize));
+        CHECK(parser.IsComplete());
+        CHECK(response.Body.empty());
+    }
+
+    SECTION("Chunked")
+    {
+        REQUIRE(Feed(
+            parser,
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Length: 99\r\n\r\n"
+            "4\r\n0123\r\na;name=value\r\n456789abcd\r\n0\r\nTrailer: x\r\n\r\n",
+            blockSize));
+        CHECK(parser.IsComplete());
+        CHECK(response.Body == "0123456789abcd");
+    }
+
+    SECTION("Connection close")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.0 200 OK\nConnection: close\n\n0123456789", blockSize));
+        CHECK_FALSE(parser.IsComplete());
+        CHECK(parser.OnConnectionClosed());
+        CHECK(parser.IsComplete());
+        CHECK(response.Body == "0123456789");
+    }
+}
+
+TEST_CASE("UHttpResponseParser detects incomplete responses")
+{
+    ParsedResponse response;
+    UHttpResponseParser parser{ OnHeaders, OnBody, &response };
+
+    SECTION("Connection closed before the end of a Content-Length body")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n01234", 4096));
+        CHECK_FALSE(parser.OnConnectionClosed());
+        CHECK_FALSE(parser.IsComplete());
+    }
+
+    SECTION("Connection closed before the last chunk")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\n0123\r\n", 4096));
+        CHECK_FALSE(parser.OnConnectionClosed());
+    }
+
+    SECTION("Connection closed in the headers")
+    {
+        REQUIRE(Feed(parser, "HTTP/1.1 200 OK\r\nContent-Le", 4096));
+        CHECK_FALSE(parser.OnConnectionClosed());
+        CHECK(response.HeadersCalls == 0);
+    }
+}
+
+TEST_CASE("UHttpResponseParser rejects malformed responses")
+{
+    const std::string response = GENERATE(
+        std::string{ "HTTP/1.1\r\n\r\n" },
+        std::string{ "ICY 200 OK\r\n\r\n" },
+        std::string{ "HTTP/1.1 abc OK\r\n\r\n" },
+        std::string{ "HTTP/1.1 200 OK\r\nNo colon\r\n\r\n" },
+        std::string{ "HTTP/1.1 200 OK\r\nContent-Length: many\r\n\r\n" },
+        std::string{ "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n" },
+        std::string{ "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\n0123\r\n0\r\n\r\n" },
+        std::string{ "HTTP/1.1 200 OK\r\nX-Long: " } + std::string(UHTTP_RESPONSE_PARSER_MAX_LINE_LENGTH, 'x'));
+
+    ParsedResponse parsed;
+    UHttpResponseParser parser{ OnHeaders, OnBody, &parsed };
+
+    CHECK_FALSE(Feed(parser, response, 4096));
+    CHECK_FALSE(parser.IsComplete());
+
+    // A failed parser stays failed.
+    CHECK_FALSE(Feed(parser, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", 4096));
+}
+
+TEST_CASE("UHttpResponseParser stops when the headers are rejected")
+{
+    ParsedResponse response;
+    response.AcceptHeaders = false;
+    UHttpResponseParser parser{ OnHeaders, OnBody, &response };
+
+    CHECK_FALSE(Feed(parser, "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nNot found", 4096));
+    CHECK(response.StatusCode == 404);
+    CHECK(parser.GetStatusCode() == 404);
+    CHECK(response.Body.empty());
+}
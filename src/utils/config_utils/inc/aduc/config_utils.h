@@ -45,6 +45,22 @@ typedef struct tagADUC_AgentInfo
 
 } ADUC_AgentInfo;
 
+/**
+ * @brief A daily period with its own download bandwidth limit.
+ */
+typedef struct tagADUC_DownloadWindow
+{
+    unsigned int startMinute; /**< Start of the window, in minutes after midnight, local time. */
+
+    unsigned int endMinute; /**< End of the window, exclusive. Before startMinute for a window that spans midnight;
+                               equal to startMinute for the whole day. */
+
+    unsigned int bandwidthLimitKBps; /**< Combined bandwidth of all downloads during the window, in KiB/s.
+                                        0 for no limit. */
+
+    bool pauseDownloads; /**< Downloads don't transfer any data during the window. */
+} ADUC_DownloadWindow;
+
 /**
  * @brief  ADUC_ConfigInfo that stores all the configuration info from configuration file
  */
@@ -68,6 +84,51 @@ typedef struct tagADUC_ConfigInfo
     unsigned int agentCount; /**< Total number of agents configured. */
 
     char* compatPropertyNames; /**< Compat property names. */
+
+    unsigned int downloadSegmentCount; /**< Maximum number of concurrent range requests used to download one large
+                                          file. 0 or 1 disables segmented downloads. */
+
+    unsigned int downloadMinSegmentSizeInMB; /**< Minimum size of one download segment, in MiB. Files smaller than
+                                                twice this size are downloaded with a single request. */
+
+    unsigned int downloadConcurrency; /**< Maximum number of files of a workflow downloaded at the same time.
+                                         0 for the default. */
+
+    unsigned int downloadConcurrencyPerHost; /**< Maximum number of files downloaded at the same time from one host.
+                                                0 for no limit. */
+
+    unsigned int downloadBandwidthLimitKBps; /**< Combined bandwidth of all downloads, in KiB/s, outside of the
+                                                download windows. 0 for no limit. */
+
+    ADUC_DownloadWindow* downloadWindows; /**< Daily periods that override downloadBandwidthLimitKBps. */
+
+    unsigned int downloadWindowCount; /**< Number of download windows. */
+
+    char* downloadPauseFilePath; /**< Downloads pause while this file exists, e.g. on a metered connection. */
+
+    char** downloadCacheEndpoints; /**< Local caches tried, in order, before the origin of a file by the cache
+                                      downloader: "http(s)://host[:port][/path]", "unix:/path/to/socket" or
+                                      "file:///path/to/mirror". */
+
+    unsigned int downloadCacheEndpointCount; /**< Number of download cache endpoints. */
+
+    unsigned int payloadCacheSizeInMB; /**< Disk budget of the payload cache, in MiB. 0 disables the cache. */
+
+    unsigned int stepsPrefetchDepth; /**< Number of upcoming steps whose payloads the steps handler downloads while
+                                        the current step installs. 0 disables download pipelining. */
+
+    unsigned int stepsPrefetchDiskBudgetInMB; /**< Maximum size, in MiB, of the payloads of steps downloaded but
+                                                 not yet installed while pipelining. 0 for no limit. */
+
+    unsigned int extensionPreloadConcurrency; /**< Number of threads that verify and load the registered extensions
+                                                 in the background at startup. 0 disables preloading. */
+
+    unsigned int fileHashBufferSizeInKB; /**< Size of each read when hashing a file, in KiB. 0 for the default. */
+
+    bool fileHashUseMmap; /**< Hash files through a read-only memory mapping instead of read(). */
+
+    bool fileHashDropPageCache; /**< Drop hashed pages from the page cache. Saves memory when hashing large files
+                                   that are not read again, but makes the install phase read them from disk. */
 } ADUC_ConfigInfo;
 
 /**
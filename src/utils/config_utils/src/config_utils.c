@@ -16,6 +16,7 @@
 #include <parson.h>
 #include <parson_json_utils.h>
 #include <stdbool.h>
+#include <stdio.h> // for sscanf
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -219,6 +220,162 @@ done:
     return succeeded;
 }
 
+/**
+ * @brief Parses a time of day in "HH:MM" format.
+ * @param value The time of day.
+ * @param[out] minuteOfDay The number of minutes after midnight.
+ * @return _Bool True on success.
+ */
+static _Bool ParseTimeOfDay(const char* value, unsigned int* minuteOfDay)
+{
+    unsigned int hours = 0;
+    unsigned int minutes = 0;
+    int length = 0;
+
+    if (value == NULL || sscanf(value, "%2u:%2u%n", &hours, &minutes, &length) != 2 || value[length] != '\0'
+        || hours > 23 || minutes > 59)
+    {
+        return false;
+    }
+
+    *minuteOfDay = hours * 60 + minutes;
+    return true;
+}
+
+/**
+ * @param root_value config JSON_Value to get the optional download windows from
+ * @param windowCount Returned number of windows. 0 if there are none.
+ * @param windows Returned windows (size windowCount). Array to be freed using free().
+ * @return _Bool False if the windows are invalid.
+ */
+static _Bool ADUC_Json_GetDownloadWindows(JSON_Value* root_value, unsigned int* windowCount, ADUC_DownloadWindow** windows)
+{
+    _Bool succeeded = false;
+    const JSON_Array* windows_array = json_object_get_array(json_value_get_object(root_value), "downloadWindows");
+    const size_t windows_count = json_array_get_count(windows_array);
+
+    *windowCount = 0;
+    *windows = NULL;
+
+    if (windows_count == 0)
+    {
+        return true;
+    }
+
+    *windows = calloc(windows_count, sizeof(ADUC_DownloadWindow));
+    if (*windows == NULL)
+    {
+        goto done;
+    }
+
+    for (size_t index = 0; index < windows_count; ++index)
+    {
+        ADUC_DownloadWindow* cur_window = *windows + index;
+        JSON_Value* cur_window_value = json_array_get_value(windows_array, index);
+        const JSON_Object* cur_window_obj = json_value_get_object(cur_window_value);
+
+        if (!ParseTimeOfDay(json_object_get_string(cur_window_obj, "start"), &(cur_window->startMinute))
+            || !ParseTimeOfDay(json_object_get_string(cur_window_obj, "end"), &(cur_window->endMinute))
+            || !ADUC_JSON_GetUnsignedIntegerField(
+                cur_window_value, "bandwidthLimitKBps", &(cur_window->bandwidthLimitKBps)))
+        {
+            Log_Error("Invalid download window @ %zu", index);
+            goto done;
+        }
+
+        cur_window->pauseDownloads = ADUC_JSON_GetBooleanField(cur_window_value, "pauseDownloads");
+    }
+
+    *windowCount = windows_count;
+    succeeded = true;
+
+done:
+    if (!succeeded)
+    {
+        free(*windows);
+        *windows = NULL;
+    }
+
+    return succeeded;
+}
+
+/**
+ * @brief Frees an array of strings.
+ * @param stringCount The number of strings.
+ * @param strings The array to free.
+ */
+static void ADUC_StringArray_Free(unsigned int stringCount, char** strings)
+{
+    if (strings == NULL)
+    {
+        return;
+    }
+
+    for (unsigned int index = 0; index < stringCount; ++index)
+    {
+        free(strings[index]);
+    }
+
+    free(strings);
+}
+
+/**
+ * @param root_value config JSON_Value to get the optional download cache endpoints from
+ * @param endpointCount Returned number of endpoints. 0 if there are none.
+ * @param endpoints Returned endpoints (size endpointCount). Array to be freed using ADUC_StringArray_Free().
+ * @return _Bool False if the endpoints are invalid.
+ */
+static _Bool
+ADUC_Json_GetDownloadCacheEndpoints(JSON_Value* root_value, unsigned int* endpointCount, char*** endpoints)
+{
+    _Bool succeeded = false;
+    const JSON_Array* endpoints_array =
+        json_object_get_array(json_value_get_object(root_value), "downloadCacheEndpoints");
+    const size_t endpoints_count = json_array_get_count(endpoints_array);
+
+    *endpointCount = 0;
+    *endpoints = NULL;
+
+    if (endpoints_count == 0)
+    {
+        return true;
+    }
+
+    *endpoints = calloc(endpoints_count, sizeof(char*));
+    if (*endpoints == NULL)
+    {
+        goto done;
+    }
+
+    for (size_t index = 0; index < endpoints_count; ++index)
+    {
+        const char* endpoint = json_array_get_string(endpoints_array, index);
+
+        if (endpoint == NULL || *endpoint == '\0')
+        {
+            Log_Error("Invalid download cache endpoint @ %zu", index);
+            goto done;
+        }
+
+        if (mallocAndStrcpy_s(*endpoints + index, endpoint) != 0)
+        {
+            goto done;
+        }
+    }
+
+    *endpointCount = endpoints_count;
+    succeeded = true;
+
+done:
+    if (!succeeded)
+    {
+        ADUC_StringArray_Free(endpoints_count, *endpoints);
+        *endpoints = NULL;
+    }
+
+    return succeeded;
+}
+
 /**
  * @brief Allocates the memory for the ADUC_ConfigInfo struct member values
  * @param config A pointer to an ADUC_ConfigInfo struct whose member values will be allocated
@@ -304,6 +461,87 @@ _Bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFilePath)
         }
     }
 
+    // Segmented downloads are optional; a missing field leaves them disabled.
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "downloadSegmentCount", &(config->downloadSegmentCount))
+        || !ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "downloadMinSegmentSizeInMB", &(config->downloadMinSegmentSizeInMB)))
+    {
+        Log_Warn("Invalid downloadSegmentCount or downloadMinSegmentSizeInMB, segmented downloads are disabled.");
+        config->downloadSegmentCount = 0;
+        config->downloadMinSegmentSizeInMB = 0;
+    }
+
+    // Download scheduling limits are optional; a missing field selects the default.
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "downloadConcurrency", &(config->downloadConcurrency))
+        || !ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "downloadConcurrencyPerHost", &(config->downloadConcurrencyPerHost))
+        || !ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "downloadBandwidthLimitKBps", &(config->downloadBandwidthLimitKBps)))
+    {
+        Log_Warn("Invalid download scheduling limits, using the defaults.");
+        config->downloadConcurrency = 0;
+        config->downloadConcurrencyPerHost = 0;
+        config->downloadBandwidthLimitKBps = 0;
+    }
+
+    // Download windows are optional; invalid windows are ignored as a whole.
+    if (!ADUC_Json_GetDownloadWindows(root_value, &(config->downloadWindowCount), &(config->downloadWindows)))
+    {
+        Log_Warn("Invalid downloadWindows, downloadBandwidthLimitKBps applies all day.");
+    }
+
+    const char* download_pause_file_path = ADUC_JSON_GetStringFieldPtr(root_value, "downloadPauseFilePath");
+
+    if (download_pause_file_path != NULL)
+    {
+        if (mallocAndStrcpy_s(&(config->downloadPauseFilePath), download_pause_file_path) != 0)
+        {
+            goto done;
+        }
+    }
+
+    // Download cache endpoints are optional; invalid endpoints are ignored as a whole.
+    if (!ADUC_Json_GetDownloadCacheEndpoints(
+            root_value, &(config->downloadCacheEndpointCount), &(config->downloadCacheEndpoints)))
+    {
+        Log_Warn("Invalid downloadCacheEndpoints, files are downloaded from their origin.");
+    }
+
+    // The payload cache is optional; a missing field disables it.
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "payloadCacheSizeInMB", &(config->payloadCacheSizeInMB)))
+    {
+        Log_Warn("Invalid payloadCacheSizeInMB, the payload cache is disabled.");
+        config->payloadCacheSizeInMB = 0;
+    }
+
+    // Download pipelining is optional; a missing field disables it.
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "stepsPrefetchDepth", &(config->stepsPrefetchDepth))
+        || !ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "stepsPrefetchDiskBudgetInMB", &(config->stepsPrefetchDiskBudgetInMB)))
+    {
+        Log_Warn("Invalid stepsPrefetchDepth or stepsPrefetchDiskBudgetInMB, download pipelining is disabled.");
+        config->stepsPrefetchDepth = 0;
+        config->stepsPrefetchDiskBudgetInMB = 0;
+    }
+
+    // Extension preloading is optional; a missing field disables it.
+    if (!ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "extensionPreloadConcurrency", &(config->extensionPreloadConcurrency)))
+    {
+        Log_Warn("Invalid extensionPreloadConcurrency, extensions are loaded on first use.");
+        config->extensionPreloadConcurrency = 0;
+    }
+
+    // File hashing options are optional; a missing field selects the default.
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "fileHashBufferSizeInKB", &(config->fileHashBufferSizeInKB)))
+    {
+        Log_Warn("Invalid fileHashBufferSizeInKB, using the default.");
+        config->fileHashBufferSizeInKB = 0;
+    }
+
+    config->fileHashUseMmap = ADUC_JSON_GetBooleanField(root_value, "fileHashUseMmap");
+    config->fileHashDropPageCache = ADUC_JSON_GetBooleanField(root_value, "fileHashDropPageCache");
+
     succeeded = true;
 
 done:
@@ -328,6 +566,9 @@ void ADUC_ConfigInfo_UnInit(ADUC_ConfigInfo* config)
 
     free(config->manufacturer);
     free(config->model);
+    free(config->downloadWindows);
+    free(config->downloadPauseFilePath);
+    ADUC_StringArray_Free(config->downloadCacheEndpointCount, config->downloadCacheEndpoints);
     ADUC_AgentInfoArray_Free(config->agentCount, config->agents);
 
     memset(config, 0, sizeof(*config));
@@ -29,6 +29,24 @@ static const char* validConfigContentStr =
         R"("manufacturer": "device_info_manufacturer",)"
         R"("model": "device_info_model",)"
         R"("compatPropertyNames": "manufacturer,model",)"
+        R"("downloadSegmentCount": 4,)"
+        R"("downloadMinSegmentSizeInMB": 32,)"
+        R"("downloadConcurrency": 8,)"
+        R"("downloadConcurrencyPerHost": 2,)"
+        R"("downloadBandwidthLimitKBps": 512,)"
+        R"("downloadWindows": [)"
+            R"({ "start": "08:00", "end": "18:30", "bandwidthLimitKBps": 128 },)"
+            R"({ "start": "22:00", "end": "06:00", "pauseDownloads": true })"
+        R"(],)"
+        R"("downloadPauseFilePath": "/run/adu/metered",)"
+        R"("downloadCacheEndpoints": ["unix:/run/adu-cache.sock", "http://cache.local:8080/adu"],)"
+        R"("payloadCacheSizeInMB": 1024,)"
+        R"("stepsPrefetchDepth": 2,)"
+        R"("stepsPrefetchDiskBudgetInMB": 512,)"
+        R"("extensionPreloadConcurrency": 4,)"
+        R"("fileHashBufferSizeInKB": 1024,)"
+        R"("fileHashUseMmap": true,)"
+        R"("fileHashDropPageCache": true,)"
         R"("agents": [)"
             R"({ )"
             R"("name": "host-update",)"
@@ -141,6 +159,31 @@ static const char* invalidConfigContentNoDevicePropertiesStr =
         R"(])"
     R"(})";
 
+static const char* validConfigContentInvalidDownloadSettingsStr =
+    R"({)"
+        R"("schemaVersion": "1.0",)"
+        R"("aduShellTrustedUsers": ["adu","do"],)"
+        R"("manufacturer": "device_info_manufacturer",)"
+        R"("model": "device_info_model",)"
+        R"("downloadWindows": [)"
+            R"({ "start": "08:00", "end": "18:00" },)"
+            R"({ "start": "24:00", "end": "06:00" })"
+        R"(],)"
+        R"("downloadCacheEndpoints": ["file:///srv/adu-mirror", 42],)"
+        R"("agents": [)"
+            R"({ )"
+            R"("name": "host-update",)"
+            R"("runas": "adu",)"
+            R"("connectionSource": {)"
+                R"("connectionType": "AIS",)"
+                R"("connectionData": "iotHubDeviceUpdate")"
+            R"(},)"
+            R"("manufacturer": "Contoso",)"
+            R"("model": "Smart-Box")"
+            R"(})"
+        R"(])"
+    R"(})";
+
 static const char* invalidConfigContentStrEmpty = R"({})";
 
 static const char* invalidConfigContentStr =
@@ -195,6 +238,31 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         CHECK_THAT(config.manufacturer, Equals("device_info_manufacturer"));
         CHECK_THAT(config.model, Equals("device_info_model"));
         CHECK_THAT(config.compatPropertyNames, Equals("manufacturer,model"));
+        CHECK(config.downloadSegmentCount == 4);
+        CHECK(config.downloadMinSegmentSizeInMB == 32);
+        CHECK(config.downloadConcurrency == 8);
+        CHECK(config.downloadConcurrencyPerHost == 2);
+        CHECK(config.downloadBandwidthLimitKBps == 512);
+        REQUIRE(config.downloadWindowCount == 2);
+        CHECK(config.downloadWindows[0].startMinute == 8 * 60);
+        CHECK(config.downloadWindows[0].endMinute == 18 * 60 + 30);
+        CHECK(config.downloadWindows[0].bandwidthLimitKBps == 128);
+        CHECK_FALSE(config.downloadWindows[0].pauseDownloads);
+        CHECK(config.downloadWindows[1].startMinute == 22 * 60);
+        CHECK(config.downloadWindows[1].endMinute == 6 * 60);
+        CHECK(config.downloadWindows[1].bandwidthLimitKBps == 0);
+        CHECK(config.downloadWindows[1].pauseDownloads);
+        CHECK_THAT(config.downloadPauseFilePath, Equals("/run/adu/metered"));
+        REQUIRE(config.downloadCacheEndpointCount == 2);
+        CHECK_THAT(config.downloadCacheEndpoints[0], Equals("unix:/run/adu-cache.sock"));
+        CHECK_THAT(config.downloadCacheEndpoints[1], Equals("http://cache.local:8080/adu"));
+        CHECK(config.payloadCacheSizeInMB == 1024);
+        CHECK(config.stepsPrefetchDepth == 2);
+        CHECK(config.stepsPrefetchDiskBudgetInMB == 512);
+        CHECK(config.extensionPreloadConcurrency == 4);
+        CHECK(config.fileHashBufferSizeInKB == 1024);
+        CHECK(config.fileHashUseMmap);
+        CHECK(config.fileHashDropPageCache);
         CHECK(config.agentCount == 2);
         const ADUC_AgentInfo* first_agent_info = ADUC_ConfigInfo_GetAgent(&config, 0);
         CHECK_THAT(first_agent_info->name, Equals("host-update"));
@@ -225,6 +293,41 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
 
         CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu/du-config.json"));
         CHECK(config.compatPropertyNames == nullptr);
+        CHECK(config.downloadSegmentCount == 0);
+        CHECK(config.downloadMinSegmentSizeInMB == 0);
+        CHECK(config.downloadConcurrency == 0);
+        CHECK(config.downloadConcurrencyPerHost == 0);
+        CHECK(config.downloadBandwidthLimitKBps == 0);
+        CHECK(config.downloadWindowCount == 0);
+        CHECK(config.downloadWindows == nullptr);
+        CHECK(config.downloadPauseFilePath == nullptr);
+        CHECK(config.downloadCacheEndpointCount == 0);
+        CHECK(config.downloadCacheEndpoints == nullptr);
+        CHECK(config.payloadCacheSizeInMB == 0);
+        CHECK(config.stepsPrefetchDepth == 0);
+        CHECK(config.stepsPrefetchDiskBudgetInMB == 0);
+        CHECK(config.extensionPreloadConcurrency == 0);
+        CHECK(config.fileHashBufferSizeInKB == 0);
+        CHECK_FALSE(config.fileHashUseMmap);
+        CHECK_FALSE(config.fileHashDropPageCache);
+
+        ADUC_ConfigInfo_UnInit(&config);
+
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc): g_configContentString is a basic C-string so it must be freed by a call to free()
+        free(g_configContentString);
+    }
+
+    SECTION("Valid config content with invalid download windows and cache endpoints, Success Test")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentInvalidDownloadSettingsStr) == 0);
+
+        ADUC_ConfigInfo config = {};
+
+        CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu/du-config.json"));
+        CHECK(config.downloadWindowCount == 0);
+        CHECK(config.downloadWindows == nullptr);
+        CHECK(config.downloadCacheEndpointCount == 0);
+        CHECK(config.downloadCacheEndpoints == nullptr);
 
         ADUC_ConfigInfo_UnInit(&config);
 
@@ -0,0 +1,99 @@
+/**
+ * @file decompression_utils.h
+ * @brief Streaming decompression of gzip, xz and zstd content.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DECOMPRESSION_UTILS_H
+#define ADUC_DECOMPRESSION_UTILS_H
+
+#include "aduc/c_utils.h"
+#include "aduc/types/update_content.h" // for ADUC_FileCompression
+
+#include <stdbool.h> // for _Bool
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint64_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Receives decompressed content.
+ * @param context The context passed to ADUC_Decompressor_Create.
+ * @param data The decompressed data.
+ * @param size The number of bytes in @p data.
+ * @return bool True to continue, false to fail the decompression.
+ */
+typedef _Bool (*ADUC_Decompressor_OutputFunc)(void* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief A decompression stream. Compressed content is fed in with ADUC_Decompressor_Write, in any block size,
+ * and the decompressed content is passed to the output function as it becomes available.
+ */
+typedef struct tagADUC_Decompressor ADUC_Decompressor;
+
+/**
+ * @brief Checks whether the agent was built with a decoder for @p compression.
+ * @param compression The compression format.
+ * @return bool True if @p compression can be decompressed. Always true for ADUC_FileCompression_None.
+ */
+_Bool ADUC_Decompression_IsSupported(ADUC_FileCompression compression);
+
+/**
+ * @brief Creates a decompression stream.
+ *
+ * gzip and xz streams may be made of several concatenated members or streams. xz content compressed in
+ * multiple blocks (xz --threads) is decoded by several threads when liblzma supports it.
+ *
+ * @param compression The compression format. Must not be ADUC_FileCompression_None.
+ * @param output Receives the decompressed content.
+ * @param outputContext Passed to @p output.
+ * @return ADUC_Decompressor* The stream, or NULL if @p compression is not supported or on failure.
+ * Caller must call ADUC_Decompressor_Destroy().
+ */
+ADUC_Decompressor* ADUC_Decompressor_Create(
+    ADUC_FileCompression compression, ADUC_Decompressor_OutputFunc output, void* outputContext);
+
+/**
+ * @brief Decompresses @p size bytes of compressed @p data.
+ * @param decompressor The stream.
+ * @param data The compressed data.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success; false if the content is corrupt, or the output function failed.
+ * Once a write fails, all further writes fail.
+ */
+_Bool ADUC_Decompressor_Write(ADUC_Decompressor* decompressor, const uint8_t* data, size_t size);
+
+/**
+ * @brief Flushes the remaining decompressed content once all compressed content was written.
+ * @param decompressor The stream.
+ * @return bool True if the compressed content was complete and valid.
+ */
+_Bool ADUC_Decompressor_Finish(ADUC_Decompressor* decompressor);
+
+/**
+ * @brief Gets the number of decompressed bytes passed to the output function so far.
+ * @param decompressor The stream.
+ * @return uint64_t The number of bytes.
+ */
+uint64_t ADUC_Decompressor_GetBytesOut(const ADUC_Decompressor* decompressor);
+
+/**
+ * @brief Destroys the stream. May be NULL.
+ * @param decompressor The stream.
+ */
+void ADUC_Decompressor_Destroy(ADUC_Decompressor* decompressor);
+
+/**
+ * @brief Decompresses the file at @p sourcePath into a new file at @p targetPath.
+ * @param compression The compression format of @p sourcePath.
+ * @param sourcePath The compressed file.
+ * @param targetPath The decompressed file. It is replaced if it exists, and removed on failure.
+ * @return bool True on success.
+ */
+_Bool ADUC_Decompression_DecompressFile(
+    ADUC_FileCompression compression, const char* sourcePath, const char* targetPath);
+
+EXTERN_C_END
+
+#endif // ADUC_DECOMPRESSION_UTILS_H
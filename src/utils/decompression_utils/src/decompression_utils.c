@@ -0,0 +1,587 @@
+/**
+ * @file decompression_utils.c
+ * @brief Implements streaming decompression of gzip (zlib), xz (liblzma) and zstd (libzstd) content.
+ *
+ * Each decoder is only built when its library was found at configure time, see ADUC_DECOMPRESSION_GZIP,
+ * ADUC_DECOMPRESSION_XZ and ADUC_DECOMPRESSION_ZSTD.
+ *
+ * libzstd has no multi-threaded decoder; zstd decoding is fast enough to keep up with the network on a single
+ * core. liblzma 5.4 and later decode the blocks of a multi-block xz stream in parallel.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/decompression_utils.h"
+
+#include <aduc/logging.h>
+
+#include <errno.h>
+#include <stdio.h> // for fopen, fread, fwrite
+#include <stdlib.h> // for calloc, free
+
+#ifdef ADUC_DECOMPRESSION_GZIP
+#    include <zlib.h>
+#endif
+
+#ifdef ADUC_DECOMPRESSION_XZ
+#    include <lzma.h>
+#endif
+
+#ifdef ADUC_DECOMPRESSION_ZSTD
+#    include <zstd.h>
+#endif
+
+/**
+ * @brief Size of the buffer that receives decompressed content before it is passed to the output function.
+ */
+#define DECOMPRESSION_OUTPUT_BUFFER_SIZE (256 * 1024)
+
+/**
+ * @brief Size of the blocks read by ADUC_Decompression_DecompressFile.
+ */
+#define DECOMPRESSION_FILE_BUFFER_SIZE (256 * 1024)
+
+struct tagADUC_Decompressor
+{
+    ADUC_FileCompression Compression;
+    ADUC_Decompressor_OutputFunc Output;
+    void* OutputContext;
+    uint8_t* Buffer; /**< Receives decompressed content. DECOMPRESSION_OUTPUT_BUFFER_SIZE bytes. */
+    uint64_t BytesOut; /**< Bytes passed to the output function. */
+    bool StreamEnded; /**< The last member, stream or frame is complete. */
+    bool Failed;
+
+#ifdef ADUC_DECOMPRESSION_GZIP
+    z_stream Gzip;
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    lzma_stream Xz;
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    ZSTD_DStream* Zstd;
+#endif
+};
+
+/**
+ * @brief Passes the first @p size bytes of the output buffer to the output function.
+ */
+static bool EmitOutput(ADUC_Decompressor* decompressor, size_t size)
+{
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (!decompressor->Output(decompressor->OutputContext, decompressor->Buffer, size))
+    {
+        return false;
+    }
+
+    decompressor->BytesOut += size;
+    return true;
+}
+
+//
+// gzip
+//
+
+#ifdef ADUC_DECOMPRESSION_GZIP
+
+static bool GzipInit(ADUC_Decompressor* decompressor)
+{
+    // 16 + MAX_WBITS: gzip header and trailer.
+    const int ret = inflateInit2(&decompressor->Gzip, 16 + MAX_WBITS);
+    if (ret != Z_OK)
+    {
+        Log_Error("inflateInit2 failed: %d", ret);
+        return false;
+    }
+
+    return true;
+}
+
+static bool GzipWrite(ADUC_Decompressor* decompressor, const uint8_t* data, size_t size)
+{
+    z_stream* stream = &decompressor->Gzip;
+
+    // avail_in is an unsigned int.
+    while (size > 0)
+    {
+        const uInt chunkSize = (size > 0x40000000) ? 0x40000000 : (uInt)size;
+
+        stream->next_in = (Bytef*)data;
+        stream->avail_in = chunkSize;
+        data += chunkSize;
+        size -= chunkSize;
+
+        do
+        {
+            // A gzip file may be made of several members.
+            if (decompressor->StreamEnded && stream->avail_in > 0)
+            {
+                if (inflateReset(stream) != Z_OK)
+                {
+                    return false;
+                }
+                decompressor->StreamEnded = false;
+            }
+
+            stream->next_out = decompressor->Buffer;
+            stream->avail_out = DECOMPRESSION_OUTPUT_BUFFER_SIZE;
+
+            const int ret = inflate(stream, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END)
+            {
+                decompressor->StreamEnded = true;
+            }
+            else if (ret != Z_OK)
+            {
+                Log_Error("Corrupt gzip content: %d (%s)", ret, stream->msg != NULL ? stream->msg : "");
+                return false;
+            }
+
+            if (!EmitOutput(decompressor, DECOMPRESSION_OUTPUT_BUFFER_SIZE - stream->avail_out))
+            {
+                return false;
+            }
+        } while (stream->avail_in > 0 || stream->avail_out == 0);
+    }
+
+    return true;
+}
+
+#endif // ADUC_DECOMPRESSION_GZIP
+
+//
+// xz
+//
+
+#ifdef ADUC_DECOMPRESSION_XZ
+
+static bool XzInit(ADUC_Decompressor* decompressor)
+{
+    lzma_ret ret;
+    const lzma_stream init = LZMA_STREAM_INIT;
+
+    decompressor->Xz = init;
+
+#    if LZMA_VERSION >= 50040002
+    lzma_mt options = { 0 };
+    options.flags = LZMA_CONCATENATED;
+    options.threads = lzma_cputhreads();
+    if (options.threads == 0)
+    {
+        options.threads = 1;
+    }
+    // Fall back to a single thread rather than use more than a quarter of the RAM for parallel decoding.
+    options.memlimit_threading = lzma_physmem() / 4;
+    options.memlimit_stop = UINT64_MAX;
+
+    ret = lzma_stream_decoder_mt(&decompressor->Xz, &options);
+#    else
+    ret = lzma_stream_decoder(&decompressor->Xz, UINT64_MAX, LZMA_CONCATENATED);
+#    endif
+
+    if (ret != LZMA_OK)
+    {
+        Log_Error("Cannot initialize xz decoder: %d", ret);
+        return false;
+    }
+
+    return true;
+}
+
+static bool XzCode(ADUC_Decompressor* decompressor, const uint8_t* data, size_t size, lzma_action action)
+{
+    lzma_stream* stream = &decompressor->Xz;
+
+    stream->next_in = data;
+    stream->avail_in = size;
+
+    do
+    {
+        stream->next_out = decompressor->Buffer;
+        stream->avail_out = DECOMPRESSION_OUTPUT_BUFFER_SIZE;
+
+        const lzma_ret ret = lzma_code(stream, action);
+        if (ret == LZMA_STREAM_END)
+        {
+            decompressor->StreamEnded = true;
+        }
+        else if (ret != LZMA_OK)
+        {
+            Log_Error("Corrupt xz content: %d", ret);
+            return false;
+        }
+
+        if (!EmitOutput(decompressor, DECOMPRESSION_OUTPUT_BUFFER_SIZE - stream->avail_out))
+        {
+            return false;
+        }
+
+        if (ret == LZMA_STREAM_END)
+        {
+            break;
+        }
+        // With LZMA_FINISH, keep going until the decoder reports the end of the stream.
+    } while (stream->avail_in > 0 || stream->avail_out == 0 || action == LZMA_FINISH);
+
+    return true;
+}
+
+#endif // ADUC_DECOMPRESSION_XZ
+
+//
+// zstd
+//
+
+#ifdef ADUC_DECOMPRESSION_ZSTD
+
+static bool ZstdInit(ADUC_Decompressor* decompressor)
+{
+    decompressor->Zstd = ZSTD_createDStream();
+    if (decompressor->Zstd == NULL || ZSTD_isError(ZSTD_initDStream(decompressor->Zstd)))
+    {
+        Log_Error("Cannot initialize zstd decoder.");
+        return false;
+    }
+
+    return true;
+}
+
+static bool ZstdWrite(ADUC_Decompressor* decompressor, const uint8_t* data, size_t size)
+{
+    ZSTD_inBuffer input = { data, size, 0 };
+    ZSTD_outBuffer output = { decompressor->Buffer, DECOMPRESSION_OUTPUT_BUFFER_SIZE, 0 };
+
+    // A full output buffer may hold back more output, even when all input was consumed.
+    do
+    {
+        output.pos = 0;
+
+        const size_t ret = ZSTD_decompressStream(decompressor->Zstd, &output, &input);
+        if (ZSTD_isError(ret))
+        {
+            Log_Error("Corrupt zstd content: %s", ZSTD_getErrorName(ret));
+            return false;
+        }
+
+        // 0 means a frame is complete; the content may hold several frames.
+        decompressor->StreamEnded = (ret == 0);
+
+        if (!EmitOutput(decompressor, output.pos))
+        {
+            return false;
+        }
+    } while (input.pos < input.size || output.pos == output.size);
+
+    return true;
+}
+
+#endif // ADUC_DECOMPRESSION_ZSTD
+
+/**
+ * @brief Checks whether the agent was built with a decoder for @p compression.
+ * @param compression The compression format.
+ * @return bool True if @p compression can be decompressed. Always true for ADUC_FileCompression_None.
+ */
+_Bool ADUC_Decompression_IsSupported(ADUC_FileCompression compression)
+{
+    switch (compression)
+    {
+    case ADUC_FileCompression_None:
+        return true;
+#ifdef ADUC_DECOMPRESSION_GZIP
+    case ADUC_FileCompression_Gzip:
+        return true;
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    case ADUC_FileCompression_Xz:
+        return true;
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    case ADUC_FileCompression_Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Creates a decompression stream.
+ * @param compression The compression format. Must not be ADUC_FileCompression_None.
+ * @param output Receives the decompressed content.
+ * @param outputContext Passed to @p output.
+ * @return ADUC_Decompressor* The stream, or NULL if @p compression is not supported or on failure.
+ * Caller must call ADUC_Decompressor_Destroy().
+ */
+ADUC_Decompressor* ADUC_Decompressor_Create(
+    ADUC_FileCompression compression, ADUC_Decompressor_OutputFunc output, void* outputContext)
+{
+    bool success = false;
+    ADUC_Decompressor* decompressor = NULL;
+
+    if (compression == ADUC_FileCompression_None || !ADUC_Decompression_IsSupported(compression) || output == NULL)
+    {
+        Log_Error("Unsupported compression format %d", compression);
+        return NULL;
+    }
+
+    decompressor = calloc(1, sizeof(*decompressor));
+    if (decompressor == NULL)
+    {
+        goto done;
+    }
+
+    decompressor->Compression = compression;
+    decompressor->Output = output;
+    decompressor->OutputContext = outputContext;
+
+    decompressor->Buffer = malloc(DECOMPRESSION_OUTPUT_BUFFER_SIZE);
+    if (decompressor->Buffer == NULL)
+    {
+        goto done;
+    }
+
+    switch (compression)
+    {
+#ifdef ADUC_DECOMPRESSION_GZIP
+    case ADUC_FileCompression_Gzip:
+        success = GzipInit(decompressor);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    case ADUC_FileCompression_Xz:
+        success = XzInit(decompressor);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    case ADUC_FileCompression_Zstd:
+        success = ZstdInit(decompressor);
+        break;
+#endif
+    default:
+        break;
+    }
+
+done:
+    if (!success)
+    {
+        // Releasing a zero-initialized decoder is safe for all three libraries.
+        ADUC_Decompressor_Destroy(decompressor);
+        decompressor = NULL;
+    }
+
+    return decompressor;
+}
+
+/**
+ * @brief Decompresses @p size bytes of compressed @p data.
+ * @param decompressor The stream.
+ * @param data The compressed data.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success; false if the content is corrupt, or the output function failed.
+ */
+_Bool ADUC_Decompressor_Write(ADUC_Decompressor* decompressor, const uint8_t* data, size_t size)
+{
+    bool success = false;
+
+    if (decompressor == NULL || decompressor->Failed)
+    {
+        return false;
+    }
+
+    if (size == 0)
+    {
+        return true;
+    }
+
+    switch (decompressor->Compression)
+    {
+#ifdef ADUC_DECOMPRESSION_GZIP
+    case ADUC_FileCompression_Gzip:
+        success = GzipWrite(decompressor, data, size);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    case ADUC_FileCompression_Xz:
+        success = XzCode(decompressor, data, size, LZMA_RUN);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    case ADUC_FileCompression_Zstd:
+        success = ZstdWrite(decompressor, data, size);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    decompressor->Failed = !success;
+    return success;
+}
+
+/**
+ * @brief Flushes the remaining decompressed content once all compressed content was written.
+ * @param decompressor The stream.
+ * @return bool True if the compressed content was complete and valid.
+ */
+_Bool ADUC_Decompressor_Finish(ADUC_Decompressor* decompressor)
+{
+    if (decompressor == NULL || decompressor->Failed)
+    {
+        return false;
+    }
+
+#ifdef ADUC_DECOMPRESSION_XZ
+    // The concatenated xz decoder only validates the end of the content when it is told there is no more.
+    if (decompressor->Compression == ADUC_FileCompression_Xz && !XzCode(decompressor, NULL, 0, LZMA_FINISH))
+    {
+        decompressor->Failed = true;
+        return false;
+    }
+#endif
+
+    if (!decompressor->StreamEnded)
+    {
+        Log_Error("Compressed content is truncated.");
+        decompressor->Failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gets the number of decompressed bytes passed to the output function so far.
+ * @param decompressor The stream.
+ * @return uint64_t The number of bytes.
+ */
+uint64_t ADUC_Decompressor_GetBytesOut(const ADUC_Decompressor* decompressor)
+{
+    return (decompressor == NULL) ? 0 : decompressor->BytesOut;
+}
+
+/**
+ * @brief Destroys the stream. May be NULL.
+ * @param decompressor The stream.
+ */
+void ADUC_Decompressor_Destroy(ADUC_Decompressor* decompressor)
+{
+    if (decompressor == NULL)
+    {
+        return;
+    }
+
+    switch (decompressor->Compression)
+    {
+#ifdef ADUC_DECOMPRESSION_GZIP
+    case ADUC_FileCompression_Gzip:
+        inflateEnd(&decompressor->Gzip);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    case ADUC_FileCompression_Xz:
+        lzma_end(&decompressor->Xz);
+        break;
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    case ADUC_FileCompression_Zstd:
+        ZSTD_freeDStream(decompressor->Zstd);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    free(decompressor->Buffer);
+    free(decompressor);
+}
+
+static _Bool WriteToFile(void* context, const uint8_t* data, size_t size)
+{
+    return fwrite(data, 1, size, (FILE*)context) == size;
+}
+
+/**
+ * @brief Decompresses the file at @p sourcePath into a new file at @p targetPath.
+ * @param compression The compression format of @p sourcePath.
+ * @param sourcePath The compressed file.
+ * @param targetPath The decompressed file. It is replaced if it exists, and removed on failure.
+ * @return bool True on success.
+ */
+_Bool ADUC_Decompression_DecompressFile(
+    ADUC_FileCompression compression, const char* sourcePath, const char* targetPath)
+{
+    bool success = false;
+    FILE* source = NULL;
+    FILE* target = NULL;
+    uint8_t* buffer = NULL;
+    ADUC_Decompressor* decompressor = NULL;
+    size_t readSize = 0;
+
+    if (sourcePath == NULL || targetPath == NULL)
+    {
+        return false;
+    }
+
+    buffer = malloc(DECOMPRESSION_FILE_BUFFER_SIZE);
+    source = fopen(sourcePath, "rb");
+    target = fopen(targetPath, "wb");
+    if (buffer == NULL || source == NULL || target == NULL)
+    {
+        Log_Error("Cannot decompress %s to %s (errno %d).", sourcePath, targetPath, errno);
+        goto done;
+    }
+
+    decompressor = ADUC_Decompressor_Create(compression, WriteToFile, target);
+    if (decompressor == NULL)
+    {
+        goto done;
+    }
+
+    while ((readSize = fread(buffer, 1, DECOMPRESSION_FILE_BUFFER_SIZE, source)) > 0)
+    {
+        if (!ADUC_Decompressor_Write(decompressor, buffer, readSize))
+        {
+            goto done;
+        }
+    }
+
+    if (ferror(source) || !ADUC_Decompressor_Finish(decompressor))
+    {
+        goto done;
+    }
+
+    Log_Info(
+        "Decompressed %s to %s (%llu bytes).",
+        sourcePath,
+        targetPath,
+        (unsigned long long)ADUC_Decompressor_GetBytesOut(decompressor));
+    success = true;
+
+done:
+    ADUC_Decompressor_Destroy(decompressor);
+    free(buffer);
+
+    if (source != NULL)
+    {
+        fclose(source);
+    }
+
+    if (target != NULL)
+    {
+        if (fclose(target) != 0)
+        {
+            success = false;
+        }
+
+        if (!success)
+        {
+            remove(targetPath);
+        }
+    }
+
+    return success;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file decompression_utils_ut.cpp
+ * @brief Unit Tests for decompression_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/decompression_utils.h>
+
+#include <catch2/catch.hpp>
+
+#include <algorithm> // for std::min
+#include <cstdio> // for std::remove
+#include <cstdlib> // for mkstemp
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h> // for close
+#include <vector>
+
+#ifdef ADUC_DECOMPRESSION_GZIP
+#    include <zlib.h>
+#endif
+
+#ifdef ADUC_DECOMPRESSION_XZ
+#    include <lzma.h>
+#endif
+
+#ifdef ADUC_DECOMPRESSION_ZSTD
+#    include <zstd.h>
+#endif
+
+static std::string MakeContent(size_t lineCount)
+{
+    std::stringstream content;
+    for (size_t i = 0; i < lineCount; ++i)
+    {
+        content << "line " << i << " of the payload, " << (i * 7919) % 1000003 << "\n";
+    }
+    return content.str();
+}
+
+/**
+ * @brief Compresses @p content in @p compression format with the library the decoder uses.
+ */
+static std::vector<uint8_t> Compress(ADUC_FileCompression compression, const std::string& content)
+{
+    std::vector<uint8_t> compressed;
+
+    switch (compression)
+    {
+#ifdef ADUC_DECOMPRESSION_GZIP
+    case ADUC_FileCompression_Gzip:
+    {
+        z_stream stream{};
+        REQUIRE(
+            deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        compressed.resize(deflateBound(&stream, content.size()) + 32);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-type-const-cast)
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+        stream.avail_in = static_cast<uInt>(content.size());
+        stream.next_out = compressed.data();
+        stream.avail_out = static_cast<uInt>(compressed.size());
+        REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        break;
+    }
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    case ADUC_FileCompression_Xz:
+    {
+        size_t outPos = 0;
+        compressed.resize(lzma_stream_buffer_bound(content.size()));
+        REQUIRE(
+            lzma_easy_buffer_encode(
+                6,
+                LZMA_CHECK_CRC64,
+                nullptr,
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                reinterpret_cast<const uint8_t*>(content.data()),
+                content.size(),
+                compressed.data(),
+                &outPos,
+                compressed.size())
+            == LZMA_OK);
+        compressed.resize(outPos);
+        break;
+    }
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    case ADUC_FileCompression_Zstd:
+    {
+        compressed.resize(ZSTD_compressBound(content.size()));
+        const size_t size = ZSTD_compress(compressed.data(), compressed.size(), content.data(), content.size(), 3);
+        REQUIRE_FALSE(ZSTD_isError(size));
+        compressed.resize(size);
+        break;
+    }
+#endif
+    default:
+        FAIL("Unsupported compression");
+    }
+
+    return compressed;
+}
+
+static std::vector<ADUC_FileCompression> GetSupportedFormats()
+{
+    std::vector<ADUC_FileCompression> formats;
+
+    for (ADUC_FileCompression compression :
+         { ADUC_FileCompression_Gzip, ADUC_FileCompression_Xz, ADUC_FileCompression_Zstd })
+    {
+        if (ADUC_Decompression_IsSupported(compression))
+        {
+            formats.push_back(compression);
+        }
+    }
+
+    return formats;
+}
+
+static _Bool AppendToString(void* context, const uint8_t* data, size_t size)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    static_cast<std::string*>(context)->append(reinterpret_cast<const char*>(data), size);
+    return true;
+}
+
+static _Bool FailOutput(void* context, const uint8_t* data, size_t size)
+{
+    (void)context;
+    (void)data;
+    (void)size;
+    return false;
+}
+
+/**
+ * @brief Decompresses @p compressed, written in blocks of @p blockSize bytes.
+ * @return bool True if all writes and the finish succeeded.
+ */
+static bool Decompress(
+    ADUC_FileCompression compression, const std::vector<uint8_t>& compressed, size_t blockSize, std::string* output)
+{
+    bool success = true;
+    ADUC_Decompressor* decompressor = ADUC_Decompressor_Create(compression, AppendToString, output);
+    REQUIRE(decompressor != nullptr);
+
+    for (size_t offset = 0; success && offset < compressed.size(); offset += blockSize)
+    {
+        const size_t size = std::min(blockSize, compressed.size() - offset);
+        success = ADUC_Decompressor_Write(decompressor, compressed.data() + offset, size);
+    }
+
+    success = success && ADUC_Decompressor_Finish(decompressor);
+    if (success)
+    {
+        CHECK(ADUC_Decompressor_GetBytesOut(decompressor) == output->size());
+    }
+
+    ADUC_Decompressor_Destroy(decompressor);
+    return success;
+}
+
+TEST_CASE("ADUC_Decompression_IsSupported")
+{
+    CHECK(ADUC_Decompression_IsSupported(ADUC_FileCompression_None));
+    CHECK(ADUC_Decompressor_Create(ADUC_FileCompression_None, AppendToString, nullptr) == nullptr);
+
+#ifdef ADUC_DECOMPRESSION_GZIP
+    CHECK(ADUC_Decompression_IsSupported(ADUC_FileCompression_Gzip));
+#endif
+#ifdef ADUC_DECOMPRESSION_XZ
+    CHECK(ADUC_Decompression_IsSupported(ADUC_FileCompression_Xz));
+#endif
+#ifdef ADUC_DECOMPRESSION_ZSTD
+    CHECK(ADUC_Decompression_IsSupported(ADUC_FileCompression_Zstd));
+#endif
+}
+
+TEST_CASE("ADUC_Decompressor")
+{
+    const std::string content = MakeContent(100000);
+
+    for (ADUC_FileCompression compression : GetSupportedFormats())
+    {
+        INFO("compression: " << compression);
+        const std::vector<uint8_t> compressed = Compress(compression, content);
+        REQUIRE(compressed.size() < content.size());
+
+        SECTION("Content is restored whatever the block size")
+        {
+            for (size_t blockSize : { static_cast<size_t>(1), static_cast<size_t>(4096), compressed.size() })
+            {
+                // Writing byte by byte is slow; use a smaller payload for it.
+                const std::string& expected = (blockSize == 1) ? MakeContent(1000) : content;
+                const std::vector<uint8_t> input = (blockSize == 1) ? Compress(compression, expected) : compressed;
+
+                std::string output;
+                CHECK(Decompress(compression, input, blockSize, &output));
+                CHECK(output == expected);
+            }
+        }
+
+        SECTION("Concatenated members are decompressed")
+        {
+            std::vector<uint8_t> twice = compressed;
+            twice.insert(twice.end(), compressed.begin(), compressed.end());
+
+            std::string output;
+            CHECK(Decompress(compression, twice, 65536, &output));
+            CHECK(output == content + content);
+        }
+
+        SECTION("Truncated content fails")
+        {
+            const std::vector<uint8_t> truncated(compressed.begin(), compressed.end() - 16);
+
+            std::string output;
+            CHECK_FALSE(Decompress(compression, truncated, 65536, &output));
+        }
+
+        SECTION("Corrupt content fails")
+        {
+            std::vector<uint8_t> corrupt = compressed;
+            for (size_t i = corrupt.size() / 2; i < corrupt.size() / 2 + 64; ++i)
+            {
+                corrupt[i] ^= 0x5a;
+            }
+
+            std::string output;
+            CHECK_FALSE(Decompress(compression, corrupt, 65536, &output));
+        }
+
+        SECTION("Output failure fails the write")
+        {
+            ADUC_Decompressor* decompressor = ADUC_Decompressor_Create(compression, FailOutput, nullptr);
+            REQUIRE(decompressor != nullptr);
+
+            bool success = ADUC_Decompressor_Write(decompressor, compressed.data(), compressed.size());
+            success = success && ADUC_Decompressor_Finish(decompressor);
+            CHECK_FALSE(success);
+
+            ADUC_Decompressor_Destroy(decompressor);
+        }
+    }
+}
+
+TEST_CASE("ADUC_Decompression_DecompressFile")
+{
+    const std::string content = MakeContent(10000);
+
+    for (ADUC_FileCompression compression : GetSupportedFormats())
+    {
+        INFO("compression: " << compression);
+        const std::vector<uint8_t> compressed = Compress(compression, content);
+
+        char sourcePath[] = "/tmp/decompressionXXXXXX";
+        const int fd = mkstemp(sourcePath);
+        REQUIRE(fd != -1);
+        close(fd);
+        const std::string targetPath = std::string(sourcePath) + ".out";
+
+        {
+            std::ofstream source(sourcePath, std::ios::binary | std::ios::trunc);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            source.write(
+                reinterpret_cast<const char*>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+        }
+
+        REQUIRE(ADUC_Decompression_DecompressFile(compression, sourcePath, targetPath.c_str()));
+
+        std::ifstream target(targetPath, std::ios::binary);
+        std::stringstream output;
+        output << target.rdbuf();
+        CHECK(output.str() == content);
+
+        // A corrupt file leaves no output behind.
+        {
+            std::ofstream source(sourcePath, std::ios::binary | std::ios::trunc);
+            source << "not compressed";
+        }
+
+        CHECK_FALSE(ADUC_Decompression_DecompressFile(compression, sourcePath, targetPath.c_str()));
+        CHECK(std::remove(targetPath.c_str()) != 0);
+
+        (void)std::remove(sourcePath);
+    }
+}
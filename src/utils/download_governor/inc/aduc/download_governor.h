@@ -0,0 +1,69 @@
+/**
+ * @file download_governor.h
+ * @brief Process-wide bandwidth limit and pause control shared by the content downloaders.
+ *
+ * All downloads of a process draw from one token bucket. The rate of the bucket comes from the download window
+ * that contains the current time of day, or from the default limit outside of all windows. Downloads also pause
+ * while a pause file exists, which lets a network manager hook signal a metered connection.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DOWNLOAD_GOVERNOR_H
+#define ADUC_DOWNLOAD_GOVERNOR_H
+
+#include <aduc/c_utils.h>
+#include <aduc/config_utils.h>
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Returns nonzero when a waiting download should give up.
+ * @param context The context passed to ADUC_DownloadGovernor_Acquire.
+ */
+typedef _Bool (*ADUC_DownloadGovernor_IsCancelledFunc)(void* context);
+
+/**
+ * @brief Sets the limits from the downloadBandwidthLimitKBps, downloadWindows and downloadPauseFilePath
+ * configuration fields.
+ * @param config The agent configuration, or NULL to remove all limits.
+ */
+void ADUC_DownloadGovernor_Configure(const ADUC_ConfigInfo* config);
+
+/**
+ * @brief Waits until @p size more bytes may be transferred.
+ *
+ * Returns immediately when there is no limit. Transfers larger than the bucket are allowed, and the next
+ * transfers wait until the bucket refilled.
+ *
+ * @param size The number of bytes about to be transferred, or 0 to only wait while downloads are paused.
+ * @param isCancelled Optional. Polled while waiting.
+ * @param context The context for @p isCancelled.
+ * @return _Bool True once the bytes may be transferred, false if @p isCancelled returned nonzero.
+ */
+_Bool ADUC_DownloadGovernor_Acquire(size_t size, ADUC_DownloadGovernor_IsCancelledFunc isCancelled, void* context);
+
+/**
+ * @brief Takes @p size more bytes if they may be transferred now, without waiting.
+ *
+ * For transfers that share a thread, e.g. the handles of a libcurl multi handle, which must not block each other.
+ *
+ * @param size The number of bytes about to be transferred, or 0 to only check whether downloads are paused.
+ * @param[out] waitMs Optional. When the bytes can't be transferred now, how long to wait before trying again, in
+ * milliseconds.
+ * @return _Bool True if the bytes may be transferred.
+ */
+_Bool ADUC_DownloadGovernor_TryAcquire(size_t size, uint64_t* waitMs);
+
+/**
+ * @brief Gets the limits in effect now.
+ * @param[out] bytesPerSecond Optional. The combined bandwidth of all downloads; 0 for no limit.
+ * @param[out] paused Optional. True while downloads are paused.
+ */
+void ADUC_DownloadGovernor_GetLimits(uint64_t* bytesPerSecond, _Bool* paused);
+
+EXTERN_C_END
+
+#endif // ADUC_DOWNLOAD_GOVERNOR_H
@@ -0,0 +1,330 @@
+/**
+ * @file download_governor.c
+ * @brief Implements the process-wide download bandwidth limit and pause control.
+ *
+ * The limits in effect are re-evaluated at most once per DOWNLOAD_GOVERNOR_POLICY_INTERVAL_MS, so a download
+ * window boundary or a change of the pause file takes effect within that time, without a system call for each
+ * block of received data.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_governor.h"
+
+#include <aduc/logging.h>
+
+#include <pthread.h>
+#include <stdlib.h> // for free, calloc
+#include <string.h> // for strdup, memcpy
+#include <time.h> // for clock_gettime, localtime_r, nanosleep
+#include <unistd.h> // for access
+
+/**
+ * @brief How often the download windows and the pause file are evaluated, in milliseconds.
+ */
+#define DOWNLOAD_GOVERNOR_POLICY_INTERVAL_MS 1000
+
+/**
+ * @brief Longest sleep of a waiting download before it checks for cancellation and limit changes, in milliseconds.
+ */
+#define DOWNLOAD_GOVERNOR_MAX_SLEEP_MS 250
+
+/**
+ * @brief Seconds of the rate that the bucket holds, i.e. the burst allowed after downloads were idle.
+ */
+#define DOWNLOAD_GOVERNOR_BURST_SECONDS 1
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_defaultInitOnce = PTHREAD_ONCE_INIT;
+static bool s_isConfigured = false;
+
+// The configuration.
+static uint64_t s_defaultBytesPerSecond = 0;
+static ADUC_DownloadWindow* s_windows = NULL;
+static unsigned int s_windowCount = 0;
+static char* s_pauseFilePath = NULL;
+
+// The limits in effect, evaluated at s_policyTimeMs.
+static uint64_t s_policyTimeMs = 0;
+static uint64_t s_bytesPerSecond = 0;
+static bool s_paused = false;
+
+// The token bucket. s_tokens is negative while a transfer larger than the bucket is being paid back.
+static double s_tokens = 0;
+static uint64_t s_refillTimeMs = 0;
+
+static uint64_t GetMonotonicTimeMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static void SleepMs(uint64_t milliseconds)
+{
+    struct timespec delay = { .tv_sec = (time_t)(milliseconds / 1000),
+                              .tv_nsec = (long)(milliseconds % 1000) * 1000000 };
+    (void)nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief Whether @p window contains @p minuteOfDay.
+ */
+static bool IsInWindow(const ADUC_DownloadWindow* window, unsigned int minuteOfDay)
+{
+    if (window->startMinute == window->endMinute)
+    {
+        return true;
+    }
+
+    if (window->startMinute < window->endMinute)
+    {
+        return minuteOfDay >= window->startMinute && minuteOfDay < window->endMinute;
+    }
+
+    // The window spans midnight.
+    return minuteOfDay >= window->startMinute || minuteOfDay < window->endMinute;
+}
+
+/**
+ * @brief Sets the configuration. Must be called with s_mutex held.
+ */
+static void SetConfiguration(const ADUC_ConfigInfo* config)
+{
+    free(s_windows);
+    s_windows = NULL;
+    s_windowCount = 0;
+    free(s_pauseFilePath);
+    s_pauseFilePath = NULL;
+    s_defaultBytesPerSecond = 0;
+
+    if (config != NULL)
+    {
+        s_defaultBytesPerSecond = (uint64_t)config->downloadBandwidthLimitKBps * 1024;
+
+        if (config->downloadWindowCount != 0)
+        {
+            s_windows = calloc(config->downloadWindowCount, sizeof(ADUC_DownloadWindow));
+            if (s_windows != NULL)
+            {
+                memcpy(s_windows, config->downloadWindows, config->downloadWindowCount * sizeof(ADUC_DownloadWindow));
+                s_windowCount = config->downloadWindowCount;
+            }
+        }
+
+        if (config->downloadPauseFilePath != NULL)
+        {
+            s_pauseFilePath = strdup(config->downloadPauseFilePath);
+        }
+    }
+
+    // Evaluate the limits on next use, with a full bucket.
+    s_policyTimeMs = 0;
+    s_tokens = 0;
+    s_refillTimeMs = 0;
+}
+
+/**
+ * @brief Uses the agent configuration, unless the governor was configured explicitly. This lets every content
+ * downloader that links download_governor apply the agent's limits.
+ */
+static void InitDefaultConfiguration(void)
+{
+#ifdef ADUC_CONF_FILE_PATH
+    ADUC_ConfigInfo config = {};
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (!s_isConfigured && ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        SetConfiguration(&config);
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    pthread_mutex_unlock(&s_mutex);
+#endif
+}
+
+/**
+ * @brief Re-evaluates the limits in effect if they are older than DOWNLOAD_GOVERNOR_POLICY_INTERVAL_MS,
+ * and refills the bucket. Must be called with s_mutex held.
+ */
+static void UpdateLimits(uint64_t nowMs)
+{
+    if (s_policyTimeMs == 0 || nowMs - s_policyTimeMs >= DOWNLOAD_GOVERNOR_POLICY_INTERVAL_MS)
+    {
+        const uint64_t previousBytesPerSecond = s_bytesPerSecond;
+        const bool previousPaused = s_paused;
+        const bool isFirstEvaluation = (s_policyTimeMs == 0);
+        uint64_t bytesPerSecond = s_defaultBytesPerSecond;
+        bool paused = false;
+
+        if (s_windowCount != 0)
+        {
+            const time_t now = time(NULL);
+            struct tm localNow;
+
+            if (localtime_r(&now, &localNow) != NULL)
+            {
+                const unsigned int minuteOfDay = (unsigned int)(localNow.tm_hour * 60 + localNow.tm_min);
+
+                // The first window that contains the current time applies.
+                for (unsigned int i = 0; i < s_windowCount; ++i)
+                {
+                    if (IsInWindow(&s_windows[i], minuteOfDay))
+                    {
+                        bytesPerSecond = (uint64_t)s_windows[i].bandwidthLimitKBps * 1024;
+                        paused = s_windows[i].pauseDownloads;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (s_pauseFilePath != NULL && access(s_pauseFilePath, F_OK) == 0)
+        {
+            paused = true;
+        }
+
+        s_policyTimeMs = nowMs;
+        s_bytesPerSecond = bytesPerSecond;
+        s_paused = paused;
+
+        if (isFirstEvaluation || previousBytesPerSecond != bytesPerSecond || previousPaused != paused)
+        {
+            if (paused)
+            {
+                Log_Info("Downloads are paused.");
+            }
+            else if (bytesPerSecond == 0)
+            {
+                Log_Info("Download bandwidth is not limited.");
+            }
+            else
+            {
+                Log_Info("Download bandwidth is limited to %llu bytes/s.", (unsigned long long)bytesPerSecond);
+            }
+
+            // Start the new rate with a full bucket.
+            s_tokens = (double)bytesPerSecond * DOWNLOAD_GOVERNOR_BURST_SECONDS;
+            s_refillTimeMs = nowMs;
+        }
+    }
+
+    if (s_bytesPerSecond != 0 && nowMs > s_refillTimeMs)
+    {
+        const double capacity = (double)s_bytesPerSecond * DOWNLOAD_GOVERNOR_BURST_SECONDS;
+
+        s_tokens += (double)(nowMs - s_refillTimeMs) * (double)s_bytesPerSecond / 1000;
+        if (s_tokens > capacity)
+        {
+            s_tokens = capacity;
+        }
+    }
+
+    s_refillTimeMs = nowMs;
+}
+
+void ADUC_DownloadGovernor_Configure(const ADUC_ConfigInfo* config)
+{
+    pthread_mutex_lock(&s_mutex);
+    s_isConfigured = true;
+    SetConfiguration(config);
+    pthread_mutex_unlock(&s_mutex);
+}
+
+/**
+ * @brief Takes @p size bytes from the bucket if they may be transferred now. Must be called with s_mutex held.
+ * @param[out] waitMs How long to wait before trying again, if the bytes can't be transferred now.
+ * @return bool True if the bytes may be transferred.
+ */
+static bool TryAcquireLocked(size_t size, uint64_t* waitMs)
+{
+    UpdateLimits(GetMonotonicTimeMs());
+
+    if (s_paused)
+    {
+        *waitMs = DOWNLOAD_GOVERNOR_MAX_SLEEP_MS;
+        return false;
+    }
+
+    if (s_bytesPerSecond == 0)
+    {
+        return true;
+    }
+
+    if (s_tokens >= 0)
+    {
+        // Transfers may overdraw the bucket; the following ones wait until it is paid back.
+        s_tokens -= (double)size;
+        return true;
+    }
+
+    *waitMs = (uint64_t)(-s_tokens * 1000 / (double)s_bytesPerSecond) + 1;
+    if (*waitMs > DOWNLOAD_GOVERNOR_MAX_SLEEP_MS)
+    {
+        *waitMs = DOWNLOAD_GOVERNOR_MAX_SLEEP_MS;
+    }
+
+    return false;
+}
+
+_Bool ADUC_DownloadGovernor_Acquire(size_t size, ADUC_DownloadGovernor_IsCancelledFunc isCancelled, void* context)
+{
+    for (;;)
+    {
+        uint64_t waitMs = 0;
+
+        if (ADUC_DownloadGovernor_TryAcquire(size, &waitMs))
+        {
+            return true;
+        }
+
+        if (isCancelled != NULL && isCancelled(context))
+        {
+            return false;
+        }
+
+        SleepMs(waitMs);
+    }
+}
+
+_Bool ADUC_DownloadGovernor_TryAcquire(size_t size, uint64_t* waitMs)
+{
+    uint64_t localWaitMs = 0;
+    bool acquired = false;
+
+    pthread_once(&s_defaultInitOnce, InitDefaultConfiguration);
+
+    pthread_mutex_lock(&s_mutex);
+    acquired = TryAcquireLocked(size, &localWaitMs);
+    pthread_mutex_unlock(&s_mutex);
+
+    if (waitMs != NULL)
+    {
+        *waitMs = acquired ? 0 : localWaitMs;
+    }
+
+    return acquired;
+}
+
+void ADUC_DownloadGovernor_GetLimits(uint64_t* bytesPerSecond, _Bool* paused)
+{
+    pthread_once(&s_defaultInitOnce, InitDefaultConfiguration);
+
+    pthread_mutex_lock(&s_mutex);
+
+    UpdateLimits(GetMonotonicTimeMs());
+
+    if (bytesPerSecond != NULL)
+    {
+        *bytesPerSecond = s_bytesPerSecond;
+    }
+
+    if (paused != NULL)
+    {
+        *paused = s_paused;
+    }
+
+    pthread_mutex_unlock(&s_mutex);
+}
@@ -0,0 +1,186 @@
+/**
+ * @file download_governor_ut.cpp
+ * @brief Unit Tests for the download governor.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_governor.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio> // for std::remove
+#include <ctime> // for time, localtime_r
+#include <fstream>
+#include <future>
+#include <string>
+#include <unistd.h> // for getpid
+
+/**
+ * @brief Returns the current time of day, in minutes after midnight, shifted by @p offsetMinutes.
+ */
+static unsigned int GetMinuteOfDay(int offsetMinutes)
+{
+    const time_t now = time(nullptr);
+    struct tm localNow = {};
+    REQUIRE(localtime_r(&now, &localNow) != nullptr);
+    return static_cast<unsigned int>((localNow.tm_hour * 60 + localNow.tm_min + offsetMinutes + 24 * 60) % (24 * 60));
+}
+
+static _Bool CancelAfterFourPolls(void* context)
+{
+    auto* pollCount = static_cast<int*>(context);
+    return ++(*pollCount) >= 4;
+}
+
+TEST_CASE("ADUC_DownloadGovernor_Acquire")
+{
+    ADUC_ConfigInfo config = {};
+
+    SECTION("No limits")
+    {
+        ADUC_DownloadGovernor_Configure(nullptr);
+
+        uint64_t bytesPerSecond = 1;
+        _Bool paused = true;
+        ADUC_DownloadGovernor_GetLimits(&bytesPerSecond, &paused);
+        CHECK(bytesPerSecond == 0);
+        CHECK_FALSE(paused);
+
+        const auto start = std::chrono::steady_clock::now();
+        CHECK(ADUC_DownloadGovernor_Acquire(100 * 1024 * 1024, nullptr, nullptr));
+        CHECK(ADUC_DownloadGovernor_Acquire(100 * 1024 * 1024, nullptr, nullptr));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+    }
+
+    SECTION("Limits the combined bandwidth")
+    {
+        config.downloadBandwidthLimitKBps = 1024;
+        ADUC_DownloadGovernor_Configure(&config);
+
+        uint64_t bytesPerSecond = 0;
+        ADUC_DownloadGovernor_GetLimits(&bytesPerSecond, nullptr);
+        CHECK(bytesPerSecond == 1024 * 1024);
+
+        // After a 1 MiB burst, 3 MiB from two threads at 1 MiB/s take about 2 seconds.
+        const auto start = std::chrono::steady_clock::now();
+        auto transfer = []() {
+            int acquiredCount = 0;
+            for (int i = 0; i < 24; ++i)
+            {
+                acquiredCount += ADUC_DownloadGovernor_Acquire(64 * 1024, nullptr, nullptr) ? 1 : 0;
+            }
+            return acquiredCount;
+        };
+        std::future<int> other = std::async(std::launch::async, transfer);
+        CHECK(transfer() == 24);
+        CHECK(other.get() == 24);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        CHECK(elapsed >= std::chrono::milliseconds(1700));
+        CHECK(elapsed < std::chrono::seconds(4));
+    }
+
+    SECTION("The first window that contains the current time applies")
+    {
+        ADUC_DownloadWindow windows[3] = {};
+        windows[0].startMinute = GetMinuteOfDay(120);
+        windows[0].endMinute = GetMinuteOfDay(180);
+        windows[0].pauseDownloads = true;
+        windows[1].startMinute = GetMinuteOfDay(-60);
+        windows[1].endMinute = GetMinuteOfDay(60);
+        windows[1].bandwidthLimitKBps = 64;
+        windows[2].startMinute = 0;
+        windows[2].endMinute = 0;
+        windows[2].bandwidthLimitKBps = 32;
+
+        config.downloadBandwidthLimitKBps = 1024;
+        config.downloadWindows = windows;
+        config.downloadWindowCount = 3;
+        ADUC_DownloadGovernor_Configure(&config);
+
+        uint64_t bytesPerSecond = 0;
+        _Bool paused = true;
+        ADUC_DownloadGovernor_GetLimits(&bytesPerSecond, &paused);
+        CHECK(bytesPerSecond == 64 * 1024);
+        CHECK_FALSE(paused);
+
+        // Outside of all windows, the default limit applies.
+        config.downloadWindowCount = 1;
+        ADUC_DownloadGovernor_Configure(&config);
+        ADUC_DownloadGovernor_GetLimits(&bytesPerSecond, &paused);
+        CHECK(bytesPerSecond == 1024 * 1024);
+        CHECK_FALSE(paused);
+    }
+
+    SECTION("A paused window blocks until cancelled")
+    {
+        ADUC_DownloadWindow window = {};
+        window.startMinute = GetMinuteOfDay(-60);
+        window.endMinute = GetMinuteOfDay(60);
+        window.pauseDownloads = true;
+
+        config.downloadWindows = &window;
+        config.downloadWindowCount = 1;
+        ADUC_DownloadGovernor_Configure(&config);
+
+        _Bool paused = false;
+        ADUC_DownloadGovernor_GetLimits(nullptr, &paused);
+        CHECK(paused);
+
+        int pollCount = 0;
+        CHECK_FALSE(ADUC_DownloadGovernor_Acquire(0, CancelAfterFourPolls, &pollCount));
+        CHECK(pollCount == 4);
+
+        uint64_t waitMs = 0;
+        CHECK_FALSE(ADUC_DownloadGovernor_TryAcquire(1024, &waitMs));
+        CHECK(waitMs > 0);
+    }
+
+    SECTION("TryAcquire doesn't wait for the bucket to refill")
+    {
+        config.downloadBandwidthLimitKBps = 64;
+        ADUC_DownloadGovernor_Configure(&config);
+
+        // The first transfer overdraws the 64 KiB bucket by 64 KiB, which is paid back in about a second.
+        uint64_t waitMs = 1;
+        CHECK(ADUC_DownloadGovernor_TryAcquire(128 * 1024, &waitMs));
+        CHECK(waitMs == 0);
+
+        const auto start = std::chrono::steady_clock::now();
+        CHECK_FALSE(ADUC_DownloadGovernor_TryAcquire(1024, &waitMs));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+        CHECK(waitMs > 0);
+        CHECK(waitMs <= 250);
+    }
+
+    SECTION("Downloads pause while the pause file exists")
+    {
+        std::string pauseFilePath = "/tmp/download_governor_ut." + std::to_string(getpid());
+        std::ofstream{ pauseFilePath }.close();
+
+        config.downloadPauseFilePath = &pauseFilePath[0];
+        ADUC_DownloadGovernor_Configure(&config);
+
+        _Bool paused = false;
+        ADUC_DownloadGovernor_GetLimits(nullptr, &paused);
+        CHECK(paused);
+
+        std::atomic<bool> acquired{ false };
+        std::future<void> download = std::async(std::launch::async, [&acquired]() {
+            acquired = ADUC_DownloadGovernor_Acquire(1024, nullptr, nullptr);
+        });
+
+        CHECK(download.wait_for(std::chrono::milliseconds(500)) == std::future_status::timeout);
+        CHECK_FALSE(acquired);
+
+        // Resumes within the evaluation interval.
+        REQUIRE(std::remove(pauseFilePath.c_str()) == 0);
+        CHECK(download.wait_for(std::chrono::seconds(3)) == std::future_status::ready);
+        CHECK(acquired);
+    }
+
+    ADUC_DownloadGovernor_Configure(nullptr);
+}
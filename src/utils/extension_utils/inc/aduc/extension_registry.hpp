@@ -0,0 +1,156 @@
+/**
+ * @file extension_registry.hpp
+ * @brief In-memory registry of the registered Device Update extensions.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_EXTENSION_REGISTRY_HPP
+#define ADUC_EXTENSION_REGISTRY_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ADUC
+{
+/**
+ * @brief The kinds of extensions.
+ */
+enum class ExtensionKind
+{
+    UpdateContentHandler,
+    ContentDownloader,
+    ComponentEnumerator,
+};
+
+/**
+ * @brief A registered extension, as described by its registration file.
+ */
+struct ExtensionRegistration
+{
+    ExtensionKind Kind; /**< The kind of extension. */
+    std::string HandlerId; /**< The update type of an update content handler, if it was registered with one. */
+    std::string RegistrationFile; /**< The path of the registration file. */
+    std::string FilePath; /**< The path of the extension shared library. */
+    std::vector<std::pair<std::string, std::string>> Hashes; /**< The (algorithm, base64 value) file hashes. */
+    std::vector<std::string> RequiredSymbols; /**< The functions that the extension must export. */
+};
+
+/**
+ * @brief Registry of the registered extensions.
+ *
+ * The extension folders are scanned, and the registration files parsed, once when the registry is created. The
+ * registry then watches the folders with inotify, so a registration written while the agent runs (e.g. with
+ * --register-content-handler) is picked up on the next lookup.
+ *
+ * Lookups return an immutable snapshot of a registration, which remains valid after a refresh.
+ */
+class ExtensionRegistry
+{
+public:
+    /**
+     * @brief The folders and file names of the registrations.
+     */
+    struct Folders
+    {
+        std::string UpdateContentHandlers; /**< Holds one sub-folder per update content handler. */
+        std::string ContentDownloader; /**< Holds the content downloader registration. */
+        std::string ComponentEnumerator; /**< Holds the component enumerator registration. */
+        std::string UpdateContentHandlerRegFileName; /**< The name of an update content handler registration. */
+        std::string ExtensionRegFileName; /**< The name of the other registrations. */
+    };
+
+    /**
+     * @brief Creates a registry of the extensions registered in @p folders.
+     * @param folders The registration folders.
+     */
+    explicit ExtensionRegistry(Folders folders);
+    ~ExtensionRegistry();
+
+    ExtensionRegistry(const ExtensionRegistry&) = delete;
+    ExtensionRegistry& operator=(const ExtensionRegistry&) = delete;
+    ExtensionRegistry(ExtensionRegistry&&) = delete;
+    ExtensionRegistry& operator=(ExtensionRegistry&&) = delete;
+
+    /**
+     * @brief Gets the registry of the extensions registered in the agent's extension folders.
+     * @return ExtensionRegistry& The registry, created on first use.
+     */
+    static ExtensionRegistry& GetInstance();
+
+    /**
+     * @brief Finds the update content handler registered for @p updateType.
+     * @param updateType An update type or step handler type, e.g. "microsoft/script:1".
+     * @return std::shared_ptr<const ExtensionRegistration> The registration, or nullptr if there is none.
+     */
+    std::shared_ptr<const ExtensionRegistration> FindUpdateContentHandler(const std::string& updateType);
+
+    /**
+     * @brief Gets all the registered update content handlers.
+     * @return std::vector<std::shared_ptr<const ExtensionRegistration>> The registrations, by folder name.
+     */
+    std::vector<std::shared_ptr<const ExtensionRegistration>> GetUpdateContentHandlers();
+
+    /**
+     * @brief Finds the registered content downloader.
+     * @return std::shared_ptr<const ExtensionRegistration> The registration, or nullptr if there is none.
+     */
+    std::shared_ptr<const ExtensionRegistration> FindContentDownloader();
+
+    /**
+     * @brief Finds the registered component enumerator.
+     * @return std::shared_ptr<const ExtensionRegistration> The registration, or nullptr if there is none.
+     */
+    std::shared_ptr<const ExtensionRegistration> FindComponentEnumerator();
+
+    /**
+     * @brief Verifies the extension file of @p registration against its registered hashes.
+     * @param registration A registration returned by this registry.
+     * @return bool True if the file matches.
+     */
+    static bool VerifyFile(const ExtensionRegistration& registration);
+
+    /**
+     * @brief Scans the registration folders again, without waiting for a change notification.
+     */
+    void Refresh();
+
+    /**
+     * @brief Gets the name of the registration folder of an update content handler.
+     * @param updateType An update type or step handler type.
+     * @return std::string @p updateType, with '/' and ':' replaced by '_'.
+     */
+    static std::string FolderNameFromHandlerId(const std::string& updateType);
+
+private:
+    /**
+     * @brief An immutable view of the registration folders.
+     */
+    struct Snapshot
+    {
+        /** The update content handlers, by registration folder name. */
+        std::map<std::string, std::shared_ptr<const ExtensionRegistration>> UpdateContentHandlers;
+        std::shared_ptr<const ExtensionRegistration> ContentDownloader;
+        std::shared_ptr<const ExtensionRegistration> ComponentEnumerator;
+    };
+
+    std::shared_ptr<const Snapshot> GetSnapshot();
+    void RefreshLocked();
+    bool DrainNotifications();
+    bool Watch(const std::string& folder);
+
+    const Folders _folders;
+    std::mutex _mutex; /**< Guards _snapshot and the watches. */
+    std::shared_ptr<const Snapshot> _snapshot;
+    int _inotifyFd = -1;
+    std::map<int, std::string> _watches; /**< Watched folders, by watch descriptor. */
+    bool _watchingAll = false; /**< Whether the three registration folders are watched. */
+};
+
+} // namespace ADUC
+
+#endif // ADUC_EXTENSION_REGISTRY_HPP
@@ -15,6 +15,8 @@ EXTERN_C_BEGIN
 
 _Bool GetExtensionFileEntity(const char* extensionRegFile, ADUC_FileEntity* fileEntity);
 
+_Bool GetExtensionRegistrationInfo(const char* extensionRegFile, ADUC_FileEntity* fileEntity, char** handlerId);
+
 _Bool GetUpdateContentHandlerFileEntity(const char* updateType, ADUC_FileEntity* fileEntity);
 
 _Bool RegisterUpdateContentHandler(const char* updateType, const char* handlerFilePath);
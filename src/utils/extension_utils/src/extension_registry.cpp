@@ -0,0 +1,353 @@
+/**
+ * @file extension_registry.cpp
+ * @brief Implements the in-memory registry of the registered Device Update extensions.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/extension_registry.hpp"
+#include "aduc/extension_utils.h"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/parser_utils.h" // for ADUC_FileEntity_Uninit
+
+#include <algorithm> // for std::replace
+#include <dirent.h> // for opendir
+#include <errno.h>
+#include <stdlib.h> // for free
+#include <sys/inotify.h>
+#include <sys/stat.h> // for stat
+#include <unistd.h> // for read, close
+
+// Changes in a registration folder that may add, replace or remove a registration.
+#define EXTENSION_REGISTRY_WATCH_MASK \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+namespace ADUC
+{
+namespace
+{
+/**
+ * @brief Gets the functions that an extension of kind @p kind must export.
+ */
+std::vector<std::string> GetRequiredSymbols(ExtensionKind kind)
+{
+    switch (kind)
+    {
+    case ExtensionKind::UpdateContentHandler:
+        return { "CreateUpdateContentHandlerExtension" };
+
+    case ExtensionKind::ContentDownloader:
+        return { "Download", "Initialize" };
+
+    case ExtensionKind::ComponentEnumerator:
+        return { "GetAllComponents" };
+    }
+
+    return {};
+}
+
+/**
+ * @brief Parses the registration file @p regFile.
+ * @return std::shared_ptr<const ExtensionRegistration> The registration, or nullptr if @p regFile doesn't exist or
+ * isn't valid.
+ */
+std::shared_ptr<const ExtensionRegistration> ParseRegistration(const std::string& regFile, ExtensionKind kind)
+{
+    struct stat st;
+    if (stat(regFile.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return nullptr;
+    }
+
+    ADUC_FileEntity entity = {};
+    char* handlerId = nullptr;
+    if (!GetExtensionRegistrationInfo(regFile.c_str(), &entity, &handlerId))
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<ExtensionRegistration> registration;
+
+    if (entity.TargetFilename == nullptr || *entity.TargetFilename == '\0')
+    {
+        Log_Error("No extension file in registration '%s'.", regFile.c_str());
+    }
+    else
+    {
+        registration = std::make_shared<ExtensionRegistration>();
+        registration->Kind = kind;
+        registration->HandlerId = (handlerId != nullptr) ? handlerId : "";
+        registration->RegistrationFile = regFile;
+        registration->FilePath = entity.TargetFilename;
+        registration->RequiredSymbols = GetRequiredSymbols(kind);
+
+        for (size_t i = 0; i < entity.HashCount; ++i)
+        {
+            registration->Hashes.emplace_back(entity.Hash[i].type, entity.Hash[i].value);
+        }
+    }
+
+    ADUC_FileEntity_Uninit(&entity);
+    free(handlerId);
+
+    return registration;
+}
+
+} // namespace
+
+ExtensionRegistry::ExtensionRegistry(Folders folders) : _folders(std::move(folders))
+{
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd < 0)
+    {
+        // Registrations are still found, by scanning the folders on every lookup.
+        Log_Warn("Cannot watch the extension folders, errno: %d", errno);
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    RefreshLocked();
+}
+
+ExtensionRegistry::~ExtensionRegistry()
+{
+    if (_inotifyFd >= 0)
+    {
+        close(_inotifyFd);
+    }
+}
+
+ExtensionRegistry& ExtensionRegistry::GetInstance()
+{
+    static ExtensionRegistry instance{ Folders{ ADUC_UPDATE_CONTENT_HANDLER_EXTENSION_DIR,
+                                                ADUC_CONTENT_DOWNLOADER_EXTENSION_DIR,
+                                                ADUC_COMPONENT_ENUMERATOR_EXTENSION_DIR,
+                                                ADUC_UPDATE_CONTENT_HANDLER_REG_FILENAME,
+                                                ADUC_EXTENSION_REG_FILENAME } };
+    return instance;
+}
+
+std::string ExtensionRegistry::FolderNameFromHandlerId(const std::string& updateType)
+{
+    std::string name = updateType;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), ':', '_');
+    return name;
+}
+
+std::shared_ptr<const ExtensionRegistration>
+ExtensionRegistry::FindUpdateContentHandler(const std::string& updateType)
+{
+    const std::shared_ptr<const Snapshot> snapshot = GetSnapshot();
+
+    const auto entry = snapshot->UpdateContentHandlers.find(FolderNameFromHandlerId(updateType));
+    if (entry == snapshot->UpdateContentHandlers.end())
+    {
+        Log_Debug("No update content handler registered for '%s'.", updateType.c_str());
+        return nullptr;
+    }
+
+    return entry->second;
+}
+
+std::vector<std::shared_ptr<const ExtensionRegistration>> ExtensionRegistry::GetUpdateContentHandlers()
+{
+    const std::shared_ptr<const Snapshot> snapshot = GetSnapshot();
+
+    std::vector<std::shared_ptr<const ExtensionRegistration>> registrations;
+    for (const auto& entry : snapshot->UpdateContentHandlers)
+    {
+        registrations.push_back(entry.second);
+    }
+
+    return registrations;
+}
+
+std::shared_ptr<const ExtensionRegistration> ExtensionRegistry::FindContentDownloader()
+{
+    return GetSnapshot()->ContentDownloader;
+}
+
+std::shared_ptr<const ExtensionRegistration> ExtensionRegistry::FindComponentEnumerator()
+{
+    return GetSnapshot()->ComponentEnumerator;
+}
+
+bool ExtensionRegistry::VerifyFile(const ExtensionRegistration& registration)
+{
+    SHAversion algVersion;
+    std::vector<ADUC_Hash> hashes;
+
+    for (const auto& hash : registration.Hashes)
+    {
+        // ADUC_Hash isn't const-correct; ADUC_HashUtils_VerifyFileHashes doesn't modify the hashes.
+        hashes.push_back(ADUC_Hash{ const_cast<char*>(hash.second.c_str()), const_cast<char*>(hash.first.c_str()) });
+    }
+
+    if (hashes.empty() || !ADUC_HashUtils_GetShaVersionForTypeString(hashes[0].type, &algVersion))
+    {
+        Log_Error(
+            "Registration of %s has unsupported hash type %s",
+            registration.FilePath.c_str(),
+            hashes.empty() ? "(none)" : hashes[0].type);
+        return false;
+    }
+
+    if (!ADUC_HashUtils_VerifyFileHashes(
+            registration.FilePath.c_str(), hashes.data(), hashes.size(), nullptr /* verdicts */))
+    {
+        Log_Error("Hash for %s is not valid", registration.FilePath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void ExtensionRegistry::Refresh()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    (void)DrainNotifications();
+    RefreshLocked();
+}
+
+/**
+ * @brief Gets the current snapshot, scanning the folders again first if they changed. Folders that can't be watched,
+ * e.g. because they don't exist yet, are scanned on every lookup.
+ */
+std::shared_ptr<const ExtensionRegistry::Snapshot> ExtensionRegistry::GetSnapshot()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (DrainNotifications() || !_watchingAll)
+    {
+        RefreshLocked();
+    }
+
+    return _snapshot;
+}
+
+/**
+ * @brief Scans the registration folders and replaces the snapshot. Must be called with _mutex held.
+ *
+ * Each folder is watched before it is read, so a registration written during the scan is either read or notified.
+ */
+void ExtensionRegistry::RefreshLocked()
+{
+    auto snapshot = std::make_shared<Snapshot>();
+
+    bool watchingAll = Watch(_folders.UpdateContentHandlers);
+    watchingAll = Watch(_folders.ContentDownloader) && watchingAll;
+    watchingAll = Watch(_folders.ComponentEnumerator) && watchingAll;
+
+    DIR* dir = opendir(_folders.UpdateContentHandlers.c_str());
+    if (dir != nullptr)
+    {
+        const struct dirent* entry = nullptr;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+
+            const std::string folder = _folders.UpdateContentHandlers + "/" + name;
+            struct stat st;
+            if (stat(folder.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+            {
+                continue;
+            }
+
+            (void)Watch(folder);
+
+            auto registration = ParseRegistration(
+                folder + "/" + _folders.UpdateContentHandlerRegFileName, ExtensionKind::UpdateContentHandler);
+            if (registration != nullptr)
+            {
+                snapshot->UpdateContentHandlers.emplace(name, std::move(registration));
+            }
+        }
+
+        closedir(dir);
+    }
+
+    snapshot->ContentDownloader = ParseRegistration(
+        _folders.ContentDownloader + "/" + _folders.ExtensionRegFileName, ExtensionKind::ContentDownloader);
+    snapshot->ComponentEnumerator = ParseRegistration(
+        _folders.ComponentEnumerator + "/" + _folders.ExtensionRegFileName, ExtensionKind::ComponentEnumerator);
+
+    Log_Debug(
+        "Extension registry: %zu update content handler(s), content downloader: %s, component enumerator: %s.",
+        snapshot->UpdateContentHandlers.size(),
+        snapshot->ContentDownloader != nullptr ? snapshot->ContentDownloader->FilePath.c_str() : "(none)",
+        snapshot->ComponentEnumerator != nullptr ? snapshot->ComponentEnumerator->FilePath.c_str() : "(none)");
+
+    _snapshot = std::move(snapshot);
+    _watchingAll = watchingAll;
+}
+
+/**
+ * @brief Reads the pending change notifications. Must be called with _mutex held.
+ * @return bool True if a registration folder changed.
+ */
+bool ExtensionRegistry::DrainNotifications()
+{
+    bool changed = false;
+
+    if (_inotifyFd < 0)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        const ssize_t length = read(_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            // EAGAIN: no more notifications.
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < length;)
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+
+            if ((event->mask & IN_IGNORED) != 0)
+            {
+                // The folder was removed; it's watched again if it comes back.
+                _watches.erase(event->wd);
+            }
+
+            changed = true;
+            offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * @brief Watches @p folder for registration changes. Must be called with _mutex held.
+ * @return bool True if @p folder is watched.
+ */
+bool ExtensionRegistry::Watch(const std::string& folder)
+{
+    if (_inotifyFd < 0)
+    {
+        return false;
+    }
+
+    // Watching a folder again returns the same descriptor.
+    const int wd = inotify_add_watch(_inotifyFd, folder.c_str(), EXTENSION_REGISTRY_WATCH_MASK);
+    if (wd < 0)
+    {
+        return false;
+    }
+
+    _watches[wd] = folder;
+    return true;
+}
+
+} // namespace ADUC
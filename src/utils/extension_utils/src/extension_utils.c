@@ -40,12 +40,31 @@ static STRING_HANDLE FolderNameFromHandlerId(const char* handlerId)
  * @return _Bool Returns 'true' if succeeded.
  */
 _Bool GetExtensionFileEntity(const char* extensionRegFile, ADUC_FileEntity* fileEntity)
+{
+    return GetExtensionRegistrationInfo(extensionRegFile, fileEntity, NULL /* handlerId */);
+}
+
+/**
+ * @brief Get the Extension File Entity object, and the handler id of an update content handler registration.
+ *
+ * @param[in] extensionRegFile A full path to the extension registration file.
+ * @param[in,out] fileEntity An output buffer to hold file entity data.
+ * @param[out] handlerId Optional. Receives the registered handler id, or NULL if the registration has none.
+ * Caller must free.
+ * @return _Bool Returns 'true' if succeeded.
+ */
+_Bool GetExtensionRegistrationInfo(const char* extensionRegFile, ADUC_FileEntity* fileEntity, char** handlerId)
 {
     _Bool found = false;
     size_t tempHashCount = 0;
     ADUC_Hash* tempHash = NULL;
     const char* fileName = NULL;
 
+    if (handlerId != NULL)
+    {
+        *handlerId = NULL;
+    }
+
     JSON_Value* rootValue = json_parse_file(extensionRegFile);
     if (rootValue == NULL)
     {
@@ -77,6 +96,15 @@ _Bool GetExtensionFileEntity(const char* extensionRegFile, ADUC_FileEntity* file
         goto done;
     }
 
+    if (handlerId != NULL)
+    {
+        const char* id = json_object_get_string(fileObj, "handlerId");
+        if (id != NULL && mallocAndStrcpy_s(handlerId, id) != 0)
+        {
+            goto done;
+        }
+    }
+
     fileEntity->Hash = tempHash;
     fileEntity->HashCount = tempHashCount;
 
@@ -0,0 +1,195 @@
+/**
+ * @file extension_registry_ut.cpp
+ * @brief Unit Tests for the extension registry.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/extension_registry.hpp>
+#include <aduc/hash_utils.h>
+
+#include <catch2/catch.hpp>
+
+#include <cstdio> // for std::remove
+#include <fstream>
+#include <ftw.h> // for nftw
+#include <stdlib.h> // for mkdtemp, free
+#include <string>
+#include <sys/stat.h> // for mkdir
+
+using ADUC::ExtensionKind;
+using ADUC::ExtensionRegistration;
+using ADUC::ExtensionRegistry;
+
+class TempFolder
+{
+public:
+    TempFolder()
+    {
+        REQUIRE(mkdtemp(_path) != nullptr);
+    }
+
+    ~TempFolder()
+    {
+        (void)nftw(
+            _path,
+            [](const char* path, const struct stat*, int, struct FTW*) { return std::remove(path); },
+            16,
+            FTW_DEPTH | FTW_PHYS);
+    }
+
+    TempFolder(const TempFolder&) = delete;
+    TempFolder& operator=(const TempFolder&) = delete;
+    TempFolder(TempFolder&&) = delete;
+    TempFolder& operator=(TempFolder&&) = delete;
+
+    std::string Path(const std::string& name) const
+    {
+        return std::string(_path) + "/" + name;
+    }
+
+    ExtensionRegistry::Folders RegistryFolders() const
+    {
+        return ExtensionRegistry::Folders{
+            Path("handlers"), Path("downloader"), Path("enumerator"), "handler.json", "extension.json"
+        };
+    }
+
+private:
+    char _path[32] = "/tmp/extregistryXXXXXX";
+};
+
+static void WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+}
+
+/**
+ * @brief Writes an extension file with @p content, and its registration file in @p regFolder, the way the agent's
+ * --register-* options do.
+ */
+static void Register(
+    const std::string& regFolder,
+    const std::string& regFileName,
+    const std::string& extensionFile,
+    const std::string& content,
+    const std::string& handlerId = "")
+{
+    WriteFile(extensionFile, content);
+
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHash(extensionFile.c_str(), SHA256, &hash));
+
+    (void)mkdir(regFolder.c_str(), S_IRWXU);
+    WriteFile(
+        regFolder + "/" + regFileName,
+        R"({ "fileName": ")" + extensionFile + R"(", "sizeInBytes": )" + std::to_string(content.size())
+            + R"(, "hashes": { "sha256": ")" + hash + R"(" })"
+            + (handlerId.empty() ? "" : R"(, "handlerId": ")" + handlerId + R"(")") + " }");
+
+    free(hash);
+}
+
+TEST_CASE("ExtensionRegistry finds the registered extensions")
+{
+    TempFolder temp;
+    REQUIRE(mkdir(temp.Path("handlers").c_str(), S_IRWXU) == 0);
+
+    Register(
+        temp.Path("handlers/microsoft_script_1"),
+        "handler.json",
+        temp.Path("libscript.so"),
+        "script",
+        "microsoft/script:1");
+    Register(temp.Path("handlers/contoso_legacy_1"), "handler.json", temp.Path("liblegacy.so"), "legacy");
+    Register(temp.Path("downloader"), "extension.json", temp.Path("libdownloader.so"), "downloader");
+
+    ExtensionRegistry registry{ temp.RegistryFolders() };
+
+    SECTION("Update content handlers are found by update type")
+    {
+        auto registration = registry.FindUpdateContentHandler("microsoft/script:1");
+        REQUIRE(registration != nullptr);
+        CHECK(registration->Kind == ExtensionKind::UpdateContentHandler);
+        CHECK(registration->HandlerId == "microsoft/script:1");
+        CHECK(registration->FilePath == temp.Path("libscript.so"));
+        CHECK(registration->RegistrationFile == temp.Path("handlers/microsoft_script_1/handler.json"));
+        REQUIRE(registration->Hashes.size() == 1);
+        CHECK(registration->Hashes[0].first == "sha256");
+        CHECK(registration->RequiredSymbols == std::vector<std::string>{ "CreateUpdateContentHandlerExtension" });
+
+        CHECK(registry.FindUpdateContentHandler("microsoft/apt:1") == nullptr);
+    }
+
+    SECTION("All update content handlers are listed")
+    {
+        auto registrations = registry.GetUpdateContentHandlers();
+        REQUIRE(registrations.size() == 2);
+
+        // Registrations written by older agents have no handler id.
+        CHECK(registrations[0]->FilePath == temp.Path("liblegacy.so"));
+        CHECK(registrations[0]->HandlerId.empty());
+        CHECK(registrations[1]->HandlerId == "microsoft/script:1");
+    }
+
+    SECTION("Other extensions are found by kind")
+    {
+        auto downloader = registry.FindContentDownloader();
+        REQUIRE(downloader != nullptr);
+        CHECK(downloader->Kind == ExtensionKind::ContentDownloader);
+        CHECK(downloader->FilePath == temp.Path("libdownloader.so"));
+        CHECK(downloader->RequiredSymbols == std::vector<std::string>{ "Download", "Initialize" });
+
+        CHECK(registry.FindComponentEnumerator() == nullptr);
+    }
+
+    SECTION("Extension files are verified against their registered hashes")
+    {
+        auto registration = registry.FindUpdateContentHandler("microsoft/script:1");
+        REQUIRE(registration != nullptr);
+        CHECK(ExtensionRegistry::VerifyFile(*registration));
+
+        WriteFile(temp.Path("libscript.so"), "tampered");
+        CHECK_FALSE(ExtensionRegistry::VerifyFile(*registration));
+    }
+}
+
+TEST_CASE("ExtensionRegistry picks up registrations written after it was created")
+{
+    TempFolder temp;
+    REQUIRE(mkdir(temp.Path("handlers").c_str(), S_IRWXU) == 0);
+    REQUIRE(mkdir(temp.Path("downloader").c_str(), S_IRWXU) == 0);
+    REQUIRE(mkdir(temp.Path("enumerator").c_str(), S_IRWXU) == 0);
+
+    Register(temp.Path("downloader"), "extension.json", temp.Path("libdownloader1.so"), "downloader 1");
+
+    ExtensionRegistry registry{ temp.RegistryFolders() };
+
+    auto before = registry.FindContentDownloader();
+    REQUIRE(before != nullptr);
+    CHECK(registry.FindUpdateContentHandler("microsoft/swupdate:1") == nullptr);
+
+    Register(temp.Path("handlers/microsoft_swupdate_1"), "handler.json", temp.Path("libswupdate.so"), "swupdate");
+    Register(temp.Path("downloader"), "extension.json", temp.Path("libdownloader2.so"), "downloader 2");
+    Register(temp.Path("enumerator"), "extension.json", temp.Path("libenumerator.so"), "enumerator");
+
+    auto handler = registry.FindUpdateContentHandler("microsoft/swupdate:1");
+    REQUIRE(handler != nullptr);
+    CHECK(handler->FilePath == temp.Path("libswupdate.so"));
+
+    auto after = registry.FindContentDownloader();
+    REQUIRE(after != nullptr);
+    CHECK(after->FilePath == temp.Path("libdownloader2.so"));
+
+    auto enumerator = registry.FindComponentEnumerator();
+    REQUIRE(enumerator != nullptr);
+    CHECK(enumerator->FilePath == temp.Path("libenumerator.so"));
+
+    // Registrations returned earlier don't change.
+    CHECK(before->FilePath == temp.Path("libdownloader1.so"));
+
+    // Removed registrations are dropped.
+    REQUIRE(std::remove(temp.Path("enumerator/extension.json").c_str()) == 0);
+    CHECK(registry.FindComponentEnumerator() == nullptr);
+}
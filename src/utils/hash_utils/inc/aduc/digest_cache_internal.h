@@ -0,0 +1,44 @@
+/**
+ * @file digest_cache_internal.h
+ * @brief Internal interface between hash_utils and the persistent file digest cache.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DIGEST_CACHE_INTERNAL_H
+#define ADUC_DIGEST_CACHE_INTERNAL_H
+
+#include "aduc/c_utils.h"
+
+#include "azure_c_shared_utility/sha.h" // for SHAversion
+
+#include <stdbool.h> // for _Bool
+#include <stdint.h> // for int64_t
+#include <sys/stat.h> // for struct stat
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Looks up the digest of the file described by @p st.
+ * @param st The metadata of the opened file, from fstat().
+ * @param algorithm The hashing algorithm.
+ * @return char* The base64 digest if the cache holds a trusted entry whose key matches @p st, otherwise NULL.
+ * Caller must call free() when done.
+ */
+char* ADUC_DigestCache_Lookup(const struct stat* st, SHAversion algorithm);
+
+/**
+ * @brief Records the digest of the file described by @p st.
+ * @param path The path of the file.
+ * @param st The metadata of the file, from fstat() before it was read.
+ * @param algorithm The hashing algorithm.
+ * @param hashBase64 The base64 digest of the file content.
+ * @param hashStartTimeNs The CLOCK_REALTIME time, in nanoseconds, at which hashing started. Entries for files
+ * modified too close to that time are not recorded, since a later write in the same timestamp tick would go unnoticed.
+ */
+void ADUC_DigestCache_Store(
+    const char* path, const struct stat* st, SHAversion algorithm, const char* hashBase64, int64_t hashStartTimeNs);
+
+EXTERN_C_END
+
+#endif // ADUC_DIGEST_CACHE_INTERNAL_H
@@ -15,9 +15,246 @@
 
 #include <stdbool.h> // for _Bool
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint64_t
+#include <stdio.h> // for FILE
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief The implementation that computes message digests.
+ */
+typedef enum tagADUC_HashUtils_DigestBackend
+{
+    ADUC_HashUtils_DigestBackend_Portable = 0, /**< azure_c_shared_utility's portable C implementation. */
+    ADUC_HashUtils_DigestBackend_OpenSSL = 1, /**< OpenSSL EVP, which uses SHA-NI or ARMv8 crypto when available. */
+} ADUC_HashUtils_DigestBackend;
+
+/**
+ * @brief A message digest in progress, computed by the active digest backend.
+ */
+typedef struct tagADUC_HashUtils_DigestContext
+{
+    SHAversion Algorithm; /**< The hashing algorithm. */
+    void* EvpContext; /**< The EVP_MD_CTX when the OpenSSL backend is used; otherwise NULL. */
+    USHAContext ShaContext; /**< The portable digest state, used when EvpContext is NULL. */
+} ADUC_HashUtils_DigestContext;
+
+/**
+ * @brief Gets the digest backend used for new digest contexts.
+ * @return The active digest backend.
+ */
+ADUC_HashUtils_DigestBackend ADUC_HashUtils_GetDigestBackend(void);
+
+/**
+ * @brief Overrides the digest backend used for new digest contexts.
+ * @remark Not thread-safe. Intended for tests and diagnostics.
+ * @param backend The backend to use. Selecting OpenSSL when it is unavailable is ignored.
+ */
+void ADUC_HashUtils_SetDigestBackend(ADUC_HashUtils_DigestBackend backend);
+
+/**
+ * @brief Gets the name of the SHA instruction set extension detected on this CPU.
+ * @return "sha-ni", "armv8-sha2", "armv8-sha2-sha512" or "none".
+ */
+const char* ADUC_HashUtils_GetCpuShaAcceleration(void);
+
+/**
+ * @brief Initializes @p context to compute a @p algorithm digest.
+ * @param context The context to initialize.
+ * @param algorithm The hashing algorithm.
+ * @return bool True on success. On failure, @p context holds no resources.
+ */
+_Bool ADUC_HashUtils_DigestInit(ADUC_HashUtils_DigestContext* context, SHAversion algorithm);
+
+/**
+ * @brief Feeds @p size bytes of @p data into the digest.
+ * @param context The initialized context.
+ * @param data The data to hash.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_DigestUpdate(ADUC_HashUtils_DigestContext* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief Finalizes the digest and releases the context's resources.
+ * @param context The initialized context. It is uninitialized on return, even on failure.
+ * @param digest [out] Receives the digest. Must be at least USHAMaxHashSize bytes.
+ * @param digestSize [out] Receives the size of the digest, in bytes.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_DigestFinal(ADUC_HashUtils_DigestContext* context, uint8_t* digest, size_t* digestSize);
+
+/**
+ * @brief Finalizes the digest, encodes it as base64 and releases the context's resources.
+ * @param context The initialized context. It is uninitialized on return, even on failure.
+ * @return char* The base64 digest, or NULL on failure. Caller must call free() when done.
+ */
+char* ADUC_HashUtils_DigestFinalBase64(ADUC_HashUtils_DigestContext* context);
+
+/**
+ * @brief Initializes @p dest with a copy of the running digest in @p src, so an intermediate digest can be
+ * finalized while @p src keeps going.
+ * @param dest The context to initialize.
+ * @param src The initialized context to copy.
+ * @return bool True on success. On failure, @p dest holds no resources.
+ */
+_Bool ADUC_HashUtils_DigestCopy(ADUC_HashUtils_DigestContext* dest, const ADUC_HashUtils_DigestContext* src);
+
+/**
+ * @brief Releases the context's resources without finalizing the digest. Safe to call more than once.
+ * @param context The context.
+ */
+void ADUC_HashUtils_DigestUninit(ADUC_HashUtils_DigestContext* context);
+
+/**
+ * @brief The default size of the buffer used to read a file while hashing it.
+ */
+#define ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief The smallest and largest supported file hashing buffer sizes.
+ */
+#define ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE (64 * 1024)
+#define ADUC_HASH_UTILS_MAX_FILE_BUFFER_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief The alignment of the file hashing buffer.
+ */
+#define ADUC_HASH_UTILS_FILE_BUFFER_ALIGNMENT 4096
+
+/**
+ * @brief Options for the file digest engine used by ADUC_HashUtils_GetFileHash and ADUC_HashUtils_IsValidFileHash.
+ */
+typedef struct tagADUC_HashUtils_FileHashOptions
+{
+    size_t BufferSize; /**< The size of each read, in bytes. 0 selects ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE. */
+    _Bool UseMmap; /**< Whether to hash regular files through a read-only memory mapping instead of read(). */
+    _Bool DropPageCache; /**< Whether to drop already hashed pages from the page cache (POSIX_FADV_DONTNEED). */
+} ADUC_HashUtils_FileHashOptions;
+
+/**
+ * @brief Sets the options used by ADUC_HashUtils_GetFileHash and ADUC_HashUtils_IsValidFileHash.
+ * The agent sets them from the fileHash* options of its configuration file. Modules that don't call this function
+ * use the defaults.
+ * @remark Not thread-safe. Call once at startup, before any file is hashed.
+ * @param options The options to use. If NULL, restores the defaults. A BufferSize of 0 selects the default size,
+ * other sizes are clamped to [ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE, ADUC_HASH_UTILS_MAX_FILE_BUFFER_SIZE].
+ */
+void ADUC_HashUtils_SetFileHashOptions(const ADUC_HashUtils_FileHashOptions* options);
+
+/**
+ * @brief Gets the options currently used by the file digest engine.
+ * @param options [out] Receives the options.
+ */
+void ADUC_HashUtils_GetFileHashOptions(ADUC_HashUtils_FileHashOptions* options);
+
+/**
+ * @brief Enables the persistent digest cache in @p cacheFolder, creating the folder if needed.
+ *
+ * Once enabled, ADUC_HashUtils_GetFileHash and ADUC_HashUtils_IsValidFileHash reuse the recorded digest of a file
+ * whose device, inode, size, mtime and ctime are unchanged since it was last hashed, instead of reading it again.
+ * Modules that don't call this function use ADUC_DIGEST_CACHE_FOLDER if it already exists and is trusted.
+ *
+ * @remark Not thread-safe. Call once at startup.
+ * @param cacheFolder The cache folder. It must be owned by the effective user and have mode 0700.
+ * @return bool True if the cache is enabled.
+ */
+_Bool ADUC_HashUtils_DigestCache_Init(const char* cacheFolder);
+
+/**
+ * @brief Disables the persistent digest cache.
+ * @remark Not thread-safe.
+ */
+void ADUC_HashUtils_DigestCache_Uninit(void);
+
+/**
+ * @brief Removes the entries of files that were deleted, replaced or modified, the leftovers of interrupted stores,
+ * and the oldest entries beyond a fixed maximum number of entries.
+ * @remark Call while no file is being hashed, e.g. when the agent is idle.
+ */
+void ADUC_HashUtils_DigestCache_CollectGarbage(void);
+
+/**
+ * @brief Verifies a stream of file content block by block against an ADUC_ChunkManifest,
+ * so corrupt content is rejected as soon as the first bad block has been received.
+ */
+typedef struct tagADUC_HashUtils_ChunkVerifier
+{
+    const ADUC_ChunkManifest* Manifest; /**< The block hashes. Not owned. NULL if block verification is disabled. */
+    SHAversion Algorithm; /**< The algorithm of the block hashes. */
+    ADUC_HashUtils_DigestContext Context; /**< The running digest of the block being received. */
+    size_t ChunkIndex; /**< The index of the block being received. All blocks before it were verified. */
+    size_t ChunkFill; /**< The number of bytes of the current block received so far. */
+} ADUC_HashUtils_ChunkVerifier;
+
+/**
+ * @brief Initializes @p verifier to verify content starting at @p offset.
+ * @param verifier The verifier to initialize.
+ * @param manifest The block hashes. Must outlive the verifier.
+ * @param offset The offset of the first byte that will be passed to ADUC_HashUtils_ChunkVerifier_Update.
+ * Must be a multiple of the block size; the blocks before it are treated as verified.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Init(
+    ADUC_HashUtils_ChunkVerifier* verifier, const ADUC_ChunkManifest* manifest, uint64_t offset);
+
+/**
+ * @brief Feeds @p size bytes of @p data into the verifier, checking each block as soon as it is complete.
+ * @param verifier The initialized verifier.
+ * @param data The data.
+ * @param size The number of bytes in @p data.
+ * @return bool True if every block completed so far matches its hash.
+ * On a mismatch, the verifier is rewound to the start of the bad block.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Update(ADUC_HashUtils_ChunkVerifier* verifier, const uint8_t* data, size_t size);
+
+/**
+ * @brief Verifies the trailing partial block, if any, and releases the verifier's resources.
+ * @param verifier The initialized verifier.
+ * @return bool True if every block in the manifest was received and matches its hash.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Final(ADUC_HashUtils_ChunkVerifier* verifier);
+
+/**
+ * @brief Releases the verifier's resources. Safe to call more than once.
+ * @param verifier The verifier.
+ */
+void ADUC_HashUtils_ChunkVerifier_Uninit(ADUC_HashUtils_ChunkVerifier* verifier);
+
+/**
+ * @brief Gets the number of leading bytes that were verified, i.e. the offset of the current block.
+ * @param verifier The initialized verifier.
+ * @return uint64_t The size of the verified prefix, in bytes.
+ */
+uint64_t ADUC_HashUtils_ChunkVerifier_GetVerifiedSize(const ADUC_HashUtils_ChunkVerifier* verifier);
+
+/**
+ * @brief The number of SHAversion values, used to index per-algorithm arrays.
+ */
+#define ADUC_HASH_UTILS_SHA_VERSION_COUNT (SHA512 + 1)
+
+/**
+ * @brief A download sink that writes received content to a file and hashes it in the same pass,
+ * so the file never has to be read back for verification.
+ */
+typedef struct tagADUC_HashUtils_FileSink
+{
+    FILE* File; /**< The output file. NULL when the sink is not open. */
+    ADUC_HashUtils_DigestContext Context; /**< The running digest of everything written from DigestOffset on. */
+    SHAversion Algorithm; /**< The hashing algorithm. */
+    uint64_t BytesWritten; /**< The number of bytes written to the sink. */
+    /** The number of leading bytes kept from an earlier attempt and verified by blocks only, so not in the digests. */
+    uint64_t DigestOffset;
+    char* ResumePath; /**< The output file of a sink opened for resume, whose verified blocks are recorded on close. */
+    ADUC_HashUtils_ChunkVerifier Chunks; /**< Block-level verification. Disabled if Chunks.Manifest is NULL. */
+    _Bool ChunkMismatch; /**< True if content was rejected because it does not match the chunk manifest. */
+    const ADUC_Hash* ExpectedHashes; /**< Every hash compared on close. Not owned. NULL if not set. */
+    size_t ExpectedHashCount; /**< The number of hashes in ExpectedHashes. */
+    /** The running digests of the other algorithms of ExpectedHashes, indexed by SHAversion. */
+    ADUC_HashUtils_DigestContext ExtraContexts[ADUC_HASH_UTILS_SHA_VERSION_COUNT];
+    _Bool ExtraActive[ADUC_HASH_UTILS_SHA_VERSION_COUNT]; /**< Which of ExtraContexts are in use. */
+} ADUC_HashUtils_FileSink;
+
 _Bool ADUC_HashUtils_IsValidFileHash(const char* path, const char* hashBase64, SHAversion algorithm);
 
 _Bool ADUC_HashUtils_IsValidBufferHash(
@@ -27,6 +264,118 @@ _Bool ADUC_HashUtils_GetShaVersionForTypeString(const char* hashTypeStr, SHAvers
 
 _Bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash);
 
+/**
+ * @brief The result of verifying one entry of an ADUC_Hash array.
+ */
+typedef enum tagADUC_HashUtils_HashVerdict
+{
+    ADUC_HashUtils_HashVerdict_Unsupported = 0, /**< The hash type is not supported, so it was not checked. */
+    ADUC_HashUtils_HashVerdict_Match = 1, /**< The file matches the hash. */
+    ADUC_HashUtils_HashVerdict_Mismatch = 2, /**< The file does not match the hash. */
+} ADUC_HashUtils_HashVerdict;
+
+/**
+ * @brief Verifies every hash in @p hashArray against the file at @p path, reading the file at most once.
+ *
+ * @param path The path to the file to check.
+ * @param hashArray The expected hashes, e.g. ADUC_FileEntity::Hash.
+ * @param hashCount The number of hashes in @p hashArray.
+ * @param verdicts Optional. An array of @p hashCount entries that receives the verdict for each hash.
+ * @return bool True if @p hashArray isn't empty, and every hash has a supported algorithm and matches. A hash with
+ * an unsupported or missing type fails the verification, so a file is never accepted on a subset of its hashes.
+ */
+_Bool ADUC_HashUtils_VerifyFileHashes(
+    const char* path, const ADUC_Hash* hashArray, size_t hashCount, ADUC_HashUtils_HashVerdict* verdicts);
+
+/**
+ * @brief Opens (truncates) the file at @p path for writing and resets the running digest.
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm to use.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_Open(ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm);
+
+/**
+ * @brief Enables block-level verification of the content written to @p sink.
+ * Once enabled, ADUC_HashUtils_FileSink_Write fails as soon as a block does not match @p manifest.
+ * @param sink The open sink. Nothing must have been written to it yet.
+ * @param manifest The block hashes. Must outlive the sink.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_SetChunkManifest(ADUC_HashUtils_FileSink* sink, const ADUC_ChunkManifest* manifest);
+
+/**
+ * @brief Has the sink compute a digest for every algorithm in @p hashArray, and compare every hash on close.
+ * If content was already kept in the sink's file, e.g. by ADUC_HashUtils_FileSink_OpenForAppend, it is read back
+ * for the algorithms other than the sink's own.
+ * @param sink The open sink.
+ * @param hashArray The expected hashes, e.g. ADUC_FileEntity::Hash. Must outlive the sink.
+ * @param hashCount The number of hashes in @p hashArray.
+ * @return bool True on success. False if a hash has an unsupported or missing type.
+ */
+_Bool ADUC_HashUtils_FileSink_SetExpectedHashes(
+    ADUC_HashUtils_FileSink* sink, const ADUC_Hash* hashArray, size_t hashCount);
+
+/**
+ * @brief Opens the partially downloaded file at @p path so the download can be resumed.
+ *
+ * The leading blocks of the file that match @p manifest are kept, and the file is truncated after them. The last
+ * block is always re-downloaded. On return, BytesWritten and DigestOffset are the offset at which the download must
+ * resume; it is 0 if the file does not exist or its first block is bad.
+ *
+ * When the sink is closed, the number of verified blocks and the identity of the file are recorded next to it (in
+ * "<path>.chunks"), so the next attempt keeps them without reading them back. Without a valid record, the blocks
+ * are read back and verified. The kept blocks are not fed into the whole-file digests: the chunk manifest covers
+ * every byte of the file, so a sink that kept blocks is verified by blocks only, and ADUC_HashUtils_FileSink_Close
+ * returns no hash for it.
+ *
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm of the whole-file hash.
+ * @param manifest The block hashes. Must outlive the sink.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_OpenForResume(
+    ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm, const ADUC_ChunkManifest* manifest);
+
+/**
+ * @brief Opens the partially downloaded file at @p path to append to its first @p length bytes.
+ *
+ * The first @p length bytes are fed into the running digest, and the file is truncated after them.
+ *
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm.
+ * @param length The number of bytes to keep.
+ * @param prefixHashBase64 Optional. The expected hash of the first @p length bytes, e.g. the one returned by
+ * ADUC_HashUtils_FileSink_Close when the previous attempt stopped.
+ * @return bool True on success. False if the file is shorter than @p length or its prefix doesn't match.
+ */
+_Bool ADUC_HashUtils_FileSink_OpenForAppend(
+    ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm, uint64_t length, const char* prefixHashBase64);
+
+/**
+ * @brief Writes @p size bytes of @p data to the sink's file and feeds them into the running digest.
+ * @param sink The open sink.
+ * @param data The data to write.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_Write(ADUC_HashUtils_FileSink* sink, const uint8_t* data, size_t size);
+
+/**
+ * @brief Flushes and closes the sink's file, then compares the digest of everything written to @p hashBase64,
+ * and to every hash set with ADUC_HashUtils_FileSink_SetExpectedHashes.
+ * @param sink The sink to close. The sink is always closed, even on failure.
+ * @param hashBase64 The expected hash of the sink's algorithm. If NULL, only computes the hash, and neither the
+ * expected hashes nor the completeness of the chunk manifest are checked, e.g. for an incomplete download.
+ * @param outputHash Optional. Receives the computed base64 hash, or NULL if DigestOffset is not 0.
+ * Caller must call free() when done.
+ * @return bool True if the file was written successfully and every hash matches.
+ */
+_Bool ADUC_HashUtils_FileSink_Close(ADUC_HashUtils_FileSink* sink, const char* hashBase64, char** outputHash);
+
 /**
  * @brief Get file hash type at specified index.
  * @param hashArray The ADUC_Hash array.
@@ -69,6 +418,12 @@ void ADUC_Hash_UnInit(ADUC_Hash* hash);
  */
 void ADUC_Hash_FreeArray(size_t hashCount, ADUC_Hash* hashArray);
 
+/**
+ * @brief Frees an ADUC_ChunkManifest and its members.
+ * @param manifest The chunk manifest. May be NULL.
+ */
+void ADUC_ChunkManifest_Free(ADUC_ChunkManifest* manifest);
+
 EXTERN_C_END
 
 #endif // ADUC_HASH_UTILS_H
@@ -0,0 +1,226 @@
+/**
+ * @file chunk_verifier.c
+ * @brief Implements block-level verification of file content against an ADUC_ChunkManifest.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/hash_utils.h"
+
+#include <stdlib.h> // for free
+#include <string.h> // for memset, strcmp
+
+#include <azure_c_shared_utility/azure_base64.h>
+#include <azure_c_shared_utility/strings.h>
+
+#include <aduc/logging.h>
+
+/**
+ * @brief Finalizes the digest of the current block and compares it to the manifest.
+ * @return bool True if the block matches. Either way, the verifier is positioned at a block boundary.
+ */
+static bool VerifyCurrentChunk(ADUC_HashUtils_ChunkVerifier* verifier)
+{
+    bool success = false;
+    uint8_t digest[USHAMaxHashSize];
+    size_t digestSize = 0;
+    STRING_HANDLE encodedDigest = NULL;
+    const char* expected = verifier->Manifest->ChunkHashes[verifier->ChunkIndex];
+
+    verifier->ChunkFill = 0;
+
+    if (!ADUC_HashUtils_DigestFinal(&verifier->Context, digest, &digestSize))
+    {
+        goto done;
+    }
+
+    encodedDigest = Azure_Base64_Encode_Bytes(digest, digestSize);
+    if (encodedDigest == NULL)
+    {
+        Log_Error("Error in Base64 Encoding");
+        goto done;
+    }
+
+    if (expected == NULL || strcmp(expected, STRING_c_str(encodedDigest)) != 0)
+    {
+        Log_Error(
+            "Invalid hash for block %zu, Expect: %s, Result: %s",
+            verifier->ChunkIndex,
+            expected,
+            STRING_c_str(encodedDigest));
+        goto done;
+    }
+
+    ++verifier->ChunkIndex;
+    success = true;
+
+done:
+    STRING_delete(encodedDigest);
+    return success;
+}
+
+/**
+ * @brief Initializes @p verifier to verify content starting at @p offset.
+ * @param verifier The verifier to initialize.
+ * @param manifest The block hashes. Must outlive the verifier.
+ * @param offset The offset of the first byte that will be passed to ADUC_HashUtils_ChunkVerifier_Update.
+ * Must be a multiple of the block size; the blocks before it are treated as verified.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Init(
+    ADUC_HashUtils_ChunkVerifier* verifier, const ADUC_ChunkManifest* manifest, uint64_t offset)
+{
+    if (verifier == NULL || manifest == NULL)
+    {
+        Log_Error("Invalid input. verifier: %p, manifest: %p", verifier, manifest);
+        return false;
+    }
+
+    memset(verifier, 0, sizeof(*verifier));
+
+    if (manifest->ChunkSize == 0 || manifest->ChunkSize > ADUC_CHUNK_MANIFEST_MAX_CHUNK_SIZE
+        || manifest->ChunkCount == 0 || manifest->ChunkHashes == NULL)
+    {
+        Log_Error("Invalid chunk manifest. chunkSize: %zu, chunkCount: %zu", manifest->ChunkSize, manifest->ChunkCount);
+        return false;
+    }
+
+    if (!ADUC_HashUtils_GetShaVersionForTypeString(manifest->HashType, &verifier->Algorithm))
+    {
+        Log_Error("Unsupported chunk hash type %s", manifest->HashType);
+        return false;
+    }
+
+    if (offset % manifest->ChunkSize != 0 || offset / manifest->ChunkSize > manifest->ChunkCount)
+    {
+        Log_Error("Offset %llu is not a block boundary.", (unsigned long long)offset);
+        return false;
+    }
+
+    verifier->Manifest = manifest;
+    verifier->ChunkIndex = (size_t)(offset / manifest->ChunkSize);
+    return true;
+}
+
+/**
+ * @brief Feeds @p size bytes of @p data into the verifier, checking each block as soon as it is complete.
+ * @param verifier The initialized verifier.
+ * @param data The data.
+ * @param size The number of bytes in @p data.
+ * @return bool True if every block completed so far matches its hash.
+ * On a mismatch, the verifier is rewound to the start of the bad block.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Update(ADUC_HashUtils_ChunkVerifier* verifier, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        if (verifier->ChunkIndex >= verifier->Manifest->ChunkCount)
+        {
+            Log_Error("Content is larger than the %zu blocks in the chunk manifest.", verifier->Manifest->ChunkCount);
+            return false;
+        }
+
+        if (verifier->ChunkFill == 0 && !ADUC_HashUtils_DigestInit(&verifier->Context, verifier->Algorithm))
+        {
+            return false;
+        }
+
+        const size_t remaining = verifier->Manifest->ChunkSize - verifier->ChunkFill;
+        const size_t updateSize = (size < remaining) ? size : remaining;
+
+        if (!ADUC_HashUtils_DigestUpdate(&verifier->Context, data, updateSize))
+        {
+            return false;
+        }
+
+        verifier->ChunkFill += updateSize;
+        data += updateSize;
+        size -= updateSize;
+
+        if (verifier->ChunkFill == verifier->Manifest->ChunkSize && !VerifyCurrentChunk(verifier))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Verifies the trailing partial block, if any, and releases the verifier's resources.
+ * @param verifier The initialized verifier.
+ * @return bool True if every block in the manifest was received and matches its hash.
+ */
+_Bool ADUC_HashUtils_ChunkVerifier_Final(ADUC_HashUtils_ChunkVerifier* verifier)
+{
+    bool success = false;
+
+    // Only the last block may be shorter than the block size.
+    if (verifier->ChunkFill > 0
+        && (verifier->ChunkIndex + 1 != verifier->Manifest->ChunkCount || !VerifyCurrentChunk(verifier)))
+    {
+        goto done;
+    }
+
+    if (verifier->ChunkIndex != verifier->Manifest->ChunkCount)
+    {
+        Log_Error(
+            "Content ended after %zu of %zu blocks in the chunk manifest.",
+            verifier->ChunkIndex,
+            verifier->Manifest->ChunkCount);
+        goto done;
+    }
+
+    success = true;
+
+done:
+    ADUC_HashUtils_ChunkVerifier_Uninit(verifier);
+    return success;
+}
+
+/**
+ * @brief Releases the verifier's resources. Safe to call more than once.
+ * @param verifier The verifier.
+ */
+void ADUC_HashUtils_ChunkVerifier_Uninit(ADUC_HashUtils_ChunkVerifier* verifier)
+{
+    if (verifier != NULL)
+    {
+        ADUC_HashUtils_DigestUninit(&verifier->Context);
+        verifier->ChunkFill = 0;
+    }
+}
+
+/**
+ * @brief Gets the number of leading bytes that were verified, i.e. the offset of the current block.
+ * @param verifier The initialized verifier.
+ * @return uint64_t The size of the verified prefix, in bytes.
+ */
+uint64_t ADUC_HashUtils_ChunkVerifier_GetVerifiedSize(const ADUC_HashUtils_ChunkVerifier* verifier)
+{
+    return (verifier->Manifest == NULL) ? 0 : (uint64_t)verifier->ChunkIndex * verifier->Manifest->ChunkSize;
+}
+
+/**
+ * @brief Frees an ADUC_ChunkManifest and its members.
+ * @param manifest The chunk manifest. May be NULL.
+ */
+void ADUC_ChunkManifest_Free(ADUC_ChunkManifest* manifest)
+{
+    if (manifest == NULL)
+    {
+        return;
+    }
+
+    if (manifest->ChunkHashes != NULL)
+    {
+        for (size_t i = 0; i < manifest->ChunkCount; ++i)
+        {
+            free(manifest->ChunkHashes[i]);
+        }
+    }
+
+    free(manifest->ChunkHashes);
+    free(manifest->HashType);
+    free(manifest);
+}
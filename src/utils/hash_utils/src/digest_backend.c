@@ -0,0 +1,328 @@
+/**
+ * @file digest_backend.c
+ * @brief Implements the pluggable message digest backend used by hash_utils.
+ *
+ * The OpenSSL EVP backend is preferred. libcrypto selects SHA-NI (x86-64) or the ARMv8 cryptography
+ * extensions at runtime when the CPU supports them, and uses its assembly implementations otherwise.
+ * The portable azure_c_shared_utility SHA code is used when OpenSSL cannot provide the algorithm.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/hash_utils.h"
+
+#include <pthread.h> // for pthread_once
+#include <string.h> // for memset
+
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <cpuid.h> // for __get_cpuid_count
+#elif defined(__aarch64__)
+#    include <sys/auxv.h> // for getauxval
+#endif
+
+#include <aduc/logging.h>
+
+//
+// CPU feature detection.
+//
+
+// CPUID.(EAX=07H, ECX=0):EBX[bit 29] - Intel SHA extensions.
+#define CPUID_EBX_SHA_BIT (1u << 29)
+
+// AT_HWCAP bits for the ARMv8 cryptography extensions (see asm/hwcap.h).
+#define ARM64_HWCAP_SHA2 (1ul << 6)
+#define ARM64_HWCAP_SHA512 (1ul << 21)
+
+static pthread_once_t s_backendInitOnce = PTHREAD_ONCE_INIT;
+static ADUC_HashUtils_DigestBackend s_backend = ADUC_HashUtils_DigestBackend_Portable;
+static bool s_isOpenSSLAvailable = false;
+static const char* s_cpuAcceleration = "none";
+
+/**
+ * @brief Detects the SHA instructions supported by the CPU.
+ * @return The name of the detected SHA instruction set extension, or "none".
+ */
+static const char* DetectCpuShaAcceleration(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0 && (ebx & CPUID_EBX_SHA_BIT) != 0)
+    {
+        return "sha-ni";
+    }
+#elif defined(__aarch64__)
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+
+    if ((hwcap & ARM64_HWCAP_SHA512) != 0)
+    {
+        return "armv8-sha2-sha512";
+    }
+
+    if ((hwcap & ARM64_HWCAP_SHA2) != 0)
+    {
+        return "armv8-sha2";
+    }
+#endif
+
+    return "none";
+}
+
+/**
+ * @brief Returns the OpenSSL message digest for @p algorithm.
+ */
+static const EVP_MD* GetEvpMd(SHAversion algorithm)
+{
+    switch (algorithm)
+    {
+    case SHA1:
+        return EVP_sha1();
+    case SHA224:
+        return EVP_sha224();
+    case SHA256:
+        return EVP_sha256();
+    case SHA384:
+        return EVP_sha384();
+    case SHA512:
+        return EVP_sha512();
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Selects the digest backend once per process.
+ */
+static void InitDigestBackend(void)
+{
+    s_cpuAcceleration = DetectCpuShaAcceleration();
+
+    // Probe the EVP backend; a libcrypto built without the SHA-2 family can't be used.
+    EVP_MD_CTX* probe = EVP_MD_CTX_new();
+    if (probe != NULL && EVP_DigestInit_ex(probe, EVP_sha256(), NULL) == 1)
+    {
+        s_isOpenSSLAvailable = true;
+        s_backend = ADUC_HashUtils_DigestBackend_OpenSSL;
+    }
+    EVP_MD_CTX_free(probe);
+
+    Log_Info(
+        "Digest backend: %s, CPU SHA acceleration: %s",
+        s_backend == ADUC_HashUtils_DigestBackend_OpenSSL ? "openssl" : "portable",
+        s_cpuAcceleration);
+}
+
+/**
+ * @brief Gets the digest backend used for new digest contexts.
+ * @return The active digest backend.
+ */
+ADUC_HashUtils_DigestBackend ADUC_HashUtils_GetDigestBackend(void)
+{
+    pthread_once(&s_backendInitOnce, InitDigestBackend);
+    return s_backend;
+}
+
+/**
+ * @brief Overrides the digest backend used for new digest contexts.
+ * @remark Not thread-safe. Intended for tests and diagnostics.
+ * @param backend The backend to use. Selecting OpenSSL when it is unavailable is ignored.
+ */
+void ADUC_HashUtils_SetDigestBackend(ADUC_HashUtils_DigestBackend backend)
+{
+    pthread_once(&s_backendInitOnce, InitDigestBackend);
+
+    if (backend == ADUC_HashUtils_DigestBackend_Portable)
+    {
+        s_backend = backend;
+    }
+    else if (backend == ADUC_HashUtils_DigestBackend_OpenSSL)
+    {
+        s_backend = s_isOpenSSLAvailable ? backend : ADUC_HashUtils_DigestBackend_Portable;
+    }
+}
+
+/**
+ * @brief Gets the name of the SHA instruction set extension detected on this CPU.
+ * @return "sha-ni", "armv8-sha2", "armv8-sha2-sha512" or "none".
+ */
+const char* ADUC_HashUtils_GetCpuShaAcceleration(void)
+{
+    pthread_once(&s_backendInitOnce, InitDigestBackend);
+    return s_cpuAcceleration;
+}
+
+//
+// Digest context.
+//
+
+/**
+ * @brief Initializes @p context to compute a @p algorithm digest.
+ * @param context The context to initialize.
+ * @param algorithm The hashing algorithm.
+ * @return bool True on success. On failure, @p context holds no resources.
+ */
+_Bool ADUC_HashUtils_DigestInit(ADUC_HashUtils_DigestContext* context, SHAversion algorithm)
+{
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    memset(context, 0, sizeof(*context));
+    context->Algorithm = algorithm;
+
+    if (ADUC_HashUtils_GetDigestBackend() == ADUC_HashUtils_DigestBackend_OpenSSL)
+    {
+        const EVP_MD* md = GetEvpMd(algorithm);
+        EVP_MD_CTX* evpContext = (md != NULL) ? EVP_MD_CTX_new() : NULL;
+
+        if (evpContext != NULL && EVP_DigestInit_ex(evpContext, md, NULL) == 1)
+        {
+            context->EvpContext = evpContext;
+            return true;
+        }
+
+        EVP_MD_CTX_free(evpContext);
+        Log_Warn("EVP digest init failed, SHAversion: %d. Using portable implementation.", algorithm);
+    }
+
+    if (USHAReset(&context->ShaContext, algorithm) != 0)
+    {
+        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Feeds @p size bytes of @p data into the digest.
+ * @param context The initialized context.
+ * @param data The data to hash.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_DigestUpdate(ADUC_HashUtils_DigestContext* context, const uint8_t* data, size_t size)
+{
+    if (context->EvpContext != NULL)
+    {
+        if (EVP_DigestUpdate((EVP_MD_CTX*)context->EvpContext, data, size) != 1)
+        {
+            Log_Error("Error in EVP digest update, SHAversion: %d", context->Algorithm);
+            return false;
+        }
+
+        return true;
+    }
+
+    // USHAInput takes an unsigned int length.
+    while (size > 0)
+    {
+        const unsigned int chunkSize = (size > 0x40000000) ? 0x40000000 : (unsigned int)size;
+
+        if (USHAInput(&context->ShaContext, data, chunkSize) != 0)
+        {
+            Log_Error("Error in SHA Input, SHAversion: %d", context->Algorithm);
+            return false;
+        }
+
+        data += chunkSize;
+        size -= chunkSize;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Finalizes the digest and releases the context's resources.
+ * @param context The initialized context. It is uninitialized on return, even on failure.
+ * @param digest [out] Receives the digest. Must be at least USHAMaxHashSize bytes.
+ * @param digestSize [out] Receives the size of the digest, in bytes.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_DigestFinal(ADUC_HashUtils_DigestContext* context, uint8_t* digest, size_t* digestSize)
+{
+    _Bool success = false;
+
+    if (context->EvpContext != NULL)
+    {
+        unsigned int evpDigestSize = 0;
+
+        if (EVP_DigestFinal_ex((EVP_MD_CTX*)context->EvpContext, digest, &evpDigestSize) != 1)
+        {
+            Log_Error("Error in EVP digest final, SHAversion: %d", context->Algorithm);
+            goto done;
+        }
+
+        *digestSize = evpDigestSize;
+    }
+    else
+    {
+        if (USHAResult(&context->ShaContext, digest) != 0)
+        {
+            Log_Error("Error in SHA Result, SHAversion: %d", context->Algorithm);
+            goto done;
+        }
+
+        *digestSize = (size_t)USHAHashSize(context->Algorithm);
+    }
+
+    success = true;
+
+done:
+    ADUC_HashUtils_DigestUninit(context);
+    return success;
+}
+
+/**
+ * @brief Initializes @p dest with a copy of the running digest in @p src, so an intermediate digest can be
+ * finalized while @p src keeps going.
+ * @param dest The context to initialize.
+ * @param src The initialized context to copy.
+ * @return bool True on success. On failure, @p dest holds no resources.
+ */
+_Bool ADUC_HashUtils_DigestCopy(ADUC_HashUtils_DigestContext* dest, const ADUC_HashUtils_DigestContext* src)
+{
+    if (dest == NULL || src == NULL)
+    {
+        return false;
+    }
+
+    memset(dest, 0, sizeof(*dest));
+    dest->Algorithm = src->Algorithm;
+
+    if (src->EvpContext == NULL)
+    {
+        dest->ShaContext = src->ShaContext;
+        return true;
+    }
+
+    EVP_MD_CTX* evpContext = EVP_MD_CTX_new();
+    if (evpContext == NULL || EVP_MD_CTX_copy_ex(evpContext, (const EVP_MD_CTX*)src->EvpContext) != 1)
+    {
+        Log_Error("Error in EVP digest copy, SHAversion: %d", src->Algorithm);
+        EVP_MD_CTX_free(evpContext);
+        return false;
+    }
+
+    dest->EvpContext = evpContext;
+    return true;
+}
+
+/**
+ * @brief Releases the context's resources without finalizing the digest. Safe to call more than once.
+ * @param context The context.
+ */
+void ADUC_HashUtils_DigestUninit(ADUC_HashUtils_DigestContext* context)
+{
+    if (context != NULL && context->EvpContext != NULL)
+    {
+        EVP_MD_CTX_free((EVP_MD_CTX*)context->EvpContext);
+        context->EvpContext = NULL;
+    }
+}
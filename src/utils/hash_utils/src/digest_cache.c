@@ -0,0 +1,517 @@
+/**
+ * @file digest_cache.c
+ * @brief Implements a persistent cache of verified file digests.
+ *
+ * Each entry is a small file named <dev>-<inode>-<algorithm> in the cache folder that records the size,
+ * mtime and ctime of the file when it was hashed, its base64 digest and its path. An entry is only used when
+ * all of those still match the file, so any write, truncation, chmod, rename or replacement invalidates it.
+ * The path lets ADUC_HashUtils_DigestCache_CollectGarbage find the entries of deleted or replaced files.
+ *
+ * To guard against tampering, the cache folder must be a directory owned by the effective user of the process
+ * with mode 0700, and each entry must be a regular file owned by the same user with mode 0600.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/digest_cache_internal.h"
+#include "aduc/hash_utils.h"
+
+#include <dirent.h> // for opendir, readdir
+#include <errno.h>
+#include <fcntl.h> // for open
+#include <inttypes.h> // for PRIx64, SCNd64
+#include <limits.h> // for PATH_MAX
+#include <pthread.h> // for pthread_once
+#include <stdio.h> // for snprintf
+#include <stdlib.h> // for free, qsort
+#include <string.h> // for strdup, strcspn
+#include <sys/stat.h> // for mkdir, fstat
+#include <time.h> // for time
+#include <unistd.h> // for geteuid
+
+#include <aduc/logging.h>
+
+/**
+ * @brief Version tag of the entry format.
+ */
+#define DIGEST_CACHE_ENTRY_VERSION "v2"
+
+/**
+ * @brief Files whose ctime is this close to the start of hashing are not cached. See ADUC_DigestCache_Store.
+ */
+#define DIGEST_CACHE_RACY_WINDOW_NS (1000000000LL)
+
+/**
+ * @brief Large enough for an entry with a base64 SHA512 digest and a path.
+ */
+#define DIGEST_CACHE_ENTRY_MAX_SIZE (256 + PATH_MAX)
+
+/**
+ * @brief Large enough for a base64 SHA512 digest.
+ */
+#define DIGEST_CACHE_DIGEST_MAX_SIZE 128
+
+/**
+ * @brief The number of entries kept by ADUC_HashUtils_DigestCache_CollectGarbage. The oldest entries beyond it
+ * are removed.
+ */
+#define DIGEST_CACHE_MAX_ENTRIES 4096
+
+/**
+ * @brief Temp files of interrupted stores older than this are removed by ADUC_HashUtils_DigestCache_CollectGarbage.
+ */
+#define DIGEST_CACHE_TEMP_FILE_MAX_AGE_SECONDS 3600
+
+static char* s_cacheFolder = NULL;
+static bool s_isConfigured = false;
+static pthread_once_t s_defaultInitOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Checks that a cache folder or entry is owned by the effective user and has exactly @p permissions.
+ */
+static bool IsTrustedCacheNode(const struct stat* st, mode_t fileType, mode_t permissions)
+{
+    return (st->st_mode & S_IFMT) == fileType && st->st_uid == geteuid() && (st->st_mode & 07777) == permissions;
+}
+
+static int64_t StatTimeToNs(const struct timespec* ts)
+{
+    return ((int64_t)ts->tv_sec * 1000000000LL) + ts->tv_nsec;
+}
+
+/**
+ * @brief Uses the default cache folder, if it exists and is trusted, unless the cache was configured explicitly.
+ * This lets every module that links hash_utils share the cache the agent created at startup.
+ */
+static void InitDefaultCacheFolder(void)
+{
+#ifdef ADUC_DIGEST_CACHE_FOLDER
+    struct stat st;
+
+    if (!s_isConfigured && lstat(ADUC_DIGEST_CACHE_FOLDER, &st) == 0 && IsTrustedCacheNode(&st, S_IFDIR, 0700))
+    {
+        s_cacheFolder = strdup(ADUC_DIGEST_CACHE_FOLDER);
+    }
+#endif
+}
+
+static const char* GetCacheFolder(void)
+{
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    return s_cacheFolder;
+}
+
+/**
+ * @brief Enables the persistent digest cache in @p cacheFolder, creating the folder if needed.
+ * @remark Not thread-safe. Call once at startup.
+ * @param cacheFolder The cache folder. It must be owned by the effective user and have mode 0700.
+ * @return bool True if the cache is enabled.
+ */
+_Bool ADUC_HashUtils_DigestCache_Init(const char* cacheFolder)
+{
+    struct stat st;
+
+    // Don't let a later lazy default init override this.
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    ADUC_HashUtils_DigestCache_Uninit();
+
+    if (cacheFolder == NULL)
+    {
+        return false;
+    }
+
+    if (mkdir(cacheFolder, 0700) != 0 && errno != EEXIST)
+    {
+        Log_Warn("Cannot create digest cache folder %s (errno %d).", cacheFolder, errno);
+        return false;
+    }
+
+    if (lstat(cacheFolder, &st) != 0 || !IsTrustedCacheNode(&st, S_IFDIR, 0700))
+    {
+        Log_Warn("Digest cache folder %s must be a directory owned by uid %d with mode 0700.", cacheFolder, geteuid());
+        return false;
+    }
+
+    s_cacheFolder = strdup(cacheFolder);
+    if (s_cacheFolder == NULL)
+    {
+        return false;
+    }
+
+    Log_Info("Digest cache enabled: %s", cacheFolder);
+    return true;
+}
+
+/**
+ * @brief Disables the persistent digest cache.
+ * @remark Not thread-safe.
+ */
+void ADUC_HashUtils_DigestCache_Uninit(void)
+{
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    free(s_cacheFolder);
+    s_cacheFolder = NULL;
+    s_isConfigured = true;
+}
+
+/**
+ * @brief Builds the path of the entry for the file described by @p st.
+ * @return bool True on success.
+ */
+static bool GetEntryPath(const struct stat* st, SHAversion algorithm, char* path, size_t pathSize)
+{
+    const char* folder = GetCacheFolder();
+    if (folder == NULL)
+    {
+        return false;
+    }
+
+    const int len = snprintf(
+        path,
+        pathSize,
+        "%s/%" PRIx64 "-%" PRIx64 "-%d",
+        folder,
+        (uint64_t)st->st_dev,
+        (uint64_t)st->st_ino,
+        (int)algorithm);
+
+    return len > 0 && (size_t)len < pathSize;
+}
+
+/**
+ * @brief The content of an entry.
+ */
+typedef struct tagDigestCacheEntry
+{
+    int64_t Size; /**< The size of the file when it was hashed. */
+    int64_t MtimeNs; /**< The mtime of the file when it was hashed. */
+    int64_t CtimeNs; /**< The ctime of the file when it was hashed. */
+    char Digest[DIGEST_CACHE_DIGEST_MAX_SIZE]; /**< The base64 digest. */
+    char Path[PATH_MAX]; /**< The path of the file when it was hashed. */
+} DigestCacheEntry;
+
+/**
+ * @brief Reads and parses the entry at @p entryPath, if it is trusted.
+ * @param entrySt Optional. Receives the metadata of the entry file.
+ * @return bool True if the entry is trusted and well-formed.
+ */
+static bool ReadEntry(const char* entryPath, DigestCacheEntry* entry, struct stat* entrySt)
+{
+    bool success = false;
+    char content[DIGEST_CACHE_ENTRY_MAX_SIZE];
+    struct stat st;
+    ssize_t contentSize = 0;
+    int pathOffset = 0;
+
+    const int fd = open(entryPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+    {
+        goto done;
+    }
+
+    if (fstat(fd, &st) != 0 || !IsTrustedCacheNode(&st, S_IFREG, 0600))
+    {
+        Log_Warn("Ignoring untrusted digest cache entry %s", entryPath);
+        goto done;
+    }
+
+    contentSize = read(fd, content, sizeof(content) - 1);
+    if (contentSize <= 0)
+    {
+        goto done;
+    }
+
+    content[contentSize] = '\0';
+
+    if (sscanf(
+            content,
+            DIGEST_CACHE_ENTRY_VERSION " %" SCNd64 " %" SCNd64 " %" SCNd64 " %127s %n",
+            &entry->Size,
+            &entry->MtimeNs,
+            &entry->CtimeNs,
+            entry->Digest,
+            &pathOffset)
+            != 4
+        || pathOffset == 0)
+    {
+        goto done;
+    }
+
+    // The path is the rest of the line, and may contain spaces.
+    const size_t pathLength = strcspn(content + pathOffset, "\n");
+    if (pathLength == 0 || pathLength >= sizeof(entry->Path))
+    {
+        goto done;
+    }
+
+    memcpy(entry->Path, content + pathOffset, pathLength);
+    entry->Path[pathLength] = '\0';
+
+    if (entrySt != NULL)
+    {
+        *entrySt = st;
+    }
+
+    success = true;
+
+done:
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Looks up the digest of the file described by @p st.
+ * @param st The metadata of the opened file, from fstat().
+ * @param algorithm The hashing algorithm.
+ * @return char* The base64 digest if the cache holds a trusted entry whose key matches @p st, otherwise NULL.
+ * Caller must call free() when done.
+ */
+char* ADUC_DigestCache_Lookup(const struct stat* st, SHAversion algorithm)
+{
+    char* hashBase64 = NULL;
+    char entryPath[PATH_MAX];
+    DigestCacheEntry entry;
+
+    if (!GetEntryPath(st, algorithm, entryPath, sizeof(entryPath)) || !ReadEntry(entryPath, &entry, NULL))
+    {
+        goto done;
+    }
+
+    if (entry.Size != (int64_t)st->st_size || entry.MtimeNs != StatTimeToNs(&st->st_mtim)
+        || entry.CtimeNs != StatTimeToNs(&st->st_ctim))
+    {
+        // The file changed since it was hashed.
+        (void)unlink(entryPath);
+        goto done;
+    }
+
+    hashBase64 = strdup(entry.Digest);
+
+done:
+    return hashBase64;
+}
+
+/**
+ * @brief Records the digest of the file described by @p st.
+ * @param path The path of the file.
+ * @param st The metadata of the file, from fstat() before it was read.
+ * @param algorithm The hashing algorithm.
+ * @param hashBase64 The base64 digest of the file content.
+ * @param hashStartTimeNs The CLOCK_REALTIME time, in nanoseconds, at which hashing started. Entries for files
+ * modified too close to that time are not recorded, since a later write in the same timestamp tick would go unnoticed.
+ */
+void ADUC_DigestCache_Store(
+    const char* path, const struct stat* st, SHAversion algorithm, const char* hashBase64, int64_t hashStartTimeNs)
+{
+    char entryPath[PATH_MAX];
+    char tempPath[PATH_MAX];
+    char entry[DIGEST_CACHE_ENTRY_MAX_SIZE];
+
+    if (path == NULL || hashBase64 == NULL || strchr(path, '\n') != NULL
+        || !GetEntryPath(st, algorithm, entryPath, sizeof(entryPath)))
+    {
+        return;
+    }
+
+    if (StatTimeToNs(&st->st_ctim) + DIGEST_CACHE_RACY_WINDOW_NS > hashStartTimeNs)
+    {
+        return;
+    }
+
+    const int entryLen = snprintf(
+        entry,
+        sizeof(entry),
+        DIGEST_CACHE_ENTRY_VERSION " %" PRId64 " %" PRId64 " %" PRId64 " %s %s\n",
+        (int64_t)st->st_size,
+        StatTimeToNs(&st->st_mtim),
+        StatTimeToNs(&st->st_ctim),
+        hashBase64,
+        path);
+    if (entryLen <= 0 || (size_t)entryLen >= sizeof(entry))
+    {
+        return;
+    }
+
+    if ((size_t)snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", entryPath) >= sizeof(tempPath))
+    {
+        return;
+    }
+
+    // Write to a temp file, then rename, so readers never see a partial entry.
+    const int fd = mkstemp(tempPath);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    const bool written = fchmod(fd, 0600) == 0 && write(fd, entry, (size_t)entryLen) == entryLen;
+
+    if (close(fd) != 0 || !written || rename(tempPath, entryPath) != 0)
+    {
+        Log_Warn("Cannot write digest cache entry %s (errno %d).", entryPath, errno);
+        (void)unlink(tempPath);
+    }
+}
+
+/**
+ * @brief Checks whether the entry named @p name at @p entryPath still describes an existing file.
+ * @param entrySt Receives the metadata of the entry file.
+ * @return bool True if the file the entry was recorded for still exists, unchanged, at its recorded path.
+ */
+static bool IsLiveEntry(const char* name, const char* entryPath, struct stat* entrySt)
+{
+    DigestCacheEntry entry;
+    struct stat st;
+    char prefix[64];
+
+    if (!ReadEntry(entryPath, &entry, entrySt) || lstat(entry.Path, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    // Deleted files whose inode was reused by another file don't match.
+    const int len =
+        snprintf(prefix, sizeof(prefix), "%" PRIx64 "-%" PRIx64 "-", (uint64_t)st.st_dev, (uint64_t)st.st_ino);
+
+    return len > 0 && (size_t)len < sizeof(prefix) && strncmp(name, prefix, (size_t)len) == 0
+        && entry.Size == (int64_t)st.st_size && entry.MtimeNs == StatTimeToNs(&st.st_mtim)
+        && entry.CtimeNs == StatTimeToNs(&st.st_ctim);
+}
+
+/**
+ * @brief A live entry, kept by ADUC_HashUtils_DigestCache_CollectGarbage unless there are too many.
+ */
+typedef struct tagLiveEntry
+{
+    char* Name;
+    int64_t MtimeNs; /**< When the entry was recorded. */
+} LiveEntry;
+
+static int CompareLiveEntries(const void* a, const void* b)
+{
+    const int64_t mtimeA = ((const LiveEntry*)a)->MtimeNs;
+    const int64_t mtimeB = ((const LiveEntry*)b)->MtimeNs;
+    return (mtimeA > mtimeB) - (mtimeA < mtimeB);
+}
+
+/**
+ * @brief Removes the entries of files that were deleted, replaced or modified, the leftovers of interrupted stores,
+ * and the oldest entries beyond DIGEST_CACHE_MAX_ENTRIES.
+ * @remark Call while no file is being hashed, e.g. when the agent is idle.
+ */
+void ADUC_HashUtils_DigestCache_CollectGarbage(void)
+{
+    const char* folder = GetCacheFolder();
+    DIR* dir = NULL;
+    struct dirent* dirEntry = NULL;
+    LiveEntry* liveEntries = NULL;
+    size_t liveCount = 0;
+    size_t liveCapacity = 0;
+    size_t removedCount = 0;
+    char entryPath[PATH_MAX];
+    struct stat entrySt;
+
+    if (folder == NULL)
+    {
+        return;
+    }
+
+    dir = opendir(folder);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        const char* name = dirEntry->d_name;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+            continue;
+        }
+
+        const int len = snprintf(entryPath, sizeof(entryPath), "%s/%s", folder, name);
+        if (len <= 0 || (size_t)len >= sizeof(entryPath))
+        {
+            continue;
+        }
+
+        // Temp files of stores that may still be in progress are only removed once they are old.
+        if (strchr(name, '.') != NULL)
+        {
+            if (lstat(entryPath, &entrySt) == 0
+                && entrySt.st_mtim.tv_sec + DIGEST_CACHE_TEMP_FILE_MAX_AGE_SECONDS < time(NULL)
+                && unlink(entryPath) == 0)
+            {
+                ++removedCount;
+            }
+
+            continue;
+        }
+
+        if (!IsLiveEntry(name, entryPath, &entrySt))
+        {
+            if (unlink(entryPath) == 0)
+            {
+                ++removedCount;
+            }
+
+            continue;
+        }
+
+        if (liveCount == liveCapacity)
+        {
+            const size_t newCapacity = (liveCapacity == 0) ? 64 : liveCapacity * 2;
+            LiveEntry* newEntries = realloc(liveEntries, newCapacity * sizeof(*liveEntries));
+            if (newEntries == NULL)
+            {
+                break;
+            }
+
+            liveEntries = newEntries;
+            liveCapacity = newCapacity;
+        }
+
+        liveEntries[liveCount].Name = strdup(name);
+        if (liveEntries[liveCount].Name == NULL)
+        {
+            break;
+        }
+
+        liveEntries[liveCount].MtimeNs = StatTimeToNs(&entrySt.st_mtim);
+        ++liveCount;
+    }
+
+    closedir(dir);
+
+    if (liveCount > DIGEST_CACHE_MAX_ENTRIES)
+    {
+        qsort(liveEntries, liveCount, sizeof(*liveEntries), CompareLiveEntries);
+
+        for (size_t i = 0; i < liveCount - DIGEST_CACHE_MAX_ENTRIES; ++i)
+        {
+            const int len = snprintf(entryPath, sizeof(entryPath), "%s/%s", folder, liveEntries[i].Name);
+            if (len > 0 && (size_t)len < sizeof(entryPath) && unlink(entryPath) == 0)
+            {
+                ++removedCount;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < liveCount; ++i)
+    {
+        free(liveEntries[i].Name);
+    }
+
+    free(liveEntries);
+
+    if (removedCount > 0)
+    {
+        Log_Info("Removed %zu digest cache entries.", removedCount);
+    }
+}
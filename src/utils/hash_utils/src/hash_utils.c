@@ -6,10 +6,20 @@
  * Licensed under the MIT License.
  */
 #include "aduc/hash_utils.h"
+#include "aduc/digest_cache_internal.h"
 
+#include <errno.h>
+#include <fcntl.h> // for open, posix_fadvise
+#include <inttypes.h> // for PRIu64, SCNu64
+#include <limits.h> // for PATH_MAX
 #include <stdio.h> // for FILE
-#include <stdlib.h> // for calloc
+#include <stdlib.h> // for calloc, posix_memalign
+#include <string.h> // for memset
 #include <strings.h> // for strcasecmp
+#include <sys/mman.h> // for mmap, madvise
+#include <sys/stat.h> // for fstat
+#include <time.h> // for clock_gettime
+#include <unistd.h> // for read, pread, close, ftruncate
 
 #include <azure_c_shared_utility/azure_base64.h>
 #include <azure_c_shared_utility/buffer_.h>
@@ -19,237 +29,1367 @@
 #include <aduc/logging.h>
 
 /**
- * @brief Helper function gets the calculated hash from the @p context, compares it to @p hashBase64, and returns the appropriate value
- * @param context Context in which the hash was calculated and stored
- * @param hashBase64 The expected hash from the context. If NULL, skip hashes comparison.
+ * @brief Helper function finalizes the digest in @p context and encodes it as base64.
+ * @param context Context in which the hash was calculated and stored. It is uninitialized on return.
  * @param algorithm the algorithm used to calculate the hash
- * @param outputHash an optional output buffer for computed hash. Caller must call free() to deallocate the buffer when done.
- * @returns bool True if the hash is valid and equals @p hashBase64
+ * @returns char* The base64 encoded hash, or NULL on failure. Caller must call free() when done.
  */
-static bool
-GetResultAndCompareHashes(USHAContext* context, const char* hashBase64, SHAversion algorithm, char** outputHash)
+static char* FinalizeDigestToBase64(ADUC_HashUtils_DigestContext* context, SHAversion algorithm)
 {
-    bool success = false;
-    // "USHAHashSize(algorithm)" is more precise, but requires a variable length array, or heap allocation.
+    char* hashBase64 = NULL;
+    // The digest size depends on the algorithm; USHAMaxHashSize fits all of them.
     uint8_t buffer_hash[USHAMaxHashSize];
+    size_t digestSize = 0;
     STRING_HANDLE encoded_file_hash = NULL;
 
-    if (USHAResult(context, (uint8_t*)buffer_hash) != 0)
+    if (!ADUC_HashUtils_DigestFinal(context, buffer_hash, &digestSize))
     {
         Log_Error("Error in SHA Result, SHAversion: %d", algorithm);
         goto done;
     }
 
-    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, USHAHashSize(algorithm));
+    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, digestSize);
     if (encoded_file_hash == NULL)
     {
         Log_Error("Error in Base64 Encoding");
         goto done;
     }
 
-    const bool hashMatches = ((hashBase64 == NULL) || (strcmp(hashBase64, STRING_c_str(encoded_file_hash)) == 0));
+    if (mallocAndStrcpy_s(&hashBase64, STRING_c_str(encoded_file_hash)) != 0)
+    {
+        Log_Error("Cannot allocate output buffer and copy hash.");
+        hashBase64 = NULL;
+        goto done;
+    }
+
+done:
+    STRING_delete(encoded_file_hash);
+    return hashBase64;
+}
+
+/**
+ * @brief Finalizes the digest, encodes it as base64 and releases the context's resources.
+ * @param context The initialized context. It is uninitialized on return, even on failure.
+ * @return char* The base64 digest, or NULL on failure. Caller must call free() when done.
+ */
+char* ADUC_HashUtils_DigestFinalBase64(ADUC_HashUtils_DigestContext* context)
+{
+    return FinalizeDigestToBase64(context, context->Algorithm);
+}
+
+/**
+ * @brief Helper function compares the computed @p hash to the expected @p hashBase64, and optionally returns it.
+ * @param hash The computed base64 hash. Ownership is taken; it is either returned through @p outputHash or freed.
+ * @param hashBase64 The expected hash. If NULL, skip hashes comparison.
+ * @param algorithm the algorithm used to calculate the hash
+ * @param outputHash an optional output buffer for computed hash. Caller must call free() to deallocate the buffer when done.
+ * @returns bool True if @p hash is valid and equals @p hashBase64
+ */
+static bool CompareHashes(char* hash, const char* hashBase64, SHAversion algorithm, char** outputHash)
+{
+    bool success = false;
+
+    if (hash == NULL)
+    {
+        goto done;
+    }
 
-    if (!hashMatches)
+    if ((hashBase64 != NULL) && (strcmp(hashBase64, hash) != 0))
     {
-        Log_Error(
-            "Invalid Hash, Expect: %s, Result: %s, SHAversion: %d",
-            hashBase64,
-            STRING_c_str(encoded_file_hash),
-            algorithm);
+        Log_Error("Invalid Hash, Expect: %s, Result: %s, SHAversion: %d", hashBase64, hash, algorithm);
         goto done;
     }
 
     if (outputHash != NULL)
     {
-        if (mallocAndStrcpy_s(outputHash, STRING_c_str(encoded_file_hash)) != 0)
-        {
-            Log_Error("Cannot allocate output buffer and copy hash.");
-            goto done;
-        }
+        *outputHash = hash;
+        hash = NULL;
     }
 
     success = true;
 
 done:
-    STRING_delete(encoded_file_hash);
+    free(hash);
     return success;
 }
 
 /**
- * @brief Checks if the hash of the file at @p path matches @p hashBase64
- *
- * @param path The path to the file to check
- * @param algorithm The hashing algorithm to use to calculate the hash.
- * @param hash [out] The pointer to output buffer. Caller must call free() when done with the returned buffer.
- * @return bool True if the hash data is successfully generated.
+ * @brief Helper function gets the calculated hash from the @p context, compares it to @p hashBase64, and returns the appropriate value
+ * @param context Context in which the hash was calculated and stored. It is uninitialized on return.
+ * @param hashBase64 The expected hash from the context. If NULL, skip hashes comparison.
+ * @param algorithm the algorithm used to calculate the hash
+ * @param outputHash an optional output buffer for computed hash. Caller must call free() to deallocate the buffer when done.
+ * @returns bool True if the hash is valid and equals @p hashBase64
  */
-_Bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash)
+static bool GetResultAndCompareHashes(
+    ADUC_HashUtils_DigestContext* context, const char* hashBase64, SHAversion algorithm, char** outputHash)
 {
-    _Bool success = false;
-    FILE* file = NULL;
+    return CompareHashes(FinalizeDigestToBase64(context, algorithm), hashBase64, algorithm, outputHash);
+}
 
-    if (hash == NULL)
-    {
-        Log_Error("Invalid input. 'hash' is NULL.");
-        goto done;
-    }
+/**
+ * @brief The options used by the file digest engine. See ADUC_HashUtils_SetFileHashOptions.
+ */
+static ADUC_HashUtils_FileHashOptions s_fileHashOptions = {
+    .BufferSize = ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE,
+    .UseMmap = false,
+    .DropPageCache = false,
+};
 
-    *hash = NULL;
+/**
+ * @brief Copies @p options to s_fileHashOptions, clamping the buffer size.
+ */
+static void ApplyFileHashOptions(const ADUC_HashUtils_FileHashOptions* options)
+{
+    s_fileHashOptions = *options;
 
-    file = fopen(path, "rb");
-    if (file == NULL)
+    if (s_fileHashOptions.BufferSize == 0)
     {
-        // Sometime we call this function to check whether the file is already exist.
-        // So, log info here instead of error.
-        Log_Info("No such file or directory: %s", path);
-        goto done;
+        s_fileHashOptions.BufferSize = ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE;
     }
-
-    USHAContext context;
-
-    if (USHAReset(&context, algorithm) != 0)
+    else if (s_fileHashOptions.BufferSize < ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE)
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
-        goto done;
+        s_fileHashOptions.BufferSize = ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE;
+    }
+    else if (s_fileHashOptions.BufferSize > ADUC_HASH_UTILS_MAX_FILE_BUFFER_SIZE)
+    {
+        s_fileHashOptions.BufferSize = ADUC_HASH_UTILS_MAX_FILE_BUFFER_SIZE;
+    }
+}
+
+/**
+ * @brief Sets the options used by ADUC_HashUtils_GetFileHash and ADUC_HashUtils_IsValidFileHash.
+ * @remark Not thread-safe. Call once at startup, before any file is hashed.
+ * @param options The options to use. If NULL, restores the defaults. A BufferSize of 0 selects the default size,
+ * other sizes are clamped to [ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE, ADUC_HASH_UTILS_MAX_FILE_BUFFER_SIZE].
+ */
+void ADUC_HashUtils_SetFileHashOptions(const ADUC_HashUtils_FileHashOptions* options)
+{
+    const ADUC_HashUtils_FileHashOptions defaultOptions = {
+        .BufferSize = ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE,
+        .UseMmap = false,
+        .DropPageCache = false,
     };
 
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
-    {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
-        {
-            if (ferror(file))
-            {
-                Log_Error("Error reading file content.");
-                goto done;
-            }
+    ApplyFileHashOptions(options == NULL ? &defaultOptions : options);
+}
 
-            // At the end of file. We're done here.
-            break;
-        }
+/**
+ * @brief Gets the options currently used by the file digest engine.
+ * @param options [out] Receives the options.
+ */
+void ADUC_HashUtils_GetFileHashOptions(ADUC_HashUtils_FileHashOptions* options)
+{
+    if (options != NULL)
+    {
+        *options = s_fileHashOptions;
+    }
+}
 
-        if (USHAInput(&context, buffer, readSize) != 0)
-        {
-            Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-            goto done;
-        };
+/**
+ * @brief Tells the kernel that the already hashed range of @p fd won't be needed again,
+ * so hashing a multi-GB image doesn't evict everything else from the page cache.
+ */
+static void DropHashedPages(int fd, off_t offset, off_t length)
+{
+    if (s_fileHashOptions.DropPageCache)
+    {
+        (void)posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
     }
+}
 
-    success = GetResultAndCompareHashes(&context, NULL, algorithm, hash);
+/**
+ * @brief The digests of a file, computed in a single pass and indexed by SHAversion.
+ */
+typedef struct tagFileDigests
+{
+    bool Wanted[ADUC_HASH_UTILS_SHA_VERSION_COUNT]; /**< The algorithms to compute. */
+    char* Hashes[ADUC_HASH_UTILS_SHA_VERSION_COUNT]; /**< The computed base64 hashes. Free with FileDigests_UnInit. */
+} FileDigests;
 
-done:
+static void FileDigests_UnInit(FileDigests* digests)
+{
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        free(digests->Hashes[i]);
+        digests->Hashes[i] = NULL;
+    }
+}
 
-    if (file != NULL)
+/**
+ * @brief Feeds @p size bytes of @p data into every active context.
+ * @return bool True on success.
+ */
+static bool UpdateDigests(
+    ADUC_HashUtils_DigestContext* contexts, const bool* active, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
     {
-        fclose(file);
+        if (active[i] && !ADUC_HashUtils_DigestUpdate(&contexts[i], data, size))
+        {
+            Log_Error("Error in SHA Input, SHAversion: %d", (int)i);
+            return false;
+        }
     }
 
-    return success;
+    return true;
 }
 
 /**
- * @brief Get file hash type at specified index.
- * @param hashArray The ADUC_Hash array.
- * @param arraySize Size of array.
- * @param hashIndex Index of the hash to return.
- *
- * @return Hash type if succeeded. Otherwise, return NULL.
+ * @brief Feeds the content of @p fd into the active @p contexts through a memory mapping.
+ * @return bool True on success. False if the file could not be mapped, in which case nothing was hashed.
  */
-char* ADUC_HashUtils_GetHashType(const ADUC_Hash* hashArray, size_t arraySize, size_t index)
+static bool HashFileContentMmap(
+    int fd, off_t fileSize, ADUC_HashUtils_DigestContext* contexts, const bool* active, bool* hashFailed)
 {
-    if (index >= arraySize)
+    const uint8_t* mapped = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED)
     {
-        return NULL;
+        Log_Info("mmap failed (errno %d), falling back to read.", errno);
+        return false;
     }
 
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    return hashArray[index].type;
+    (void)madvise((void*)mapped, (size_t)fileSize, MADV_SEQUENTIAL);
+
+    for (off_t offset = 0; offset < fileSize; offset += (off_t)s_fileHashOptions.BufferSize)
+    {
+        const size_t chunkSize = (size_t)(fileSize - offset) < s_fileHashOptions.BufferSize
+            ? (size_t)(fileSize - offset)
+            : s_fileHashOptions.BufferSize;
+
+        if (!UpdateDigests(contexts, active, mapped + offset, chunkSize))
+        {
+            *hashFailed = true;
+            break;
+        }
+
+        DropHashedPages(fd, offset, (off_t)chunkSize);
+    }
+
+    munmap((void*)mapped, (size_t)fileSize);
+    return true;
 }
 
 /**
- * @brief Get file hash value at specified index.
- * @param hashArray The ADUC_Hash array.
- * @param arraySize Size of array.
- * @param hashIndex Index of the hash to return.
- *
- * @return Hash value if succeeded. Otherwise, return NULL.
+ * @brief Feeds the content of @p fd into the active @p contexts using large, page-aligned read() calls.
+ * @return bool True on success.
  */
-char* ADUC_HashUtils_GetHashValue(const ADUC_Hash* hashArray, size_t arraySize, size_t index)
+static bool HashFileContentRead(int fd, ADUC_HashUtils_DigestContext* contexts, const bool* active)
 {
-    if (index >= arraySize)
+    bool success = false;
+    uint8_t* buffer = NULL;
+    off_t offset = 0;
+
+    if (posix_memalign((void**)&buffer, ADUC_HASH_UTILS_FILE_BUFFER_ALIGNMENT, s_fileHashOptions.BufferSize) != 0)
     {
-        return NULL;
+        Log_Error("Cannot allocate %zu bytes hash buffer.", s_fileHashOptions.BufferSize);
+        goto done;
     }
 
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    return hashArray[index].value;
+    for (;;)
+    {
+        const ssize_t readSize = read(fd, buffer, s_fileHashOptions.BufferSize);
+        if (readSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Error reading file content (errno %d).", errno);
+            goto done;
+        }
+
+        if (readSize == 0)
+        {
+            // At the end of file. We're done here.
+            break;
+        }
+
+        if (!UpdateDigests(contexts, active, buffer, (size_t)readSize))
+        {
+            goto done;
+        }
+
+        DropHashedPages(fd, offset, readSize);
+        offset += readSize;
+    }
+
+    success = true;
+
+done:
+    free(buffer);
+    return success;
 }
 
 /**
- * @brief Checks if the hash of the file at @p path matches @p hashBase64
+ * @brief The file digest engine. Computes every wanted digest of the file at @p path with at most one read pass.
  *
- * @param path The path to the file to check
- * @param hashBase64 The expected hash of the file at @p path
- * @param algorithm The hashing algorithm to use to calculate the hash.
- * @return bool True if the hash is valid and matches @p hashBase64
+ * Digests found in the digest cache are not recomputed; the file is only read if at least one is missing.
+ *
+ * @param path The path to the file to hash.
+ * @param digests The wanted algorithms; receives the computed hashes.
+ * @return bool True if every wanted digest was computed.
  */
-_Bool ADUC_HashUtils_IsValidFileHash(const char* path, const char* hashBase64, SHAversion algorithm)
+static bool ComputeFileDigests(const char* path, FileDigests* digests)
 {
-    _Bool success = false;
+    bool success = false;
+    bool hashFailed = false;
+    bool needsRead = false;
+    bool active[ADUC_HASH_UTILS_SHA_VERSION_COUNT] = { false };
+    ADUC_HashUtils_DigestContext contexts[ADUC_HASH_UTILS_SHA_VERSION_COUNT];
+    struct stat st;
+    struct timespec hashStartTime;
 
-    FILE* file = fopen(path, "rb");
-    if (file == NULL)
+    memset(contexts, 0, sizeof(contexts));
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        if (errno == ENOENT)
+        {
+            // Sometime we call this function to check whether the file is already exist.
+            // So, log info here instead of error.
+            Log_Info("No such file or directory: %s", path);
+        }
+        else
+        {
+            Log_Error("Cannot open file: %s (errno %d)", path, errno);
+        }
+        goto done;
+    }
+
+    if (fstat(fd, &st) != 0)
     {
-        Log_Error("Cannot open file: %s", path);
+        Log_Error("Cannot stat file: %s (errno %d)", path, errno);
         goto done;
     }
 
-    USHAContext context;
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (!digests->Wanted[i])
+        {
+            continue;
+        }
+
+        // A digest recorded for this exact (dev, inode, size, mtime, ctime) can be trusted without reading the file.
+        if (S_ISREG(st.st_mode))
+        {
+            digests->Hashes[i] = ADUC_DigestCache_Lookup(&st, (SHAversion)i);
+        }
+
+        if (digests->Hashes[i] == NULL)
+        {
+            needsRead = true;
+        }
+    }
 
-    if (USHAReset(&context, algorithm) != 0)
+    if (!needsRead)
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
+        success = true;
         goto done;
-    };
+    }
 
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
+    if (clock_gettime(CLOCK_REALTIME, &hashStartTime) != 0)
     {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
+        hashStartTime.tv_sec = 0;
+        hashStartTime.tv_nsec = 0;
+    }
+
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (digests->Wanted[i] && digests->Hashes[i] == NULL)
         {
-            if (ferror(file))
+            if (!ADUC_HashUtils_DigestInit(&contexts[i], (SHAversion)i))
             {
-                Log_Error("Error reading file content.");
                 goto done;
             }
 
-            // At the end of file. We're done here.
-            break;
+            active[i] = true;
         }
+    }
 
-        if (USHAInput(&context, buffer, readSize) != 0)
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (s_fileHashOptions.UseMmap && S_ISREG(st.st_mode) && st.st_size > 0
+        && HashFileContentMmap(fd, st.st_size, contexts, active, &hashFailed))
+    {
+        if (hashFailed)
         {
-            Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
             goto done;
-        };
+        }
     }
-
-    success = GetResultAndCompareHashes(&context, hashBase64, algorithm, NULL);
-    if (!success)
+    else if (!HashFileContentRead(fd, contexts, active))
     {
         goto done;
     }
 
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (!active[i])
+        {
+            continue;
+        }
+
+        digests->Hashes[i] = FinalizeDigestToBase64(&contexts[i], (SHAversion)i);
+        if (digests->Hashes[i] == NULL)
+        {
+            goto done;
+        }
+
+        if (S_ISREG(st.st_mode))
+        {
+            ADUC_DigestCache_Store(
+                path,
+                &st,
+                (SHAversion)i,
+                digests->Hashes[i],
+                ((int64_t)hashStartTime.tv_sec * 1000000000LL) + hashStartTime.tv_nsec);
+        }
+    }
+
+    success = true;
+
 done:
-    if (file != NULL)
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        ADUC_HashUtils_DigestUninit(&contexts[i]);
+    }
+
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Computes the @p algorithm digest of the file at @p path and compares it to @p hashBase64.
+ *
+ * @param path The path to the file to hash.
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @param hashBase64 The expected hash. If NULL, skip hashes comparison.
+ * @param outputHash Optional. Receives the computed hash. Caller must call free() when done.
+ * @return bool True if the file was hashed and the hash equals @p hashBase64.
+ */
+static bool ComputeFileHash(const char* path, SHAversion algorithm, const char* hashBase64, char** outputHash)
+{
+    FileDigests digests;
+    memset(&digests, 0, sizeof(digests));
+
+    if ((int)algorithm < 0 || (int)algorithm >= ADUC_HASH_UTILS_SHA_VERSION_COUNT)
     {
-        fclose(file);
+        Log_Error("Unsupported SHAversion: %d", algorithm);
+        return false;
+    }
+
+    digests.Wanted[algorithm] = true;
+
+    if (!ComputeFileDigests(path, &digests))
+    {
+        FileDigests_UnInit(&digests);
+        return false;
     }
 
+    // CompareHashes takes ownership of the hash.
+    char* hash = digests.Hashes[algorithm];
+    digests.Hashes[algorithm] = NULL;
+
+    return CompareHashes(hash, hashBase64, algorithm, outputHash);
+}
+
+/**
+ * @brief Verifies every hash in @p hashArray against the file at @p path, reading the file at most once.
+ *
+ * @param path The path to the file to check.
+ * @param hashArray The expected hashes, e.g. ADUC_FileEntity::Hash.
+ * @param hashCount The number of hashes in @p hashArray.
+ * @param verdicts Optional. An array of @p hashCount entries that receives the verdict for each hash.
+ * @return bool True if @p hashArray isn't empty, and every hash has a supported algorithm and matches. A hash with
+ * an unsupported or missing type fails the verification, so a file is never accepted on a subset of its hashes.
+ */
+_Bool ADUC_HashUtils_VerifyFileHashes(
+    const char* path, const ADUC_Hash* hashArray, size_t hashCount, ADUC_HashUtils_HashVerdict* verdicts)
+{
+    bool success = false;
+    bool hasUnsupportedHash = false;
+    SHAversion algorithm;
+    FileDigests digests;
+
+    memset(&digests, 0, sizeof(digests));
+
+    for (size_t i = 0; i < hashCount; ++i)
+    {
+        if (verdicts != NULL)
+        {
+            verdicts[i] = ADUC_HashUtils_HashVerdict_Unsupported;
+        }
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* hash = &hashArray[i];
+        if (hash->type != NULL && hash->value != NULL
+            && ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm))
+        {
+            digests.Wanted[algorithm] = true;
+        }
+        else
+        {
+            Log_Error("Cannot verify %s: unsupported hash type %s", path, hash->type);
+            hasUnsupportedHash = true;
+        }
+    }
+
+    if (hashCount == 0)
+    {
+        Log_Error("No hash to verify %s", path);
+        goto done;
+    }
+
+    if (hasUnsupportedHash)
+    {
+        goto done;
+    }
+
+    if (!ComputeFileDigests(path, &digests))
+    {
+        goto done;
+    }
+
+    success = true;
+
+    for (size_t i = 0; i < hashCount; ++i)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* hash = &hashArray[i];
+        (void)ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm);
+
+        const bool matches = (strcmp(hash->value, digests.Hashes[algorithm]) == 0);
+        if (!matches)
+        {
+            Log_Error(
+                "Invalid Hash, Expect: %s, Result: %s, SHAversion: %d",
+                hash->value,
+                digests.Hashes[algorithm],
+                algorithm);
+            success = false;
+        }
+
+        if (verdicts != NULL)
+        {
+            verdicts[i] = matches ? ADUC_HashUtils_HashVerdict_Match : ADUC_HashUtils_HashVerdict_Mismatch;
+        }
+    }
+
+done:
+    FileDigests_UnInit(&digests);
+    return success;
+}
+
+/**
+ * @brief Checks if the hash of the file at @p path matches @p hashBase64
+ *
+ * @param path The path to the file to check
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @param hash [out] The pointer to output buffer. Caller must call free() when done with the returned buffer.
+ * @return bool True if the hash data is successfully generated.
+ */
+_Bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash)
+{
+    if (hash == NULL)
+    {
+        Log_Error("Invalid input. 'hash' is NULL.");
+        return false;
+    }
+
+    *hash = NULL;
+
+    return ComputeFileHash(path, algorithm, NULL, hash);
+}
+
+/**
+ * @brief Get file hash type at specified index.
+ * @param hashArray The ADUC_Hash array.
+ * @param arraySize Size of array.
+ * @param hashIndex Index of the hash to return.
+ *
+ * @return Hash type if succeeded. Otherwise, return NULL.
+ */
+char* ADUC_HashUtils_GetHashType(const ADUC_Hash* hashArray, size_t arraySize, size_t index)
+{
+    if (index >= arraySize)
+    {
+        return NULL;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return hashArray[index].type;
+}
+
+/**
+ * @brief Get file hash value at specified index.
+ * @param hashArray The ADUC_Hash array.
+ * @param arraySize Size of array.
+ * @param hashIndex Index of the hash to return.
+ *
+ * @return Hash value if succeeded. Otherwise, return NULL.
+ */
+char* ADUC_HashUtils_GetHashValue(const ADUC_Hash* hashArray, size_t arraySize, size_t index)
+{
+    if (index >= arraySize)
+    {
+        return NULL;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return hashArray[index].value;
+}
+
+/**
+ * @brief Checks if the hash of the file at @p path matches @p hashBase64
+ *
+ * @param path The path to the file to check
+ * @param hashBase64 The expected hash of the file at @p path
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @return bool True if the hash is valid and matches @p hashBase64
+ */
+_Bool ADUC_HashUtils_IsValidFileHash(const char* path, const char* hashBase64, SHAversion algorithm)
+{
+    return ComputeFileHash(path, algorithm, hashBase64, NULL);
+}
+
+/**
+ * @brief Releases the sink's digests of the other algorithms of its expected hashes.
+ * @param sink The sink.
+ */
+static void UninitExtraDigests(ADUC_HashUtils_FileSink* sink)
+{
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (sink->ExtraActive[i])
+        {
+            ADUC_HashUtils_DigestUninit(&sink->ExtraContexts[i]);
+            sink->ExtraActive[i] = false;
+        }
+    }
+}
+
+/**
+ * @brief Finalizes the sink's other digests and compares every expected hash.
+ * @param sink The sink. Its other digests are uninitialized on return.
+ * @param hash The computed hash of the sink's own algorithm. May be NULL if it could not be computed.
+ * @return bool True if every expected hash matches.
+ */
+static bool CompareExpectedHashes(ADUC_HashUtils_FileSink* sink, const char* hash)
+{
+    bool success = true;
+    char* extraHashes[ADUC_HASH_UTILS_SHA_VERSION_COUNT] = { NULL };
+    SHAversion algorithm;
+
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        if (sink->ExtraActive[i])
+        {
+            extraHashes[i] = FinalizeDigestToBase64(&sink->ExtraContexts[i], (SHAversion)i);
+            sink->ExtraActive[i] = false;
+        }
+    }
+
+    for (size_t i = 0; i < sink->ExpectedHashCount; ++i)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* expected = &sink->ExpectedHashes[i];
+
+        // The types were validated by ADUC_HashUtils_FileSink_SetExpectedHashes.
+        (void)ADUC_HashUtils_GetShaVersionForTypeString(expected->type, &algorithm);
+
+        const char* actual = (algorithm == sink->Algorithm) ? hash : extraHashes[algorithm];
+        if (actual == NULL || strcmp(expected->value, actual) != 0)
+        {
+            Log_Error("Invalid Hash, Expect: %s, Result: %s, SHAversion: %d", expected->value, actual, algorithm);
+            success = false;
+        }
+    }
+
+    for (size_t i = 0; i < ADUC_HASH_UTILS_SHA_VERSION_COUNT; ++i)
+    {
+        free(extraHashes[i]);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Opens (truncates) the file at @p path for writing and resets the running digest.
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm to use.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_Open(ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm)
+{
+    if (sink == NULL || path == NULL)
+    {
+        Log_Error("Invalid input. sink: %p, path: %p", sink, path);
+        return false;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->Algorithm = algorithm;
+
+    if (!ADUC_HashUtils_DigestInit(&sink->Context, algorithm))
+    {
+        return false;
+    }
+
+    sink->File = fopen(path, "wb");
+    if (sink->File == NULL)
+    {
+        Log_Error("Cannot open file for writing: %s (errno %d)", path, errno);
+        ADUC_HashUtils_DigestUninit(&sink->Context);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes @p size bytes of @p data to the sink's file and feeds them into the running digest.
+ * @param sink The open sink.
+ * @param data The data to write.
+ * @param size The number of bytes in @p data.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_Write(ADUC_HashUtils_FileSink* sink, const uint8_t* data, size_t size)
+{
+    if (sink == NULL || sink->File == NULL)
+    {
+        Log_Error("Sink is not open.");
+        return false;
+    }
+
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (fwrite(data, sizeof(data[0]), size, sink->File) != size)
+    {
+        Log_Error("Error writing file content (errno %d).", errno);
+        return false;
+    }
+
+    if (!ADUC_HashUtils_DigestUpdate(&sink->Context, data, size))
+    {
+        Log_Error("Error in SHA Input, SHAversion: %d", sink->Algorithm);
+        return false;
+    }
+
+    if (!UpdateDigests(sink->ExtraContexts, sink->ExtraActive, data, size))
+    {
+        return false;
+    }
+
+    sink->BytesWritten += size;
+
+    if (sink->Chunks.Manifest != NULL && !ADUC_HashUtils_ChunkVerifier_Update(&sink->Chunks, data, size))
+    {
+        sink->ChunkMismatch = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Enables block-level verification of the content written to @p sink.
+ * Once enabled, ADUC_HashUtils_FileSink_Write fails as soon as a block does not match @p manifest.
+ * @param sink The open sink. Nothing must have been written to it yet.
+ * @param manifest The block hashes. Must outlive the sink.
+ * @return bool True on success.
+ */
+_Bool ADUC_HashUtils_FileSink_SetChunkManifest(ADUC_HashUtils_FileSink* sink, const ADUC_ChunkManifest* manifest)
+{
+    if (sink == NULL || sink->File == NULL || sink->BytesWritten != 0)
+    {
+        Log_Error("Sink is not open or already has content.");
+        return false;
+    }
+
+    return ADUC_HashUtils_ChunkVerifier_Init(&sink->Chunks, manifest, 0);
+}
+
+/**
+ * @brief Has the sink compute a digest for every algorithm in @p hashArray, and compare every hash on close.
+ * If content was already kept in the sink's file, e.g. by ADUC_HashUtils_FileSink_OpenForAppend, it is read back
+ * for the algorithms other than the sink's own.
+ * @param sink The open sink.
+ * @param hashArray The expected hashes, e.g. ADUC_FileEntity::Hash. Must outlive the sink.
+ * @param hashCount The number of hashes in @p hashArray.
+ * @return bool True on success. False if a hash has an unsupported or missing type.
+ */
+_Bool ADUC_HashUtils_FileSink_SetExpectedHashes(
+    ADUC_HashUtils_FileSink* sink, const ADUC_Hash* hashArray, size_t hashCount)
+{
+    _Bool success = false;
+    bool hasExtraDigest = false;
+    uint8_t* buffer = NULL;
+    SHAversion algorithm;
+
+    if (sink == NULL || sink->File == NULL || hashArray == NULL || hashCount == 0)
+    {
+        Log_Error("Invalid input. sink: %p, hashArray: %p, hashCount: %zu", sink, hashArray, hashCount);
+        return false;
+    }
+
+    UninitExtraDigests(sink);
+    sink->ExpectedHashes = NULL;
+    sink->ExpectedHashCount = 0;
+
+    for (size_t i = 0; i < hashCount; ++i)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const ADUC_Hash* hash = &hashArray[i];
+        if (hash->type == NULL || hash->value == NULL
+            || !ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm))
+        {
+            Log_Error("Unsupported hash type %s", hash->type);
+            goto done;
+        }
+
+        if (algorithm != sink->Algorithm && !sink->ExtraActive[algorithm])
+        {
+            if (!ADUC_HashUtils_DigestInit(&sink->ExtraContexts[algorithm], algorithm))
+            {
+                goto done;
+            }
+
+            sink->ExtraActive[algorithm] = true;
+            hasExtraDigest = true;
+        }
+    }
+
+    // Content kept from an earlier attempt was only fed into the sink's own digest.
+    if (hasExtraDigest && sink->BytesWritten > sink->DigestOffset)
+    {
+        const size_t bufferSize = s_fileHashOptions.BufferSize;
+
+        buffer = malloc(bufferSize);
+        if (buffer == NULL || fflush(sink->File) != 0)
+        {
+            goto done;
+        }
+
+        for (uint64_t offset = sink->DigestOffset; offset < sink->BytesWritten;)
+        {
+            const uint64_t remaining = sink->BytesWritten - offset;
+            const size_t readSize = (remaining < bufferSize) ? (size_t)remaining : bufferSize;
+            const ssize_t bytesRead = pread(fileno(sink->File), buffer, readSize, (off_t)offset);
+
+            if (bytesRead <= 0)
+            {
+                Log_Error("Cannot read back kept content (errno %d).", errno);
+                goto done;
+            }
+
+            if (!UpdateDigests(sink->ExtraContexts, sink->ExtraActive, buffer, (size_t)bytesRead))
+            {
+                goto done;
+            }
+
+            offset += (uint64_t)bytesRead;
+        }
+    }
+
+    sink->ExpectedHashes = hashArray;
+    sink->ExpectedHashCount = hashCount;
+    success = true;
+
+done:
+    free(buffer);
+
+    if (!success)
+    {
+        UninitExtraDigests(sink);
+    }
+
+    return success;
+}
+
+/**
+ * @brief The suffix of the record of the verified blocks of a partially downloaded file.
+ */
+#define CHUNK_STATE_SUFFIX ".chunks"
+
+/**
+ * @brief The format version of the record of verified blocks.
+ */
+#define CHUNK_STATE_VERSION "v1"
+
+/**
+ * @brief Builds the path of the record of the verified blocks of the file at @p path.
+ * @return bool True on success.
+ */
+static bool GetChunkStatePath(const char* path, char* statePath, size_t statePathSize)
+{
+    const int len = snprintf(statePath, statePathSize, "%s" CHUNK_STATE_SUFFIX, path);
+    return len > 0 && (size_t)len < statePathSize;
+}
+
+/**
+ * @brief Records that the first @p verifiedChunks blocks of the closed file at @p path match its chunk manifest,
+ * along with the identity of the file, so any later change to the file invalidates the record.
+ */
+static void SaveChunkState(const char* path, size_t verifiedChunks)
+{
+    char statePath[PATH_MAX];
+    struct stat st;
+    FILE* file = NULL;
+
+    if (!GetChunkStatePath(path, statePath, sizeof(statePath)))
+    {
+        return;
+    }
+
+    if (verifiedChunks == 0 || stat(path, &st) != 0)
+    {
+        (void)remove(statePath);
+        return;
+    }
+
+    file = fopen(statePath, "w");
+    if (file == NULL)
+    {
+        Log_Warn("Cannot record the verified blocks of %s (errno %d).", path, errno);
+        return;
+    }
+
+    const int written = fprintf(
+        file,
+        CHUNK_STATE_VERSION " %zu %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 " %ld %" PRId64 " %ld\n",
+        verifiedChunks,
+        (uint64_t)st.st_dev,
+        (uint64_t)st.st_ino,
+        (uint64_t)st.st_size,
+        (int64_t)st.st_mtim.tv_sec,
+        st.st_mtim.tv_nsec,
+        (int64_t)st.st_ctim.tv_sec,
+        st.st_ctim.tv_nsec);
+
+    if (fclose(file) != 0 || written <= 0)
+    {
+        Log_Warn("Cannot record the verified blocks of %s (errno %d).", path, errno);
+        (void)remove(statePath);
+    }
+}
+
+/**
+ * @brief Reads the number of leading blocks of the open file @p fd recorded as verified by SaveChunkState.
+ * @return size_t The number of verified blocks, or 0 if there is no record or the file changed since.
+ */
+static size_t LoadChunkState(const char* path, int fd, const ADUC_ChunkManifest* manifest)
+{
+    char statePath[PATH_MAX];
+    struct stat st;
+    size_t verifiedChunks = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtimeSec = 0;
+    long mtimeNsec = 0;
+    int64_t ctimeSec = 0;
+    long ctimeNsec = 0;
+    FILE* file = NULL;
+
+    if (!GetChunkStatePath(path, statePath, sizeof(statePath)) || fstat(fd, &st) != 0)
+    {
+        return 0;
+    }
+
+    file = fopen(statePath, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    const int fieldCount = fscanf(
+        file,
+        CHUNK_STATE_VERSION " %zu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64 " %ld %" SCNd64 " %ld",
+        &verifiedChunks,
+        &dev,
+        &ino,
+        &size,
+        &mtimeSec,
+        &mtimeNsec,
+        &ctimeSec,
+        &ctimeNsec);
+    fclose(file);
+
+    if (fieldCount != 8 || dev != (uint64_t)st.st_dev || ino != (uint64_t)st.st_ino || size != (uint64_t)st.st_size
+        || mtimeSec != (int64_t)st.st_mtim.tv_sec || mtimeNsec != st.st_mtim.tv_nsec
+        || ctimeSec != (int64_t)st.st_ctim.tv_sec || ctimeNsec != st.st_ctim.tv_nsec
+        || verifiedChunks > manifest->ChunkCount || verifiedChunks > size / manifest->ChunkSize)
+    {
+        Log_Info("Ignoring stale record of the verified blocks of %s", path);
+        return 0;
+    }
+
+    return verifiedChunks;
+}
+
+/**
+ * @brief Reads back the leading blocks of the sink's file and verifies them against its chunk manifest.
+ * @param sink The sink, with its file positioned at the start and its verifier at the first block.
+ * @param maxChunks The largest number of blocks to verify.
+ * @return bool True on success, even if a block is bad. False if the content could not be read.
+ */
+static bool VerifyKeptChunks(ADUC_HashUtils_FileSink* sink, size_t maxChunks)
+{
+    const ADUC_ChunkManifest* manifest = sink->Chunks.Manifest;
+    const size_t bufferSize = s_fileHashOptions.BufferSize;
+    uint8_t* buffer = malloc(bufferSize);
+
+    if (buffer == NULL)
+    {
+        return false;
+    }
+
+    // The verifier only advances past complete blocks that match, so a short or bad read just stops the scan.
+    const uint64_t end = (uint64_t)maxChunks * manifest->ChunkSize;
+    for (uint64_t offset = 0; offset < end;)
+    {
+        const uint64_t remaining = end - offset;
+        const size_t readSize = (remaining < bufferSize) ? (size_t)remaining : bufferSize;
+        const size_t bytesRead = fread(buffer, 1, readSize, sink->File);
+
+        if (bytesRead == 0 || !ADUC_HashUtils_ChunkVerifier_Update(&sink->Chunks, buffer, bytesRead))
+        {
+            break;
+        }
+
+        offset += bytesRead;
+    }
+
+    free(buffer);
+    return true;
+}
+
+/**
+ * @brief Opens the partially downloaded file at @p path so the download can be resumed.
+ *
+ * The leading blocks of the file that match @p manifest are kept, and the file is truncated after them. The last
+ * block is always re-downloaded. On return, BytesWritten and DigestOffset are the offset at which the download must
+ * resume; it is 0 if the file does not exist or its first block is bad.
+ *
+ * When the sink is closed, the number of verified blocks and the identity of the file are recorded next to it (in
+ * "<path>.chunks"), so the next attempt keeps them without reading them back. Without a valid record, the blocks
+ * are read back and verified. The kept blocks are not fed into the whole-file digests: the chunk manifest covers
+ * every byte of the file, so a sink that kept blocks is verified by blocks only, and ADUC_HashUtils_FileSink_Close
+ * returns no hash for it.
+ *
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm of the whole-file hash.
+ * @param manifest The block hashes. Must outlive the sink.
+ * @return bool True on success. On failure, the file is left as it was.
+ */
+_Bool ADUC_HashUtils_FileSink_OpenForResume(
+    ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm, const ADUC_ChunkManifest* manifest)
+{
+    _Bool success = false;
+    size_t keptChunks = 0;
+
+    if (sink == NULL || path == NULL)
+    {
+        Log_Error("Invalid input. sink: %p, path: %p", sink, path);
+        return false;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->Algorithm = algorithm;
+
+    if (!ADUC_HashUtils_ChunkVerifier_Init(&sink->Chunks, manifest, 0))
+    {
+        return false;
+    }
+
+    if (!ADUC_HashUtils_DigestInit(&sink->Context, algorithm))
+    {
+        return false;
+    }
+
+    sink->ResumePath = strdup(path);
+    if (sink->ResumePath == NULL)
+    {
+        goto done;
+    }
+
+    sink->File = fopen(path, "r+b");
+    if (sink->File == NULL && errno == ENOENT)
+    {
+        sink->File = fopen(path, "wb");
+    }
+
+    if (sink->File == NULL)
+    {
+        Log_Error("Cannot open file for writing: %s (errno %d)", path, errno);
+        goto done;
+    }
+
+    // Keep the leading blocks that match the manifest, except the last one, so there is always something left to
+    // download.
+    keptChunks = LoadChunkState(path, fileno(sink->File), manifest);
+    if (keptChunks == 0)
+    {
+        if (!VerifyKeptChunks(sink, manifest->ChunkCount - 1))
+        {
+            goto done;
+        }
+
+        keptChunks = sink->Chunks.ChunkIndex;
+    }
+
+    if (keptChunks > manifest->ChunkCount - 1)
+    {
+        keptChunks = manifest->ChunkCount - 1;
+    }
+
+    sink->BytesWritten = (uint64_t)keptChunks * manifest->ChunkSize;
+    sink->DigestOffset = sink->BytesWritten;
+
+    ADUC_HashUtils_ChunkVerifier_Uninit(&sink->Chunks);
+    if (!ADUC_HashUtils_ChunkVerifier_Init(&sink->Chunks, manifest, sink->BytesWritten))
+    {
+        goto done;
+    }
+
+    // Drop whatever follows the verified prefix, and append from there.
+    if (fflush(sink->File) != 0 || ftruncate(fileno(sink->File), (off_t)sink->BytesWritten) != 0
+        || fseeko(sink->File, (off_t)sink->BytesWritten, SEEK_SET) != 0)
+    {
+        Log_Error("Cannot truncate file: %s (errno %d)", path, errno);
+        goto done;
+    }
+
+    if (sink->BytesWritten > 0)
+    {
+        Log_Info("Keeping %llu verified bytes of %s", (unsigned long long)sink->BytesWritten, path);
+    }
+
+    success = true;
+
+done:
+    if (!success)
+    {
+        if (sink->File != NULL)
+        {
+            fclose(sink->File);
+            sink->File = NULL;
+        }
+
+        free(sink->ResumePath);
+        sink->ResumePath = NULL;
+        sink->BytesWritten = 0;
+        sink->DigestOffset = 0;
+        ADUC_HashUtils_ChunkVerifier_Uninit(&sink->Chunks);
+        ADUC_HashUtils_DigestUninit(&sink->Context);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Opens the partially downloaded file at @p path to append to its first @p length bytes.
+ *
+ * The first @p length bytes are fed into the running digest, and the file is truncated after them.
+ *
+ * @param sink The sink to initialize.
+ * @param path The path of the output file.
+ * @param algorithm The hashing algorithm.
+ * @param length The number of bytes to keep.
+ * @param prefixHashBase64 Optional. The expected hash of the first @p length bytes, e.g. the one returned by
+ * ADUC_HashUtils_FileSink_Close when the previous attempt stopped.
+ * @return bool True on success. False if the file is shorter than @p length or its prefix doesn't match.
+ */
+_Bool ADUC_HashUtils_FileSink_OpenForAppend(
+    ADUC_HashUtils_FileSink* sink, const char* path, SHAversion algorithm, uint64_t length, const char* prefixHashBase64)
+{
+    _Bool success = false;
+    uint8_t* buffer = NULL;
+    ADUC_HashUtils_DigestContext prefixContext;
+
+    memset(&prefixContext, 0, sizeof(prefixContext));
+
+    if (sink == NULL || path == NULL)
+    {
+        Log_Error("Invalid input. sink: %p, path: %p", sink, path);
+        return false;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->Algorithm = algorithm;
+
+    if (!ADUC_HashUtils_DigestInit(&sink->Context, algorithm))
+    {
+        return false;
+    }
+
+    sink->File = fopen(path, "r+b");
+    if (sink->File == NULL)
+    {
+        Log_Info("Cannot open partial file: %s (errno %d)", path, errno);
+        goto done;
+    }
+
+    buffer = malloc(s_fileHashOptions.BufferSize);
+    if (buffer == NULL)
+    {
+        goto done;
+    }
+
+    while (sink->BytesWritten < length)
+    {
+        const uint64_t remaining = length - sink->BytesWritten;
+        const size_t readSize = (remaining < s_fileHashOptions.BufferSize) ? (size_t)remaining
+                                                                          : s_fileHashOptions.BufferSize;
+
+        if (fread(buffer, 1, readSize, sink->File) != readSize)
+        {
+            Log_Warn("Partial file %s is shorter than %llu bytes.", path, (unsigned long long)length);
+            goto done;
+        }
+
+        if (!ADUC_HashUtils_DigestUpdate(&sink->Context, buffer, readSize))
+        {
+            goto done;
+        }
+
+        sink->BytesWritten += readSize;
+    }
+
+    if (prefixHashBase64 != NULL)
+    {
+        if (!ADUC_HashUtils_DigestCopy(&prefixContext, &sink->Context))
+        {
+            goto done;
+        }
+
+        if (!GetResultAndCompareHashes(&prefixContext, prefixHashBase64, algorithm, NULL))
+        {
+            Log_Warn("Partial file %s does not match its recorded hash.", path);
+            goto done;
+        }
+    }
+
+    // Drop whatever follows the prefix, and append from there.
+    if (fflush(sink->File) != 0 || ftruncate(fileno(sink->File), (off_t)length) != 0
+        || fseeko(sink->File, (off_t)length, SEEK_SET) != 0)
+    {
+        Log_Error("Cannot truncate file: %s (errno %d)", path, errno);
+        goto done;
+    }
+
+    success = true;
+
+done:
+    free(buffer);
+    ADUC_HashUtils_DigestUninit(&prefixContext);
+
+    if (!success)
+    {
+        if (sink->File != NULL)
+        {
+            fclose(sink->File);
+            sink->File = NULL;
+        }
+
+        ADUC_HashUtils_DigestUninit(&sink->Context);
+        sink->BytesWritten = 0;
+    }
+
+    return success;
+}
+
+/**
+ * @brief Flushes and closes the sink's file, then compares the digest of everything written to @p hashBase64.
+ * @param sink The sink to close. The sink is always closed, even on failure.
+ * @param hashBase64 The expected hash. If NULL, only computes the hash.
+ * @param outputHash Optional. Receives the computed base64 hash. Caller must call free() when done.
+ * @return bool True if the file was written successfully and the hash matches @p hashBase64.
+ */
+_Bool ADUC_HashUtils_FileSink_Close(ADUC_HashUtils_FileSink* sink, const char* hashBase64, char** outputHash)
+{
+    _Bool success = false;
+    char* hash = NULL;
+
+    if (outputHash != NULL)
+    {
+        *outputHash = NULL;
+    }
+
+    if (sink == NULL || sink->File == NULL)
+    {
+        Log_Error("Sink is not open.");
+        return false;
+    }
+
+    const int closeResult = fclose(sink->File);
+    sink->File = NULL;
+
+    if (closeResult != 0)
+    {
+        Log_Error("Error closing file (errno %d).", errno);
+        goto done;
+    }
+
+    // Only a complete download must cover every block of the chunk manifest.
+    if (sink->Chunks.Manifest != NULL && !sink->ChunkMismatch && hashBase64 != NULL
+        && !ADUC_HashUtils_ChunkVerifier_Final(&sink->Chunks))
+    {
+        sink->ChunkMismatch = true;
+    }
+
+    if (sink->ResumePath != NULL)
+    {
+        // A verified download needs no record; otherwise the next attempt keeps the blocks verified so far.
+        SaveChunkState(
+            sink->ResumePath,
+            (hashBase64 != NULL && !sink->ChunkMismatch) ? 0 : sink->Chunks.ChunkIndex);
+    }
+
+    if (sink->ChunkMismatch)
+    {
+        goto done;
+    }
+
+    // The blocks kept from an earlier attempt are not in the digests, but every block matches the chunk manifest.
+    if (sink->DigestOffset > 0)
+    {
+        Log_Info("Content kept from an earlier attempt was verified by blocks only.");
+        success = true;
+        goto done;
+    }
+
+    if (hashBase64 == NULL || sink->ExpectedHashes == NULL)
+    {
+        UninitExtraDigests(sink);
+        success = GetResultAndCompareHashes(&sink->Context, hashBase64, sink->Algorithm, outputHash);
+        goto done;
+    }
+
+    hash = FinalizeDigestToBase64(&sink->Context, sink->Algorithm);
+    const bool expectedHashesMatch = CompareExpectedHashes(sink, hash);
+
+    // CompareHashes takes ownership of the hash.
+    success = CompareHashes(hash, hashBase64, sink->Algorithm, expectedHashesMatch ? outputHash : NULL)
+        && expectedHashesMatch;
+
+done:
+    ADUC_HashUtils_ChunkVerifier_Uninit(&sink->Chunks);
+    UninitExtraDigests(sink);
+    ADUC_HashUtils_DigestUninit(&sink->Context);
+    free(sink->ResumePath);
+    sink->ResumePath = NULL;
     return success;
 }
 
@@ -264,17 +1404,16 @@ done:
 _Bool ADUC_HashUtils_IsValidBufferHash(
     const uint8_t* buffer, size_t bufferLen, const char* hashBase64, SHAversion algorithm)
 {
-    USHAContext context;
+    ADUC_HashUtils_DigestContext context;
 
-    if (USHAReset(&context, algorithm) != 0)
+    if (!ADUC_HashUtils_DigestInit(&context, algorithm))
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
         return false;
     }
 
-    if (USHAInput(&context, buffer, bufferLen) != 0)
+    if (!ADUC_HashUtils_DigestUpdate(&context, buffer, bufferLen))
     {
-        Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
+        ADUC_HashUtils_DigestUninit(&context);
         return false;
     }
 
@@ -6,12 +6,20 @@
  * Licensed under the MIT License.
  */
 #include <aduc/hash_utils.h>
+#include <azure_c_shared_utility/azure_base64.h>
+#include <azure_c_shared_utility/strings.h>
 
 #include <catch2/catch.hpp>
 using Catch::Matchers::Equals;
 
+#include <algorithm> // for std::min
 #include <array>
+#include <climits> // for PATH_MAX
+#include <cstring> // for strdup
 #include <fstream>
+#include <string>
+#include <sys/stat.h> // for stat, chmod
+#include <unistd.h> // for close, sleep
 #include <unordered_map>
 
 // To generate file hashes:
@@ -307,3 +315,630 @@ TEST_CASE("ADUC_HashUtils_GetFileHash - LargeFile")
         hash = nullptr;
     }
 }
+
+TEST_CASE("ADUC_HashUtils_VerifyFileHashes")
+{
+    LargeFile testFile;
+
+    // ADUC_Hash has non-const members.
+    std::string sha256Type{ "sha256" };
+    std::string sha512Type{ "sha512" };
+    std::string md5Type{ "md5" };
+    std::string sha256Value{ testFile.GetDataHashBase64(SHAversion::SHA256) };
+    std::string sha512Value{ testFile.GetDataHashBase64(SHAversion::SHA512) };
+    std::string badValue{ "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=" };
+
+    SECTION("All hashes match")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &sha512Value[0], &sha512Type[0] } } };
+        std::array<ADUC_HashUtils_HashVerdict, 2> verdicts{};
+
+        REQUIRE(ADUC_HashUtils_VerifyFileHashes(testFile.Filename(), hashes.data(), hashes.size(), verdicts.data()));
+        CHECK(verdicts[0] == ADUC_HashUtils_HashVerdict_Match);
+        CHECK(verdicts[1] == ADUC_HashUtils_HashVerdict_Match);
+    }
+
+    SECTION("One hash mismatches")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &badValue[0], &sha512Type[0] } } };
+        std::array<ADUC_HashUtils_HashVerdict, 2> verdicts{};
+
+        REQUIRE_FALSE(
+            ADUC_HashUtils_VerifyFileHashes(testFile.Filename(), hashes.data(), hashes.size(), verdicts.data()));
+        CHECK(verdicts[0] == ADUC_HashUtils_HashVerdict_Match);
+        CHECK(verdicts[1] == ADUC_HashUtils_HashVerdict_Mismatch);
+    }
+
+    SECTION("Unsupported hash types fail the verification")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &badValue[0], &md5Type[0] }, { &sha256Value[0], &sha256Type[0] } } };
+        std::array<ADUC_HashUtils_HashVerdict, 2> verdicts{};
+
+        REQUIRE_FALSE(
+            ADUC_HashUtils_VerifyFileHashes(testFile.Filename(), hashes.data(), hashes.size(), verdicts.data()));
+        CHECK(verdicts[0] == ADUC_HashUtils_HashVerdict_Unsupported);
+    }
+
+    SECTION("No supported hash")
+    {
+        std::array<ADUC_Hash, 1> hashes{ { { &badValue[0], &md5Type[0] } } };
+
+        REQUIRE_FALSE(ADUC_HashUtils_VerifyFileHashes(testFile.Filename(), hashes.data(), hashes.size(), nullptr));
+    }
+
+    SECTION("Missing file")
+    {
+        std::array<ADUC_Hash, 1> hashes{ { { &sha256Value[0], &sha256Type[0] } } };
+
+        REQUIRE_FALSE(ADUC_HashUtils_VerifyFileHashes("/tmp/nonexistent-file-xyz", hashes.data(), hashes.size(), nullptr));
+    }
+}
+
+TEST_CASE("ADUC_HashUtils_FileSink")
+{
+    LargeFile sourceFile;
+    char outputPath[] = "/tmp/tmpsinkXXXXXX";
+    const int fd = mkstemp(outputPath);
+    REQUIRE(fd != -1);
+    close(fd);
+
+    // clang-format off
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA1,
+        SHAversion::SHA256,
+        SHAversion::SHA512);
+    // clang-format on
+
+    // Feed the data in odd-sized chunks, the way a download arrives.
+    const auto writeChunks = [&sourceFile](ADUC_HashUtils_FileSink* sink) {
+        const size_t chunkSize = 4093;
+        for (size_t offset = 0; offset < sourceFile.GetDataByteLen(); offset += chunkSize)
+        {
+            const size_t size = std::min(chunkSize, sourceFile.GetDataByteLen() - offset);
+            REQUIRE(ADUC_HashUtils_FileSink_Write(sink, sourceFile.GetData() + offset, size));
+        }
+    };
+
+    SECTION("Verify streamed hash and written content")
+    {
+        INFO("SHAversion: " << version);
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, version));
+        writeChunks(&sink);
+        CHECK(sink.BytesWritten == sourceFile.GetDataByteLen());
+
+        char* hash = nullptr;
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, sourceFile.GetDataHashBase64(version), &hash));
+        CHECK_THAT(hash, Equals(sourceFile.GetDataHashBase64(version)));
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+        free(hash);
+
+        CHECK(ADUC_HashUtils_IsValidFileHash(outputPath, sourceFile.GetDataHashBase64(version), version));
+    }
+
+    SECTION("Verify bad streamed hash")
+    {
+        INFO("SHAversion: " << version);
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, version));
+        writeChunks(&sink);
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_Close(&sink, "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=", nullptr));
+        CHECK(sink.File == nullptr);
+    }
+
+    REQUIRE(std::remove(outputPath) == 0);
+}
+
+TEST_CASE("ADUC_HashUtils_FileSink_SetExpectedHashes")
+{
+    LargeFile sourceFile;
+    char outputPath[] = "/tmp/tmpsinkXXXXXX";
+    const int fd = mkstemp(outputPath);
+    REQUIRE(fd != -1);
+    close(fd);
+
+    // ADUC_Hash has non-const members.
+    std::string sha256Type{ "sha256" };
+    std::string sha512Type{ "sha512" };
+    std::string md5Type{ "md5" };
+    std::string sha256Value{ sourceFile.GetDataHashBase64(SHAversion::SHA256) };
+    std::string sha512Value{ sourceFile.GetDataHashBase64(SHAversion::SHA512) };
+    std::string badValue{ "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=" };
+    const size_t prefixSize = 200 * 1024 + 7;
+
+    ADUC_HashUtils_FileSink sink{};
+    REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+
+    SECTION("Every hash is compared")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &sha512Value[0], &sha512Type[0] } } };
+        REQUIRE(ADUC_HashUtils_FileSink_SetExpectedHashes(&sink, hashes.data(), hashes.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, sourceFile.GetData(), sourceFile.GetDataByteLen()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, sha256Value.c_str(), nullptr));
+    }
+
+    SECTION("A mismatch of another algorithm fails the close")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &badValue[0], &sha512Type[0] } } };
+        REQUIRE(ADUC_HashUtils_FileSink_SetExpectedHashes(&sink, hashes.data(), hashes.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, sourceFile.GetData(), sourceFile.GetDataByteLen()));
+
+        char* hash = nullptr;
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_Close(&sink, sha256Value.c_str(), &hash));
+        CHECK(hash == nullptr);
+    }
+
+    SECTION("Content kept before the hashes are set is read back")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &sha512Value[0], &sha512Type[0] } } };
+        REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, sourceFile.GetData(), prefixSize));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForAppend(&sink, outputPath, SHAversion::SHA256, prefixSize, nullptr));
+        REQUIRE(ADUC_HashUtils_FileSink_SetExpectedHashes(&sink, hashes.data(), hashes.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Write(
+            &sink, sourceFile.GetData() + prefixSize, sourceFile.GetDataByteLen() - prefixSize));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, sha256Value.c_str(), nullptr));
+    }
+
+    SECTION("Unsupported hash types are rejected")
+    {
+        std::array<ADUC_Hash, 2> hashes{ { { &sha256Value[0], &sha256Type[0] }, { &badValue[0], &md5Type[0] } } };
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_SetExpectedHashes(&sink, hashes.data(), hashes.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+    }
+
+    REQUIRE(std::remove(outputPath) == 0);
+}
+
+TEST_CASE("ADUC_HashUtils_FileSink_OpenForAppend")
+{
+    LargeFile sourceFile;
+    const char* expectedHash = sourceFile.GetDataHashBase64(SHAversion::SHA256);
+    const size_t prefixSize = 200 * 1024 + 7;
+    char outputPath[] = "/tmp/tmpsinkXXXXXX";
+    const int fd = mkstemp(outputPath);
+    REQUIRE(fd != -1);
+    close(fd);
+
+    // An interrupted download that stopped after prefixSize bytes, followed by some garbage.
+    char* prefixHash = nullptr;
+    ADUC_HashUtils_FileSink sink{};
+    REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+    REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, sourceFile.GetData(), prefixSize));
+    REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, &prefixHash));
+    {
+        std::ofstream file{ outputPath, std::ios::app | std::ios::binary };
+        file << "garbage";
+    }
+
+    SECTION("Append after the recorded prefix")
+    {
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForAppend(&sink, outputPath, SHAversion::SHA256, prefixSize, prefixHash));
+        CHECK(sink.BytesWritten == prefixSize);
+        REQUIRE(ADUC_HashUtils_FileSink_Write(
+            &sink, sourceFile.GetData() + prefixSize, sourceFile.GetDataByteLen() - prefixSize));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+        CHECK(ADUC_HashUtils_IsValidFileHash(outputPath, expectedHash, SHAversion::SHA256));
+    }
+
+    SECTION("Reject a prefix that doesn't match its hash")
+    {
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_OpenForAppend(
+            &sink, outputPath, SHAversion::SHA256, prefixSize - 1, prefixHash));
+        CHECK(sink.File == nullptr);
+    }
+
+    SECTION("Reject a file shorter than the prefix")
+    {
+        REQUIRE_FALSE(
+            ADUC_HashUtils_FileSink_OpenForAppend(&sink, outputPath, SHAversion::SHA256, prefixSize + 4096, nullptr));
+        CHECK(sink.File == nullptr);
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    free(prefixHash);
+    (void)std::remove(outputPath);
+}
+
+/**
+ * @brief Builds a chunk manifest of @p data with the given block size.
+ * Free the result with ADUC_ChunkManifest_Free.
+ */
+static ADUC_ChunkManifest* CreateChunkManifest(const uint8_t* data, size_t size, size_t chunkSize)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    auto* manifest = static_cast<ADUC_ChunkManifest*>(calloc(1, sizeof(ADUC_ChunkManifest)));
+    REQUIRE(manifest != nullptr);
+    manifest->ChunkSize = chunkSize;
+    manifest->HashType = strdup("sha256");
+    manifest->ChunkCount = (size + chunkSize - 1) / chunkSize;
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    manifest->ChunkHashes = static_cast<char**>(calloc(manifest->ChunkCount, sizeof(char*)));
+    REQUIRE(manifest->ChunkHashes != nullptr);
+
+    for (size_t i = 0; i < manifest->ChunkCount; ++i)
+    {
+        const size_t offset = i * chunkSize;
+        const size_t blockSize = std::min(chunkSize, size - offset);
+        uint8_t digest[USHAMaxHashSize];
+        size_t digestSize = 0;
+        ADUC_HashUtils_DigestContext context{};
+
+        REQUIRE(ADUC_HashUtils_DigestInit(&context, SHAversion::SHA256));
+        REQUIRE(ADUC_HashUtils_DigestUpdate(&context, data + offset, blockSize));
+        REQUIRE(ADUC_HashUtils_DigestFinal(&context, digest, &digestSize));
+
+        STRING_HANDLE encoded = Azure_Base64_Encode_Bytes(digest, digestSize);
+        REQUIRE(encoded != nullptr);
+        manifest->ChunkHashes[i] = strdup(STRING_c_str(encoded));
+        STRING_delete(encoded);
+    }
+
+    return manifest;
+}
+
+TEST_CASE("ADUC_HashUtils_FileSink with chunk manifest")
+{
+    LargeFile sourceFile;
+    const size_t chunkSize = 64 * 1024;
+    ADUC_ChunkManifest* manifest = CreateChunkManifest(sourceFile.GetData(), sourceFile.GetDataByteLen(), chunkSize);
+    std::vector<uint8_t> data{ sourceFile.GetData(), sourceFile.GetData() + sourceFile.GetDataByteLen() };
+    const char* expectedHash = sourceFile.GetDataHashBase64(SHAversion::SHA256);
+    char outputPath[] = "/tmp/tmpsinkXXXXXX";
+    const int fd = mkstemp(outputPath);
+    REQUIRE(fd != -1);
+    close(fd);
+
+    // Writes data[begin, end) in odd-sized pieces; returns false as soon as the sink rejects a write.
+    const auto writeRange = [&data](ADUC_HashUtils_FileSink* sink, size_t begin, size_t end) {
+        const size_t pieceSize = 4093;
+        for (size_t offset = begin; offset < end; offset += pieceSize)
+        {
+            if (!ADUC_HashUtils_FileSink_Write(sink, data.data() + offset, std::min(pieceSize, end - offset)))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    SECTION("Verify blocks while streaming")
+    {
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+        REQUIRE(ADUC_HashUtils_FileSink_SetChunkManifest(&sink, manifest));
+        REQUIRE(writeRange(&sink, 0, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+        CHECK_FALSE(sink.ChunkMismatch);
+    }
+
+    SECTION("Reject the stream at the first bad block")
+    {
+        data[(2 * chunkSize) + 10] ^= 0xFF;
+
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+        REQUIRE(ADUC_HashUtils_FileSink_SetChunkManifest(&sink, manifest));
+        REQUIRE_FALSE(writeRange(&sink, 0, data.size()));
+        CHECK(sink.ChunkMismatch);
+        CHECK(ADUC_HashUtils_ChunkVerifier_GetVerifiedSize(&sink.Chunks) == 2 * chunkSize);
+        CHECK(sink.BytesWritten < 3 * chunkSize + 4093);
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+    }
+
+    SECTION("Resume after the verified prefix")
+    {
+        // An interrupted download that stopped in the middle of block 3.
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+        REQUIRE(writeRange(&sink, 0, (3 * chunkSize) + 100));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == 3 * chunkSize);
+
+        struct stat st
+        {
+        };
+        REQUIRE(stat(outputPath, &st) == 0);
+        CHECK(st.st_size == static_cast<off_t>(3 * chunkSize));
+
+        REQUIRE(writeRange(&sink, sink.BytesWritten, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+        CHECK(ADUC_HashUtils_IsValidFileHash(outputPath, expectedHash, SHAversion::SHA256));
+    }
+
+    SECTION("Resume discards a bad block and everything after it")
+    {
+        std::vector<uint8_t> corrupt{ data };
+        corrupt[chunkSize + 1] ^= 0xFF;
+
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_Open(&sink, outputPath, SHAversion::SHA256));
+        REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, corrupt.data(), corrupt.size()));
+        REQUIRE_FALSE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == chunkSize);
+        REQUIRE(writeRange(&sink, sink.BytesWritten, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+    }
+
+    SECTION("Resume a missing file from the start")
+    {
+        REQUIRE(std::remove(outputPath) == 0);
+
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == 0);
+        REQUIRE(writeRange(&sink, 0, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+    }
+
+    SECTION("Resume from the recorded blocks")
+    {
+        const std::string statePath = std::string(outputPath) + ".chunks";
+
+        // An interrupted download that stopped in the middle of block 3 records the 3 verified blocks.
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        REQUIRE(writeRange(&sink, 0, (3 * chunkSize) + 100));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+        CHECK(access(statePath.c_str(), F_OK) == 0);
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == 3 * chunkSize);
+        CHECK(sink.DigestOffset == 3 * chunkSize);
+
+        // Interrupted again after block 5; the kept blocks are not in the digest, so no hash is returned.
+        char* hash = nullptr;
+        REQUIRE(writeRange(&sink, sink.BytesWritten, 5 * chunkSize));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, &hash));
+        CHECK(hash == nullptr);
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == 5 * chunkSize);
+        REQUIRE(writeRange(&sink, sink.BytesWritten, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, &hash));
+        CHECK(hash == nullptr);
+        CHECK(ADUC_HashUtils_IsValidFileHash(outputPath, expectedHash, SHAversion::SHA256));
+
+        // A verified download needs no record.
+        CHECK(access(statePath.c_str(), F_OK) != 0);
+    }
+
+    SECTION("Blocks of a file modified since they were recorded are read back")
+    {
+        ADUC_HashUtils_FileSink sink{};
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        REQUIRE(writeRange(&sink, 0, (3 * chunkSize) + 100));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+
+        {
+            std::fstream file{ outputPath, std::ios::in | std::ios::out | std::ios::binary };
+            file.seekp(static_cast<std::streamoff>(chunkSize + 1));
+            file.put(static_cast<char>(data[chunkSize + 1] ^ 0xFF));
+        }
+
+        REQUIRE(ADUC_HashUtils_FileSink_OpenForResume(&sink, outputPath, SHAversion::SHA256, manifest));
+        CHECK(sink.BytesWritten == chunkSize);
+        REQUIRE(writeRange(&sink, sink.BytesWritten, data.size()));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, expectedHash, nullptr));
+        CHECK(ADUC_HashUtils_IsValidFileHash(outputPath, expectedHash, SHAversion::SHA256));
+    }
+
+    SECTION("Reject oversized blocks")
+    {
+        ADUC_HashUtils_ChunkVerifier verifier{};
+        const size_t chunkCount = manifest->ChunkCount;
+        manifest->ChunkSize = ADUC_CHUNK_MANIFEST_MAX_CHUNK_SIZE + 1;
+        manifest->ChunkCount = 1;
+        CHECK_FALSE(ADUC_HashUtils_ChunkVerifier_Init(&verifier, manifest, 0));
+        manifest->ChunkCount = chunkCount;
+    }
+
+    (void)std::remove(outputPath);
+    (void)std::remove((std::string(outputPath) + ".chunks").c_str());
+    ADUC_ChunkManifest_Free(manifest);
+}
+
+TEST_CASE("ADUC_HashUtils_SetFileHashOptions")
+{
+    LargeFile testFile;
+
+    SECTION("Buffer size is clamped")
+    {
+        ADUC_HashUtils_FileHashOptions options{};
+        options.BufferSize = 1;
+        ADUC_HashUtils_SetFileHashOptions(&options);
+        ADUC_HashUtils_GetFileHashOptions(&options);
+        CHECK(options.BufferSize == ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE);
+
+        options.BufferSize = 0;
+        ADUC_HashUtils_SetFileHashOptions(&options);
+        ADUC_HashUtils_GetFileHashOptions(&options);
+        CHECK(options.BufferSize == ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE);
+    }
+
+    SECTION("Hashed pages stay in the page cache by default")
+    {
+        ADUC_HashUtils_FileHashOptions options{};
+        ADUC_HashUtils_SetFileHashOptions(nullptr);
+        ADUC_HashUtils_GetFileHashOptions(&options);
+        CHECK(options.BufferSize == ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE);
+        CHECK_FALSE(options.UseMmap);
+        CHECK_FALSE(options.DropPageCache);
+    }
+
+    SECTION("Verify file hash with read and mmap engines")
+    {
+        // clang-format off
+        auto useMmap = GENERATE(false, true);
+        auto bufferSize = GENERATE(
+            static_cast<size_t>(ADUC_HASH_UTILS_MIN_FILE_BUFFER_SIZE),
+            static_cast<size_t>(ADUC_HASH_UTILS_DEFAULT_FILE_BUFFER_SIZE));
+        // clang-format on
+
+        INFO("UseMmap: " << useMmap << ", BufferSize: " << bufferSize);
+
+        ADUC_HashUtils_FileHashOptions options{};
+        options.BufferSize = bufferSize;
+        options.UseMmap = useMmap;
+        options.DropPageCache = true;
+        ADUC_HashUtils_SetFileHashOptions(&options);
+
+        CHECK(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+
+        char* hash = nullptr;
+        REQUIRE(ADUC_HashUtils_GetFileHash(testFile.Filename(), SHAversion::SHA512, &hash));
+        CHECK_THAT(hash, Equals(testFile.GetDataHashBase64(SHAversion::SHA512)));
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+        free(hash);
+    }
+
+    ADUC_HashUtils_SetFileHashOptions(nullptr);
+}
+
+TEST_CASE("ADUC_HashUtils digest backends")
+{
+    LargeFile testFile;
+
+    REQUIRE(ADUC_HashUtils_GetCpuShaAcceleration() != nullptr);
+
+    const ADUC_HashUtils_DigestBackend defaultBackend = ADUC_HashUtils_GetDigestBackend();
+
+    // clang-format off
+    auto backend = GENERATE(
+        ADUC_HashUtils_DigestBackend_Portable,
+        ADUC_HashUtils_DigestBackend_OpenSSL);
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA1,
+        SHAversion::SHA224,
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+    // clang-format on
+
+    SECTION("Every backend computes the same digests")
+    {
+        INFO("Backend: " << backend << ", SHAversion: " << version);
+        ADUC_HashUtils_SetDigestBackend(backend);
+
+        CHECK(ADUC_HashUtils_IsValidFileHash(testFile.Filename(), testFile.GetDataHashBase64(version), version));
+        CHECK(ADUC_HashUtils_IsValidBufferHash(
+            testFile.GetData(), testFile.GetDataByteLen(), testFile.GetDataHashBase64(version), version));
+    }
+
+    ADUC_HashUtils_SetDigestBackend(defaultBackend);
+}
+
+TEST_CASE("ADUC_HashUtils_DigestCache")
+{
+    char cacheFolder[] = "/tmp/digestcacheXXXXXX";
+    REQUIRE(mkdtemp(cacheFolder) != nullptr);
+    REQUIRE(ADUC_HashUtils_DigestCache_Init(cacheFolder));
+
+    LargeFile testFile;
+
+    struct stat st
+    {
+    };
+    REQUIRE(stat(testFile.Filename(), &st) == 0);
+
+    char entryPath[PATH_MAX];
+    snprintf(
+        entryPath,
+        sizeof(entryPath),
+        "%s/%llx-%llx-%d",
+        cacheFolder,
+        static_cast<unsigned long long>(st.st_dev),
+        static_cast<unsigned long long>(st.st_ino),
+        static_cast<int>(SHAversion::SHA256));
+
+    SECTION("Recently modified files are not cached")
+    {
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+        CHECK(access(entryPath, F_OK) != 0);
+    }
+
+    SECTION("Verified digest is reused, and ignored once the file changes")
+    {
+        // Files are only cached once their ctime is older than the racy window.
+        sleep(2);
+
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+        REQUIRE(access(entryPath, F_OK) == 0);
+
+        struct stat entrySt
+        {
+        };
+        REQUIRE(stat(entryPath, &entrySt) == 0);
+        CHECK((entrySt.st_mode & 07777) == 0600);
+
+        // Served from the cache.
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+        REQUIRE_FALSE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=", SHAversion::SHA256));
+
+        // Any metadata change invalidates the entry.
+        {
+            std::ofstream file{ testFile.Filename(), std::ios::app | std::ios::binary };
+            file.put(0);
+        }
+
+        REQUIRE_FALSE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+    }
+
+    SECTION("Untrusted entries are ignored")
+    {
+        sleep(2);
+
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+        REQUIRE(access(entryPath, F_OK) == 0);
+
+        // Replace the entry with a forged digest that is readable by others.
+        std::ifstream entryFile{ entryPath };
+        std::string entry{ std::istreambuf_iterator<char>(entryFile), std::istreambuf_iterator<char>() };
+        entryFile.close();
+        const std::string realHash{ testFile.GetDataHashBase64(SHAversion::SHA256) };
+        entry.replace(entry.find(realHash), realHash.size(), "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=");
+        {
+            std::ofstream forged{ entryPath, std::ios::trunc };
+            forged << entry;
+        }
+        REQUIRE(chmod(entryPath, 0644) == 0);
+
+        CHECK(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+    }
+
+    SECTION("Entries of deleted files are collected")
+    {
+        const std::string movedPath = std::string(testFile.Filename()) + ".moved";
+
+        sleep(2);
+
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(
+            testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256));
+        REQUIRE(access(entryPath, F_OK) == 0);
+
+        ADUC_HashUtils_DigestCache_CollectGarbage();
+        CHECK(access(entryPath, F_OK) == 0);
+
+        REQUIRE(std::rename(testFile.Filename(), movedPath.c_str()) == 0);
+        ADUC_HashUtils_DigestCache_CollectGarbage();
+        CHECK(access(entryPath, F_OK) != 0);
+        REQUIRE(std::rename(movedPath.c_str(), testFile.Filename()) == 0);
+    }
+
+    ADUC_HashUtils_DigestCache_Uninit();
+    (void)std::remove(entryPath);
+    REQUIRE(rmdir(cacheFolder) == 0);
+}
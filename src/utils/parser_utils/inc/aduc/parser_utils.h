@@ -53,6 +53,28 @@ JSON_Value* ADUC_JSON_GetUpdateManifestRoot(const JSON_Value* updateActionJson);
  */
 ADUC_Hash* ADUC_HashArray_AllocAndInit(const JSON_Object* hashObj, size_t* hashCount);
 
+/**
+ * @brief Allocates and populates an ADUC_ChunkManifest from a Parson JSON_Object.
+ *
+ * @param chunkObj JSON Object that contains the block hashes. May be NULL.
+ * @returns If success, a pointer to an ADUC_ChunkManifest. NULL if @p chunkObj is NULL or malformed.
+ *  Caller must call ADUC_ChunkManifest_Free() to free it.
+ */
+ADUC_ChunkManifest* ADUC_ChunkManifest_AllocAndInit(const JSON_Object* chunkObj);
+
+/**
+ * @brief Sets the compression format of @p fileEntity from the "compression" field of its file object.
+ *
+ * "auto" selects the format from the suffix of the file name, and leaves the file uncompressed if the suffix
+ * is unknown. When the file name ends with the suffix of the format, the suffix is removed, so TargetFilename
+ * names the decompressed file.
+ *
+ * @param fileEntity The initialized file entity.
+ * @param compression The value of the "compression" field. May be NULL for an uncompressed file.
+ * @returns True on success; false if @p compression is not a supported format.
+ */
+_Bool ADUC_FileEntity_SetCompression(ADUC_FileEntity* fileEntity, const char* compression);
+
 /**
  * @brief Parse the update action JSON into a ADUC_FileEntity structure.
  * This function returns only files listed in 'updateManifest' property
@@ -12,6 +12,7 @@
 
 #include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
 #include <stdlib.h> // for calloc
+#include <string.h> // for strcmp, strlen
 
 /**
  * @brief Retrieves the updateManifest from the updateActionJson
@@ -98,6 +99,163 @@ done:
     return tempHashArray;
 }
 
+/**
+ * @brief Allocates and populates an ADUC_ChunkManifest from a Parson JSON_Object.
+ *
+ * Sample JSON:
+ * {
+ *     "chunkSize": 4194304,
+ *     "hashType": "sha256",
+ *     "hashes": [ "<base64 hash of block 0>", "<base64 hash of block 1>", ... ]
+ * }
+ *
+ * @param chunkObj JSON Object that contains the block hashes. May be NULL.
+ * @returns If success, a pointer to an ADUC_ChunkManifest. NULL if @p chunkObj is NULL or malformed.
+ *  Caller must call ADUC_ChunkManifest_Free() to free it.
+ */
+ADUC_ChunkManifest* ADUC_ChunkManifest_AllocAndInit(const JSON_Object* chunkObj)
+{
+    _Bool success = false;
+    ADUC_ChunkManifest* manifest = NULL;
+
+    if (chunkObj == NULL)
+    {
+        return NULL;
+    }
+
+    const double chunkSize = json_object_get_number(chunkObj, ADUCITF_FIELDNAME_CHUNKSIZE);
+    const char* hashType = json_object_get_string(chunkObj, ADUCITF_FIELDNAME_HASHTYPE);
+    const JSON_Array* hashes = json_object_get_array(chunkObj, ADUCITF_FIELDNAME_HASHES);
+    const size_t chunkCount = json_array_get_count(hashes);
+
+    if (chunkSize < 1 || hashType == NULL || chunkCount == 0)
+    {
+        Log_Warn("Ignoring malformed chunk manifest.");
+        goto done;
+    }
+
+    if (chunkSize > ADUC_CHUNK_MANIFEST_MAX_CHUNK_SIZE)
+    {
+        Log_Warn(
+            "Ignoring chunk manifest with block size %.0f, the maximum is %d.",
+            chunkSize,
+            ADUC_CHUNK_MANIFEST_MAX_CHUNK_SIZE);
+        goto done;
+    }
+
+    manifest = calloc(1, sizeof(*manifest));
+    if (manifest == NULL)
+    {
+        goto done;
+    }
+
+    manifest->ChunkSize = (size_t)chunkSize;
+
+    if (mallocAndStrcpy_s(&(manifest->HashType), hashType) != 0)
+    {
+        goto done;
+    }
+
+    manifest->ChunkHashes = calloc(chunkCount, sizeof(char*));
+    if (manifest->ChunkHashes == NULL)
+    {
+        goto done;
+    }
+
+    manifest->ChunkCount = chunkCount;
+
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const char* hash = json_array_get_string(hashes, i);
+        if (hash == NULL || mallocAndStrcpy_s(&(manifest->ChunkHashes[i]), hash) != 0)
+        {
+            Log_Warn("Ignoring malformed chunk manifest.");
+            goto done;
+        }
+    }
+
+    success = true;
+
+done:
+
+    if (!success)
+    {
+        ADUC_ChunkManifest_Free(manifest);
+        manifest = NULL;
+    }
+
+    return manifest;
+}
+
+/**
+ * @brief The names and file name suffixes of the supported compression formats.
+ */
+static const struct
+{
+    ADUC_FileCompression Compression;
+    const char* Name;
+    const char* Suffix;
+} s_compressionFormats[] = {
+    { ADUC_FileCompression_Gzip, "gzip", ".gz" },
+    { ADUC_FileCompression_Xz, "xz", ".xz" },
+    { ADUC_FileCompression_Zstd, "zstd", ".zst" },
+};
+
+static _Bool HasSuffix(const char* str, const char* suffix)
+{
+    const size_t strLength = strlen(str);
+    const size_t suffixLength = strlen(suffix);
+
+    return strLength > suffixLength && strcmp(str + strLength - suffixLength, suffix) == 0;
+}
+
+/**
+ * @brief Sets the compression format of @p fileEntity from the "compression" field of its file object.
+ *
+ * @param fileEntity The initialized file entity.
+ * @param compression The value of the "compression" field. May be NULL for an uncompressed file.
+ * @returns True on success; false if @p compression is not a supported format.
+ */
+_Bool ADUC_FileEntity_SetCompression(ADUC_FileEntity* fileEntity, const char* compression)
+{
+    const _Bool isAuto = (compression != NULL && strcmp(compression, "auto") == 0);
+
+    fileEntity->Compression = ADUC_FileCompression_None;
+
+    if (compression == NULL)
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(s_compressionFormats); ++i)
+    {
+        const _Bool hasSuffix = HasSuffix(fileEntity->TargetFilename, s_compressionFormats[i].Suffix);
+
+        if ((isAuto && hasSuffix) || strcmp(compression, s_compressionFormats[i].Name) == 0)
+        {
+            fileEntity->Compression = s_compressionFormats[i].Compression;
+
+            // The sandbox only holds the decompressed file.
+            if (hasSuffix)
+            {
+                char* suffix = fileEntity->TargetFilename + strlen(fileEntity->TargetFilename)
+                    - strlen(s_compressionFormats[i].Suffix);
+                *suffix = '\0';
+            }
+
+            return true;
+        }
+    }
+
+    if (!isAuto)
+    {
+        Log_Error("Unsupported compression '%s' for file %s", compression, fileEntity->TargetFilename);
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * @brief Free memory allocated for the specified ADUC_FileEntity object's member.
  *
@@ -114,6 +272,7 @@ void ADUC_FileEntity_Uninit(ADUC_FileEntity* entity)
     free(entity->FileId);
     free(entity->Arguments);
     ADUC_Hash_FreeArray(entity->HashCount, entity->Hash);
+    ADUC_ChunkManifest_Free(entity->ChunkManifest);
     memset(entity, 0, sizeof(*entity));
 }
 
@@ -428,6 +587,14 @@ _Bool ADUC_Json_GetFiles(const JSON_Value* updateActionJson, unsigned int* fileC
             Log_Error("Invalid file arguments");
             goto done;
         }
+
+        curFile->ChunkManifest =
+            ADUC_ChunkManifest_AllocAndInit(json_object_get_object(fileObj, ADUCITF_FIELDNAME_CHUNKHASHES));
+
+        if (!ADUC_FileEntity_SetCompression(curFile, json_object_get_string(fileObj, ADUCITF_FIELDNAME_COMPRESSION)))
+        {
+            goto done;
+        }
     }
 
     succeeded = true;
@@ -0,0 +1,81 @@
+/**
+ * @file payload_cache.h
+ * @brief A content-addressable store of downloaded payload files, shared across workflows.
+ *
+ * Entries are keyed by the base64 sha256 hash of the file from the update manifest, so a payload that was
+ * downloaded once can be placed in the sandbox of a later workflow, retry or replacement without network I/O.
+ * The store is kept under a disk budget by evicting the least recently used entries.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_PAYLOAD_CACHE_H
+#define ADUC_PAYLOAD_CACHE_H
+
+#include "aduc/c_utils.h"
+
+#include <stdbool.h> // for _Bool
+#include <stdint.h> // for uint64_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Enables the payload cache in @p cacheFolder, creating the folder if needed.
+ *
+ * Modules that don't call this function use ADUC_PAYLOAD_CACHE_FOLDER, with the budget from the
+ * payloadCacheSizeInMB setting of the agent configuration file, if the folder already exists and is trusted.
+ *
+ * @remark Not thread-safe. Call once at startup.
+ * @param cacheFolder The cache folder. It must be owned by the effective user and have mode 0700.
+ * @param budgetInBytes The disk budget of the cache. 0 disables the cache and removes the entries in @p cacheFolder.
+ * @return bool True if the cache is enabled.
+ */
+_Bool ADUC_PayloadCache_Init(const char* cacheFolder, uint64_t budgetInBytes);
+
+/**
+ * @brief Disables the payload cache. The entries stay on disk.
+ * @remark Not thread-safe.
+ */
+void ADUC_PayloadCache_Uninit(void);
+
+/**
+ * @brief Places the cached payload with hash @p sha256HashBase64 at @p targetPath.
+ *
+ * The payload is reflinked when the file system supports it, otherwise copied, so the caller may modify @p targetPath
+ * without affecting the entry. The entry becomes the most recently used one.
+ * The caller must verify the hash of @p targetPath; an entry that doesn't match should be removed with
+ * ADUC_PayloadCache_Remove.
+ *
+ * @param sha256HashBase64 The base64 sha256 hash of the payload.
+ * @param targetPath The path of the file to create. It must not exist.
+ * @return bool True if @p targetPath was created from the cache.
+ */
+_Bool ADUC_PayloadCache_Fetch(const char* sha256HashBase64, const char* targetPath);
+
+/**
+ * @brief Adds the verified file at @p sourcePath to the cache, then evicts the least recently used entries
+ * that exceed the budget.
+ *
+ * @param sha256HashBase64 The base64 sha256 hash of the file. The caller must have verified it.
+ * @param sourcePath The file. It is reflinked into the cache when the file system supports it, otherwise copied, so
+ * the caller may modify it later without affecting the entry.
+ * @return bool True if the cache holds the file on return.
+ */
+_Bool ADUC_PayloadCache_Store(const char* sha256HashBase64, const char* sourcePath);
+
+/**
+ * @brief Removes the entry for @p sha256HashBase64, if any.
+ * @param sha256HashBase64 The base64 sha256 hash of the payload.
+ */
+void ADUC_PayloadCache_Remove(const char* sha256HashBase64);
+
+/**
+ * @brief Removes the leftovers of interrupted stores and unexpected files, and evicts the least recently used
+ * entries that exceed the budget.
+ * @remark Call while no payload is being stored, e.g. when the agent is idle.
+ */
+void ADUC_PayloadCache_CollectGarbage(void);
+
+EXTERN_C_END
+
+#endif // ADUC_PAYLOAD_CACHE_H
@@ -0,0 +1,546 @@
+/**
+ * @file payload_cache.c
+ * @brief Implements the content-addressable payload cache.
+ *
+ * Each entry is a file in the cache folder named by the URL-safe base64 sha256 hash of its content ('+' and '/'
+ * replaced by '-' and '_', padding stripped). The mtime of an entry is the time it was last used, which orders
+ * LRU eviction. Files are added under a temporary ".tmp." name and renamed, so an entry is always complete.
+ *
+ * The cache folder must be a directory owned by the effective user of the process with mode 0700.
+ * Entries are not trusted blindly: callers verify the hash of every fetched payload.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/payload_cache.h"
+
+#include <aduc/config_utils.h>
+#include <aduc/logging.h>
+
+#include <dirent.h> // for opendir
+#include <errno.h>
+#include <fcntl.h> // for open, AT_FDCWD
+#include <limits.h> // for PATH_MAX
+#include <linux/fs.h> // for FICLONE
+#include <pthread.h>
+#include <stdio.h> // for snprintf, rename
+#include <stdlib.h> // for free, qsort
+#include <string.h> // for strdup, strlen, strncmp
+#include <sys/ioctl.h> // for ioctl
+#include <sys/sendfile.h> // for sendfile
+#include <sys/stat.h> // for mkdir, lstat, utimensat
+#include <unistd.h> // for geteuid, unlink
+
+/**
+ * @brief Prefix of files that are being added to the cache.
+ */
+#define PAYLOAD_CACHE_TEMP_PREFIX ".tmp."
+
+/**
+ * @brief Longest accepted key; a base64 sha512 hash is 88 characters.
+ */
+#define PAYLOAD_CACHE_MAX_KEY_LENGTH 88
+
+static char* s_cacheFolder = NULL;
+static uint64_t s_budgetInBytes = 0;
+static bool s_isConfigured = false;
+static pthread_once_t s_defaultInitOnce = PTHREAD_ONCE_INIT;
+
+// Serializes stores and evictions, which may run on concurrent download threads.
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int s_tempFileCounter = 0;
+
+/**
+ * @brief An entry considered for eviction.
+ */
+typedef struct tagPayloadCacheEntry
+{
+    char* Name;
+    uint64_t Size;
+    struct timespec LastUsed;
+} PayloadCacheEntry;
+
+static bool IsTrustedCacheFolder(const struct stat* st)
+{
+    return S_ISDIR(st->st_mode) && st->st_uid == geteuid() && (st->st_mode & 07777) == 0700;
+}
+
+/**
+ * @brief Uses the default cache folder, if it exists and is trusted, with the configured budget, unless the
+ * cache was configured explicitly. This lets every module that links payload_cache share the agent's cache.
+ */
+static void InitDefaultCacheFolder(void)
+{
+#ifdef ADUC_PAYLOAD_CACHE_FOLDER
+    struct stat st;
+    ADUC_ConfigInfo config = {};
+
+    if (s_isConfigured || lstat(ADUC_PAYLOAD_CACHE_FOLDER, &st) != 0 || !IsTrustedCacheFolder(&st))
+    {
+        return;
+    }
+
+    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    {
+        if (config.payloadCacheSizeInMB != 0)
+        {
+            s_budgetInBytes = (uint64_t)config.payloadCacheSizeInMB * 1024 * 1024;
+            s_cacheFolder = strdup(ADUC_PAYLOAD_CACHE_FOLDER);
+        }
+
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+#endif
+}
+
+static const char* GetCacheFolder(void)
+{
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    return s_cacheFolder;
+}
+
+/**
+ * @brief Builds the path of the entry for @p sha256HashBase64 in @p folder.
+ * @return bool True on success; false if the hash isn't base64 or the path is too long.
+ */
+static bool GetEntryPath(const char* folder, const char* sha256HashBase64, char* path, size_t pathSize)
+{
+    char key[PAYLOAD_CACHE_MAX_KEY_LENGTH + 1];
+    size_t keyLength = 0;
+
+    if (folder == NULL || sha256HashBase64 == NULL)
+    {
+        return false;
+    }
+
+    for (const char* c = sha256HashBase64; *c != '\0' && *c != '='; ++c)
+    {
+        const bool isAlnum = (*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9');
+
+        if (keyLength == PAYLOAD_CACHE_MAX_KEY_LENGTH || (!isAlnum && *c != '+' && *c != '/'))
+        {
+            return false;
+        }
+
+        key[keyLength++] = (*c == '+') ? '-' : (*c == '/') ? '_' : *c;
+    }
+
+    if (keyLength == 0)
+    {
+        return false;
+    }
+
+    key[keyLength] = '\0';
+
+    const int len = snprintf(path, pathSize, "%s/%s", folder, key);
+    return len > 0 && (size_t)len < pathSize;
+}
+
+/**
+ * @brief Marks the entry at @p entryPath as the most recently used.
+ */
+static void TouchEntry(const char* entryPath)
+{
+    if (utimensat(AT_FDCWD, entryPath, NULL, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        Log_Warn("Cannot update the last use of payload cache entry %s (errno %d).", entryPath, errno);
+    }
+}
+
+/**
+ * @brief Creates @p targetPath with the content of @p sourcePath, sharing its blocks when the file system
+ * supports reflinks, otherwise copying them. Unlike a hard link, writing to either file later leaves the other
+ * one intact, e.g. a handler that patches a payload in its sandbox can't corrupt the cache entry.
+ * @return bool True on success. On failure, @p targetPath doesn't exist.
+ */
+static bool CloneFile(const char* sourcePath, const char* targetPath)
+{
+    bool success = false;
+    struct stat st;
+    off_t offset = 0;
+    int targetFd = -1;
+    const int sourceFd = open(sourcePath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (sourceFd == -1 || fstat(sourceFd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        goto done;
+    }
+
+    targetFd = open(targetPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777);
+    if (targetFd == -1)
+    {
+        goto done;
+    }
+
+    if (ioctl(targetFd, FICLONE, sourceFd) == 0)
+    {
+        success = true;
+        goto done;
+    }
+
+    while (offset < st.st_size)
+    {
+        const ssize_t sent = sendfile(targetFd, sourceFd, &offset, (size_t)(st.st_size - offset));
+        if (sent <= 0)
+        {
+            if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Cannot copy %s to %s (errno %d).", sourcePath, targetPath, errno);
+            goto done;
+        }
+    }
+
+    success = true;
+
+done:
+    if (targetFd != -1)
+    {
+        if (close(targetFd) != 0)
+        {
+            success = false;
+        }
+
+        if (!success)
+        {
+            unlink(targetPath);
+        }
+    }
+
+    if (sourceFd != -1)
+    {
+        close(sourceFd);
+    }
+
+    return success;
+}
+
+static int CompareLastUsed(const void* a, const void* b)
+{
+    const struct timespec* ta = &((const PayloadCacheEntry*)a)->LastUsed;
+    const struct timespec* tb = &((const PayloadCacheEntry*)b)->LastUsed;
+
+    if (ta->tv_sec != tb->tv_sec)
+    {
+        return (ta->tv_sec < tb->tv_sec) ? -1 : 1;
+    }
+
+    return (ta->tv_nsec < tb->tv_nsec) ? -1 : (ta->tv_nsec > tb->tv_nsec) ? 1 : 0;
+}
+
+/**
+ * @brief Scans the cache folder and evicts the least recently used entries until the cache fits in the budget.
+ * @remark Caller must hold s_mutex.
+ * @param removeLeftovers If true, also removes temporary files and anything that isn't a regular file.
+ */
+static void EvictLocked(const char* folder, uint64_t budgetInBytes, bool removeLeftovers)
+{
+    DIR* dir = NULL;
+    struct dirent* dirEntry = NULL;
+    PayloadCacheEntry* entries = NULL;
+    size_t entryCount = 0;
+    size_t entryCapacity = 0;
+    uint64_t totalSize = 0;
+    char path[PATH_MAX];
+
+    dir = opendir(folder);
+    if (dir == NULL)
+    {
+        Log_Warn("Cannot open payload cache folder %s (errno %d).", folder, errno);
+        goto done;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        const char* name = dirEntry->d_name;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+            continue;
+        }
+
+        const int len = snprintf(path, sizeof(path), "%s/%s", folder, name);
+        if (len <= 0 || (size_t)len >= sizeof(path) || lstat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        if (strncmp(name, PAYLOAD_CACHE_TEMP_PREFIX, strlen(PAYLOAD_CACHE_TEMP_PREFIX)) == 0 || !S_ISREG(st.st_mode))
+        {
+            if (removeLeftovers && unlink(path) != 0)
+            {
+                Log_Warn("Cannot remove %s from the payload cache (errno %d).", path, errno);
+            }
+            continue;
+        }
+
+        if (entryCount == entryCapacity)
+        {
+            const size_t newCapacity = (entryCapacity == 0) ? 64 : entryCapacity * 2;
+            PayloadCacheEntry* newEntries = realloc(entries, newCapacity * sizeof(*entries));
+            if (newEntries == NULL)
+            {
+                goto done;
+            }
+            entries = newEntries;
+            entryCapacity = newCapacity;
+        }
+
+        entries[entryCount].Name = strdup(name);
+        if (entries[entryCount].Name == NULL)
+        {
+            goto done;
+        }
+
+        entries[entryCount].Size = (uint64_t)st.st_size;
+        entries[entryCount].LastUsed = st.st_mtim;
+        totalSize += entries[entryCount].Size;
+        ++entryCount;
+    }
+
+    if (totalSize <= budgetInBytes)
+    {
+        goto done;
+    }
+
+    qsort(entries, entryCount, sizeof(*entries), CompareLastUsed);
+
+    for (size_t i = 0; i < entryCount && totalSize > budgetInBytes; ++i)
+    {
+        const int len = snprintf(path, sizeof(path), "%s/%s", folder, entries[i].Name);
+        if (len > 0 && (size_t)len < sizeof(path) && unlink(path) == 0)
+        {
+            Log_Info(
+                "Evicted %s (%llu bytes) from the payload cache.",
+                entries[i].Name,
+                (unsigned long long)entries[i].Size);
+            totalSize -= entries[i].Size;
+        }
+    }
+
+done:
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        free(entries[i].Name);
+    }
+
+    free(entries);
+
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+}
+
+/**
+ * @brief Enables the payload cache in @p cacheFolder, creating the folder if needed.
+ * @remark Not thread-safe. Call once at startup.
+ * @param cacheFolder The cache folder. It must be owned by the effective user and have mode 0700.
+ * @param budgetInBytes The disk budget of the cache. 0 disables the cache and removes the entries in @p cacheFolder.
+ * @return bool True if the cache is enabled.
+ */
+_Bool ADUC_PayloadCache_Init(const char* cacheFolder, uint64_t budgetInBytes)
+{
+    struct stat st;
+
+    // Don't let a later lazy default init override this.
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    ADUC_PayloadCache_Uninit();
+
+    if (cacheFolder == NULL)
+    {
+        return false;
+    }
+
+    if (budgetInBytes == 0)
+    {
+        // Release the disk space of a cache that was enabled before.
+        if (lstat(cacheFolder, &st) == 0 && IsTrustedCacheFolder(&st))
+        {
+            pthread_mutex_lock(&s_mutex);
+            EvictLocked(cacheFolder, 0, true /* removeLeftovers */);
+            pthread_mutex_unlock(&s_mutex);
+        }
+
+        return false;
+    }
+
+    if (mkdir(cacheFolder, 0700) != 0 && errno != EEXIST)
+    {
+        Log_Warn("Cannot create payload cache folder %s (errno %d).", cacheFolder, errno);
+        return false;
+    }
+
+    if (lstat(cacheFolder, &st) != 0 || !IsTrustedCacheFolder(&st))
+    {
+        Log_Warn(
+            "Payload cache folder %s must be a directory owned by uid %d with mode 0700.", cacheFolder, geteuid());
+        return false;
+    }
+
+    s_cacheFolder = strdup(cacheFolder);
+    if (s_cacheFolder == NULL)
+    {
+        return false;
+    }
+
+    s_budgetInBytes = budgetInBytes;
+
+    Log_Info("Payload cache enabled: %s, budget %llu bytes.", cacheFolder, (unsigned long long)budgetInBytes);
+    return true;
+}
+
+/**
+ * @brief Disables the payload cache. The entries stay on disk.
+ * @remark Not thread-safe.
+ */
+void ADUC_PayloadCache_Uninit(void)
+{
+    pthread_once(&s_defaultInitOnce, InitDefaultCacheFolder);
+    free(s_cacheFolder);
+    s_cacheFolder = NULL;
+    s_budgetInBytes = 0;
+    s_isConfigured = true;
+}
+
+/**
+ * @brief Places the cached payload with hash @p sha256HashBase64 at @p targetPath.
+ * @param sha256HashBase64 The base64 sha256 hash of the payload.
+ * @param targetPath The path of the file to create. It must not exist.
+ * @return bool True if @p targetPath was created from the cache.
+ */
+_Bool ADUC_PayloadCache_Fetch(const char* sha256HashBase64, const char* targetPath)
+{
+    char entryPath[PATH_MAX];
+    struct stat st;
+
+    if (targetPath == NULL || !GetEntryPath(GetCacheFolder(), sha256HashBase64, entryPath, sizeof(entryPath)))
+    {
+        return false;
+    }
+
+    if (lstat(entryPath, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    if (!CloneFile(entryPath, targetPath))
+    {
+        Log_Warn("Cannot place payload cache entry %s at %s (errno %d).", entryPath, targetPath, errno);
+        return false;
+    }
+
+    TouchEntry(entryPath);
+
+    Log_Info("Payload %s (%llu bytes) taken from the payload cache.", targetPath, (unsigned long long)st.st_size);
+    return true;
+}
+
+/**
+ * @brief Adds the verified file at @p sourcePath to the cache, then evicts the least recently used entries
+ * that exceed the budget.
+ * @param sha256HashBase64 The base64 sha256 hash of the file. The caller must have verified it.
+ * @param sourcePath The file. It is reflinked or copied into the cache.
+ * @return bool True if the cache holds the file on return.
+ */
+_Bool ADUC_PayloadCache_Store(const char* sha256HashBase64, const char* sourcePath)
+{
+    bool success = false;
+    char entryPath[PATH_MAX];
+    char tempPath[PATH_MAX];
+    struct stat st;
+    const char* folder = GetCacheFolder();
+    unsigned int tempFileNumber = 0;
+
+    if (sourcePath == NULL || !GetEntryPath(folder, sha256HashBase64, entryPath, sizeof(entryPath)))
+    {
+        return false;
+    }
+
+    if (lstat(sourcePath, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > s_budgetInBytes)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (lstat(entryPath, &st) == 0)
+    {
+        TouchEntry(entryPath);
+        success = true;
+        goto done;
+    }
+
+    tempFileNumber = s_tempFileCounter++;
+
+    // Copying a large payload takes a while; don't hold up the other stores.
+    pthread_mutex_unlock(&s_mutex);
+
+    const int len = snprintf(
+        tempPath, sizeof(tempPath), "%s/" PAYLOAD_CACHE_TEMP_PREFIX "%d.%u", folder, (int)getpid(), tempFileNumber);
+
+    if (len <= 0 || (size_t)len >= sizeof(tempPath))
+    {
+        return false;
+    }
+
+    if (!CloneFile(sourcePath, tempPath))
+    {
+        Log_Warn("Cannot add %s to the payload cache (errno %d).", sourcePath, errno);
+        return false;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (rename(tempPath, entryPath) != 0)
+    {
+        Log_Warn("Cannot add %s to the payload cache (errno %d).", sourcePath, errno);
+        unlink(tempPath);
+        goto done;
+    }
+
+    TouchEntry(entryPath);
+    EvictLocked(folder, s_budgetInBytes, false /* removeLeftovers */);
+
+    success = (lstat(entryPath, &st) == 0);
+
+done:
+    pthread_mutex_unlock(&s_mutex);
+    return success;
+}
+
+/**
+ * @brief Removes the entry for @p sha256HashBase64, if any.
+ * @param sha256HashBase64 The base64 sha256 hash of the payload.
+ */
+void ADUC_PayloadCache_Remove(const char* sha256HashBase64)
+{
+    char entryPath[PATH_MAX];
+
+    if (GetEntryPath(GetCacheFolder(), sha256HashBase64, entryPath, sizeof(entryPath)) && unlink(entryPath) == 0)
+    {
+        Log_Warn("Removed payload cache entry %s.", entryPath);
+    }
+}
+
+/**
+ * @brief Removes the leftovers of interrupted stores and unexpected files, and evicts the least recently used
+ * entries that exceed the budget.
+ * @remark Call while no payload is being stored, e.g. when the agent is idle.
+ */
+void ADUC_PayloadCache_CollectGarbage(void)
+{
+    const char* folder = GetCacheFolder();
+
+    if (folder == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+    EvictLocked(folder, s_budgetInBytes, true /* removeLeftovers */);
+    pthread_mutex_unlock(&s_mutex);
+}
@@ -0,0 +1,194 @@
+/**
+ * @file payload_cache_ut.cpp
+ * @brief Unit Tests for payload_cache library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/payload_cache.h>
+
+#include <catch2/catch.hpp>
+
+#include <cstdio> // for std::remove
+#include <dirent.h> // for opendir
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h> // for stat
+#include <unistd.h> // for rmdir
+
+// The keys only need to look like base64 hashes; the cache doesn't hash content.
+static const char* hashA = "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=";
+static const char* hashB = "ypeBEsobvcr6wjGzmiPcTaeG7/gUfE5yuYB3ha/uSLs=";
+static const char* hashC = "LCa0a2j/xo/5m0U8HTBBNBNCLXBkg7+g+YpeiGJm564=";
+
+class TempFolder
+{
+public:
+    TempFolder()
+    {
+        REQUIRE(mkdtemp(_path) != nullptr);
+    }
+
+    ~TempFolder()
+    {
+        DIR* dir = opendir(_path);
+        if (dir != nullptr)
+        {
+            struct dirent* entry = nullptr;
+            while ((entry = readdir(dir)) != nullptr)
+            {
+                (void)std::remove(Path(entry->d_name).c_str());
+            }
+            closedir(dir);
+        }
+
+        (void)rmdir(_path);
+    }
+
+    TempFolder(const TempFolder&) = delete;
+    TempFolder& operator=(const TempFolder&) = delete;
+    TempFolder(TempFolder&&) = delete;
+    TempFolder& operator=(TempFolder&&) = delete;
+
+    const char* Folder() const
+    {
+        return _path;
+    }
+
+    std::string Path(const char* name) const
+    {
+        return std::string(_path) + "/" + name;
+    }
+
+private:
+    char _path[32] = "/tmp/payloadcacheXXXXXX";
+};
+
+static void WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+}
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static bool Exists(const std::string& path)
+{
+    struct stat st
+    {
+    };
+    return lstat(path.c_str(), &st) == 0;
+}
+
+TEST_CASE("ADUC_PayloadCache")
+{
+    TempFolder cache;
+    TempFolder sandbox;
+
+    REQUIRE(ADUC_PayloadCache_Init(cache.Folder(), 12));
+
+    const std::string fileA = sandbox.Path("a.bin");
+    WriteFile(fileA, "payload-A");
+
+    SECTION("Stored payload is fetched by hash")
+    {
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+
+        // The key is the URL-safe hash, so it is a valid file name.
+        CHECK(Exists(cache.Path("47DEQpj8HBSa-_TImW-5JCeuQeRkm5NMpJWZG3hSuFU")));
+
+        const std::string target = sandbox.Path("fetched.bin");
+        REQUIRE(ADUC_PayloadCache_Fetch(hashA, target.c_str()));
+        CHECK(ReadFile(target) == "payload-A");
+
+        // An existing target is not replaced.
+        CHECK_FALSE(ADUC_PayloadCache_Fetch(hashA, target.c_str()));
+    }
+
+    SECTION("Modifying a stored or fetched file leaves the entry intact")
+    {
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+        WriteFile(fileA, "patched-A");
+
+        const std::string target = sandbox.Path("fetched.bin");
+        REQUIRE(ADUC_PayloadCache_Fetch(hashA, target.c_str()));
+        CHECK(ReadFile(target) == "payload-A");
+        WriteFile(target, "patched-A");
+
+        const std::string other = sandbox.Path("other.bin");
+        REQUIRE(ADUC_PayloadCache_Fetch(hashA, other.c_str()));
+        CHECK(ReadFile(other) == "payload-A");
+    }
+
+    SECTION("Unknown and malformed hashes miss")
+    {
+        const std::string target = sandbox.Path("fetched.bin");
+        CHECK_FALSE(ADUC_PayloadCache_Fetch(hashB, target.c_str()));
+        CHECK_FALSE(ADUC_PayloadCache_Fetch("../a.bin", target.c_str()));
+        CHECK_FALSE(ADUC_PayloadCache_Fetch("", target.c_str()));
+        CHECK_FALSE(ADUC_PayloadCache_Store("../a.bin", fileA.c_str()));
+        CHECK_FALSE(Exists(target));
+    }
+
+    SECTION("Removed entry misses")
+    {
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+        ADUC_PayloadCache_Remove(hashA);
+        CHECK_FALSE(ADUC_PayloadCache_Fetch(hashA, sandbox.Path("fetched.bin").c_str()));
+    }
+
+    SECTION("Least recently used entries are evicted to fit the budget")
+    {
+        const std::string fileB = sandbox.Path("b.bin");
+        const std::string fileC = sandbox.Path("c.bin");
+        WriteFile(fileB, "B-data");
+        WriteFile(fileC, "C-data");
+        WriteFile(fileA, "A-data");
+
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+        REQUIRE(ADUC_PayloadCache_Store(hashB, fileB.c_str()));
+
+        // Using A makes B the least recently used entry.
+        REQUIRE(ADUC_PayloadCache_Fetch(hashA, sandbox.Path("fetched.bin").c_str()));
+        REQUIRE(ADUC_PayloadCache_Store(hashC, fileC.c_str()));
+
+        CHECK(ADUC_PayloadCache_Fetch(hashA, sandbox.Path("a2.bin").c_str()));
+        CHECK_FALSE(ADUC_PayloadCache_Fetch(hashB, sandbox.Path("b2.bin").c_str()));
+        CHECK(ADUC_PayloadCache_Fetch(hashC, sandbox.Path("c2.bin").c_str()));
+    }
+
+    SECTION("Files larger than the budget are not stored")
+    {
+        WriteFile(fileA, "larger than twelve bytes");
+        CHECK_FALSE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+    }
+
+    SECTION("Garbage collection removes leftovers")
+    {
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+        WriteFile(cache.Path(".tmp.1.0"), "partial");
+
+        ADUC_PayloadCache_CollectGarbage();
+
+        CHECK_FALSE(Exists(cache.Path(".tmp.1.0")));
+        CHECK(ADUC_PayloadCache_Fetch(hashA, sandbox.Path("fetched.bin").c_str()));
+    }
+
+    SECTION("A budget of 0 disables the cache and releases its entries")
+    {
+        REQUIRE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+
+        CHECK_FALSE(ADUC_PayloadCache_Init(cache.Folder(), 0));
+        CHECK_FALSE(Exists(cache.Path("47DEQpj8HBSa-_TImW-5JCeuQeRkm5NMpJWZG3hSuFU")));
+        CHECK_FALSE(ADUC_PayloadCache_Store(hashA, fileA.c_str()));
+    }
+
+    ADUC_PayloadCache_Uninit();
+}
@@ -9,6 +9,7 @@
 #define ADUC_PROCESS_UTILS_HPP
 
 #include <azure_c_shared_utility/vector.h>
+#include <cstdint>
 #include <functional>
 #include <grp.h>
 #include <pwd.h>
@@ -30,6 +31,24 @@
  */
 int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string> args, std::string& output);
 
+/**
+ * @brief Runs specified command in a new process and streams its standard output, chunk by chunk, to @p outputSink.
+ *        Standard error is captured separately into @p errorOutput.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param outputSink Receives each chunk of the standard output as it is read. Returning false terminates the child process.
+ * @param errorOutput A standard error from the command.
+ *
+ * @return An exit code from the command, or -1 if the command could not be launched or was terminated by @p outputSink.
+ */
+int ADUC_LaunchChildProcessWithOutputSink(
+    const std::string& command,
+    std::vector<std::string> args,
+    const std::function<bool(const uint8_t* data, size_t size)>& outputSink,
+    std::string& errorOutput);
+
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
  * @remark This function is not thread-safe if called with the defaults for the optional args.
@@ -29,6 +29,8 @@
 #include <chrono>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -149,6 +151,175 @@ int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string>
     return childExitStatus;
 }
 
+/**
+ * @brief Runs specified command in a new process and streams its standard output, chunk by chunk, to @p outputSink.
+ *        Standard error is captured separately into @p errorOutput.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param outputSink Receives each chunk of the standard output as it is read. Returning false terminates the child process.
+ * @param errorOutput A standard error from the command.
+ *
+ * @return An exit code from the command, or -1 if the command could not be launched or was terminated by @p outputSink.
+ */
+int ADUC_LaunchChildProcessWithOutputSink(
+    const std::string& command,
+    std::vector<std::string> args,
+    const std::function<bool(const uint8_t* data, size_t size)>& outputSink,
+    std::string& errorOutput) // NOLINT(google-runtime-references)
+{
+    // Large enough to keep the number of read() calls low for multi-GB payloads.
+    const size_t outputBufferSize = 64 * 1024;
+
+    int outPipe[2];
+    int errPipe[2];
+
+    if (pipe(outPipe) != 0)
+    {
+        Log_Error("Cannot create output pipe. %s (errno %d).", strerror(errno), errno);
+        return -1;
+    }
+
+    if (pipe(errPipe) != 0)
+    {
+        Log_Error("Cannot create error pipe. %s (errno %d).", strerror(errno), errno);
+        close(outPipe[READ_END]);
+        close(outPipe[WRITE_END]);
+        return -1;
+    }
+
+    const int pid = fork();
+
+    if (pid == 0)
+    {
+        // Running inside child process.
+        dup2(outPipe[WRITE_END], STDOUT_FILENO);
+        dup2(errPipe[WRITE_END], STDERR_FILENO);
+
+        close(outPipe[READ_END]);
+        close(outPipe[WRITE_END]);
+        close(errPipe[READ_END]);
+        close(errPipe[WRITE_END]);
+
+        std::vector<char*> argv;
+        argv.reserve(args.size() + 2);
+        argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        for (const std::string& arg : args)
+        {
+            argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        }
+        argv.emplace_back(nullptr);
+
+        int status = execvp(command.c_str(), &argv[0]);
+
+        fprintf(stderr, "execvp failed, returned %d, error %d\n", status, errno);
+
+        _exit(EXIT_FAILURE);
+    }
+
+    close(outPipe[WRITE_END]);
+    close(errPipe[WRITE_END]);
+
+    if (pid < 0)
+    {
+        Log_Error("fork failed, error %d", errno);
+        close(outPipe[READ_END]);
+        close(errPipe[READ_END]);
+        return -1;
+    }
+
+    std::vector<uint8_t> buffer(outputBufferSize);
+    bool sinkFailed = false;
+
+    struct pollfd fds[2] = { { outPipe[READ_END], POLLIN, 0 }, { errPipe[READ_END], POLLIN, 0 } };
+    nfds_t openCount = 2;
+
+    while (openCount > 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("poll failed, error %d", errno);
+            break;
+        }
+
+        for (struct pollfd& pfd : fds)
+        {
+            if (pfd.fd < 0 || pfd.revents == 0)
+            {
+                continue;
+            }
+
+            const ssize_t count = read(pfd.fd, buffer.data(), buffer.size());
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (count <= 0)
+            {
+                close(pfd.fd);
+                pfd.fd = -1;
+                --openCount;
+                continue;
+            }
+
+            if (pfd.fd == errPipe[READ_END])
+            {
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                errorOutput.append(reinterpret_cast<const char*>(buffer.data()), static_cast<size_t>(count));
+            }
+            else if (!outputSink(buffer.data(), static_cast<size_t>(count)))
+            {
+                Log_Error("Output sink failed, terminating child process %d", pid);
+                sinkFailed = true;
+                kill(pid, SIGTERM);
+                break;
+            }
+        }
+
+        if (sinkFailed)
+        {
+            break;
+        }
+    }
+
+    for (const struct pollfd& pfd : fds)
+    {
+        if (pfd.fd >= 0)
+        {
+            close(pfd.fd);
+        }
+    }
+
+    int wstatus = 0;
+    waitpid(pid, &wstatus, 0);
+
+    if (sinkFailed)
+    {
+        return -1;
+    }
+
+    if (WIFEXITED(wstatus))
+    {
+        return WEXITSTATUS(wstatus);
+    }
+
+    if (WIFSIGNALED(wstatus))
+    {
+        Log_Info("Child process terminated, signal %d", WTERMSIG(wstatus));
+        return WTERMSIG(wstatus);
+    }
+
+    Log_Error("Child process terminated abnormally.");
+    return EXIT_FAILURE;
+}
+
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
  * @remark This function is not thread-safe if called with the defaults for the optional args.
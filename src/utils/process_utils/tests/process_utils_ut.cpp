@@ -92,6 +92,41 @@ TEST_CASE("Invalid option - cp -1")
     CHECK_THAT(output.c_str(), Contains("invalid option -- '1'"));
 }
 
+TEST_CASE("Stream standard output to sink")
+{
+    std::vector<std::string> args;
+    args.emplace_back("-c");
+    args.emplace_back("echo streamed; echo diagnostics >&2");
+    std::string streamed;
+    std::string errorOutput;
+
+    const int exitCode = ADUC_LaunchChildProcessWithOutputSink(
+        "sh",
+        args,
+        [&streamed](const uint8_t* data, size_t size) -> bool {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            streamed.append(reinterpret_cast<const char*>(data), size);
+            return true;
+        },
+        errorOutput);
+
+    REQUIRE(exitCode == EXIT_SUCCESS);
+    CHECK(streamed == "streamed\n");
+    CHECK_THAT(errorOutput.c_str(), Contains("diagnostics"));
+}
+
+TEST_CASE("Stream sink failure terminates child")
+{
+    std::vector<std::string> args;
+    args.emplace_back("/dev/zero");
+    std::string errorOutput;
+
+    const int exitCode = ADUC_LaunchChildProcessWithOutputSink(
+        "cat", args, [](const uint8_t* /*data*/, size_t /*size*/) -> bool { return false; }, errorOutput);
+
+    REQUIRE(exitCode == -1);
+}
+
 TEST_CASE("VerifyProcessEffectiveGroup")
 {
     SECTION("it should return false when gegrnam returns nullptr and sets errno")
@@ -0,0 +1,185 @@
+/**
+ * @file resumable_download_utils.hpp
+ * @brief Retry loop and resumable partial files shared by the HTTP content downloaders.
+ *
+ * Content is downloaded into "<target>.partial" and renamed to the target once its hashes are verified. When an
+ * attempt fails, a small sidecar file, "<target>.partial.json", records how many bytes were written, the hash of
+ * those bytes, and the ETag/Last-Modified validators of the response, so the next attempt can resume with an HTTP
+ * range request guarded by If-Range instead of starting over. With a chunk manifest, the sink records the verified
+ * blocks itself (see ADUC_HashUtils_FileSink_OpenForResume), and the sidecar only keeps the validators.
+ *
+ * A download fetched in concurrent segments records the bytes kept at the start of each segment instead, so the next
+ * attempt only requests the missing ranges (see ADUC_ResumableDownload_LoadSegments).
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_RESUMABLE_DOWNLOAD_UTILS_HPP
+#define ADUC_RESUMABLE_DOWNLOAD_UTILS_HPP
+
+#include <aduc/download_governor.h>
+#include <aduc/hash_utils.h>
+#include <aduc/result.h>
+#include <aduc/types/adu_core.h> // for ADUC_Result_*
+#include <aduc/types/update_content.h>
+
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The files and resume state of one download.
+ */
+struct ADUC_ResumableDownload
+{
+    std::string TargetPath; /**< The verified file. */
+    std::string PartialPath; /**< The content downloaded so far. */
+    std::string StatePath; /**< The sidecar file with the resume state. */
+
+    std::string Url; /**< The URL the partial content comes from. */
+    bool HasState = false; /**< The sidecar of an earlier attempt was loaded. */
+    uint64_t BytesWritten = 0; /**< The number of bytes in the partial file, according to the sidecar. */
+    std::string PrefixHash; /**< The base64 hash of those bytes. Empty with a chunk manifest. */
+    std::string ETag; /**< The ETag of the response that the partial content came from, if any. */
+    std::string LastModified; /**< The Last-Modified date of that response, if any. */
+    uint64_t SegmentSize = 0; /**< The segment size of a segmented download, or 0. */
+    std::vector<uint64_t> SegmentBytesWritten; /**< The bytes kept at the start of each segment. */
+
+    long ResponseStatus = 0; /**< The HTTP status of the last response of the current attempt. */
+    std::string ResponseETag; /**< The ETag of the last response of the current attempt. */
+    std::string ResponseLastModified; /**< The Last-Modified date of the last response of the current attempt. */
+};
+
+/**
+ * @brief The result of one download attempt, for ADUC_ResumableDownload_Run.
+ * @param[out] retriable Set to true if the attempt failed in a way worth retrying.
+ * @return ADUC_Result The result of the attempt.
+ */
+typedef std::function<ADUC_Result(bool* retriable)> ADUC_ResumableDownload_AttemptFunc;
+
+/**
+ * @brief Sets the files of the download of @p url to @p targetPath.
+ * @param download The download to initialize.
+ * @param targetPath The full path of the verified file.
+ * @param url The download URL.
+ */
+void ADUC_ResumableDownload_Init(ADUC_ResumableDownload* download, const std::string& targetPath, const char* url);
+
+/**
+ * @brief Opens the hashing file sink of an attempt on the partial file.
+ *
+ * With a chunk manifest, the verified blocks of an earlier attempt are kept. Otherwise the bytes recorded in the
+ * sidecar are kept if their hash still matches. Anything else starts over with an empty file. The sidecar is removed;
+ * ADUC_ResumableDownload_SaveState writes it again if the attempt fails too.
+ *
+ * @param download The download.
+ * @param sink The sink to initialize. On success, BytesWritten is the offset at which the transfer must resume.
+ * @param entity The file to download.
+ * @param algorithm The algorithm of the sink's digest.
+ * @param allowResume False to always start over, e.g. when the content is decompressed as it arrives.
+ * @return bool True on success.
+ */
+bool ADUC_ResumableDownload_OpenSink(
+    ADUC_ResumableDownload* download,
+    ADUC_HashUtils_FileSink* sink,
+    const ADUC_FileEntity* entity,
+    SHAversion algorithm,
+    bool allowResume);
+
+/**
+ * @brief Gets the If-Range header of a transfer that resumes at @p offset.
+ * @param download The download.
+ * @param offset The offset at which the transfer resumes.
+ * @return std::string "If-Range: <validator>", or an empty string if the transfer starts over or there is no
+ * validator. The server then sends all of the content instead of the range if it changed since the partial file was
+ * written.
+ */
+std::string ADUC_ResumableDownload_GetIfRangeHeader(const ADUC_ResumableDownload* download, uint64_t offset);
+
+/**
+ * @brief Parses one response header line of the current attempt, e.g. "HTTP/1.1 206 Partial Content" or
+ * "ETag: "abc"". The status line of a new response forgets the validators of the previous one.
+ * @param download The download.
+ * @param line The header line, with or without its line break.
+ * @param length The length of @p line.
+ */
+void ADUC_ResumableDownload_OnResponseHeader(ADUC_ResumableDownload* download, const char* line, size_t length);
+
+/**
+ * @brief Records the state of a failed attempt in the sidecar, so the next attempt resumes after its content.
+ * Nothing is recorded if the sink has no content to keep.
+ * @param download The download.
+ * @param entity The file to download.
+ * @param sink The closed sink of the attempt.
+ * @param prefixHash The base64 hash of the content of the sink, as returned by ADUC_HashUtils_FileSink_Close.
+ * May be NULL with a chunk manifest.
+ */
+void ADUC_ResumableDownload_SaveState(
+    ADUC_ResumableDownload* download,
+    const ADUC_FileEntity* entity,
+    const ADUC_HashUtils_FileSink* sink,
+    const char* prefixHash);
+
+/**
+ * @brief Loads the progress of the segments of an earlier segmented attempt from the sidecar.
+ *
+ * The progress is kept if the sidecar was written for the same URL and the same segments. Otherwise every segment
+ * starts over. The sidecar is removed; ADUC_ResumableDownload_SaveSegments writes it again if the attempt fails too.
+ *
+ * @param download The download. On return, SegmentBytesWritten has @p segmentCount entries.
+ * @param segmentSize The segment size of the attempt.
+ * @param segmentCount The number of segments of the attempt.
+ * @return bool True if the progress of an earlier attempt was loaded.
+ */
+bool ADUC_ResumableDownload_LoadSegments(ADUC_ResumableDownload* download, uint64_t segmentSize, size_t segmentCount);
+
+/**
+ * @brief Records download->SegmentBytesWritten in the sidecar, so the next attempt only requests the missing ranges.
+ * The bytes kept for a segment must be written to the partial file, and verified if there is a chunk manifest.
+ * @param download The download.
+ */
+void ADUC_ResumableDownload_SaveSegments(ADUC_ResumableDownload* download);
+
+/**
+ * @brief Removes the partial file and its sidecar, so the next attempt starts over.
+ * @param download The download.
+ */
+void ADUC_ResumableDownload_Restart(ADUC_ResumableDownload* download);
+
+/**
+ * @brief Renames the verified partial file to the target, and removes the sidecar.
+ * @param download The download.
+ * @return bool True on success.
+ */
+bool ADUC_ResumableDownload_Commit(ADUC_ResumableDownload* download);
+
+/**
+ * @brief Whether a failed transfer is worth retrying: network errors, interrupted transfers and server errors.
+ * @param curlCode The libcurl result, or the exit code of curl(1), which uses the same values.
+ * @param httpStatus The HTTP status of the response, or 0.
+ * @return bool True if the transfer should be retried.
+ */
+bool ADUC_ResumableDownload_IsRetriableFailure(int curlCode, long httpStatus);
+
+/**
+ * @brief Runs @p attempt until it succeeds, fails in a way not worth retrying, or @p retryTimeout expires.
+ *
+ * The delay between two attempts doubles from 1 to 60 seconds. No attempt starts while downloads are paused (see
+ * ADUC_DownloadGovernor_Acquire).
+ *
+ * @param retryTimeout The time, in seconds, after which no attempt starts.
+ * @param attempt Runs one attempt.
+ * @param isCancelled Optional. Polled while waiting between attempts and while downloads are paused.
+ * @param context The context for @p isCancelled.
+ * @return ADUC_Result The result of the last attempt, or ADUC_Result_Failure_Cancelled if @p isCancelled returned
+ * nonzero while waiting.
+ */
+ADUC_Result ADUC_ResumableDownload_Run(
+    unsigned int retryTimeout,
+    const ADUC_ResumableDownload_AttemptFunc& attempt,
+    ADUC_DownloadGovernor_IsCancelledFunc isCancelled,
+    void* context);
+
+#endif // ADUC_RESUMABLE_DOWNLOAD_UTILS_HPP
@@ -0,0 +1,515 @@
+/**
+ * @file resumable_download_utils.cpp
+ * @brief Retry loop and resumable partial files shared by the HTTP content downloaders.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/resumable_download_utils.hpp"
+#include "aduc/logging.h"
+
+#include <algorithm> // for std::all_of, std::fill, std::min
+#include <chrono>
+#include <errno.h>
+#include <stdio.h> // for remove, rename
+#include <stdlib.h> // for strtol
+#include <strings.h> // for strncasecmp
+#include <thread>
+
+#include <parson.h>
+
+// Initial and maximum delay between two download attempts.
+#define RESUMABLE_DOWNLOAD_INITIAL_RETRY_DELAY_SECONDS 1
+#define RESUMABLE_DOWNLOAD_MAX_RETRY_DELAY_SECONDS 60
+
+// How often cancellation is polled between two attempts.
+#define RESUMABLE_DOWNLOAD_CANCEL_POLL_INTERVAL std::chrono::milliseconds(250)
+
+// libcurl results, which are also the exit codes of curl(1).
+#define RESUMABLE_DOWNLOAD_CURLE_COULDNT_RESOLVE_PROXY 5
+#define RESUMABLE_DOWNLOAD_CURLE_COULDNT_RESOLVE_HOST 6
+#define RESUMABLE_DOWNLOAD_CURLE_COULDNT_CONNECT 7
+#define RESUMABLE_DOWNLOAD_CURLE_PARTIAL_FILE 18
+#define RESUMABLE_DOWNLOAD_CURLE_HTTP_RETURNED_ERROR 22
+#define RESUMABLE_DOWNLOAD_CURLE_OPERATION_TIMEDOUT 28
+#define RESUMABLE_DOWNLOAD_CURLE_RANGE_ERROR 33
+#define RESUMABLE_DOWNLOAD_CURLE_SSL_CONNECT_ERROR 35
+#define RESUMABLE_DOWNLOAD_CURLE_GOT_NOTHING 52
+#define RESUMABLE_DOWNLOAD_CURLE_SEND_ERROR 55
+#define RESUMABLE_DOWNLOAD_CURLE_RECV_ERROR 56
+
+// Sidecar file fields.
+#define PARTIAL_STATE_FIELD_URL "url"
+#define PARTIAL_STATE_FIELD_BYTES_WRITTEN "bytesWritten"
+#define PARTIAL_STATE_FIELD_PREFIX_HASH "prefixHash"
+#define PARTIAL_STATE_FIELD_ETAG "etag"
+#define PARTIAL_STATE_FIELD_LAST_MODIFIED "lastModified"
+#define PARTIAL_STATE_FIELD_SEGMENT_SIZE "segmentSize"
+#define PARTIAL_STATE_FIELD_SEGMENTS "segments"
+
+namespace
+{
+/**
+ * @brief Loads the sidecar of @p download, if it was written for the same URL.
+ * @return bool True if the state was loaded.
+ */
+bool LoadState(ADUC_ResumableDownload* download)
+{
+    JSON_Value* root = json_parse_file(download->StatePath.c_str());
+    const JSON_Object* object = json_value_get_object(root);
+    const char* url = json_object_get_string(object, PARTIAL_STATE_FIELD_URL);
+    const char* prefixHash = json_object_get_string(object, PARTIAL_STATE_FIELD_PREFIX_HASH);
+    const char* etag = json_object_get_string(object, PARTIAL_STATE_FIELD_ETAG);
+    const char* lastModified = json_object_get_string(object, PARTIAL_STATE_FIELD_LAST_MODIFIED);
+    const bool isValid = (url != nullptr && prefixHash != nullptr && download->Url == url);
+
+    if (isValid)
+    {
+        download->BytesWritten =
+            static_cast<uint64_t>(json_object_get_number(object, PARTIAL_STATE_FIELD_BYTES_WRITTEN));
+        download->PrefixHash = prefixHash;
+        download->ETag = (etag != nullptr) ? etag : "";
+        download->LastModified = (lastModified != nullptr) ? lastModified : "";
+    }
+
+    json_value_free(root);
+    return isValid;
+}
+
+/**
+ * @brief Keeps the validators of the last response of the current attempt, if it carried content.
+ */
+void UpdateValidators(ADUC_ResumableDownload* download)
+{
+    if (download->ResponseStatus == 200 || download->ResponseStatus == 206)
+    {
+        download->ETag = download->ResponseETag;
+        download->LastModified = download->ResponseLastModified;
+    }
+}
+
+/**
+ * @brief Returns the value of a "Name: value" header line, without surrounding whitespace.
+ */
+std::string GetHeaderValue(const std::string& line, size_t nameLength)
+{
+    const size_t begin = line.find_first_not_of(" \t", nameLength);
+    const size_t end = line.find_last_not_of(" \t\r\n");
+    return (begin == std::string::npos || end < begin) ? "" : line.substr(begin, end - begin + 1);
+}
+
+/**
+ * @brief Waits @p seconds before the next attempt.
+ * @return bool False if @p isCancelled returned nonzero while waiting.
+ */
+bool WaitForRetry(unsigned int seconds, ADUC_DownloadGovernor_IsCancelledFunc isCancelled, void* context)
+{
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::steady_clock::now() < end)
+    {
+        if (isCancelled != nullptr && isCancelled(context))
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(RESUMABLE_DOWNLOAD_CANCEL_POLL_INTERVAL);
+    }
+
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Sets the files of the download of @p url to @p targetPath.
+ * @param download The download to initialize.
+ * @param targetPath The full path of the verified file.
+ * @param url The download URL.
+ */
+void ADUC_ResumableDownload_Init(ADUC_ResumableDownload* download, const std::string& targetPath, const char* url)
+{
+    *download = ADUC_ResumableDownload{};
+    download->TargetPath = targetPath;
+    download->PartialPath = targetPath + ".partial";
+    download->StatePath = download->PartialPath + ".json";
+    download->Url = (url != nullptr) ? url : "";
+}
+
+/**
+ * @brief Opens the hashing file sink of an attempt on the partial file.
+ *
+ * With a chunk manifest, the verified blocks of an earlier attempt are kept. Otherwise the bytes recorded in the
+ * sidecar are kept if their hash still matches. Anything else starts over with an empty file. The sidecar is removed;
+ * ADUC_ResumableDownload_SaveState writes it again if the attempt fails too.
+ *
+ * @param download The download.
+ * @param sink The sink to initialize. On success, BytesWritten is the offset at which the transfer must resume.
+ * @param entity The file to download.
+ * @param algorithm The algorithm of the sink's digest.
+ * @param allowResume False to always start over, e.g. when the content is decompressed as it arrives.
+ * @return bool True on success.
+ */
+bool ADUC_ResumableDownload_OpenSink(
+    ADUC_ResumableDownload* download,
+    ADUC_HashUtils_FileSink* sink,
+    const ADUC_FileEntity* entity,
+    SHAversion algorithm,
+    bool allowResume)
+{
+    bool sinkOpened = false;
+    const char* partialPath = download->PartialPath.c_str();
+
+    download->HasState = allowResume && LoadState(download);
+    if (!download->HasState)
+    {
+        download->BytesWritten = 0;
+        download->PrefixHash.clear();
+        download->ETag.clear();
+        download->LastModified.clear();
+    }
+
+    download->ResponseStatus = 0;
+    download->ResponseETag.clear();
+    download->ResponseLastModified.clear();
+
+    if (allowResume && entity->ChunkManifest != nullptr)
+    {
+        sinkOpened = ADUC_HashUtils_FileSink_OpenForResume(sink, partialPath, algorithm, entity->ChunkManifest);
+    }
+    else
+    {
+        if (download->HasState && download->BytesWritten > 0)
+        {
+            sinkOpened = ADUC_HashUtils_FileSink_OpenForAppend(
+                sink, partialPath, algorithm, download->BytesWritten, download->PrefixHash.c_str());
+        }
+
+        if (!sinkOpened)
+        {
+            sinkOpened = ADUC_HashUtils_FileSink_Open(sink, partialPath, algorithm);
+        }
+    }
+
+    (void)remove(download->StatePath.c_str());
+    return sinkOpened;
+}
+
+/**
+ * @brief Gets the If-Range header of a transfer that resumes at @p offset.
+ * @param download The download.
+ * @param offset The offset at which the transfer resumes.
+ * @return std::string "If-Range: <validator>", or an empty string if the transfer starts over or there is no
+ * validator. The server then sends all of the content instead of the range if it changed since the partial file was
+ * written.
+ */
+std::string ADUC_ResumableDownload_GetIfRangeHeader(const ADUC_ResumableDownload* download, uint64_t offset)
+{
+    const std::string& validator = !download->ETag.empty() ? download->ETag : download->LastModified;
+
+    if (offset == 0 || !download->HasState || validator.empty())
+    {
+        return std::string{};
+    }
+
+    return "If-Range: " + validator;
+}
+
+/**
+ * @brief Parses one response header line of the current attempt, e.g. "HTTP/1.1 206 Partial Content" or
+ * "ETag: "abc"". The status line of a new response forgets the validators of the previous one.
+ * @param download The download.
+ * @param line The header line, with or without its line break.
+ * @param length The length of @p line.
+ */
+void ADUC_ResumableDownload_OnResponseHeader(ADUC_ResumableDownload* download, const char* line, size_t length)
+{
+    static const char etagName[] = "ETag:";
+    static const char lastModifiedName[] = "Last-Modified:";
+    const std::string header{ line, length };
+
+    if (header.compare(0, 5, "HTTP/") == 0)
+    {
+        const size_t statusBegin = header.find(' ');
+        download->ResponseStatus =
+            (statusBegin == std::string::npos) ? 0 : strtol(header.c_str() + statusBegin, nullptr, 10);
+        download->ResponseETag.clear();
+        download->ResponseLastModified.clear();
+    }
+    else if (strncasecmp(header.c_str(), etagName, sizeof(etagName) - 1) == 0)
+    {
+        download->ResponseETag = GetHeaderValue(header, sizeof(etagName) - 1);
+    }
+    else if (strncasecmp(header.c_str(), lastModifiedName, sizeof(lastModifiedName) - 1) == 0)
+    {
+        download->ResponseLastModified = GetHeaderValue(header, sizeof(lastModifiedName) - 1);
+    }
+}
+
+/**
+ * @brief Records the state of a failed attempt in the sidecar, so the next attempt resumes after its content.
+ * Nothing is recorded if the sink has no content to keep.
+ * @param download The download.
+ * @param entity The file to download.
+ * @param sink The closed sink of the attempt.
+ * @param prefixHash The base64 hash of the content of the sink, as returned by ADUC_HashUtils_FileSink_Close.
+ * May be NULL with a chunk manifest.
+ */
+void ADUC_ResumableDownload_SaveState(
+    ADUC_ResumableDownload* download,
+    const ADUC_FileEntity* entity,
+    const ADUC_HashUtils_FileSink* sink,
+    const char* prefixHash)
+{
+    JSON_Value* root = nullptr;
+    JSON_Object* object = nullptr;
+
+    if (sink->BytesWritten == 0 || (prefixHash == nullptr && entity->ChunkManifest == nullptr))
+    {
+        return;
+    }
+
+    // Only a response that carried content has the validators of the partial content.
+    UpdateValidators(download);
+
+    // With a chunk manifest, the sink records the verified blocks itself, and the state only keeps the validators
+    // for If-Range.
+    download->BytesWritten = sink->BytesWritten;
+    download->PrefixHash = (prefixHash != nullptr) ? prefixHash : "";
+
+    root = json_value_init_object();
+    object = json_value_get_object(root);
+
+    json_object_set_string(object, PARTIAL_STATE_FIELD_URL, download->Url.c_str());
+    json_object_set_number(object, PARTIAL_STATE_FIELD_BYTES_WRITTEN, static_cast<double>(download->BytesWritten));
+    json_object_set_string(object, PARTIAL_STATE_FIELD_PREFIX_HASH, download->PrefixHash.c_str());
+    json_object_set_string(object, PARTIAL_STATE_FIELD_ETAG, download->ETag.c_str());
+    json_object_set_string(object, PARTIAL_STATE_FIELD_LAST_MODIFIED, download->LastModified.c_str());
+
+    if (json_serialize_to_file(root, download->StatePath.c_str()) != JSONSuccess)
+    {
+        Log_Warn("Cannot save download state to %s", download->StatePath.c_str());
+    }
+
+    json_value_free(root);
+}
+
+/**
+ * @brief Loads the progress of the segments of an earlier segmented attempt from the sidecar.
+ *
+ * The progress is kept if the sidecar was written for the same URL and the same segments. Otherwise every segment
+ * starts over. The sidecar is removed; ADUC_ResumableDownload_SaveSegments writes it again if the attempt fails too.
+ *
+ * @param download The download. On return, SegmentBytesWritten has @p segmentCount entries.
+ * @param segmentSize The segment size of the attempt.
+ * @param segmentCount The number of segments of the attempt.
+ * @return bool True if the progress of an earlier attempt was loaded.
+ */
+bool ADUC_ResumableDownload_LoadSegments(ADUC_ResumableDownload* download, uint64_t segmentSize, size_t segmentCount)
+{
+    JSON_Value* root = json_parse_file(download->StatePath.c_str());
+    const JSON_Object* object = json_value_get_object(root);
+    const char* url = json_object_get_string(object, PARTIAL_STATE_FIELD_URL);
+    const JSON_Array* segments = json_object_get_array(object, PARTIAL_STATE_FIELD_SEGMENTS);
+    const bool isValid = (url != nullptr && download->Url == url && segments != nullptr
+                          && json_array_get_count(segments) == segmentCount
+                          && static_cast<uint64_t>(json_object_get_number(object, PARTIAL_STATE_FIELD_SEGMENT_SIZE))
+                              == segmentSize);
+
+    download->SegmentSize = segmentSize;
+    download->SegmentBytesWritten.assign(segmentCount, 0);
+    download->HasState = isValid;
+    download->ResponseStatus = 0;
+    download->ResponseETag.clear();
+    download->ResponseLastModified.clear();
+
+    if (isValid)
+    {
+        const char* etag = json_object_get_string(object, PARTIAL_STATE_FIELD_ETAG);
+        const char* lastModified = json_object_get_string(object, PARTIAL_STATE_FIELD_LAST_MODIFIED);
+
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            download->SegmentBytesWritten[i] =
+                std::min(static_cast<uint64_t>(json_array_get_number(segments, i)), segmentSize);
+        }
+
+        download->ETag = (etag != nullptr) ? etag : "";
+        download->LastModified = (lastModified != nullptr) ? lastModified : "";
+    }
+    else
+    {
+        download->ETag.clear();
+        download->LastModified.clear();
+    }
+
+    json_value_free(root);
+    (void)remove(download->StatePath.c_str());
+    return isValid;
+}
+
+/**
+ * @brief Records download->SegmentBytesWritten in the sidecar, so the next attempt only requests the missing ranges.
+ * The bytes kept for a segment must be written to the partial file, and verified if there is a chunk manifest.
+ * @param download The download.
+ */
+void ADUC_ResumableDownload_SaveSegments(ADUC_ResumableDownload* download)
+{
+    JSON_Value* root = nullptr;
+    JSON_Object* object = nullptr;
+    JSON_Value* segments = nullptr;
+
+    if (std::all_of(download->SegmentBytesWritten.begin(), download->SegmentBytesWritten.end(), [](uint64_t bytes) {
+            return bytes == 0;
+        }))
+    {
+        return;
+    }
+
+    UpdateValidators(download);
+
+    root = json_value_init_object();
+    object = json_value_get_object(root);
+    segments = json_value_init_array();
+
+    for (uint64_t bytes : download->SegmentBytesWritten)
+    {
+        json_array_append_number(json_value_get_array(segments), static_cast<double>(bytes));
+    }
+
+    json_object_set_string(object, PARTIAL_STATE_FIELD_URL, download->Url.c_str());
+    json_object_set_number(object, PARTIAL_STATE_FIELD_SEGMENT_SIZE, static_cast<double>(download->SegmentSize));
+    json_object_set_value(object, PARTIAL_STATE_FIELD_SEGMENTS, segments);
+    json_object_set_string(object, PARTIAL_STATE_FIELD_ETAG, download->ETag.c_str());
+    json_object_set_string(object, PARTIAL_STATE_FIELD_LAST_MODIFIED, download->LastModified.c_str());
+
+    if (json_serialize_to_file(root, download->StatePath.c_str()) != JSONSuccess)
+    {
+        Log_Warn("Cannot save download state to %s", download->StatePath.c_str());
+    }
+
+    json_value_free(root);
+}
+
+/**
+ * @brief Removes the partial file and its sidecar, so the next attempt starts over.
+ * @param download The download.
+ */
+void ADUC_ResumableDownload_Restart(ADUC_ResumableDownload* download)
+{
+    (void)remove(download->PartialPath.c_str());
+    (void)remove(download->StatePath.c_str());
+    download->HasState = false;
+    std::fill(download->SegmentBytesWritten.begin(), download->SegmentBytesWritten.end(), 0);
+}
+
+/**
+ * @brief Renames the verified partial file to the target, and removes the sidecar.
+ * @param download The download.
+ * @return bool True on success.
+ */
+bool ADUC_ResumableDownload_Commit(ADUC_ResumableDownload* download)
+{
+    if (rename(download->PartialPath.c_str(), download->TargetPath.c_str()) != 0)
+    {
+        Log_Error("Cannot rename %s (errno %d)", download->PartialPath.c_str(), errno);
+        return false;
+    }
+
+    (void)remove(download->StatePath.c_str());
+    return true;
+}
+
+/**
+ * @brief Whether a failed transfer is worth retrying: network errors, interrupted transfers and server errors.
+ * @param curlCode The libcurl result, or the exit code of curl(1), which uses the same values.
+ * @param httpStatus The HTTP status of the response, or 0.
+ * @return bool True if the transfer should be retried.
+ */
+bool ADUC_ResumableDownload_IsRetriableFailure(int curlCode, long httpStatus)
+{
+    switch (curlCode)
+    {
+    case RESUMABLE_DOWNLOAD_CURLE_COULDNT_RESOLVE_PROXY:
+    case RESUMABLE_DOWNLOAD_CURLE_COULDNT_RESOLVE_HOST:
+    case RESUMABLE_DOWNLOAD_CURLE_COULDNT_CONNECT:
+    case RESUMABLE_DOWNLOAD_CURLE_PARTIAL_FILE:
+    case RESUMABLE_DOWNLOAD_CURLE_OPERATION_TIMEDOUT:
+    case RESUMABLE_DOWNLOAD_CURLE_RANGE_ERROR:
+    case RESUMABLE_DOWNLOAD_CURLE_SSL_CONNECT_ERROR:
+    case RESUMABLE_DOWNLOAD_CURLE_GOT_NOTHING:
+    case RESUMABLE_DOWNLOAD_CURLE_SEND_ERROR:
+    case RESUMABLE_DOWNLOAD_CURLE_RECV_ERROR:
+        return true;
+
+    case RESUMABLE_DOWNLOAD_CURLE_HTTP_RETURNED_ERROR:
+        return httpStatus >= 500 || httpStatus == 408 || httpStatus == 429;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Runs @p attempt until it succeeds, fails in a way not worth retrying, or @p retryTimeout expires.
+ *
+ * The delay between two attempts doubles from 1 to 60 seconds. No attempt starts while downloads are paused (see
+ * ADUC_DownloadGovernor_Acquire).
+ *
+ * @param retryTimeout The time, in seconds, after which no attempt starts.
+ * @param attempt Runs one attempt.
+ * @param isCancelled Optional. Polled while waiting between attempts and while downloads are paused.
+ * @param context The context for @p isCancelled.
+ * @return ADUC_Result The result of the last attempt, or ADUC_Result_Failure_Cancelled if @p isCancelled returned
+ * nonzero while waiting.
+ */
+ADUC_Result ADUC_ResumableDownload_Run(
+    unsigned int retryTimeout,
+    const ADUC_ResumableDownload_AttemptFunc& attempt,
+    ADUC_DownloadGovernor_IsCancelledFunc isCancelled,
+    void* context)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    unsigned int attemptCount = 0;
+    unsigned int retryDelaySeconds = RESUMABLE_DOWNLOAD_INITIAL_RETRY_DELAY_SECONDS;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(retryTimeout);
+
+    for (;;)
+    {
+        bool retriable = false;
+
+        ++attemptCount;
+
+        // Don't open connections while downloads are paused.
+        if (!ADUC_DownloadGovernor_Acquire(0, isCancelled, context))
+        {
+            result = { ADUC_Result_Failure_Cancelled };
+            break;
+        }
+
+        result = attempt(&retriable);
+
+        if (IsAducResultCodeSuccess(result.ResultCode) || !retriable
+            || std::chrono::steady_clock::now() + std::chrono::seconds(retryDelaySeconds) >= deadline)
+        {
+            break;
+        }
+
+        Log_Warn(
+            "Download attempt %u failed (0x%X), retrying in %u seconds.",
+            attemptCount,
+            result.ExtendedResultCode,
+            retryDelaySeconds);
+
+        if (!WaitForRetry(retryDelaySeconds, isCancelled, context))
+        {
+            result = { ADUC_Result_Failure_Cancelled };
+            break;
+        }
+
+        retryDelaySeconds =
+            std::min(retryDelaySeconds * 2, static_cast<unsigned int>(RESUMABLE_DOWNLOAD_MAX_RETRY_DELAY_SECONDS));
+    }
+
+    return result;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file resumable_download_utils_ut.cpp
+ * @brief Unit Tests for resumable_download_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/resumable_download_utils.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <cstdio> // for std::remove
+#include <cstdlib> // for free
+#include <cstring> // for strlen
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h> // for getpid
+#include <vector>
+
+// "0123456789" and the base64 sha256 hash of its first 4 bytes, "0123".
+static const char* const c_content = "0123456789";
+static const char* const c_prefixHash = "G+LkUrRteg2WVrux92joJI66G3W67WX12Z6vqUiJmmo=";
+
+static const char* const c_url = "http://example.com/file.bin";
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file{ path, std::ios::binary };
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static bool FileExists(const std::string& path)
+{
+    return std::ifstream{ path }.good();
+}
+
+static _Bool CancelAfterFourPolls(void* context)
+{
+    auto* pollCount = static_cast<int*>(context);
+    return ++(*pollCount) >= 4;
+}
+
+/**
+ * @brief Writes the first @p length bytes of c_content into the partial file of @p download, and records them as
+ * the state of a failed attempt, with the validators of a 206 response.
+ */
+static void FailAfter(ADUC_ResumableDownload* download, const ADUC_FileEntity* entity, size_t length)
+{
+    ADUC_HashUtils_FileSink sink{};
+    char* prefixHash = nullptr;
+
+    REQUIRE(ADUC_ResumableDownload_OpenSink(download, &sink, entity, SHA256, true /* allowResume */));
+
+    const char* statusLine = "HTTP/1.1 206 Partial Content\r\n";
+    const char* etagLine = "etag: \"v1\"\r\n";
+    ADUC_ResumableDownload_OnResponseHeader(download, statusLine, strlen(statusLine));
+    ADUC_ResumableDownload_OnResponseHeader(download, etagLine, strlen(etagLine));
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, reinterpret_cast<const uint8_t*>(c_content), length));
+    REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, &prefixHash));
+
+    ADUC_ResumableDownload_SaveState(download, entity, &sink, prefixHash);
+    free(prefixHash);
+}
+
+TEST_CASE("ADUC_ResumableDownload partial files")
+{
+    const std::string targetPath = "/tmp/resumable_download_utils_ut." + std::to_string(getpid());
+    ADUC_FileEntity entity{};
+    ADUC_ResumableDownload download;
+    ADUC_HashUtils_FileSink sink{};
+
+    ADUC_ResumableDownload_Init(&download, targetPath, c_url);
+    CHECK(download.PartialPath == targetPath + ".partial");
+    CHECK(download.StatePath == targetPath + ".partial.json");
+
+    SECTION("A failed attempt is resumed after its content")
+    {
+        FailAfter(&download, &entity, 4);
+        CHECK(FileExists(download.StatePath));
+
+        ADUC_ResumableDownload resumed;
+        ADUC_ResumableDownload_Init(&resumed, targetPath, c_url);
+        REQUIRE(ADUC_ResumableDownload_OpenSink(&resumed, &sink, &entity, SHA256, true /* allowResume */));
+        CHECK(resumed.HasState);
+        CHECK(resumed.PrefixHash == c_prefixHash);
+        CHECK(sink.BytesWritten == 4);
+        CHECK(ADUC_ResumableDownload_GetIfRangeHeader(&resumed, sink.BytesWritten) == "If-Range: \"v1\"");
+        CHECK_FALSE(FileExists(resumed.StatePath));
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE(ADUC_HashUtils_FileSink_Write(&sink, reinterpret_cast<const uint8_t*>(c_content) + 4, 6));
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+
+        REQUIRE(ADUC_ResumableDownload_Commit(&resumed));
+        CHECK(ReadFile(targetPath) == c_content);
+        CHECK_FALSE(FileExists(resumed.PartialPath));
+    }
+
+    SECTION("The content of another URL is not resumed")
+    {
+        FailAfter(&download, &entity, 4);
+
+        ADUC_ResumableDownload other;
+        ADUC_ResumableDownload_Init(&other, targetPath, "http://example.com/other.bin");
+        REQUIRE(ADUC_ResumableDownload_OpenSink(&other, &sink, &entity, SHA256, true /* allowResume */));
+        CHECK_FALSE(other.HasState);
+        CHECK(sink.BytesWritten == 0);
+        CHECK(ADUC_ResumableDownload_GetIfRangeHeader(&other, sink.BytesWritten).empty());
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+        CHECK(ReadFile(other.PartialPath).empty());
+    }
+
+    SECTION("Nothing is resumed without allowResume")
+    {
+        FailAfter(&download, &entity, 4);
+
+        REQUIRE(ADUC_ResumableDownload_OpenSink(&download, &sink, &entity, SHA256, false /* allowResume */));
+        CHECK(sink.BytesWritten == 0);
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+        CHECK_FALSE(FileExists(download.StatePath));
+    }
+
+    SECTION("Content modified since the failed attempt is not resumed")
+    {
+        FailAfter(&download, &entity, 4);
+        std::ofstream{ download.PartialPath, std::ios::binary } << "abcd";
+
+        REQUIRE(ADUC_ResumableDownload_OpenSink(&download, &sink, &entity, SHA256, true /* allowResume */));
+        CHECK(sink.BytesWritten == 0);
+        REQUIRE(ADUC_HashUtils_FileSink_Close(&sink, nullptr, nullptr));
+    }
+
+    SECTION("The segments of a failed attempt are resumed after what each one wrote")
+    {
+        const char* statusLine = "HTTP/1.1 206 Partial Content\r\n";
+        const char* etagLine = "etag: \"v1\"\r\n";
+
+        CHECK_FALSE(ADUC_ResumableDownload_LoadSegments(&download, 4, 3));
+        REQUIRE(download.SegmentBytesWritten.size() == 3);
+        ADUC_ResumableDownload_OnResponseHeader(&download, statusLine, strlen(statusLine));
+        ADUC_ResumableDownload_OnResponseHeader(&download, etagLine, strlen(etagLine));
+        download.SegmentBytesWritten = { 4, 0, 1 };
+        ADUC_ResumableDownload_SaveSegments(&download);
+        CHECK(FileExists(download.StatePath));
+
+        ADUC_ResumableDownload resumed;
+        ADUC_ResumableDownload_Init(&resumed, targetPath, c_url);
+        REQUIRE(ADUC_ResumableDownload_LoadSegments(&resumed, 4, 3));
+        CHECK(resumed.SegmentBytesWritten == std::vector<uint64_t>{ 4, 0, 1 });
+        CHECK(ADUC_ResumableDownload_GetIfRangeHeader(&resumed, 1) == "If-Range: \"v1\"");
+        CHECK_FALSE(FileExists(resumed.StatePath));
+    }
+
+    SECTION("The segments of a failed attempt with another segment size are not resumed")
+    {
+        ADUC_ResumableDownload_LoadSegments(&download, 4, 3);
+        download.SegmentBytesWritten = { 4, 4, 1 };
+        ADUC_ResumableDownload_SaveSegments(&download);
+
+        ADUC_ResumableDownload resumed;
+        ADUC_ResumableDownload_Init(&resumed, targetPath, c_url);
+        CHECK_FALSE(ADUC_ResumableDownload_LoadSegments(&resumed, 5, 2));
+        CHECK(resumed.SegmentBytesWritten == std::vector<uint64_t>{ 0, 0 });
+    }
+
+    SECTION("Restart removes the partial file and its state")
+    {
+        FailAfter(&download, &entity, 4);
+        ADUC_ResumableDownload_Restart(&download);
+        CHECK_FALSE(FileExists(download.PartialPath));
+        CHECK_FALSE(FileExists(download.StatePath));
+    }
+
+    (void)std::remove(targetPath.c_str());
+    (void)std::remove(download.PartialPath.c_str());
+    (void)std::remove(download.StatePath.c_str());
+}
+
+TEST_CASE("ADUC_ResumableDownload_OnResponseHeader")
+{
+    ADUC_ResumableDownload download;
+    ADUC_ResumableDownload_Init(&download, "/tmp/unused", c_url);
+
+    for (const char* line : { "HTTP/1.1 302 Found\r\n",
+                              "ETag: \"redirect\"\r\n",
+                              "HTTP/1.1 200 OK\r\n",
+                              "Last-Modified:  Wed, 21 Oct 2015 07:28:00 GMT \r\n",
+                              "Content-Length: 10\r\n",
+                              "\r\n" })
+    {
+        ADUC_ResumableDownload_OnResponseHeader(&download, line, strlen(line));
+    }
+
+    CHECK(download.ResponseStatus == 200);
+    CHECK(download.ResponseETag.empty());
+    CHECK(download.ResponseLastModified == "Wed, 21 Oct 2015 07:28:00 GMT");
+}
+
+TEST_CASE("ADUC_ResumableDownload_IsRetriableFailure")
+{
+    CHECK(ADUC_ResumableDownload_IsRetriableFailure(7 /* couldn't connect */, 0));
+    CHECK(ADUC_ResumableDownload_IsRetriableFailure(18 /* partial file */, 200));
+    CHECK(ADUC_ResumableDownload_IsRetriableFailure(33 /* range error */, 200));
+    CHECK(ADUC_ResumableDownload_IsRetriableFailure(22 /* HTTP error */, 503));
+    CHECK(ADUC_ResumableDownload_IsRetriableFailure(22 /* HTTP error */, 429));
+    CHECK_FALSE(ADUC_ResumableDownload_IsRetriableFailure(22 /* HTTP error */, 404));
+    CHECK_FALSE(ADUC_ResumableDownload_IsRetriableFailure(23 /* write error */, 200));
+    CHECK_FALSE(ADUC_ResumableDownload_IsRetriableFailure(42 /* aborted by callback */, 200));
+}
+
+TEST_CASE("ADUC_ResumableDownload_Run")
+{
+    unsigned int attemptCount = 0;
+
+    SECTION("Retriable failures are retried")
+    {
+        const ADUC_Result result = ADUC_ResumableDownload_Run(
+            60 /* retryTimeout */,
+            [&attemptCount](bool* retriable) -> ADUC_Result {
+                *retriable = true;
+                return (++attemptCount < 2) ? ADUC_Result{ ADUC_Result_Failure }
+                                            : ADUC_Result{ ADUC_Result_Download_Success };
+            },
+            nullptr /* isCancelled */,
+            nullptr /* context */);
+
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(attemptCount == 2);
+    }
+
+    SECTION("Other failures are not retried")
+    {
+        const ADUC_Result result = ADUC_ResumableDownload_Run(
+            60 /* retryTimeout */,
+            [&attemptCount](bool* retriable) -> ADUC_Result {
+                ++attemptCount;
+                *retriable = false;
+                return { ADUC_Result_Failure, 42 };
+            },
+            nullptr /* isCancelled */,
+            nullptr /* context */);
+
+        CHECK(result.ResultCode == ADUC_Result_Failure);
+        CHECK(result.ExtendedResultCode == 42);
+        CHECK(attemptCount == 1);
+    }
+
+    SECTION("No attempt starts after the retry timeout")
+    {
+        const ADUC_Result result = ADUC_ResumableDownload_Run(
+            0 /* retryTimeout */,
+            [&attemptCount](bool* retriable) -> ADUC_Result {
+                ++attemptCount;
+                *retriable = true;
+                return { ADUC_Result_Failure, 42 };
+            },
+            nullptr /* isCancelled */,
+            nullptr /* context */);
+
+        CHECK(result.ExtendedResultCode == 42);
+        CHECK(attemptCount == 1);
+    }
+
+    SECTION("Cancellation stops the wait for the next attempt")
+    {
+        int pollCount = 0;
+        const ADUC_Result result = ADUC_ResumableDownload_Run(
+            600 /* retryTimeout */,
+            [&attemptCount](bool* retriable) -> ADUC_Result {
+                ++attemptCount;
+                *retriable = true;
+                return { ADUC_Result_Failure };
+            },
+            CancelAfterFourPolls,
+            &pollCount);
+
+        CHECK(result.ResultCode == ADUC_Result_Failure_Cancelled);
+        CHECK(attemptCount == 1);
+    }
+}
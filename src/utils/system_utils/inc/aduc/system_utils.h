@@ -38,6 +38,8 @@ int ADUC_SystemUtils_WriteStringToFile(const char* path, const char* buff);
 
 int ADUC_SystemUtils_ReadStringFromFile(const char* path, char* buff, size_t buffLen);
 
+int ADUC_SystemUtils_GetAvailableDiskSpace(const char* path, unsigned long long* availableBytes);
+
 _Bool SystemUtils_IsDir(const char* path);
 
 _Bool SystemUtils_IsFile(const char* path);
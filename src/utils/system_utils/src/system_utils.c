@@ -25,6 +25,7 @@
 #include <string.h> // for strncpy, strlen
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h> // for statvfs
 #include <sys/types.h>
 #include <sys/wait.h> // for waitpid
 #include <unistd.h>
@@ -651,6 +652,32 @@ done:
     return status;
 }
 
+/**
+ * @brief Gets the space available to unprivileged users on the file system that contains @p path.
+ * @details Blocks reserved for root are not counted, since the agent may not be able to use them.
+ *
+ * @param path A path on the file system, e.g. the sandbox folder.
+ * @param[out] availableBytes The available space, in bytes.
+ * @return int On success 0 is returned; otherwise errno, or -1 for invalid arguments.
+ */
+int ADUC_SystemUtils_GetAvailableDiskSpace(const char* path, unsigned long long* availableBytes)
+{
+    struct statvfs st;
+
+    if (path == NULL || availableBytes == NULL)
+    {
+        return -1;
+    }
+
+    if (statvfs(path, &st) != 0)
+    {
+        return errno;
+    }
+
+    *availableBytes = (unsigned long long)st.f_bavail * (unsigned long long)st.f_frsize;
+    return 0;
+}
+
 /**
  * @brief Checks if the file object at the given path is a directory.
  * @param path The path.
@@ -9,6 +9,7 @@
 
 #include "aduc/system_utils.h"
 
+#include <cerrno>
 #include <sys/stat.h>
 
 TEST_CASE("ADUC_SystemUtils_GetTemporaryPathName")
@@ -163,3 +164,28 @@ TEST_CASE_METHOD(TestCaseFixture, "ADUC_SystemUtils_RmDirRecursive")
         CHECK_FALSE(S_ISDIR(st.st_mode));
     }
 }
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_SystemUtils_GetAvailableDiskSpace")
+{
+    SECTION("Existing directory")
+    {
+        REQUIRE(ADUC_SystemUtils_MkDirDefault(TestPath()) == 0);
+
+        unsigned long long availableBytes = 0;
+        CHECK(ADUC_SystemUtils_GetAvailableDiskSpace(TestPath(), &availableBytes) == 0);
+        CHECK(availableBytes > 0);
+    }
+
+    SECTION("Non-existent directory")
+    {
+        unsigned long long availableBytes = 0;
+        CHECK(ADUC_SystemUtils_GetAvailableDiskSpace(TestPath(), &availableBytes) == ENOENT);
+    }
+
+    SECTION("Invalid arguments")
+    {
+        unsigned long long availableBytes = 0;
+        CHECK(ADUC_SystemUtils_GetAvailableDiskSpace(nullptr, &availableBytes) == -1);
+        CHECK(ADUC_SystemUtils_GetAvailableDiskSpace(TestPath(), nullptr) == -1);
+    }
+}
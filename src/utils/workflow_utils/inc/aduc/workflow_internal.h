@@ -6,6 +6,7 @@
  * Licensed under the MIT License.
  */
 
+#include <aduc/c_utils.h>
 #include <aduc/result.h>
 #include <aduc/types/update_content.h>
 #include <aduc/types/workflow.h>
@@ -53,4 +54,36 @@ typedef struct tagADUC_Workflow
     ADUC_WorkflowCancellationType CancellationType; /**< What type of cancellation is it? */
     struct tagADUC_Workflow*
         DeferredReplacementWorkflow; /**< A replacement workflow that came in while another deployment was in progress. */
+
+    //
+    // Files verified during the workflow. Only set on the root workflow.
+    //
+    struct tagADUC_VerifiedFile* VerifiedFiles; /**< See workflow_is_file_verified. */
+
+    //
+    // Index of the components enumerated during the workflow. Only set on the root workflow.
+    //
+    void* ComponentIndex; /**< See workflow_set_component_index. */
+    void (*FreeComponentIndex)(void* index); /**< Frees ComponentIndex. */
 } ADUC_Workflow;
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Convert ADUC_WorkflowHandle to ADUC_Workflow*.
+ */
+ADUC_Workflow* workflow_from_handle(ADUC_WorkflowHandle handle);
+
+/**
+ * @brief Frees the verified files recorded on @p wf.
+ * @param wf The workflow.
+ */
+void workflow_free_verified_files(ADUC_Workflow* wf);
+
+/**
+ * @brief Frees the component index attached to @p wf.
+ * @param wf The workflow.
+ */
+void workflow_free_component_index(ADUC_Workflow* wf);
+
+EXTERN_C_END
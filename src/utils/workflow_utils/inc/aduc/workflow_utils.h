@@ -605,6 +605,55 @@ bool workflow_get_step_detached_manifest_file(ADUC_WorkflowHandle handle, size_t
  */
 char* workflow_get_serialized_update_manifest(ADUC_WorkflowHandle handle, bool pretty);
 
+/**
+ * @brief Checks whether the file at @p filePath was verified against @p hashArray earlier in this workflow.
+ *
+ * The verified files are recorded on the root workflow, so they are shared by all steps, components and phases
+ * of a deployment. A record only holds while the device, inode, size, mtime and ctime of the file are unchanged.
+ * Thread-safe.
+ *
+ * @param handle A workflow object handle. Can be a step workflow.
+ * @param filePath The path of the file.
+ * @param hashArray The expected hashes, e.g. ADUC_FileEntity::Hash.
+ * @param hashCount The number of hashes in @p hashArray.
+ * @return bool True if there is at least one hash, and every hash in @p hashArray has a supported algorithm and was
+ * verified.
+ */
+bool workflow_is_file_verified(
+    ADUC_WorkflowHandle handle, const char* filePath, const ADUC_Hash* hashArray, size_t hashCount);
+
+/**
+ * @brief Records that the file at @p filePath matches @p hashArray, so that later checks in this workflow can skip
+ * hashing it. Call only after the hashes were verified. For a file decompressed from a compressed payload, the
+ * hashes are those of the compressed content it was decompressed from. Thread-safe.
+ *
+ * @param handle A workflow object handle. Can be a step workflow.
+ * @param filePath The path of the file.
+ * @param hashArray The verified hashes.
+ * @param hashCount The number of hashes in @p hashArray.
+ */
+void workflow_set_file_verified(
+    ADUC_WorkflowHandle handle, const char* filePath, const ADUC_Hash* hashArray, size_t hashCount);
+
+/**
+ * @brief Attaches the index of the components enumerated during this workflow to the root workflow of @p handle,
+ * replacing an earlier index. The root workflow owns @p index and frees it with @p freeIndex.
+ * Not thread-safe; callers serialize access to the index.
+ *
+ * @param handle A workflow object handle. Can be a step workflow.
+ * @param index The index.
+ * @param freeIndex Frees @p index.
+ */
+void workflow_set_component_index(ADUC_WorkflowHandle handle, void* index, void (*freeIndex)(void* index));
+
+/**
+ * @brief Gets the component index attached to the root workflow of @p handle.
+ *
+ * @param handle A workflow object handle. Can be a step workflow.
+ * @return void* The index, or NULL if there is none. Owned by the workflow.
+ */
+void* workflow_peek_component_index(ADUC_WorkflowHandle handle);
+
 EXTERN_C_END
 
 #endif // ADUC_WORKFLOW_UTILS_H
@@ -0,0 +1,52 @@
+/**
+ * @file workflow_component_index.c
+ * @brief Holds the component index of a workflow.
+ *
+ * The steps of a deployment select their components from the same inventory. The extension manager enumerates
+ * the components once per deployment and attaches an index of them to the root workflow, which frees it with the
+ * workflow. A workflow retried because the components changed is a new workflow, with a new index.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/workflow_internal.h"
+#include "aduc/workflow_utils.h"
+
+#include <stddef.h> // for NULL
+
+void workflow_set_component_index(ADUC_WorkflowHandle handle, void* index, void (*freeIndex)(void* index))
+{
+    ADUC_Workflow* root = workflow_from_handle(workflow_get_root(handle));
+
+    if (root == NULL)
+    {
+        if (index != NULL && freeIndex != NULL)
+        {
+            freeIndex(index);
+        }
+
+        return;
+    }
+
+    workflow_free_component_index(root);
+
+    root->ComponentIndex = index;
+    root->FreeComponentIndex = freeIndex;
+}
+
+void* workflow_peek_component_index(ADUC_WorkflowHandle handle)
+{
+    ADUC_Workflow* root = workflow_from_handle(workflow_get_root(handle));
+    return (root == NULL) ? NULL : root->ComponentIndex;
+}
+
+void workflow_free_component_index(ADUC_Workflow* wf)
+{
+    if (wf->ComponentIndex != NULL && wf->FreeComponentIndex != NULL)
+    {
+        wf->FreeComponentIndex(wf->ComponentIndex);
+    }
+
+    wf->ComponentIndex = NULL;
+    wf->FreeComponentIndex = NULL;
+}
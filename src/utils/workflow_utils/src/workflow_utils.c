@@ -1246,6 +1246,15 @@ bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_Fil
         goto done;
     }
 
+    // Optional block-level hashes, used to verify the file while it is being downloaded.
+    (*entity)->ChunkManifest =
+        ADUC_ChunkManifest_AllocAndInit(json_object_get_object(file, ADUCITF_FIELDNAME_CHUNKHASHES));
+
+    if (!ADUC_FileEntity_SetCompression(*entity, json_object_get_string(file, ADUCITF_FIELDNAME_COMPRESSION)))
+    {
+        goto done;
+    }
+
     succeeded = true;
 
 done:
@@ -1352,6 +1361,15 @@ bool workflow_get_first_update_file_of_type(ADUC_WorkflowHandle handle, const ch
         goto done;
     }
 
+    // Optional block-level hashes, used to verify the file while it is being downloaded.
+    (*entity)->ChunkManifest =
+        ADUC_ChunkManifest_AllocAndInit(json_object_get_object(file, ADUCITF_FIELDNAME_CHUNKHASHES));
+
+    if (!ADUC_FileEntity_SetCompression(*entity, json_object_get_string(file, ADUCITF_FIELDNAME_COMPRESSION)))
+    {
+        goto done;
+    }
+
     succeeded = true;
 
 done:
@@ -1467,6 +1485,15 @@ bool workflow_get_bundle_updates_file(ADUC_WorkflowHandle handle, size_t index,
         goto done;
     }
 
+    // Optional block-level hashes, used to verify the file while it is being downloaded.
+    (*entity)->ChunkManifest =
+        ADUC_ChunkManifest_AllocAndInit(json_object_get_object(file, ADUCITF_FIELDNAME_CHUNKHASHES));
+
+    if (!ADUC_FileEntity_SetCompression(*entity, json_object_get_string(file, ADUCITF_FIELDNAME_COMPRESSION)))
+    {
+        goto done;
+    }
+
     succeeded = true;
 
 done:
@@ -2054,6 +2081,12 @@ void workflow_uninit(ADUC_WorkflowHandle handle)
         workflow_free(wf->DeferredReplacementWorkflow);
         wf->DeferredReplacementWorkflow = NULL;
     }
+
+    if (wf != NULL)
+    {
+        workflow_free_verified_files(wf);
+        workflow_free_component_index(wf);
+    }
 }
 
 /**
@@ -2960,6 +2993,15 @@ bool workflow_get_step_detached_manifest_file(ADUC_WorkflowHandle handle, size_t
         goto done;
     }
 
+    // Optional block-level hashes, used to verify the file while it is being downloaded.
+    (*entity)->ChunkManifest =
+        ADUC_ChunkManifest_AllocAndInit(json_object_get_object(file, ADUCITF_FIELDNAME_CHUNKHASHES));
+
+    if (!ADUC_FileEntity_SetCompression(*entity, json_object_get_string(file, ADUCITF_FIELDNAME_COMPRESSION)))
+    {
+        goto done;
+    }
+
     succeeded = true;
 
 done:
@@ -0,0 +1,221 @@
+/**
+ * @file workflow_verified_files.c
+ * @brief Workflow-scoped registry of files whose hashes were verified.
+ *
+ * A deployment often checks the same sandbox file many times: a step is processed once per selected component,
+ * and the download, install and IsInstalled phases each verify the files of a step. The root workflow records
+ * the files it verified, with their identity (device, inode, size, mtime and ctime), so a file that didn't change
+ * is hashed once per deployment.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/workflow_internal.h"
+#include "aduc/workflow_utils.h"
+
+#include <pthread.h>
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for strcmp, strdup
+#include <strings.h> // for strcasecmp
+#include <sys/stat.h> // for stat
+
+/**
+ * @brief A file whose hashes were verified.
+ */
+typedef struct tagADUC_VerifiedFile
+{
+    char* Path; /**< The path of the file. */
+    struct stat Identity; /**< The stat of the file when it was verified. */
+    ADUC_Hash* Hashes; /**< The verified hashes. */
+    size_t HashCount; /**< The number of hashes in Hashes. */
+    struct tagADUC_VerifiedFile* Next; /**< The next file. */
+} ADUC_VerifiedFile;
+
+/**
+ * @brief Guards the verified files of all workflows; checks are quick and rarely contend.
+ */
+static pthread_mutex_t s_verifiedFilesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void VerifiedFile_Free(ADUC_VerifiedFile* file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+
+    ADUC_Hash_FreeArray(file->HashCount, file->Hashes);
+    free(file->Path);
+    free(file);
+}
+
+/**
+ * @brief Compares the identity of a file with the one recorded when it was verified.
+ */
+static bool IsSameFile(const struct stat* recorded, const struct stat* current)
+{
+    return recorded->st_dev == current->st_dev && recorded->st_ino == current->st_ino
+        && recorded->st_size == current->st_size && recorded->st_mtim.tv_sec == current->st_mtim.tv_sec
+        && recorded->st_mtim.tv_nsec == current->st_mtim.tv_nsec && recorded->st_ctim.tv_sec == current->st_ctim.tv_sec
+        && recorded->st_ctim.tv_nsec == current->st_ctim.tv_nsec;
+}
+
+/**
+ * @brief Checks whether @p hash is one of the hashes verified for @p file.
+ */
+static bool HasVerifiedHash(const ADUC_VerifiedFile* file, const ADUC_Hash* hash)
+{
+    for (size_t i = 0; i < file->HashCount; ++i)
+    {
+        if (strcasecmp(file->Hashes[i].type, hash->type) == 0 && strcmp(file->Hashes[i].value, hash->value) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Checks whether @p hash can be verified, i.e. has a value and a supported algorithm.
+ */
+static bool IsSupportedHash(const ADUC_Hash* hash)
+{
+    SHAversion algorithm;
+    return hash->type != NULL && hash->value != NULL
+        && ADUC_HashUtils_GetShaVersionForTypeString(hash->type, &algorithm);
+}
+
+/**
+ * @brief Finds the record of @p filePath. Must be called with s_verifiedFilesMutex held.
+ * @return ADUC_VerifiedFile** The link to the record, or to the end of the list if there is none.
+ */
+static ADUC_VerifiedFile** FindVerifiedFile(ADUC_Workflow* root, const char* filePath)
+{
+    ADUC_VerifiedFile** link = &root->VerifiedFiles;
+    while (*link != NULL && strcmp((*link)->Path, filePath) != 0)
+    {
+        link = &(*link)->Next;
+    }
+
+    return link;
+}
+
+bool workflow_is_file_verified(
+    ADUC_WorkflowHandle handle, const char* filePath, const ADUC_Hash* hashArray, size_t hashCount)
+{
+    bool verified = false;
+    struct stat current;
+    ADUC_Workflow* root = workflow_from_handle(workflow_get_root(handle));
+
+    if (root == NULL || filePath == NULL || hashArray == NULL || stat(filePath, &current) != 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_verifiedFilesMutex);
+
+    const ADUC_VerifiedFile* file = *FindVerifiedFile(root, filePath);
+    if (file == NULL || !IsSameFile(&file->Identity, &current))
+    {
+        goto done;
+    }
+
+    // Like ADUC_HashUtils_VerifyFileHashes, a hash that can't be checked fails the verification.
+    for (size_t i = 0; i < hashCount; ++i)
+    {
+        if (!IsSupportedHash(&hashArray[i]) || !HasVerifiedHash(file, &hashArray[i]))
+        {
+            goto done;
+        }
+    }
+
+    verified = (hashCount > 0);
+
+done:
+    pthread_mutex_unlock(&s_verifiedFilesMutex);
+
+    if (verified)
+    {
+        Log_Debug("%s was verified earlier in this workflow", filePath);
+    }
+
+    return verified;
+}
+
+void workflow_set_file_verified(
+    ADUC_WorkflowHandle handle, const char* filePath, const ADUC_Hash* hashArray, size_t hashCount)
+{
+    struct stat current;
+    ADUC_VerifiedFile* file = NULL;
+    ADUC_VerifiedFile** link = NULL;
+    ADUC_Workflow* root = workflow_from_handle(workflow_get_root(handle));
+
+    if (root == NULL || filePath == NULL || hashArray == NULL || stat(filePath, &current) != 0)
+    {
+        return;
+    }
+
+    file = calloc(1, sizeof(*file));
+    if (file == NULL)
+    {
+        return;
+    }
+
+    file->Identity = current;
+    file->Path = strdup(filePath);
+    file->Hashes = calloc(hashCount, sizeof(*file->Hashes));
+    if (file->Path == NULL || (hashCount > 0 && file->Hashes == NULL))
+    {
+        goto done;
+    }
+
+    for (size_t i = 0; i < hashCount; ++i)
+    {
+        if (IsSupportedHash(&hashArray[i]))
+        {
+            if (!ADUC_Hash_Init(&file->Hashes[file->HashCount], hashArray[i].value, hashArray[i].type))
+            {
+                goto done;
+            }
+
+            ++file->HashCount;
+        }
+    }
+
+    pthread_mutex_lock(&s_verifiedFilesMutex);
+
+    // Replace an earlier record of the file.
+    link = FindVerifiedFile(root, filePath);
+    if (*link != NULL)
+    {
+        file->Next = (*link)->Next;
+        VerifiedFile_Free(*link);
+    }
+
+    *link = file;
+    file = NULL;
+
+    pthread_mutex_unlock(&s_verifiedFilesMutex);
+
+done:
+    VerifiedFile_Free(file);
+}
+
+void workflow_free_verified_files(ADUC_Workflow* wf)
+{
+    pthread_mutex_lock(&s_verifiedFilesMutex);
+
+    ADUC_VerifiedFile* file = wf->VerifiedFiles;
+    wf->VerifiedFiles = NULL;
+
+    pthread_mutex_unlock(&s_verifiedFilesMutex);
+
+    while (file != NULL)
+    {
+        ADUC_VerifiedFile* next = file->Next;
+        VerifiedFile_Free(file);
+        file = next;
+    }
+}
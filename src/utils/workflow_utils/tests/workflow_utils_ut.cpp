@@ -11,8 +11,11 @@
 #include <catch2/catch.hpp>
 using Catch::Matchers::Equals;
 
+#include <cstdio> // for std::remove
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <unistd.h> // for getpid
 
 /* Example of an Action PnP Data.
 {
@@ -661,3 +664,52 @@ TEST_CASE("Mininum update manifest version check - 1")
     CHECK(result.ExtendedResultCode == ADUC_ERC_UTILITIES_UPDATE_DATA_PARSER_UNSUPPORTED_UPDATE_MANIFEST_VERSION);
     workflow_free(handle);
 }
+
+TEST_CASE("Verified files are shared by the workflow tree")
+{
+    ADUC_WorkflowHandle bundle = nullptr;
+    ADUC_WorkflowHandle leaf0 = nullptr;
+    const std::string filePath = "/tmp/workflow_utils_ut_verified_" + std::to_string(getpid());
+    ADUC_Hash hashes[] = { { const_cast<char*>("E2o94XQss/K8niR1pW6OdaIS/y3tInwhEKMn/6Rw1Gw="),
+                             const_cast<char*>("sha256") },
+                           { const_cast<char*>("not-a-hash"), const_cast<char*>("md5") } };
+
+    std::ofstream{ filePath } << "payload";
+
+    ADUC_Result result = workflow_init(action_bundle, false, &bundle);
+    REQUIRE(result.ResultCode != 0);
+    result = workflow_init(action_leaf0, false, &leaf0);
+    REQUIRE(result.ResultCode != 0);
+    REQUIRE(workflow_insert_child(bundle, 0, leaf0));
+
+    CHECK_FALSE(workflow_is_file_verified(leaf0, filePath.c_str(), hashes, 2));
+
+    // Recorded by a step, seen by the whole deployment. Only the supported hashes are recorded.
+    workflow_set_file_verified(leaf0, filePath.c_str(), hashes, 2);
+    CHECK(workflow_is_file_verified(leaf0, filePath.c_str(), hashes, 1));
+    CHECK(workflow_is_file_verified(bundle, filePath.c_str(), hashes, 1));
+
+    // A file is never accepted on a subset of its hashes.
+    CHECK_FALSE(workflow_is_file_verified(bundle, filePath.c_str(), hashes, 2));
+
+    // Another hash value, or no supported hash at all, was not verified.
+    ADUC_Hash otherHash = { const_cast<char*>("KBJ8BKKZn3c1/Yo4sslPiiHVqCAk+aFfHBg8uNuTjLs="),
+                            const_cast<char*>("sha256") };
+    CHECK_FALSE(workflow_is_file_verified(bundle, filePath.c_str(), &otherHash, 1));
+    CHECK_FALSE(workflow_is_file_verified(bundle, filePath.c_str(), &hashes[1], 1));
+
+    // A modified file must be verified again.
+    std::ofstream{ filePath, std::ios::app } << " modified";
+    CHECK_FALSE(workflow_is_file_verified(bundle, filePath.c_str(), hashes, 1));
+
+    // A workflow that is not part of the tree has its own records.
+    workflow_set_file_verified(bundle, filePath.c_str(), hashes, 1);
+    ADUC_WorkflowHandle other = nullptr;
+    result = workflow_init(action_bundle, false, &other);
+    REQUIRE(result.ResultCode != 0);
+    CHECK_FALSE(workflow_is_file_verified(other, filePath.c_str(), hashes, 1));
+
+    workflow_free(other);
+    workflow_free(bundle);
+    (void)std::remove(filePath.c_str());
+}